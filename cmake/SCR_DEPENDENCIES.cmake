@@ -81,6 +81,10 @@ IF(ENABLE_PTHREADS)
     ENDIF()
 ENDIF(ENABLE_PTHREADS)
 
+## libm, needed by the checkpoint interval tuner
+LIST(APPEND SCR_EXTERNAL_LIBS "-lm")
+LIST(APPEND SCR_LINK_LINE "-lm")
+
 ## PDSH
 IF(ENABLE_PDSH)
    IF(BUILD_PDSH)
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2009, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-411039.
+ * All rights reserved.
+ * This file is part of The Scalable Checkpoint / Restart (SCR) library.
+ * For details, see https://sourceforge.net/projects/scalablecr/
+ * Please also read this file: LICENSE.TXT.
+*/
+
+/*
+ * Usage:
+ *
+ *      ./test_api_memory [kilobytes]
+ *
+ * Writes checkpoints by registering a memory buffer with
+ * SCR_Register_memory rather than writing a file, and on restart
+ * reads the latest checkpoint back into the buffer the same way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mpi.h"
+#include "scr.h"
+#include "test_common.h"
+
+int main(int argc, char* argv[])
+{
+  int rc = 0;
+
+  size_t size = 512 * 1024;
+  if (argc == 2) {
+    size = (size_t) atoi(argv[1]) * 1024;
+  }
+
+  MPI_Init(&argc, &argv);
+
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  if (SCR_Init() != SCR_SUCCESS) {
+    printf("%d: failed calling SCR_Init @%s:%d\n", rank, __FILE__, __LINE__);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+
+  /* first bytes of the buffer hold the timestep, data follows */
+  size_t offset = sizeof(int);
+  char* buf = (char*) malloc(size + offset);
+  if (buf == NULL) {
+    printf("%d: failed to allocate buffer @%s:%d\n", rank, __FILE__, __LINE__);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+
+  char name[SCR_MAX_FILENAME];
+  safe_snprintf(name, sizeof(name), "rank_%d.mem", rank);
+
+  /* read in the latest checkpoint if there is one */
+  int timestep = 0;
+  int have_restart = 0;
+  SCR_Have_restart(&have_restart, NULL);
+  if (have_restart) {
+    SCR_Start_restart(NULL);
+
+    int valid = 1;
+    memset(buf, 0, size + offset);
+    if (SCR_Register_memory(name, buf, size + offset) != SCR_SUCCESS) {
+      printf("%d: failed calling SCR_Register_memory @%s:%d\n", rank, __FILE__, __LINE__);
+      valid = 0;
+    } else if (! check_buffer(buf + offset, size, rank, 0)) {
+      printf("%d: invalid value in buffer @%s:%d\n", rank, __FILE__, __LINE__);
+      valid = 0;
+    } else {
+      memcpy(&timestep, buf, sizeof(int));
+    }
+
+    if (SCR_Complete_restart(valid) != SCR_SUCCESS) {
+      printf("%d: failed to restart from memory region @%s:%d\n", rank, __FILE__, __LINE__);
+      rc = 1;
+      timestep = 0;
+    }
+  }
+
+  /* write a few checkpoints from the buffer */
+  int i;
+  for (i = 0; i < 3; i++) {
+    timestep++;
+    memcpy(buf, &timestep, sizeof(int));
+    init_buffer(buf + offset, size, rank, timestep);
+
+    char dset[SCR_MAX_FILENAME];
+    safe_snprintf(dset, sizeof(dset), "timestep.%d", timestep);
+    SCR_Start_output(dset, SCR_FLAG_CHECKPOINT);
+
+    int valid = 1;
+    if (SCR_Register_memory(name, buf, size + offset) != SCR_SUCCESS) {
+      printf("%d: failed calling SCR_Register_memory @%s:%d\n", rank, __FILE__, __LINE__);
+      valid = 0;
+    }
+
+    if (SCR_Complete_output(valid) != SCR_SUCCESS) {
+      printf("%d: failed calling SCR_Complete_output @%s:%d\n", rank, __FILE__, __LINE__);
+      rc = 1;
+    }
+  }
+
+  free(buf);
+
+  SCR_Finalize();
+
+  MPI_Finalize();
+
+  return rc;
+}
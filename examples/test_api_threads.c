@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2009, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-411039.
+ * All rights reserved.
+ * This file is part of The Scalable Checkpoint / Restart (SCR) library.
+ * For details, see https://sourceforge.net/projects/scalablecr/
+ * Please also read this file: LICENSE.TXT.
+*/
+
+/*
+ * Usage:
+ *
+ *      ./test_api_threads [threads] [kilobytes]
+ *
+ * Each process starts several threads, and each thread calls
+ * SCR_Route_file at the same time to write its own checkpoint file.
+ * On restart, each thread routes and reads back its file in parallel.
+ * Only the main thread calls the other SCR functions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "mpi.h"
+#include "scr.h"
+#include "test_common.h"
+
+typedef struct {
+  int rank;       /* MPI rank of process */
+  int thread;     /* index of thread within process */
+  int timestep;   /* timestep to write or expected on read */
+  size_t size;    /* bytes of data in file */
+  char* buf;      /* buffer for file data */
+  int valid;      /* set to 1 if the thread succeeded */
+} thread_args;
+
+/* build the name of the file written by a given thread */
+static void thread_file(char* file, size_t size, thread_args* args)
+{
+  safe_snprintf(file, size, "rank_%d.thread_%d.ckpt", args->rank, args->thread);
+}
+
+static void* write_thread(void* arg)
+{
+  thread_args* args = (thread_args*) arg;
+  args->valid = 0;
+
+  char name[SCR_MAX_FILENAME];
+  char file[SCR_MAX_FILENAME];
+  thread_file(name, sizeof(name), args);
+  if (SCR_Route_file(name, file) != SCR_SUCCESS) {
+    printf("%d: thread %d failed calling SCR_Route_file @%s:%d\n",
+      args->rank, args->thread, __FILE__, __LINE__
+    );
+    return NULL;
+  }
+
+  init_buffer(args->buf, args->size, args->rank + args->thread, args->timestep);
+
+  int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    printf("%d: thread %d failed to open %s @%s:%d\n",
+      args->rank, args->thread, file, __FILE__, __LINE__
+    );
+    return NULL;
+  }
+  args->valid = write_checkpoint(fd, args->timestep, args->buf, args->size);
+  if (fsync(fd) != 0 || close(fd) != 0) {
+    args->valid = 0;
+  }
+
+  return NULL;
+}
+
+static void* read_thread(void* arg)
+{
+  thread_args* args = (thread_args*) arg;
+  args->valid = 0;
+
+  char name[SCR_MAX_FILENAME];
+  char file[SCR_MAX_FILENAME];
+  thread_file(name, sizeof(name), args);
+  if (SCR_Route_file(name, file) != SCR_SUCCESS) {
+    printf("%d: thread %d failed calling SCR_Route_file @%s:%d\n",
+      args->rank, args->thread, __FILE__, __LINE__
+    );
+    return NULL;
+  }
+
+  int timestep;
+  if (read_checkpoint(file, &timestep, args->buf, args->size) &&
+      timestep == args->timestep &&
+      check_buffer(args->buf, args->size, args->rank + args->thread, timestep))
+  {
+    args->valid = 1;
+  } else {
+    printf("%d: thread %d read invalid data from %s @%s:%d\n",
+      args->rank, args->thread, file, __FILE__, __LINE__
+    );
+  }
+
+  return NULL;
+}
+
+/* start a thread per file, wait for them all,
+ * and return 1 if all threads succeeded */
+static int run_threads(int nthreads, thread_args* args, void* (*func)(void*))
+{
+  pthread_t* threads = (pthread_t*) malloc(nthreads * sizeof(pthread_t));
+
+  int i;
+  for (i = 0; i < nthreads; i++) {
+    pthread_create(&threads[i], NULL, func, &args[i]);
+  }
+
+  int valid = 1;
+  for (i = 0; i < nthreads; i++) {
+    pthread_join(threads[i], NULL);
+    if (! args[i].valid) {
+      valid = 0;
+    }
+  }
+
+  free(threads);
+  return valid;
+}
+
+int main(int argc, char* argv[])
+{
+  int rc = 0;
+
+  int nthreads = 8;
+  if (argc > 1) {
+    nthreads = atoi(argv[1]);
+  }
+
+  size_t size = 256 * 1024;
+  if (argc > 2) {
+    size = (size_t) atoi(argv[2]) * 1024;
+  }
+
+  /* only the main thread makes MPI calls */
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  if (SCR_Init() != SCR_SUCCESS) {
+    printf("%d: failed calling SCR_Init @%s:%d\n", rank, __FILE__, __LINE__);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+
+  thread_args* args = (thread_args*) malloc(nthreads * sizeof(thread_args));
+  int i;
+  for (i = 0; i < nthreads; i++) {
+    args[i].rank   = rank;
+    args[i].thread = i;
+    args[i].size   = size;
+    args[i].buf    = (char*) malloc(size);
+    if (args[i].buf == NULL) {
+      printf("%d: failed to allocate buffer @%s:%d\n", rank, __FILE__, __LINE__);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+  }
+
+  /* read in the latest checkpoint if there is one */
+  int timestep = 0;
+  int have_restart = 0;
+  char dset[SCR_MAX_FILENAME];
+  SCR_Have_restart(&have_restart, dset);
+  if (have_restart) {
+    SCR_Start_restart(dset);
+
+    /* dataset names are timestep.N */
+    char* dot = strrchr(dset, '.');
+    int restart_timestep = (dot != NULL) ? atoi(dot + 1) : 0;
+    for (i = 0; i < nthreads; i++) {
+      args[i].timestep = restart_timestep;
+    }
+
+    int valid = run_threads(nthreads, args, read_thread);
+    if (SCR_Complete_restart(valid) == SCR_SUCCESS) {
+      timestep = restart_timestep;
+    } else {
+      printf("%d: failed to restart from %s @%s:%d\n", rank, dset, __FILE__, __LINE__);
+      rc = 1;
+    }
+  }
+
+  /* write a few checkpoints with all threads routing files at once */
+  int ckpt;
+  for (ckpt = 0; ckpt < 3; ckpt++) {
+    timestep++;
+
+    safe_snprintf(dset, sizeof(dset), "timestep.%d", timestep);
+    SCR_Start_output(dset, SCR_FLAG_CHECKPOINT);
+
+    for (i = 0; i < nthreads; i++) {
+      args[i].timestep = timestep;
+    }
+    int valid = run_threads(nthreads, args, write_thread);
+
+    if (SCR_Complete_output(valid) != SCR_SUCCESS) {
+      printf("%d: failed calling SCR_Complete_output @%s:%d\n", rank, __FILE__, __LINE__);
+      rc = 1;
+    }
+  }
+
+  for (i = 0; i < nthreads; i++) {
+    free(args[i].buf);
+  }
+  free(args);
+
+  SCR_Finalize();
+
+  MPI_Finalize();
+
+  return rc;
+}
@@ -0,0 +1,126 @@
+"""Compare checkpoint and restart time of numpy.save/numpy.load against
+the buffer helpers in the scr module.
+
+Each MPI process checkpoints a numpy array of the given number of MiB,
+once for each method, and then reads the file back from cache.
+Write times cover the full start_output/complete_output phase.
+Reported times are the maximum across processes, and bandwidth is
+the aggregate across processes.
+
+  mpirun -np 2 python scr_bench_buffer.py [MiB] [iterations]
+"""
+
+import sys
+import mmap
+import numpy as np
+from mpi4py import MPI
+import scr
+
+comm = MPI.COMM_WORLD
+rank = comm.rank
+ranks = comm.size
+
+mib = 256
+if len(sys.argv) > 1:
+  mib = int(sys.argv[1])
+
+iters = 3
+if len(sys.argv) > 2:
+  iters = int(sys.argv[2])
+
+# keep the checkpoint we just wrote in cache so we can read it back
+scr.config("SCR_CACHE_SIZE=2")
+scr.config("SCR_FLUSH=0")
+scr.init()
+
+# allocate the array from an anonymous mapping, so that it is page aligned for O_DIRECT
+count = mib * 1024 * 1024 // 8
+region = mmap.mmap(-1, count * 8)
+data = np.frombuffer(region, dtype=np.float64, count=count)
+data[:] = np.arange(count, dtype=np.float64) + rank
+result = np.empty_like(data)
+
+def timed(func):
+  comm.Barrier()
+  start = MPI.Wtime()
+  func()
+  elapsed = MPI.Wtime() - start
+  return comm.allreduce(elapsed, op=MPI.MAX)
+
+# write methods, each returns the path of the file it wrote
+def save_numpy(fname):
+  path = scr.route_file(fname)
+  with open(path, 'wb') as f:
+    np.save(f, data)
+  return path
+
+def save_buffer(fname):
+  return scr.write_buffer(fname, data)
+
+def save_direct(fname):
+  return scr.write_buffer(fname, data, direct=True)
+
+def save_memory(fname):
+  path = scr.route_file(fname)
+  scr.register_memory(fname, data)
+  return path
+
+# read methods, called outside of a restart phase with the path in cache,
+# in which case route_file returns the path unchanged
+def load_numpy(path):
+  with open(path, 'rb') as f:
+    result[:] = np.load(f)
+
+def load_buffer(path):
+  scr.read_buffer(path, result)
+
+def load_mmap(path):
+  m = scr.map_file(path)
+  result[:] = np.frombuffer(m, dtype=np.float64, count=count)
+  m.close()
+
+methods = [
+  ("numpy.save/load",      save_numpy,  load_numpy),
+  ("write/read_buffer",    save_buffer, load_buffer),
+  ("write(direct)/mmap",   save_direct, load_mmap),
+  ("register_memory/read", save_memory, load_buffer),
+]
+
+times = {}
+step = 0
+for i in range(iters):
+  for label, save, load in methods:
+    step += 1
+    name = "bench_" + str(step)
+    fname = "rank_" + str(rank) + ".dat"
+    paths = []
+
+    def checkpoint():
+      scr.start_output(name, scr.FLAG_CHECKPOINT)
+      paths.append(save(fname))
+      scr.complete_output(True)
+
+    def restore():
+      result[:] = 0.0
+      load(paths[0])
+
+    wtime = timed(checkpoint)
+    rtime = timed(restore)
+    if not np.array_equal(result, data):
+      print(rank, ": data mismatch after reading back with", label)
+      comm.Abort(1)
+
+    w, r = times.get(label, (0.0, 0.0))
+    times[label] = (w + wtime, r + rtime)
+
+if rank == 0:
+  total = float(mib * ranks) * iters
+  print("%d processes, %d MiB per process, %d iterations" % (ranks, mib, iters))
+  print("%-22s %10s %10s %10s %10s" % ("method", "write s", "write MiB/s", "read s", "read MiB/s"))
+  base_w, base_r = times[methods[0][0]]
+  for label, save, load in methods:
+    w, r = times[label]
+    print("%-22s %10.3f %10.1f %10.3f %10.1f  (write x%.2f, read x%.2f)" %
+          (label, w, total / w, r, total / r, base_w / w, base_r / r))
+
+scr.finalize()
@@ -1,6 +1,7 @@
 """Run basic behavior tests for python interface."""
 
 import os
+import re
 import sys
 from mpi4py import MPI
 import scr
@@ -14,6 +15,10 @@ rank = MPI.COMM_WORLD.rank
 # assume we'll start the job from beginning (timestep 1)
 timestep = 1
 
+# build the 64-byte buffer that a given rank checkpoints at a given timestep
+def payload(timestep, rank):
+  return bytearray(str(timestep * 1000 + rank).zfill(64).encode())
+
 # optionally set and get SCR parameters with scr.config() before scr.init()
 val = scr.config("SCR_DEBUG")
 if test == 0: assert val is None, "SCR_DEBUG should not be set on first run"
@@ -39,6 +44,13 @@ if test == 5:
     # success, but nothing else we can do in this run
     quit()
 
+# write a metrics file, scr_test.sh sets SCR_JOB_ID to a value with a quote
+# to check that label values are escaped
+metrics_file = os.path.join(os.getcwd(), 'scr_test_metrics.prom')
+if test == 6:
+  scr.config("SCR_METRICS_ENABLE=1")
+  scr.config("SCR_METRICS_FILE=" + metrics_file)
+
 # initialize library, rebuild cached datasets, fetch latest checkpoint
 val = scr.init()
 assert val is None, "scr.init should always return None"
@@ -94,6 +106,24 @@ while True:
     # failed to read file
     valid = 0
 
+  # read buffers back with read_buffer and register_memory
+  try:
+    buf = bytearray(64)
+    scr.read_buffer('buf_' + str(timestep) + '_' + str(rank) + '.dat', buf)
+    assert buf == payload(timestep, rank), "scr.read_buffer should return the bytes written by scr.write_buffer"
+
+    buf = bytearray(64)
+    rc = scr.register_memory('mem_' + str(timestep) + '_' + str(rank) + '.dat', buf)
+    assert rc is None, "scr.register_memory should return None"
+    assert buf == payload(timestep, rank), "scr.register_memory should fill the buffer on restart"
+
+    # read back this rank's segment of the shared file
+    path = scr.route_file_segment('shared_' + str(timestep) + '.dat', 64 * rank)
+    with open(path, 'rb') as f:
+      assert f.read() == payload(timestep, rank), "scr.route_file_segment should return the bytes of this rank's segment"
+  except RuntimeError:
+    valid = 0
+
   # test: fake a bad file on rank 0 for timestep 6
   if rank == 0 and timestep == 6:
     valid = 0
@@ -150,6 +180,26 @@ while timestep < laststep:
     except:
       # failed to write file
       valid = 0
+
+    # write a buffer to a routed file, and register another buffer directly
+    buf = payload(timestep, rank)
+    path = scr.write_buffer('buf_' + str(timestep) + '_' + str(rank) + '.dat', buf)
+    assert type(path) is str, "scr.write_buffer should return the path it wrote"
+    rc = scr.register_memory('mem_' + str(timestep) + '_' + str(rank) + '.dat', buf)
+    assert rc is None, "scr.register_memory should return None"
+
+    # route a file with a size hint, which creates it empty with its space reserved
+    path = scr.route_file_size('hint_' + str(timestep) + '_' + str(rank) + '.dat', len(buf))
+    assert type(path) is str, "scr.route_file_size should return a string"
+    assert os.path.getsize(path) == 0, "scr.route_file_size should create an empty file"
+    with open(path, 'r+b') as f:
+      f.write(buf)
+
+    # write this rank's segment of a file shared by all ranks
+    path = scr.route_file_segment('shared_' + str(timestep) + '.dat', 64 * rank)
+    assert type(path) is str, "scr.route_file_segment should return a string"
+    with open(path, 'wb') as f:
+      f.write(buf)
   
     # complete the checkpoint phase
     rc = scr.complete_output(valid)
@@ -184,3 +234,15 @@ if test == 3:
 # shut down library and flush cached datasets
 rc = scr.finalize()
 assert rc is None, "scr.finalize should return None"
+
+# check that every sample in the metrics file is valid Prometheus text
+# and that the quote in the jobid was escaped
+if test == 6 and rank == 0:
+  label = r'[a-zA-Z_][a-zA-Z0-9_]*="(?:[^"\\\n]|\\[\\"n])*"'
+  sample = re.compile(r'^[a-zA-Z_:][a-zA-Z0-9_:]*\{' + label + r'(?:,' + label + r')*\} \S+$')
+  with open(metrics_file) as f:
+    lines = [line.rstrip('\n') for line in f if not line.startswith('#')]
+  assert len(lines) > 0, "metrics file should have samples"
+  for line in lines:
+    assert sample.match(line), "metrics line should be valid Prometheus text: " + line
+    assert 'jobid="job\\"1"' in line, "jobid label value should be escaped: " + line
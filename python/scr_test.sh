@@ -8,7 +8,7 @@ export LD_LIBRARY_PATH=$topdir/scr-dist/install/lib64:$topdir/deps/install/lib:$
 which python3
 
 # delete any state from previous runs
-rm -rf .scr ckpt*
+rm -rf .scr ckpt* scr_test_metrics.prom
 
 # check that a sequence of runs follows the correct order of checkpoints
 srun -n 2 python scr_test.py 0
@@ -24,3 +24,6 @@ srun -n 2 python scr_test.py 4
 
 # check that scr.init throws an exception if SCR_Init returns an error
 srun -n 2 python scr_test.py 5
+
+# check that the metrics file escapes a jobid that contains a quote
+SCR_JOB_ID='job"1' srun -n 2 python scr_test.py 6
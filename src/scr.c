@@ -34,6 +34,10 @@
 
 #include "scr_globals.h"
 
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 #include "dtcmp.h"
 #include "er.h"
 #include "axl_mpi.h"
@@ -57,6 +61,25 @@ static scr_filemap* scr_map = NULL;
 /* tracks redundancy descriptor for current dataset */
 static scr_reddesc* scr_rd = NULL;
 
+/* describes a memory region registered with SCR_Register_memory,
+ * file is the routed name of the file that holds the region */
+typedef struct {
+  char* file;
+  const void* buf;
+  size_t size;
+} scr_memory_region;
+
+/* tracks set of memory regions in current dataset */
+static scr_memory_region* scr_memory_regions = NULL;
+static int scr_memory_count = 0;
+static int scr_memory_max   = 0;
+
+#ifdef HAVE_PTHREADS
+/* protects scr_map and the memory region list, since threads of a
+ * process may call SCR_Route_file and SCR_Register_memory concurrently */
+static pthread_mutex_t scr_map_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 /* tracks whether a checkpoint is available for restart */
 static int scr_have_restart;
 
@@ -145,22 +168,37 @@ static int scr_flush_can_poststage(int id)
 {
   int poststage = 0;
 
-  /* currently only BBAPI can support poststage */
+  /* BBAPI transfers continue on their own after the job,
+   * while PTHREAD and SYNC transfers are finished by a helper
+   * process started on each node */
   const scr_storedesc* storedesc = scr_cache_get_storedesc(scr_cindex, id);
   const char* type = storedesc->xfer;
-  if (strcmp(type, "BBAPI") == 0) {
+  if (strcmp(type, "BBAPI")   == 0 ||
+      strcmp(type, "PTHREAD") == 0 ||
+      strcmp(type, "SYNC")    == 0)
+  {
     poststage = 1;
   }
 
   return poststage;
 }
 
+/* returns 1 if dataset id needs a helper process to finish its flush in poststage */
+static int scr_flush_needs_helper(int id)
+{
+  const scr_storedesc* storedesc = scr_cache_get_storedesc(scr_cindex, id);
+  return (strcmp(storedesc->xfer, "BBAPI") != 0);
+}
+
 static int scr_flush_finalize(void)
 {
   /* When using poststage, we can finalize flushes
    * after the job completes rather than waiting on them here. */
   int poststage = scr_flush_poststage;
 
+  /* whether any flush left to poststage must be finished by a helper */
+  int helper = 0;
+
   /* check each outstanding async flush, if any */
   if (poststage && scr_flush_async_in_progress()) {
     /* Got at least one outstanding async flush.
@@ -180,6 +218,9 @@ static int scr_flush_finalize(void)
       if (! scr_flush_can_poststage(id)) {
         poststage = 0;
       }
+      if (scr_flush_needs_helper(id)) {
+        helper = 1;
+      }
     }
 
     /* free list of flush ids */
@@ -202,12 +243,26 @@ static int scr_flush_finalize(void)
           );
         }
       }
+      if (scr_flush_needs_helper(scr_ckpt_dset_id)) {
+        helper = 1;
+      }
     } else {
       /* cannot use poststage, so disable */
       poststage = 0;
     }
   }
 
+  /* hand transfers that would stop when we exit over to a helper process,
+   * if some node can't start one, the transfers are left running and we
+   * wait on them below, if a helper fails after the transfers have stopped,
+   * any helpers already started are killed, we flush the latest checkpoint
+   * synchronously below, and leave any other stopped transfer to scr_postrun */
+  if (poststage && helper && scr_flush_async_in_progress()) {
+    if (scr_flush_async_handoff() != SCR_SUCCESS) {
+      poststage = 0;
+    }
+  }
+
   /* if we're not using postage, wait on all flushes now */
   if (! poststage) {
     /* wait on all async flushes to complete */
@@ -262,11 +317,93 @@ static int scr_halt(const char* reason)
     scr_log_halt(reason);
   }
 
+  /* count the halt reason in our metrics */
+  scr_metrics_halt(reason);
+
   /* and write out the halt file */
   int rc = scr_halt_sync_and_decrement(scr_halt_file, scr_halt_hash, 0);
   return rc;
 }
 
+/* id and size in bytes of the most recent checkpoint, tracked on rank 0 */
+static int    scr_halt_ckpt_id    = -1;
+static double scr_halt_ckpt_bytes = 0.0;
+
+/* whether the most recent checkpoint still needs to be flushed, we read
+ * this from the flush file once per output and again after a flush
+ * completes, rather than on every check, tracked on rank 0 */
+static int scr_halt_ckpt_need_flush = 0;
+static int scr_halt_state_output    = -1; /* output id when we last read the flush file */
+static int scr_halt_state_flushes   = -1; /* flush count when we last read the flush file */
+
+/* predict the number of seconds needed to write one more checkpoint
+ * and flush it, along with the flushes that must complete before the
+ * job exits, which are any flushes in flight and the most recent
+ * checkpoint if it is not yet on the file system, using the measured
+ * checkpoint cost and flush bandwidth, returns 0 if we have not yet
+ * measured a flush, only called on rank 0 */
+static int scr_halt_predict_seconds(void)
+{
+  /* refresh whether the most recent checkpoint needs a flush */
+  int flushes = scr_flush_recorded_count();
+  if (scr_halt_state_output != scr_dataset_id || scr_halt_state_flushes != flushes) {
+    scr_halt_ckpt_need_flush = 0;
+    if (scr_halt_ckpt_id >= 0) {
+      kvtree* hash = kvtree_new();
+      kvtree_read_path(scr_flush_file, hash);
+      kvtree* dset_hash = kvtree_get_kv_int(hash, SCR_FLUSH_KEY_DATASET, scr_halt_ckpt_id);
+      kvtree* in_cache  = kvtree_get_kv(dset_hash, SCR_FLUSH_KEY_LOCATION, SCR_FLUSH_KEY_LOCATION_CACHE);
+      kvtree* in_pfs    = kvtree_get_kv(dset_hash, SCR_FLUSH_KEY_LOCATION, SCR_FLUSH_KEY_LOCATION_PFS);
+      if (in_cache != NULL && in_pfs == NULL) {
+        scr_halt_ckpt_need_flush = 1;
+      }
+      kvtree_delete(&hash);
+    }
+    scr_halt_state_output  = scr_dataset_id;
+    scr_halt_state_flushes = flushes;
+  }
+
+  /* add up what is left to write for flushes in flight */
+  double bytes = 0.0;
+  int ckpt_in_flight = 0;
+  int ndsets;
+  int* dsets;
+  scr_cache_index_list_datasets(scr_cindex, &ndsets, &dsets);
+  int i;
+  for (i = 0; i < ndsets; i++) {
+    double pending;
+    if (scr_flush_async_pending(dsets[i], &pending) == SCR_SUCCESS) {
+      bytes += pending;
+      if (dsets[i] == scr_halt_ckpt_id) {
+        ckpt_in_flight = 1;
+      }
+    }
+  }
+  scr_free(&dsets);
+
+  /* assume the final checkpoint will be the same size as the last one */
+  bytes += scr_halt_ckpt_bytes;
+
+  /* along with the most recent checkpoint if it has yet to be flushed */
+  if (scr_halt_ckpt_need_flush && ! ckpt_in_flight) {
+    bytes += scr_halt_ckpt_bytes;
+  }
+
+  double flush_secs = scr_flush_predict_secs(bytes);
+  if (flush_secs < 0.0) {
+    return 0;
+  }
+
+  double ckpt_secs = 0.0;
+  if (scr_time_checkpoint_count > 0) {
+    ckpt_secs = scr_time_checkpoint_total / (double) scr_time_checkpoint_count;
+  }
+
+  double secs = ckpt_secs + flush_secs * SCR_HALT_PREDICT_MARGIN;
+  scr_dbg(2, "Predicted %f secs to checkpoint and flush %e bytes", secs, bytes);
+  return (int) secs + 1;
+}
+
 /* check whether we should halt the job */
 static int scr_bool_check_halt_and_decrement(int halt_cond, int decrement)
 {
@@ -296,12 +433,20 @@ static int scr_bool_check_halt_and_decrement(int halt_cond, int decrement)
       halt_seconds = 0;
     }
 
+    /* leave at least enough time to save and flush a final checkpoint */
+    if (scr_halt_predict) {
+      int predicted = scr_halt_predict_seconds();
+      if (predicted > halt_seconds) {
+        halt_seconds = predicted;
+      }
+    }
+
     /* if halt secs enabled, check the remaining time */
     if (halt_seconds > 0) {
       long int remaining = scr_env_seconds_remaining();
       if (remaining >= 0 && remaining <= halt_seconds) {
         if (halt_exit) {
-          scr_dbg(0, "Job exiting: Reached time limit: (seconds remaining = %ld) <= (SCR_HALT_SECONDS = %d).",
+          scr_dbg(0, "Job exiting: Reached time limit: (seconds remaining = %ld) <= (halt seconds = %d).",
                   remaining, halt_seconds
           );
           scr_halt("TIME_LIMIT");
@@ -386,9 +531,31 @@ static int scr_bool_check_halt_and_decrement(int halt_cond, int decrement)
 
   /* halt job if we need to, and flush latest checkpoint if needed */
   if (need_to_halt && halt_exit) {
+    /* stop checking files in cache and repair any it found corrupt */
+    scr_cache_scrub_stop(scr_cindex);
+
+    /* finish staging a lazily fetched dataset into cache */
+    scr_fetch_lazy_complete(scr_cindex);
+
     /* flush any pending datasets and shut down flush methods */
     scr_flush_finalize();
 
+    /* write final snapshot of metrics */
+    scr_metrics_finalize();
+
+    /* a halt is not a failure */
+    if (scr_checkpoint_auto && scr_my_rank_world == 0) {
+      scr_interval_finalize();
+    }
+
+    /* fold index journal into index file for tools that read it directly */
+    if (scr_my_rank_world == 0) {
+      scr_index_compact(scr_prefix_path);
+    }
+
+    /* write any pending changes to the cache index */
+    scr_cache_index_sync(scr_cindex_file, scr_cindex);
+
     /* sync up tasks before exiting (don't want tasks to exit so early that
      * runtime kills others after timeout) */
     MPI_Barrier(scr_comm_world);
@@ -467,33 +634,75 @@ static int scr_check_flush(scr_cache_index* cindex)
   return rc;
 }
 
-/* on restart, check each cached dataset to see whether it should be flushed,
- * to be called after scr_cache_rebuild and scr_flush_file_rebuild */
-int scr_flush_restart(scr_cache_index* cindex)
+/* pick the datasets in cache that must reach the prefix directory on restart,
+ * which is the newest checkpoint and any output dataset that has not been flushed,
+ * older checkpoints are replaced by the newest one so there is no need to write them,
+ * returns ids in ascending order in a newly allocated list */
+static int scr_flush_restart_plan(const scr_cache_index* cindex, int* count, int** ids)
 {
   /* get ordered list of dataset ids in cache */
   int ndsets;
   int* dsets;
   scr_cache_index_list_datasets(cindex, &ndsets, &dsets);
 
-  /* iterate over ordered list of datasets in cache,
-   * flush each dataset if needed */
+  /* find the newest checkpoint */
+  int ckpt_dset = -1;
+  int i;
+  for (i = ndsets - 1; i >= 0; i--) {
+    scr_dataset* dataset = scr_dataset_new();
+    scr_cache_index_get_dataset(cindex, dsets[i], dataset);
+    int is_ckpt = scr_dataset_is_ckpt(dataset);
+    scr_dataset_delete(&dataset);
+    if (is_ckpt) {
+      ckpt_dset = dsets[i];
+      break;
+    }
+  }
+
+  /* keep the newest checkpoint and any output that still needs a flush,
+   * the list is already ordered so the checkpoint is flushed after any
+   * older output and ends up as the current dataset in the index */
+  int n = 0;
+  for (i = 0; i < ndsets; i++) {
+    int id = dsets[i];
+
+    scr_dataset* dataset = scr_dataset_new();
+    scr_cache_index_get_dataset(cindex, id, dataset);
+    int is_output = scr_dataset_is_output(dataset);
+    scr_dataset_delete(&dataset);
+
+    if (id == ckpt_dset || (is_output && scr_flush_file_need_flush(id))) {
+      dsets[n] = id;
+      n++;
+    } else if (scr_my_rank_world == 0) {
+      scr_dbg(2, "Skipping flush of dataset %d on restart", id);
+    }
+  }
+
+  *count = n;
+  *ids   = dsets;
+  return SCR_SUCCESS;
+}
+
+/* on restart, flush the cached datasets that need to be in the prefix directory,
+ * to be called after scr_cache_rebuild and scr_flush_file_rebuild */
+int scr_flush_restart(scr_cache_index* cindex)
+{
+  /* get ordered list of datasets we need to consider */
+  int ndsets;
+  int* dsets;
+  scr_flush_restart_plan(cindex, &ndsets, &dsets);
+
+  /* flush each dataset if needed */
   int i;
   for (i = 0; i < ndsets; i++) {
     int id = dsets[i];
 
     /* check whether we need to flush data */
     if (scr_flush_on_restart) {
-      /* TODO: We could be more efficient here.
-       * This may flush some checkpoints that aren't needed.
-       * For example, if we have two checkpoints in cache, we really
-       * only need to flush the most recent one.  We could also
-       * avoid flushing a pure-output dataset that comes after the most
-       * recent checkpoint since in theory it'll be overwritten anyway. */
-
       /* Application wants the latest checkpoint flushed to be able
        * to read it during restart, so force a sync flush.
-       * We flush everything with sync here to maintain
+       * We flush with sync here to maintain
        * proper ordering of the current marker. */
       int flush_rc = scr_flush_sync(cindex, id);
       if (flush_rc != SCR_SUCCESS) {
@@ -513,6 +722,22 @@ int scr_flush_restart(scr_cache_index* cindex)
   return SCR_SUCCESS;
 }
 
+/* acquire lock on scr_map and the memory region list */
+static void scr_map_lock(void)
+{
+#ifdef HAVE_PTHREADS
+  pthread_mutex_lock(&scr_map_mutex);
+#endif
+}
+
+/* release lock on scr_map and the memory region list */
+static void scr_map_unlock(void)
+{
+#ifdef HAVE_PTHREADS
+  pthread_mutex_unlock(&scr_map_mutex);
+#endif
+}
+
 /* given a dataset id and a filename,
  * return the full path to the file which the caller should use to access the file */
 static int scr_route_file(int id, const char* file, char* newfile, int n)
@@ -577,6 +802,214 @@ static int scr_route_file(int id, const char* file, char* newfile, int n)
   return SCR_SUCCESS;
 }
 
+/*
+=========================================
+Memory regions
+=========================================
+*/
+
+/* compute crc32 of a memory buffer, zlib takes a uInt length,
+ * so feed large buffers through in pieces */
+static uLong scr_memory_crc32(const void* buf, size_t size)
+{
+  uLong crc = crc32(0L, Z_NULL, 0);
+  const Bytef* ptr = (const Bytef*) buf;
+  while (size > 0) {
+    size_t count = size;
+    if (count > ((size_t) 1 << 30)) {
+      count = ((size_t) 1 << 30);
+    }
+    crc = crc32(crc, ptr, (uInt) count);
+    ptr  += count;
+    size -= count;
+  }
+  return crc;
+}
+
+/* record a memory region for the current output dataset,
+ * replaces an existing entry for the same file */
+static void scr_memory_add(const char* file, const void* buf, size_t size)
+{
+  /* overwrite any earlier registration of this file */
+  int i;
+  for (i = 0; i < scr_memory_count; i++) {
+    if (strcmp(scr_memory_regions[i].file, file) == 0) {
+      scr_memory_regions[i].buf  = buf;
+      scr_memory_regions[i].size = size;
+      return;
+    }
+  }
+
+  /* grow the list if needed */
+  if (scr_memory_count == scr_memory_max) {
+    int newmax = (scr_memory_max > 0) ? 2 * scr_memory_max : 8;
+    scr_memory_region* regions = (scr_memory_region*) realloc(
+      scr_memory_regions, newmax * sizeof(scr_memory_region)
+    );
+    if (regions == NULL) {
+      scr_abort(-1, "Failed to allocate memory region list @ %s:%d",
+        __FILE__, __LINE__
+      );
+    }
+    scr_memory_regions = regions;
+    scr_memory_max     = newmax;
+  }
+
+  /* append the new region */
+  scr_memory_region* region = &scr_memory_regions[scr_memory_count];
+  region->file = strdup(file);
+  region->buf  = buf;
+  region->size = size;
+  scr_memory_count++;
+}
+
+/* forget all memory regions registered in the current output dataset */
+static void scr_memory_clear(void)
+{
+  int i;
+  for (i = 0; i < scr_memory_count; i++) {
+    scr_free(&scr_memory_regions[i].file);
+  }
+  scr_free(&scr_memory_regions);
+  scr_memory_count = 0;
+  scr_memory_max   = 0;
+}
+
+/* write each registered memory region to its file with a single write,
+ * and record the crc computed from the buffer in the file meta data,
+ * returns SCR_FAILURE if any region could not be written */
+static int scr_memory_write(scr_filemap* map, const scr_reddesc* rd)
+{
+  int rc = SCR_SUCCESS;
+
+  mode_t mode_file = scr_getmode(1, 1, 0);
+
+  /* skip the fsync when the files land in a memory-backed store */
+  int memory = 0;
+  if (! rd->bypass) {
+    scr_storedesc* store = scr_reddesc_get_store(rd);
+    if (store != NULL) {
+      memory = store->memory;
+    }
+  }
+
+  int i;
+  for (i = 0; i < scr_memory_count; i++) {
+    scr_memory_region* region = &scr_memory_regions[i];
+    const char* file = region->file;
+
+    /* write the region out to the file */
+    int fd = scr_open(file, O_WRONLY | O_CREAT | O_TRUNC, mode_file);
+    if (fd < 0) {
+      scr_err("Opening file for write: scr_open(%s) errno=%d %s @ %s:%d",
+        file, errno, strerror(errno), __FILE__, __LINE__
+      );
+      rc = SCR_FAILURE;
+      continue;
+    }
+    if (scr_file_preallocate(file, fd, (unsigned long) region->size) != SCR_SUCCESS) {
+      scr_close_nosync(file, fd);
+      rc = SCR_FAILURE;
+      continue;
+    }
+    ssize_t nwrite = scr_write_attempt(file, fd, region->buf, region->size);
+    if (nwrite < 0 || (size_t) nwrite != region->size) {
+      scr_err("Failed to write %lu bytes of memory region to %s @ %s:%d",
+        (unsigned long) region->size, file, __FILE__, __LINE__
+      );
+      rc = SCR_FAILURE;
+    }
+    int close_rc = memory ? scr_close_nosync(file, fd) : scr_close(file, fd);
+    if (close_rc != SCR_SUCCESS) {
+      rc = SCR_FAILURE;
+    }
+
+    /* compute the crc from the buffer rather than reading the file back */
+    if (scr_crc_on_copy || scr_crc_on_flush) {
+      uLong crc = scr_memory_crc32(region->buf, region->size);
+      scr_meta* meta = scr_meta_new();
+      scr_filemap_get_meta(map, file, meta);
+      scr_meta_set_crc32(meta, crc);
+      scr_filemap_set_meta(map, file, meta);
+      scr_meta_delete(&meta);
+    }
+  }
+
+  /* the buffers belong to the caller, we're done with them */
+  scr_memory_clear();
+
+  return rc;
+}
+
+/* read the file for a memory region directly into the caller's buffer,
+ * and check its size and crc against the values in the filemap */
+static int scr_memory_read(const char* file, void* buf, size_t size)
+{
+  /* lookup meta data for this file */
+  scr_filemap* map = scr_filemap_new();
+  scr_cache_get_map(scr_cindex, scr_dataset_id, map);
+  scr_meta* meta = scr_meta_new();
+  if (scr_filemap_get_meta(map, file, meta) != SCR_SUCCESS) {
+    scr_meta_delete(&meta);
+    scr_filemap_delete(&map);
+    scr_err("No meta data for memory region file %s @ %s:%d",
+      file, __FILE__, __LINE__
+    );
+    return SCR_FAILURE;
+  }
+
+  int rc = SCR_SUCCESS;
+
+  /* region size must match what was written */
+  unsigned long filesize = 0;
+  scr_meta_get_filesize(meta, &filesize);
+  if (filesize != (unsigned long) size) {
+    scr_err("Memory region size %lu does not match file size %lu for %s @ %s:%d",
+      (unsigned long) size, filesize, file, __FILE__, __LINE__
+    );
+    rc = SCR_FAILURE;
+  }
+
+  /* fill the buffer directly from the file */
+  if (rc == SCR_SUCCESS) {
+    int fd = scr_open(file, O_RDONLY);
+    if (fd < 0) {
+      scr_err("Opening file for read: scr_open(%s) errno=%d %s @ %s:%d",
+        file, errno, strerror(errno), __FILE__, __LINE__
+      );
+      rc = SCR_FAILURE;
+    } else {
+      ssize_t nread = scr_read_attempt(file, fd, buf, size);
+      if (nread < 0 || (size_t) nread != size) {
+        scr_err("Failed to read %lu bytes of memory region from %s @ %s:%d",
+          (unsigned long) size, file, __FILE__, __LINE__
+        );
+        rc = SCR_FAILURE;
+      }
+      scr_close(file, fd);
+    }
+  }
+
+  /* check the crc if we have one */
+  uLong crc_meta;
+  if (rc == SCR_SUCCESS && scr_crc_on_flush &&
+      scr_meta_get_crc32(meta, &crc_meta) == SCR_SUCCESS)
+  {
+    uLong crc = scr_memory_crc32(buf, size);
+    if (crc != crc_meta) {
+      scr_err("CRC32 mismatch detected for memory region %s @ %s:%d",
+        file, __FILE__, __LINE__
+      );
+      rc = SCR_FAILURE;
+    }
+  }
+
+  scr_meta_delete(&meta);
+  scr_filemap_delete(&map);
+
+  return rc;
+}
+
 /* given the current state, abort with an informative error message */
 static void scr_state_transition_error(int state, const char* function, const char* file, int line)
 {
@@ -759,6 +1192,40 @@ static int scr_get_params()
     scr_dbg(1, "SCR_LOG_DB_NAME=%s", scr_log_db_name);
   }
 
+  /* whether to export metrics to a file */
+  if ((value = scr_param_get("SCR_METRICS_ENABLE")) != NULL) {
+    scr_metrics_enable = atoi(value);
+  }
+  if (scr_my_rank_world == 0) {
+    scr_dbg(1, "SCR_METRICS_ENABLE=%d", scr_metrics_enable);
+  }
+
+  /* path of metrics file, defaults to a file in the control directory */
+  if ((value = scr_param_get("SCR_METRICS_FILE")) != NULL) {
+    scr_metrics_file = strdup(value);
+  }
+  if (scr_my_rank_world == 0) {
+    scr_dbg(1, "SCR_METRICS_FILE=%s", scr_metrics_file);
+  }
+
+  /* format of metrics file */
+  if ((value = scr_param_get("SCR_METRICS_FORMAT")) != NULL) {
+    scr_metrics_format = strdup(value);
+  } else {
+    scr_metrics_format = strdup(SCR_METRICS_FORMAT);
+  }
+  if (scr_my_rank_world == 0) {
+    scr_dbg(1, "SCR_METRICS_FORMAT=%s", scr_metrics_format);
+  }
+
+  /* minimum number of seconds between writes of metrics file */
+  if ((value = scr_param_get("SCR_METRICS_INTERVAL")) != NULL) {
+    scr_metrics_interval = atoi(value);
+  }
+  if (scr_my_rank_world == 0) {
+    scr_dbg(1, "SCR_METRICS_INTERVAL=%d", scr_metrics_interval);
+  }
+
   /* read username from SCR_USER_NAME, if not set, try to read from environment */
   if ((value = scr_param_get("SCR_USER_NAME")) != NULL) {
     scr_username = strdup(value);
@@ -981,6 +1448,14 @@ static int scr_get_params()
     scr_dbg(1, "SCR_HALT_SECONDS=%d", scr_halt_seconds);
   }
 
+  /* determine whether to predict halt seconds from flush bandwidth */
+  if ((value = scr_param_get("SCR_HALT_PREDICT")) != NULL) {
+    scr_halt_predict = atoi(value);
+  }
+  if (scr_my_rank_world == 0) {
+    scr_dbg(1, "SCR_HALT_PREDICT=%d", scr_halt_predict);
+  }
+
   /* determine whether we should call exit() upon detecting a halt condition */
   if ((value = scr_param_get("SCR_HALT_EXIT")) != NULL) {
     scr_halt_exit = atoi(value);
@@ -1037,6 +1512,14 @@ static int scr_get_params()
     scr_dbg(1, "SCR_FETCH_WIDTH=%d", scr_fetch_width);
   }
 
+  /* whether to restart from the prefix directory and stage into cache afterwards */
+  if ((value = scr_param_get("SCR_FETCH_LAZY")) != NULL) {
+    scr_fetch_lazy = atoi(value);
+  }
+  if (scr_my_rank_world == 0) {
+    scr_dbg(1, "SCR_FETCH_LAZY=%d", scr_fetch_lazy);
+  }
+
   /* allow user to specify checkpoint to start with on fetch */
   if ((value = scr_param_get("SCR_CURRENT")) != NULL) {
     scr_fetch_current = strdup(value);
@@ -1118,6 +1601,17 @@ static int scr_get_params()
     scr_dbg(1, "SCR_PREFIX_PURGE=%d ", scr_prefix_purge);
   }
 
+  /* number of updates rank 0 may append to the index journal in the prefix
+   * directory before it rewrites the full index file, set to 0 to rewrite
+   * the index file on every update */
+  if ((value = scr_param_get("SCR_INDEX_JOURNAL")) != NULL) {
+    scr_index_journal = atoi(value);
+  }
+  if (scr_my_rank_world == 0) {
+    scr_dbg(1, "SCR_INDEX_JOURNAL=%d", scr_index_journal);
+  }
+  scr_index_set_journal(scr_index_journal);
+
   /* specify whether to use asynchronous flush */
   if ((value = scr_param_get("SCR_FLUSH_ASYNC")) != NULL) {
     scr_flush_async = atoi(value);
@@ -1126,8 +1620,8 @@ static int scr_get_params()
     scr_dbg(1, "SCR_FLUSH_ASYNC=%d", scr_flush_async);
   }
 
- /* Specify whether our flush will be finalized in poststage (currently
-  * only supported with BBAPI). */
+ /* Specify whether our flush will be finalized in poststage (supported
+  * with BBAPI, PTHREAD, and SYNC). */
   if ((value = scr_param_get("SCR_FLUSH_POSTSTAGE")) != NULL) {
     scr_flush_poststage = atoi(value);
   }
@@ -1135,6 +1629,28 @@ static int scr_get_params()
     scr_dbg(1, "SCR_FLUSH_POSTSTAGE=%d", scr_flush_poststage);
   }
 
+  /* whether a new async checkpoint flush cancels the flush of an older checkpoint */
+  if ((value = scr_param_get("SCR_FLUSH_SUPERSEDE")) != NULL) {
+    scr_flush_supersede = atoi(value);
+  }
+  if (scr_my_rank_world == 0) {
+    scr_dbg(1, "SCR_FLUSH_SUPERSEDE=%d", scr_flush_supersede);
+  }
+
+  /* bytes copied between progress records so an interrupted flush can resume */
+  if ((value = scr_param_get("SCR_FLUSH_RESUME_SIZE")) != NULL) {
+    if (scr_abtoull(value, &ull) == SCR_SUCCESS) {
+      scr_flush_resume_size = (unsigned long) ull;
+    } else {
+      scr_err("Failed to read SCR_FLUSH_RESUME_SIZE successfully @ %s:%d",
+        __FILE__, __LINE__
+      );
+    }
+  }
+  if (scr_my_rank_world == 0) {
+    scr_dbg(1, "SCR_FLUSH_RESUME_SIZE=%lu", scr_flush_resume_size);
+  }
+
   /* bandwidth limit imposed during async flush (in bytes/sec) */
   if ((value = scr_param_get("SCR_FLUSH_ASYNC_BW")) != NULL) {
     if (scr_abtoull(value, &ull) == SCR_SUCCESS) {
@@ -1227,6 +1743,20 @@ static int scr_get_params()
     scr_dbg(1, "SCR_CRC_ON_DELETE=%d" , scr_crc_on_delete);
   }
 
+  /* bandwidth limit for each process when scrubbing cache (in bytes/sec) */
+  if ((value = scr_param_get("SCR_SCRUB_BW")) != NULL) {
+    if (scr_abtoull(value, &ull) == SCR_SUCCESS) {
+      scr_scrub_bw = (double) ull;
+    } else {
+      scr_err("Failed to read SCR_SCRUB_BW successfully @ %s:%d",
+        __FILE__, __LINE__
+      );
+    }
+  }
+  if (scr_my_rank_world == 0) {
+    scr_dbg(1, "SCR_SCRUB_BW=%f", scr_scrub_bw);
+  }
+
   /* override default checkpoint interval
    * (number of times to call Need_checkpoint between checkpoints) */
   if ((value = scr_param_get("SCR_CHECKPOINT_INTERVAL")) != NULL) {
@@ -1258,6 +1788,28 @@ static int scr_get_params()
     scr_dbg(1, "SCR_CHECKPOINT_OVERHEAD=%f", scr_checkpoint_overhead);
   }
 
+  /* override whether to tune the checkpoint interval */
+  if ((value = scr_param_get("SCR_CHECKPOINT_AUTO")) != NULL) {
+    scr_checkpoint_auto = atoi(value);
+  }
+  if (scr_my_rank_world == 0) {
+    scr_dbg(1, "SCR_CHECKPOINT_AUTO=%d", scr_checkpoint_auto);
+  }
+
+  /* override initial estimate of mean time between failures */
+  if ((value = scr_param_get("SCR_CHECKPOINT_MTBF")) != NULL) {
+    if (scr_atod(value, &d) == SCR_SUCCESS) {
+      scr_checkpoint_mtbf = d;
+    } else {
+      scr_err("Failed to read SCR_CHECKPOINT_MTBF successfully @ %s:%d",
+        __FILE__, __LINE__
+      );
+    }
+  }
+  if (scr_my_rank_world == 0) {
+    scr_dbg(1, "SCR_CHECKPOINT_MTBF=%f", scr_checkpoint_mtbf);
+  }
+
   if (scr_my_rank_world == 0) {
     scr_dbg(1, "Group descriptors:");
     kvtree_print_mode(scr_groupdesc_hash, 4, KVTREE_PRINT_KEYVAL);
@@ -1300,6 +1852,13 @@ static int scr_start_output(const char* name, int flags)
   /* make sure everyone is ready to start before we delete any existing checkpoints */
   MPI_Barrier(scr_comm_world);
 
+  /* stop checking files in cache and repair any it found corrupt */
+  scr_cache_scrub_stop(scr_cindex);
+
+  /* finish staging a lazily fetched dataset into cache before we
+   * decide which datasets to delete to make room for this one */
+  scr_fetch_lazy_complete(scr_cindex);
+
   /* determine whether this is a checkpoint */
   int is_ckpt = (flags & SCR_FLAG_CHECKPOINT);
 
@@ -1504,38 +2063,17 @@ static int scr_start_output(const char* name, int flags)
   }
 
   /* if we still don't have room and we're flushing,
-   * the dataset we need to delete must be flushing, so wait for it to finish */
+   * the dataset we need to delete must be flushing, so wait for it to finish,
+   * flushes complete out of order without moving the current pointer back,
+   * so we only wait on this one and leave any others running */
   if (nckpts_base >= size && flushing != -1) {
-    /* in case there are ongoing flush operations from other cache
-     * base locations, finalize datasets in order up to our target id
-     * so that we don't mess up our current pointer */
-
-    /* get full list of ids for ongoing flushes */
-    int flush_num = 0;
-    int* flush_ids = NULL;
-    scr_flush_async_get_list(scr_cindex, &flush_num, &flush_ids);
-
-    /* wait for each dataset up to and including the one we need
-     * to complete */
-    for (i = 0; i < flush_num; i++) {
-      /* wait for this dataset to complete its flush */
-      int id = flush_ids[i];
-      int flush_rc = scr_flush_async_wait(scr_cindex, id);
-      if (flush_rc != SCR_SUCCESS) {
-        scr_abort(-1, "Flush of dataset %d failed @ %s:%d",
-          id, __FILE__, __LINE__
-        );
-      }
-
-      /* can break once the target id is done */
-      if (id == flushing) {
-        break;
-      }
+    int flush_rc = scr_flush_async_wait(scr_cindex, flushing);
+    if (flush_rc != SCR_SUCCESS) {
+      scr_abort(-1, "Flush of dataset %d failed @ %s:%d",
+        flushing, __FILE__, __LINE__
+      );
     }
 
-    /* free list of flush ids */
-    scr_free(&flush_ids);
-
     /* now dataset is no longer flushing, we can delete it and continue on */
     scr_cache_delete(scr_cindex, flushing);
     nckpts_base--;
@@ -1544,6 +2082,12 @@ static int scr_start_output(const char* name, int flags)
   /* free the list of datasets */
   scr_free(&dsets);
 
+  /* rebuild any older datasets left over from scr_cache_rebuild,
+   * we do this after making room so that we do not spend time
+   * rebuilding datasets that we are about to delete, and this
+   * skips any dataset that was deleted above */
+  scr_cache_rebuild_pending(scr_cindex);
+
   /* update our file map with this new dataset */
   scr_cache_index_set_dataset(scr_cindex, scr_dataset_id, dataset);
 
@@ -1570,6 +2114,9 @@ static int scr_start_output(const char* name, int flags)
   /* free dataset object */
   scr_dataset_delete(&dataset);
 
+  /* write any changes to the cache index */
+  scr_cache_index_sync(scr_cindex_file, scr_cindex);
+
   /* print a debug message to indicate we've started the dataset */
   if (scr_my_rank_world == 0) {
     scr_dbg(1, "Starting dataset %d `%s'", scr_dataset_id, dataset_name);
@@ -1632,6 +2179,15 @@ static int scr_assign_ownership(scr_filemap* map, int bypass)
     filelist[i] = spath_strdup(path);
     spath_delete(&path);
 
+    /* segments of a shared file are distinct entries,
+     * so tack on the offset to tell them apart */
+    unsigned long offset;
+    if (scr_meta_get_segment(meta, &offset) == SCR_SUCCESS) {
+      char* segname = filelist[i];
+      filelist[i] = scr_strdupf("%s//%lu", segname, offset);
+      scr_free(&segname);
+    }
+
     /* free meta data */
     scr_meta_delete(&meta);
 
@@ -1721,6 +2277,12 @@ static int scr_complete_output(int valid)
     time_start = MPI_Wtime();
   }
 
+  /* write out any memory regions registered in this dataset,
+   * treat a failed write the same as the caller passing valid=0 */
+  if (scr_memory_write(scr_map, scr_rd) != SCR_SUCCESS) {
+    valid = 0;
+  }
+
   /* When using bypass mode, we allow different procs to write to the same file,
    * in which case, both should have registered the file in Route_file and thus
    * have an entry in the file map.  The proper thing to do here is to list the
@@ -1729,10 +2291,19 @@ static int scr_complete_output(int valid)
    * file in their file map. */
   rc = scr_assign_ownership(scr_map, scr_rd->bypass);
 
+  /* determine whether files are in a memory-backed store */
+  int memory = 0;
+  if (! scr_rd->bypass) {
+    scr_storedesc* store = scr_reddesc_get_store(scr_rd);
+    if (store != NULL) {
+      memory = store->memory;
+    }
+  }
+
   /* count number of files, number of bytes, and record filesize for each file
    * as written by this process */
   int files_valid = valid;
-  unsigned long my_counts[3] = {0, 0, 0};
+  unsigned long my_counts[4] = {0, 0, 0, 0};
   kvtree_elem* elem;
   for (elem = scr_filemap_first_file(scr_map);
        elem != NULL;
@@ -1745,15 +2316,6 @@ static int scr_complete_output(int valid)
     /* start with valid flag from caller for this file */
     int file_valid = valid;
 
-    /* check that we can read the file */
-    if (scr_file_is_readable(file) != SCR_SUCCESS) {
-      scr_dbg(2, "Do not have read access to file: %s @ %s:%d",
-        file, __FILE__, __LINE__
-      );
-      file_valid  = 0;
-      files_valid = 0;
-    }
-
     /* stat the file to get its size and other metadata */
     unsigned long filesize = 0;
     struct stat stat_buf;
@@ -1762,6 +2324,22 @@ static int scr_complete_output(int valid)
       filesize = (unsigned long) stat_buf.st_size;
     }
 
+    /* check that we can read the file, on a memory store the stat
+     * above tells us enough without another trip through the VFS */
+    int readable;
+    if (memory) {
+      readable = (stat_rc == 0 && (stat_buf.st_mode & S_IRUSR));
+    } else {
+      readable = (scr_file_is_readable(file) == SCR_SUCCESS);
+    }
+    if (! readable) {
+      scr_dbg(2, "Do not have read access to file: %s @ %s:%d",
+        file, __FILE__, __LINE__
+      );
+      file_valid  = 0;
+      files_valid = 0;
+    }
+
     /* get size of this file */
     //unsigned long filesize = scr_file_size(file);
     my_counts[1] += filesize;
@@ -1771,6 +2349,9 @@ static int scr_complete_output(int valid)
     /* fill in filesize and complete flag in the meta data for the file */
     scr_meta* meta = scr_meta_new();
     scr_filemap_get_meta(scr_map, file, meta);
+    if (scr_meta_is_segment(meta) == SCR_SUCCESS) {
+      my_counts[3]++;
+    }
     scr_meta_set_filesize(meta, filesize);
     scr_meta_set_complete(meta, file_valid);
     if (stat_rc == 0) {
@@ -1786,12 +2367,14 @@ static int scr_complete_output(int valid)
     my_counts[2] = 1;
   }
 
-  /* execute allreduce to total up number of files, bytes, and number of valid ranks */
-  unsigned long total_counts[3];
-  MPI_Allreduce(my_counts, total_counts, 3, MPI_UNSIGNED_LONG, MPI_SUM, scr_comm_world);
-  unsigned long total_files = total_counts[0];
-  unsigned long total_bytes = total_counts[1];
-  unsigned long total_valid = total_counts[2];
+  /* execute allreduce to total up number of files, bytes, number of valid ranks,
+   * and number of shared file segments */
+  unsigned long total_counts[4];
+  MPI_Allreduce(my_counts, total_counts, 4, MPI_UNSIGNED_LONG, MPI_SUM, scr_comm_world);
+  unsigned long total_files    = total_counts[0];
+  unsigned long total_bytes    = total_counts[1];
+  unsigned long total_valid    = total_counts[2];
+  unsigned long total_segments = total_counts[3];
 
   /* get dataset from filemap */
   scr_dataset* dataset = scr_dataset_new();
@@ -1804,6 +2387,9 @@ static int scr_complete_output(int valid)
   /* store total number of files, total number of bytes, and complete flag in dataset */
   scr_dataset_set_files(dataset, (int) total_files);
   scr_dataset_set_size(dataset,        total_bytes);
+  if (total_segments > 0) {
+    scr_dataset_set_segments(dataset, (int) total_segments);
+  }
   if (total_valid == scr_ranks_world) {
     /* got a valid=1 for every rank, we're complete */
     scr_dataset_set_complete(dataset, 1);
@@ -1814,7 +2400,7 @@ static int scr_complete_output(int valid)
     rc = SCR_FAILURE;
   }
   scr_cache_index_set_dataset(scr_cindex, scr_dataset_id, dataset);
-  scr_cache_index_write(scr_cindex_file, scr_cindex);
+  scr_cache_index_mark_dirty();
 
   /* write out info to filemap */
   scr_cache_set_map(scr_cindex, scr_dataset_id, scr_map);
@@ -1888,6 +2474,22 @@ static int scr_complete_output(int valid)
     if (is_ckpt) {
       scr_time_checkpoint_total += time_diff;
       scr_time_checkpoint_count++;
+      scr_halt_ckpt_id    = scr_dataset_id;
+      scr_halt_ckpt_bytes = bytes;
+
+      if (scr_checkpoint_auto) {
+        scr_interval_record(time_diff);
+      }
+    }
+
+    /* record the output in our metrics */
+    if (is_ckpt) {
+      scr_metrics_add(SCR_METRIC_CHECKPOINTS, 1.0);
+      scr_metrics_add(SCR_METRIC_CHECKPOINT_BYTES, bytes);
+      scr_metrics_observe(SCR_METRIC_CHECKPOINT_SECS, time_diff);
+    } else {
+      scr_metrics_add(SCR_METRIC_OUTPUTS, 1.0);
+      scr_metrics_add(SCR_METRIC_OUTPUT_BYTES, bytes);
     }
 
     /* log data on the output */
@@ -1964,6 +2566,12 @@ static int scr_complete_output(int valid)
   /* set redundancy descriptor back to NULL */
   scr_rd = NULL;
 
+  /* write any changes to the cache index */
+  scr_cache_index_sync(scr_cindex_file, scr_cindex);
+
+  /* check files in cache for corruption while the application computes */
+  scr_cache_scrub_start(scr_cindex);
+
   /* make sure everyone is ready before we exit */
   MPI_Barrier(scr_comm_world);
 
@@ -1981,6 +2589,9 @@ static int scr_complete_output(int valid)
   /* unset the output flag to indicate we have exited the current output phase */
   scr_in_output = 0;
 
+  /* update the metrics file if it is due */
+  scr_metrics_write(0);
+
   /* start the clock for measuring the compute time,
    * we count output time as compute time for non-checkpoint datasets */
   if (is_ckpt && scr_my_rank_world == 0) {
@@ -2409,6 +3020,9 @@ int SCR_Init()
   scr_cindex_file = spath_from_str(scr_cntl_prefix);
   spath_append_strf(scr_cindex_file, "cindex.scrinfo", scr_storedesc_cntl->rank);
 
+  /* set up metrics, which defaults to a file in the control directory */
+  scr_metrics_init();
+
   /* TODO: should we also record the list of nodes and / or MPI rank to node mapping? */
   /* record the number of nodes being used in this job to the nodes file */
   /* Each rank records its node number in the global scr_my_hostid */
@@ -2419,6 +3033,11 @@ int SCR_Init()
     kvtree_delete(&nodes_hash);
   }
 
+  /* pick up checkpoint cost and failure history from earlier runs */
+  if (scr_checkpoint_auto && scr_my_rank_world == 0) {
+    scr_interval_init();
+  }
+
   /* initialize halt info before calling scr_bool_check_halt_and_decrement
    * and set the halt seconds in our halt data structure,
    * this will be overridden if a value is already set in the halt file */
@@ -2549,6 +3168,9 @@ int SCR_Init()
    * we'll take this to mean that we have a checkpoint in cache */
   scr_have_restart = (scr_checkpoint_id > 0);
 
+  /* write changes to the cache index from the purge, rebuild, and fetch */
+  scr_cache_index_sync(scr_cindex_file, scr_cindex);
+
   /* sync everyone before returning to ensure that subsequent
    * calls to SCR functions are valid */
   MPI_Barrier(scr_comm_world);
@@ -2605,9 +3227,32 @@ int SCR_Finalize()
     scr_halt(SCR_FINALIZE_CALLED);
   }
 
+  /* stop checking files in cache and repair any it found corrupt */
+  scr_cache_scrub_stop(scr_cindex);
+
+  /* finish staging a lazily fetched dataset into cache */
+  scr_fetch_lazy_complete(scr_cindex);
+
   /* flush any pending datasets and shut down flush methods */
   scr_flush_finalize();
 
+  /* write final snapshot of metrics */
+  scr_metrics_finalize();
+
+  /* record that this run ended cleanly */
+  if (scr_checkpoint_auto && scr_my_rank_world == 0) {
+    scr_interval_finalize();
+  }
+
+  /* fold index journal into index file for tools that read it directly */
+  if (scr_my_rank_world == 0) {
+    scr_index_compact(scr_prefix_path);
+  }
+  scr_index_set_journal(0);
+
+  /* write any pending changes to the cache index */
+  scr_cache_index_sync(scr_cindex_file, scr_cindex);
+
   /* free off the memory allocated for our descriptors */
   scr_reddescs_free();
   scr_storedescs_free();
@@ -2663,6 +3308,8 @@ int SCR_Finalize()
   scr_free(&scr_log_db_user);
   scr_free(&scr_log_db_pass);
   scr_free(&scr_log_db_name);
+  scr_free(&scr_metrics_file);
+  scr_free(&scr_metrics_format);
   scr_free(&scr_username);
   scr_free(&scr_jobid);
   scr_free(&scr_jobname);
@@ -3097,9 +3744,17 @@ int SCR_Need_checkpoint(int* flag)
 
   /* have rank 0 make the decision and broadcast the result */
   if (scr_my_rank_world == 0) {
-    /* TODO: account for MTBF, time to flush, etc. */
     /* if we don't need to halt, check whether we can afford to checkpoint */
 
+    /* if tuning is enabled, checkpoint once the interval computed from
+     * the measured cost and mean time between failures has passed,
+     * or right away if we have no cost estimate yet */
+    if (!*flag && scr_checkpoint_auto) {
+      if (scr_interval_need(scr_time_checkpoint_end, MPI_Wtime()) != 0) {
+        *flag = 1;
+      }
+    }
+
     /* if checkpoint interval is set, check the current checkpoint id */
     if (!*flag && scr_checkpoint_interval > 0 && scr_need_checkpoint_count % scr_checkpoint_interval == 0) {
       *flag = 1;
@@ -3197,6 +3852,122 @@ int SCR_Start_checkpoint()
   return scr_start_output(NULL, SCR_FLAG_CHECKPOINT);
 }
 
+/* record a file routed during output in the filemap, file is the name
+ * given by the caller and newfile is where it is written, if segment is
+ * set, newfile holds the bytes of file starting at the given offset,
+ * returns SCR_FAILURE if newfile already holds a segment at another offset */
+static int scr_route_add_file(const char* file, const char* newfile, int segment, unsigned long offset)
+{
+  /* TODO: to avoid duplicates, check that the file is not already in the filemap,
+   * at the moment duplicates just overwrite each other, so there's no harm,
+   * except for segments, which we check below */
+
+  /* build meta data for this file, we do this without holding the lock
+   * on scr_map so that multiple threads can route files at once */
+  scr_meta* meta = scr_meta_new();
+
+  /* set parameters for the file */
+  scr_meta_set_complete(meta, 0);
+  if (segment) {
+    scr_meta_set_segment(meta, offset);
+  }
+  /* TODO: move the ranks field elsewhere, for now it's needed by scr_index.c */
+  scr_meta_set_ranks(meta, scr_ranks_world);
+  scr_meta_set_orig(meta, file);
+
+  /* build absolute path to file */
+  spath* path_abs = spath_from_str(file);
+  if (! spath_is_absolute(path_abs)) {
+    /* the path is not absolute, so prepend the current working directory */
+    char cwd[SCR_MAX_FILENAME];
+    if (scr_getcwd(cwd, sizeof(cwd)) == SCR_SUCCESS) {
+      spath_prepend_str(path_abs, cwd);
+    } else {
+      /* problem acquiring current working directory */
+      scr_abort(-1, "Failed to build absolute path to %s @ %s:%d",
+        file, __FILE__, __LINE__
+      );
+    }
+  }
+
+  /* simplify the absolute path (removes "." and ".." entries) */
+  spath_reduce(path_abs);
+
+  /* check that file is somewhere under prefix */
+  if (! spath_is_child(scr_prefix_path, path_abs)) {
+    /* found a file that's outside of prefix, throw an error */
+    char* path_abs_str = spath_strdup(path_abs);
+    scr_abort(-1, "File `%s' must be under SCR_PREFIX `%s' @ %s:%d",
+      path_abs_str, scr_prefix, __FILE__, __LINE__
+    );
+  }
+
+  /* cut absolute path into direcotry and file name */
+  spath* path_name = spath_cut(path_abs, -1);
+
+  /* store the full path and name of the original file */
+  char* path = spath_strdup(path_abs);
+  char* name = spath_strdup(path_name);
+  scr_meta_set_origpath(meta, path);
+  scr_meta_set_origname(meta, name);
+
+  /* TODO: would be nice to limit mkdir ops here */
+  /* if we're in bypass mode, we need to be sure directory exists
+   * for this file before user starts to write to it */
+  if (scr_rd->bypass) {
+    mode_t mode_dir = scr_getmode(1, 1, 1);
+    if (scr_mkdir(path, mode_dir) != SCR_SUCCESS) {
+      scr_abort(-1, "Failed to create directory %s @ %s:%d",
+        path, __FILE__, __LINE__
+      );
+    }
+  }
+
+  /* free full path and name of original file */
+  scr_free(&name);
+  scr_free(&path);
+
+  /* free directory and file name paths */
+  spath_delete(&path_name);
+  spath_delete(&path_abs);
+
+  /* add the file and its meta data to the filemap, and write out
+   * the filemap, the lock serializes threads in this process */
+  int rc = SCR_SUCCESS;
+  scr_map_lock();
+
+  /* a process holds one segment per shared file, so routing the same
+   * file again must name the same offset, or we would lose a segment */
+  if (segment) {
+    scr_meta* existing = scr_meta_new();
+    if (scr_filemap_get_meta(scr_map, newfile, existing) == SCR_SUCCESS) {
+      unsigned long existing_offset;
+      if (scr_meta_get_segment(existing, &existing_offset) != SCR_SUCCESS ||
+          existing_offset != offset)
+      {
+        scr_err("Segment of %s at offset %lu conflicts with one already routed to %s @ %s:%d",
+          file, offset, newfile, __FILE__, __LINE__
+        );
+        rc = SCR_FAILURE;
+      }
+    }
+    scr_meta_delete(&existing);
+  }
+
+  if (rc == SCR_SUCCESS) {
+    scr_filemap_add_file(scr_map, newfile);
+    scr_filemap_set_meta(scr_map, newfile, meta);
+    scr_cache_set_map(scr_cindex, scr_dataset_id, scr_map);
+  }
+
+  scr_map_unlock();
+
+  /* delete the meta data object */
+  scr_meta_delete(&meta);
+
+  return rc;
+}
+
 /* given a filename, return the full path to the file which the user should write to */
 int SCR_Route_file(const char* file, char* newfile)
 {
@@ -3249,86 +4020,8 @@ int SCR_Route_file(const char* file, char* newfile)
   /* if we are in a new dataset, record this file in our filemap,
    * otherwise, we are likely in a restart, so check whether the file exists */
   if (scr_in_output) {
-    /* TODO: to avoid duplicates, check that the file is not already in the filemap,
-     * at the moment duplicates just overwrite each other, so there's no harm */
-
-    /* add the file to the filemap */
-    scr_filemap_add_file(scr_map, newfile);
-
-    /* read meta data for this file */
-    scr_meta* meta = scr_meta_new();
-    scr_filemap_get_meta(scr_map, newfile, meta);
-
-    /* set parameters for the file */
-    scr_meta_set_complete(meta, 0);
-    /* TODO: move the ranks field elsewhere, for now it's needed by scr_index.c */
-    scr_meta_set_ranks(meta, scr_ranks_world);
-    scr_meta_set_orig(meta, file);
-
-    /* build absolute path to file */
-    spath* path_abs = spath_from_str(file);
-    if (! spath_is_absolute(path_abs)) {
-      /* the path is not absolute, so prepend the current working directory */
-      char cwd[SCR_MAX_FILENAME];
-      if (scr_getcwd(cwd, sizeof(cwd)) == SCR_SUCCESS) {
-        spath_prepend_str(path_abs, cwd);
-      } else {
-        /* problem acquiring current working directory */
-        scr_abort(-1, "Failed to build absolute path to %s @ %s:%d",
-          file, __FILE__, __LINE__
-        );
-      }
-    }
-
-    /* simplify the absolute path (removes "." and ".." entries) */
-    spath_reduce(path_abs);
-
-    /* check that file is somewhere under prefix */
-    if (! spath_is_child(scr_prefix_path, path_abs)) {
-      /* found a file that's outside of prefix, throw an error */
-      char* path_abs_str = spath_strdup(path_abs);
-      scr_abort(-1, "File `%s' must be under SCR_PREFIX `%s' @ %s:%d",
-        path_abs_str, scr_prefix, __FILE__, __LINE__
-      );
-    }
-
-    /* cut absolute path into direcotry and file name */
-    spath* path_name = spath_cut(path_abs, -1);
-
-    /* store the full path and name of the original file */
-    char* path = spath_strdup(path_abs);
-    char* name = spath_strdup(path_name);
-    scr_meta_set_origpath(meta, path);
-    scr_meta_set_origname(meta, name);
-
-    /* TODO: would be nice to limit mkdir ops here */
-    /* if we're in bypass mode, we need to be sure directory exists
-     * for this file before user starts to write to it */
-    if (scr_rd->bypass) {
-      mode_t mode_dir = scr_getmode(1, 1, 1);
-      if (scr_mkdir(path, mode_dir) != SCR_SUCCESS) {
-        scr_abort(-1, "Failed to create directory %s @ %s:%d",
-          path, __FILE__, __LINE__
-        );
-      }
-    }
-
-    /* free full path and name of original file */
-    scr_free(&name);
-    scr_free(&path);
-
-    /* free directory and file name paths */
-    spath_delete(&path_name);
-    spath_delete(&path_abs);
-
-    /* record the meta data for this file */
-    scr_filemap_set_meta(scr_map, newfile, meta);
-
-    /* write out the filemap */
-    scr_cache_set_map(scr_cindex, scr_dataset_id, scr_map);
-
-    /* delete the meta data object */
-    scr_meta_delete(&meta);
+    /* record the file in the filemap */
+    scr_route_add_file(file, newfile, 0, 0);
   } else {
     /* if user specified path to file within prefix, return */
     if (scr_file_is_readable(newfile) == SCR_SUCCESS) {
@@ -3419,6 +4112,195 @@ int SCR_Route_file(const char* file, char* newfile)
   return SCR_SUCCESS;
 }
 
+/* route a file the caller intends to write size bytes to, during output
+ * we reserve that space for the routed file so that a full cache is
+ * reported here rather than partway through a write */
+int SCR_Route_file_size(const char* name, size_t size, char* file)
+{
+  if (SCR_Route_file(name, file) != SCR_SUCCESS) {
+    return SCR_FAILURE;
+  }
+
+  /* the hint only applies to files in the current output */
+  if (! scr_in_output || size == 0) {
+    return SCR_SUCCESS;
+  }
+
+  /* create the file and reserve its space while leaving its size at 0,
+   * a truncate releases the space, so the caller should open the file
+   * without O_TRUNC to keep it */
+  mode_t mode_file = scr_getmode(1, 1, 0);
+  int fd = scr_open(file, O_WRONLY | O_CREAT, mode_file);
+  if (fd < 0) {
+    scr_err("Opening file for write: scr_open(%s) errno=%d %s @ %s:%d",
+      file, errno, strerror(errno), __FILE__, __LINE__
+    );
+    return SCR_FAILURE;
+  }
+
+  int rc = scr_file_preallocate(file, fd, (unsigned long) size);
+  scr_close_nosync(file, fd);
+
+  if (rc != SCR_SUCCESS) {
+    scr_err("No space for %lu bytes of %s, the output should be marked invalid @ %s:%d",
+      (unsigned long) size, file, __FILE__, __LINE__
+    );
+    scr_file_unlink(file);
+  }
+
+  return rc;
+}
+
+/* route the calling process's segment of a shared file, during output the
+ * caller writes the bytes of name starting at offset to the returned file,
+ * and a flush writes them back into name at that offset, during restart
+ * the returned file holds those same bytes */
+int SCR_Route_file_segment(const char* name, size_t offset, char* file)
+{
+  /* manage state transition */
+  if (scr_state != SCR_STATE_RESTART    &&
+      scr_state != SCR_STATE_CHECKPOINT &&
+      scr_state != SCR_STATE_OUTPUT)
+  {
+    scr_abort(-1, "Must call SCR_Route_file_segment() between a Start/Complete pair @ %s:%d",
+      __FILE__, __LINE__
+    );
+    return SCR_FAILURE;
+  }
+
+  /* if not enabled, bail with an error */
+  if (! scr_enabled) {
+    return SCR_FAILURE;
+  }
+
+  /* bail out if not initialized -- will get bad results */
+  if (! scr_initialized) {
+    scr_abort(-1, "SCR has not been initialized @ %s:%d",
+      __FILE__, __LINE__
+    );
+    return SCR_FAILURE;
+  }
+
+  /* check that we got a name and a file to write to */
+  if (name == NULL || strcmp(name, "") == 0 || file == NULL) {
+    return SCR_FAILURE;
+  }
+
+  /* check that user's filename is not too long */
+  if (strlen(name) >= SCR_MAX_FILENAME) {
+    scr_abort(-1, "file name (%s) is longer than SCR_MAX_FILENAME (%d) @ %s:%d",
+      name, SCR_MAX_FILENAME, __FILE__, __LINE__
+    );
+  }
+
+  /* the segment is always held in the dataset directory in cache,
+   * even if the dataset otherwise bypasses cache, since the flush
+   * has to gather the segments from all ranks into the shared file */
+  char* dir = NULL;
+  if (scr_cache_index_get_dir(scr_cindex, scr_dataset_id, &dir) != SCR_SUCCESS) {
+    return SCR_FAILURE;
+  }
+
+  if (scr_in_output) {
+    /* record the segment in the filemap under its path in cache */
+    char* segfile = scr_cache_segment_path(dir, name, scr_my_rank_world);
+    strncpy(file, segfile, SCR_MAX_FILENAME);
+    scr_free(&segfile);
+
+    return scr_route_add_file(name, file, 1, (unsigned long) offset);
+  }
+
+  /* otherwise, we are in a restart, so find the segment of this file
+   * that starts at the given offset in the filemap */
+  spath* path = spath_from_str(name);
+  spath_basename(path);
+  char* namebase = spath_strdup(path);
+  spath_delete(&path);
+
+  scr_filemap* map = scr_filemap_new();
+  scr_cache_get_map(scr_cindex, scr_dataset_id, map);
+
+  int found_file = 0;
+  kvtree_elem* file_elem;
+  for (file_elem = scr_filemap_first_file(map);
+       file_elem != NULL && ! found_file;
+       file_elem = kvtree_elem_next(file_elem))
+  {
+    /* get the filename */
+    char* mapfile = kvtree_elem_key(file_elem);
+
+    /* check the name and the offset of the segment */
+    scr_meta* meta = scr_meta_new();
+    if (scr_filemap_get_meta(map, mapfile, meta) == SCR_SUCCESS) {
+      char* origname = NULL;
+      unsigned long segment_offset;
+      if (scr_meta_get_origname(meta, &origname) == SCR_SUCCESS &&
+          scr_meta_get_segment(meta, &segment_offset) == SCR_SUCCESS &&
+          strcmp(origname, namebase) == 0 &&
+          segment_offset == (unsigned long) offset)
+      {
+        strncpy(file, mapfile, SCR_MAX_FILENAME);
+        found_file = 1;
+      }
+    }
+    scr_meta_delete(&meta);
+  }
+
+  scr_filemap_delete(&map);
+  scr_free(&namebase);
+
+  /* return an error if we don't have this segment */
+  if (! found_file) {
+    return SCR_FAILURE;
+  }
+
+  /* if we can't read the file, return an error */
+  if (scr_file_is_readable(file) != SCR_SUCCESS) {
+    return SCR_FAILURE;
+  }
+
+  return SCR_SUCCESS;
+}
+
+/* register a memory buffer as a file in the current output dataset,
+ * or fill it from that file during a restart */
+int SCR_Register_memory(const char* name, void* buf, size_t size)
+{
+  /* manage state transition */
+  if (scr_state != SCR_STATE_RESTART    &&
+      scr_state != SCR_STATE_CHECKPOINT &&
+      scr_state != SCR_STATE_OUTPUT)
+  {
+    scr_abort(-1, "Must call SCR_Register_memory() between a Start/Complete pair @ %s:%d",
+      __FILE__, __LINE__
+    );
+    return SCR_FAILURE;
+  }
+
+  /* check that we have a buffer */
+  if (buf == NULL && size > 0) {
+    return SCR_FAILURE;
+  }
+
+  /* register the file, or look it up during restart */
+  char file[SCR_MAX_FILENAME];
+  if (SCR_Route_file(name, file) != SCR_SUCCESS) {
+    return SCR_FAILURE;
+  }
+
+  /* during output, we write the buffer out in Complete_output,
+   * so the caller must not modify it until then */
+  if (scr_in_output) {
+    scr_map_lock();
+    scr_memory_add(file, buf, size);
+    scr_map_unlock();
+    return SCR_SUCCESS;
+  }
+
+  /* otherwise, we are in a restart, so read the data into the buffer */
+  return scr_memory_read(file, buf, size);
+}
+
 /* inform library that the current dataset is complete */
 int SCR_Complete_output(int valid)
 {
@@ -3608,6 +4490,9 @@ int SCR_Complete_restart(int valid)
    * this should eventually be changed to use an output flag instead */
   int rc = SCR_SUCCESS;
 
+  /* stop checking files in cache, since we may delete some below */
+  scr_cache_scrub_stop(scr_cindex);
+
   /* check that all procs read valid data */
   if (! scr_alltrue(valid, scr_comm_world)) {
     /* if some process fails, attempt to restart from
@@ -3656,6 +4541,10 @@ int SCR_Complete_restart(int valid)
     scr_checkpoint_id = 0;
     scr_ckpt_dset_id  = 0;
 
+    /* rebuild older checkpoints that we skipped during SCR_Init
+     * so that we can fall back to one of them */
+    scr_cache_rebuild_pending(scr_cindex);
+
     /* get ordered list of datasets we have in our cache */
     int ndsets;
     int* dsets;
@@ -3721,6 +4610,18 @@ int SCR_Complete_restart(int valid)
     scr_have_restart = (scr_checkpoint_id > 0);
   }
 
+  /* if we restarted from a lazily fetched dataset,
+   * start copying it into cache in the background */
+  if (rc == SCR_SUCCESS) {
+    scr_fetch_lazy_start(scr_cindex);
+  }
+
+  /* write changes to the cache index */
+  scr_cache_index_sync(scr_cindex_file, scr_cindex);
+
+  /* check files in cache for corruption while the application computes */
+  scr_cache_scrub_start(scr_cindex);
+
   return rc;
 }
 
@@ -3893,6 +4794,9 @@ int SCR_Current(const char* name)
   /* free the dataset object */
   scr_dataset_delete(&dataset);
 
+  /* write changes to the cache index from deleting later datasets */
+  scr_cache_index_sync(scr_cindex_file, scr_cindex);
+
   return rc;
 }
 
@@ -3978,8 +4882,12 @@ int SCR_Delete(const char* name)
    * but has yet to have been flushed.  Those will have two different
    * id values */
 
+  /* stop checking files in cache before we delete any */
+  scr_cache_scrub_stop(scr_cindex);
+
   /* delete dataset from cache first, if it exists */
   scr_cache_delete_by_name(scr_cindex, name);
+  scr_cache_index_sync(scr_cindex_file, scr_cindex);
 
   /* delete dataset from prefix directory, if it exists */
   int id = -1;
@@ -9,6 +9,9 @@
  * Please also read this file: LICENSE.TXT.
 */
 
+/* for size_t */
+#include <stddef.h>
+
 /* enable C++ codes to include this header directly */
 #ifdef __cplusplus
 extern "C" {
@@ -69,6 +72,23 @@ const char* SCR_Configf(const char* format, ...);
 /* determine the path and filename to be used to open a file */
 int SCR_Route_file(const char* name, char* file);
 
+/* determine the path and filename to be used to open a file that
+ * will hold size bytes, during output SCR reserves the space and
+ * returns an error if it is not available */
+int SCR_Route_file_size(const char* name, size_t size, char* file);
+
+/* determine the path and filename to be used to open the file that
+ * holds this process's segment of the shared file name, which starts
+ * at the given byte offset, SCR writes the segments of all processes
+ * into name when it flushes the dataset */
+int SCR_Route_file_segment(const char* name, size_t offset, char* file);
+
+/* register a memory buffer as the named file in the current output,
+ * SCR writes the buffer in SCR_Complete_output, so it must not be
+ * modified before then, during a restart the buffer is filled from
+ * the named file */
+int SCR_Register_memory(const char* name, void* buf, size_t size);
+
 /*****************
  * Restart routines
  ****************/
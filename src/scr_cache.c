@@ -100,6 +100,27 @@ char* scr_cache_dir_hidden_get(const scr_reddesc* red, int id)
   return str;
 }
 
+/* returns path within the dataset directory dir of the file that holds the
+ * given rank's segment of a shared file, caller must free returned string */
+char* scr_cache_segment_path(const char* dir, const char* file, int rank)
+{
+  /* take basename of shared file and tack on the rank,
+   * since every rank holds a segment of the same file */
+  spath* path = spath_from_str(file);
+  spath_basename(path);
+  char* name = spath_strdup(path);
+  spath_delete(&path);
+
+  path = spath_from_str(dir);
+  spath_append_strf(path, "%s.%d.seg", name, rank);
+  spath_reduce(path);
+  char* str = spath_strdup(path);
+  spath_delete(&path);
+
+  scr_free(&name);
+  return str;
+}
+
 /* create a dataset directory given a redundancy descriptor and dataset id,
  * waits for all tasks on the same node before returning */
 int scr_cache_dir_create(const scr_reddesc* red, int id)
@@ -328,8 +349,13 @@ int scr_cache_delete(scr_cache_index* cindex, int id)
       }
     }
 
-    /* if we're not using bypass, delete data files from cache */
-    if (! bypass) {
+    /* if we're not using bypass, delete data files from cache,
+     * segments of shared files are always held in cache */
+    scr_meta* meta = scr_meta_new();
+    scr_filemap_get_meta(map, file, meta);
+    int is_segment = (scr_meta_is_segment(meta) == SCR_SUCCESS);
+    scr_meta_delete(&meta);
+    if (! bypass || is_segment) {
       /* delete the file */
       scr_file_unlink(file);
     }
@@ -382,7 +408,7 @@ int scr_cache_delete(scr_cache_index* cindex, int id)
 
   /* remove this dataset from the index and write updated index to disk */
   scr_cache_index_remove_dataset(cindex, id);
-  scr_cache_index_write(scr_cindex_file, cindex);
+  scr_cache_index_mark_dirty();
 
   /* free path to hidden directory */
   scr_free(&dir_scr);
@@ -25,6 +25,10 @@ char* scr_cache_dir_get(const scr_reddesc* reddesc, int id);
  * returned string */
 char* scr_cache_dir_hidden_get(const scr_reddesc* reddesc, int id);
 
+/* returns path within the dataset directory dir of the file that holds the
+ * given rank's segment of a shared file, caller must free returned string */
+char* scr_cache_segment_path(const char* dir, const char* file, int rank);
+
 /* read file map for dataset from cache directory */
 int scr_cache_get_map(const scr_cache_index* cindex, int id, scr_filemap* map);
 
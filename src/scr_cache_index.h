@@ -136,9 +136,43 @@ Cache index read/write/free functions
 /* reads specified file and fills in cache index structure */
 int scr_cache_index_read(const spath* file, scr_cache_index* cindex);
 
+/* Changes to the cache index are written to its file in the control
+ * directory at two kinds of points:
+ *
+ *   - Before SCR creates a cache directory for a dataset (start output,
+ *     fetch, cache rebuild), it writes the index immediately with
+ *     scr_cache_index_write.  A crash at any point after this leaves a record of the directory,
+ *     so a later run can find and delete it.
+ *
+ *   - Other changes (marking a dataset complete, deleting a dataset,
+ *     recording the dataset, bypass flag, or current marker during a
+ *     rebuild, or recording the SCR_CURRENT marker) only mark the index
+ *     as dirty with scr_cache_index_mark_dirty.  They are written with
+ *     scr_cache_index_sync at the end of SCR_Init (after purge, rebuild,
+ *     and fetch), at the end of Start_output, Complete_output,
+ *     Complete_restart, SCR_Current, and SCR_Delete, and in SCR_Finalize.
+ *
+ * A crash between a deferred change and the next sync leaves the file
+ * one step behind memory, which a later run recovers from:
+ *   - a deleted dataset still listed in the file is found to be missing
+ *     its files during the cache rebuild in SCR_Init and is deleted again,
+ *   - a dataset not yet marked complete is treated as incomplete, which
+ *     is correct since Complete_output had not returned,
+ *   - a lost SCR_CURRENT marker means SCR_CURRENT is applied once more.
+ *
+ * Each write goes to a temporary file that is renamed over the index,
+ * so a crash during a write leaves either the old or the new index. */
+
 /* writes given cache index to specified file */
 int scr_cache_index_write(const spath* file, const scr_cache_index* cindex);
 
+/* records that the in-memory cache index has changed,
+ * but defers writing it until the next scr_cache_index_sync */
+void scr_cache_index_mark_dirty(void);
+
+/* writes the cache index to specified file if it has changed since it was last written */
+int scr_cache_index_sync(const spath* file, const scr_cache_index* cindex);
+
 /* create a new cache index structure */
 scr_cache_index* scr_cache_index_new(void);
 
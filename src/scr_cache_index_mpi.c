@@ -35,6 +35,10 @@
 #include "kvtree.h"
 #include "kvtree_util.h"
 
+/* set when the in-memory cache index has changes that have not yet
+ * been written to its file, see scr_cache_index.h for when we write */
+static int scr_cache_index_dirty = 0;
+
 /* reads specified file and fills in cache index structure */
 int scr_cache_index_read(const spath* path_file, scr_cache_index* cindex)
 {
@@ -79,7 +83,9 @@ int scr_cache_index_read(const spath* path_file, scr_cache_index* cindex)
   return rc;
 }
 
-/* writes given cache index to specified file */
+/* writes given cache index to specified file,
+ * writes to a temporary file and renames it into place so that
+ * a reader never sees a partially written cache index */
 int scr_cache_index_write(const spath* file, const scr_cache_index* cindex)
 {
   /* check that we have a cindex pointer */
@@ -87,17 +93,55 @@ int scr_cache_index_write(const spath* file, const scr_cache_index* cindex)
     return SCR_FAILURE;
   }
 
+  int rc = SCR_SUCCESS;
+
   if (scr_storedesc_cntl->rank == 0) {
+    /* get file name and define name of temporary file */
+    char* path = spath_strdup(file);
+    char* path_tmp = scr_strdupf("%s.tmp", path);
+
     /* write out the hash */
-    if (kvtree_write_path(file, cindex) != KVTREE_SUCCESS) {
-      char path_err[SCR_MAX_FILENAME];
-      spath_strcpy(path_err, sizeof(path_err), file);
+    if (kvtree_write_file(path_tmp, cindex) != KVTREE_SUCCESS) {
       scr_err("Writing cache index %s @ %s:%d",
-        path_err, __FILE__, __LINE__
+        path_tmp, __FILE__, __LINE__
       );
-      return SCR_FAILURE;
+      rc = SCR_FAILURE;
     }
+
+    /* replace the existing file */
+    if (rc == SCR_SUCCESS && rename(path_tmp, path) != 0) {
+      scr_err("Renaming cache index %s to %s errno=%d %s @ %s:%d",
+        path_tmp, path, errno, strerror(errno), __FILE__, __LINE__
+      );
+      unlink(path_tmp);
+      rc = SCR_FAILURE;
+    }
+
+    scr_free(&path_tmp);
+    scr_free(&path);
+  }
+
+  /* file is up to date if we wrote it, all ranks sharing the control
+   * directory make the same changes, so each clears its own flag */
+  if (rc == SCR_SUCCESS) {
+    scr_cache_index_dirty = 0;
   }
 
-  return SCR_SUCCESS;
+  return rc;
+}
+
+/* records that the in-memory cache index has changed,
+ * but defers writing it until the next scr_cache_index_sync */
+void scr_cache_index_mark_dirty(void)
+{
+  scr_cache_index_dirty = 1;
+}
+
+/* writes the cache index to specified file if it has changed since it was last written */
+int scr_cache_index_sync(const spath* file, const scr_cache_index* cindex)
+{
+  if (! scr_cache_index_dirty) {
+    return SCR_SUCCESS;
+  }
+  return scr_cache_index_write(file, cindex);
 }
@@ -32,6 +32,8 @@
 
 #include "scr_globals.h"
 
+#include <limits.h>
+
 /*
 =========================================
 Distribute and file rebuild functions
@@ -86,7 +88,7 @@ static int scr_distribute_datasets(scr_cache_index* cindex, int id)
   /* record the descriptor in our cache index */
   scr_cache_index_set_dataset(cindex, id, dataset);
   scr_cache_index_set_bypass(cindex, id, bypass);
-  scr_cache_index_write(scr_cindex_file, cindex);
+  scr_cache_index_mark_dirty();
 
   /* free off dataset object */
   scr_dataset_delete(&dataset);
@@ -128,7 +130,8 @@ static int scr_distribute_dir(scr_cache_index* cindex, int id, char** hidden_dir
   /* bcast the dataset from the minimum rank */
   scr_str_bcast(&dir, min_rank, scr_comm_world);
 
-  /* record the directory in the cache index */
+  /* record the directory in the cache index, and write it out
+   * before we create the directory so we have a record of it */
   scr_cache_index_set_dir(cindex, id, dir);
   scr_cache_index_write(scr_cindex_file, cindex);
 
@@ -162,6 +165,201 @@ static int scr_distribute_dir(scr_cache_index* cindex, int id, char** hidden_dir
   return SCR_SUCCESS;
 }
 
+/* flags tracking the state of each dataset during a rebuild */
+#define SCR_REBUILD_CKPT   (1 << 0) /* dataset is a checkpoint */
+#define SCR_REBUILD_OUTPUT (1 << 1) /* dataset is output */
+#define SCR_REBUILD_DONE   (1 << 2) /* rebuild has been attempted */
+#define SCR_REBUILD_OK     (1 << 3) /* rebuild succeeded */
+
+/* ids of datasets left in cache whose rebuild we deferred,
+ * in ascending order */
+static int  scr_rebuild_pending_count = 0;
+static int* scr_rebuild_pending = NULL;
+
+/* qsort comparison for dataset ids */
+static int scr_cache_rebuild_cmp(const void* a, const void* b)
+{
+  int x = *(const int*) a;
+  int y = *(const int*) b;
+  if (x < y) {
+    return -1;
+  } else if (x > y) {
+    return 1;
+  }
+  return 0;
+}
+
+/* gather the union of the dataset ids held by all processes,
+ * returned in ascending order, allocates dsets for caller to free */
+static int scr_cache_rebuild_list(const scr_cache_index* cindex, int* ndsets, int** dsets)
+{
+  /* get ordered list of datasets we have in our cache */
+  int my_ndsets;
+  int* my_dsets;
+  scr_cache_index_list_datasets(cindex, &my_ndsets, &my_dsets);
+
+  /* gather counts and then ids from all processes */
+  int* counts = (int*) SCR_MALLOC(scr_ranks_world * sizeof(int));
+  int* displs = (int*) SCR_MALLOC(scr_ranks_world * sizeof(int));
+  MPI_Allgather(&my_ndsets, 1, MPI_INT, counts, 1, MPI_INT, scr_comm_world);
+
+  int total = 0;
+  int i;
+  for (i = 0; i < scr_ranks_world; i++) {
+    displs[i] = total;
+    total += counts[i];
+  }
+
+  int* all = (int*) SCR_MALLOC(total * sizeof(int));
+  MPI_Allgatherv(my_dsets, my_ndsets, MPI_INT, all, counts, displs, MPI_INT, scr_comm_world);
+
+  /* sort and drop duplicates */
+  qsort(all, total, sizeof(int), scr_cache_rebuild_cmp);
+  int count = 0;
+  for (i = 0; i < total; i++) {
+    if (count == 0 || all[count - 1] != all[i]) {
+      all[count] = all[i];
+      count++;
+    }
+  }
+
+  scr_free(&displs);
+  scr_free(&counts);
+  scr_free(&my_dsets);
+
+  *ndsets = count;
+  *dsets  = all;
+  return SCR_SUCCESS;
+}
+
+/* log failure and delete a dataset that we could not rebuild */
+static void scr_cache_rebuild_failed(scr_cache_index* cindex, int id)
+{
+  /* log that we failed */
+  if (scr_my_rank_world == 0) {
+    scr_dbg(1, "Failed to rebuild dataset %d", id);
+    scr_metrics_add(SCR_METRIC_REBUILD_FAILURES, 1.0);
+    if (scr_log_enable) {
+      scr_log_event("REBUILD_FAIL", NULL, &id, NULL, NULL, NULL);
+    }
+  }
+
+  /* TODO: there is a bug here, since scr_cache_delete needs to read
+   * the redundancy descriptor from the filemap in order to delete the
+   * cache directory, but we may have failed to distribute the reddescs
+   * above so not every task has one */
+
+  /* rebuild failed, delete this dataset from cache */
+  scr_cache_delete(cindex, id);
+}
+
+/* distribute and rebuild files for a dataset whose descriptor has
+ * already been distributed, deletes the dataset if the rebuild fails */
+static int scr_cache_rebuild_dset(scr_cache_index* cindex, int id)
+{
+  /* log the attempt */
+  if (scr_my_rank_world == 0) {
+    scr_dbg(1, "Attempting to distribute and rebuild dataset %d", id);
+    if (scr_log_enable) {
+      scr_log_event("REBUILD_START", NULL, &id, NULL, NULL, NULL);
+    }
+  }
+
+  /* assume we'll fail to rebuild */
+  int rebuild_succeeded = 0;
+
+  /* get and recreate directory from cindex */
+  char* path;
+  if (scr_distribute_dir(cindex, id, &path) == SCR_SUCCESS) {
+    /* rebuild files for this dataset */
+    int tmp_rc = scr_reddesc_recover(cindex, id, path);
+    if (tmp_rc == SCR_SUCCESS) {
+      /* rebuild succeeded */
+      rebuild_succeeded = 1;
+
+      /* update our flush file to indicate this dataset is in cache */
+      scr_flush_file_location_set(id, SCR_FLUSH_KEY_LOCATION_CACHE);
+
+      /* TODO: if storing flush file in control directory on each node,
+       * if we find any process that has marked the dataset as flushed,
+       * marked it as flushed in every flush file */
+
+      /* TODO: would like to restore flushing status to datasets that
+       * were in the middle of a flush, but we need to better manage
+       * the transfer file to do this, so for now just forget about
+       * flushing this dataset */
+      scr_flush_file_location_unset(id, SCR_FLUSH_KEY_LOCATION_FLUSHING);
+    }
+
+    /* free path */
+    scr_free(&path);
+  }
+
+  /* if the rebuild failed, delete the dataset */
+  if (! rebuild_succeeded) {
+    scr_cache_rebuild_failed(cindex, id);
+    return SCR_FAILURE;
+  }
+
+  /* rebuid worked, log success */
+  if (scr_my_rank_world == 0) {
+    scr_dbg(1, "Rebuilt dataset %d", id);
+    scr_metrics_add(SCR_METRIC_REBUILDS, 1.0);
+    if (scr_log_enable) {
+      scr_log_event("REBUILD_SUCCESS", NULL, &id, NULL, NULL, NULL);
+    }
+  }
+
+  return SCR_SUCCESS;
+}
+
+/* remember a dataset to rebuild later in scr_cache_rebuild_pending */
+static void scr_cache_rebuild_defer(int id)
+{
+  int* list = (int*) realloc(scr_rebuild_pending, (scr_rebuild_pending_count + 1) * sizeof(int));
+  if (list == NULL) {
+    scr_abort(-1, "Failed to allocate list of datasets to rebuild @ %s:%d",
+      __FILE__, __LINE__
+    );
+  }
+  scr_rebuild_pending = list;
+  scr_rebuild_pending[scr_rebuild_pending_count] = id;
+  scr_rebuild_pending_count++;
+}
+
+/* rebuild any older checkpoints that scr_cache_rebuild deferred,
+ * newest first, deleting those that fail */
+int scr_cache_rebuild_pending(scr_cache_index* cindex)
+{
+  /* the list is the same on all processes */
+  if (scr_rebuild_pending_count == 0) {
+    return SCR_SUCCESS;
+  }
+
+  int rc = SCR_SUCCESS;
+  int i;
+  for (i = scr_rebuild_pending_count - 1; i >= 0; i--) {
+    int id = scr_rebuild_pending[i];
+
+    /* skip datasets that every process has since deleted */
+    char* dir = NULL;
+    int have_dir = (scr_cache_index_get_dir(cindex, id, &dir) == SCR_SUCCESS);
+    if (! scr_alltrue(! have_dir, scr_comm_world)) {
+      if (scr_cache_rebuild_dset(cindex, id) != SCR_SUCCESS) {
+        rc = SCR_FAILURE;
+      }
+    }
+  }
+
+  scr_free(&scr_rebuild_pending);
+  scr_rebuild_pending_count = 0;
+
+  /* write any changes to the cache index */
+  scr_cache_index_sync(scr_cindex_file, cindex);
+
+  return rc;
+}
+
 /* distribute and rebuild files in cache */
 int scr_cache_rebuild(scr_cache_index* cindex)
 {
@@ -211,169 +409,128 @@ int scr_cache_rebuild(scr_cache_index* cindex)
 
     /* set current marker in our cache index */
     scr_cache_index_set_current(cindex, current_name);
-    scr_cache_index_write(scr_cindex_file, cindex);
+    scr_cache_index_mark_dirty();
   }
   scr_free(&current_name);
 
-  /* get ordered list of datasets we have in our cache */
+  /* get the ordered list of datasets held by any process */
   int ndsets;
   int* dsets;
-  scr_cache_index_list_datasets(cindex, &ndsets, &dsets);
-
-  /* TODO: put dataset selection logic into a function */
-
-  /* TODO: also attempt to recover datasets which we were in the
-   * middle of flushing */
-  int current_id;
-  int dset_index = 0;
-  int output_failed_rebuild = 0;
-  do {
-    /* get the smallest index across all processes (returned in current_id),
-     * this also updates our dset_index value if appropriate */
-    scr_next_dataset(ndsets, dsets, &dset_index, &current_id);
-
-    /* if we found a dataset, try to distribute and rebuild it */
-    if (current_id != -1) {
-      /* remember that we made an attempt to distribute at least one dataset */
-      distribute_attempted = 1;
-      
-      /* log the attempt */
-      if (scr_my_rank_world == 0) {
-        scr_dbg(1, "Attempting to distribute and rebuild dataset %d", current_id);
-        if (scr_log_enable) {
-          scr_log_event("REBUILD_START", NULL, &current_id, NULL, NULL, NULL);
-        }
-      }
-
-      /* assume we'll fail to rebuild */
-      int rebuild_succeeded = 0;
-
-      /* distribute dataset descriptor for this dataset */
-      if (scr_distribute_datasets(cindex, current_id) == SCR_SUCCESS) {
-        /* get dataset for this id */
-        scr_dataset* dataset = scr_dataset_new();
-        scr_cache_index_get_dataset(cindex, current_id, dataset);
-
-        /* get and recreate directory from cindex */
-        char* path;
-        if (scr_distribute_dir(cindex, current_id, &path) == SCR_SUCCESS) {
-          /* rebuild files for this dataset */
-          int tmp_rc = scr_reddesc_recover(cindex, current_id, path);
-          if (tmp_rc == SCR_SUCCESS) {
-            /* rebuild succeeded */
-            rebuild_succeeded = 1;
-
-            /* if we have a checkpoint, update dataset and checkpoint counters,
-             * however skip this if we failed to rebuild an output set, in this
-             * case we'll restart from the checkpoint before the lost output set */
-            int is_ckpt = scr_dataset_is_ckpt(dataset);
-            if (is_ckpt && !output_failed_rebuild) {
-              /* if we rebuild any checkpoint, return success */
-              rc = SCR_SUCCESS;
-
-              /* if id of dataset we just rebuilt is newer,
-               * update scr_dataset_id */
-              if (current_id > scr_dataset_id) {
-                scr_dataset_id = current_id;
-              }
-
-              /* get checkpoint id for dataset */
-              int ckpt_id;
-              scr_dataset_get_ckpt(dataset, &ckpt_id);
-
-              /* if checkpoint id of dataset we just rebuilt is newer,
-               * update scr_checkpoint_id and scr_ckpt_dset_id */
-              if (ckpt_id > scr_checkpoint_id) {
-                /* got a more recent checkpoint, update our checkpoint info */
-                scr_checkpoint_id = ckpt_id;
-                scr_ckpt_dset_id = current_id;
-              }
-            }
-
-            /* update our flush file to indicate this dataset is in cache */
-            scr_flush_file_location_set(current_id, SCR_FLUSH_KEY_LOCATION_CACHE);
-
-            /* TODO: if storing flush file in control directory on each node,
-             * if we find any process that has marked the dataset as flushed,
-             * marked it as flushed in every flush file */
-
-            /* TODO: would like to restore flushing status to datasets that
-             * were in the middle of a flush, but we need to better manage
-             * the transfer file to do this, so for now just forget about
-             * flushing this dataset */
-            scr_flush_file_location_unset(current_id, SCR_FLUSH_KEY_LOCATION_FLUSHING);
-          }
-
-          /* free path */
-          scr_free(&path);
-        }
-
-        /* remember if we fail to rebuild an output set */
-        int is_output = scr_dataset_is_output(dataset);
-        if (!rebuild_succeeded && is_output) {
-          output_failed_rebuild = 1;
-        }
+  scr_cache_rebuild_list(cindex, &ndsets, &dsets);
+  if (ndsets > 0) {
+    distribute_attempted = 1;
+  }
 
-        /* free dataset */
-        scr_dataset_delete(&dataset);
-      } else {
-        /* if we failed to distribute dataset info, then we can't know
-         * whether this was output or not, so we have to assume it was */
-        output_failed_rebuild = 1;
+  /* learn whether each dataset is a checkpoint and/or output,
+   * a dataset whose descriptor we can't distribute may have been
+   * output, so treat it as a failed output set */
+  int* flags = (int*) SCR_MALLOC(ndsets * sizeof(int));
+  int fail_id = INT_MAX;
+  int i;
+  for (i = 0; i < ndsets; i++) {
+    int id = dsets[i];
+    flags[i] = 0;
+    if (scr_distribute_datasets(cindex, id) == SCR_SUCCESS) {
+      scr_dataset* dataset = scr_dataset_new();
+      scr_cache_index_get_dataset(cindex, id, dataset);
+      if (scr_dataset_is_ckpt(dataset)) {
+        flags[i] |= SCR_REBUILD_CKPT;
       }
+      if (scr_dataset_is_output(dataset)) {
+        flags[i] |= SCR_REBUILD_OUTPUT;
+      }
+      scr_dataset_delete(&dataset);
+    } else {
+      scr_cache_rebuild_failed(cindex, id);
+      flags[i] |= SCR_REBUILD_DONE;
+      if (id < fail_id) {
+        fail_id = id;
+      }
+    }
+  }
 
-      /* if the distribute or rebuild failed, delete the dataset */
-      if (! rebuild_succeeded) {
-        /* log that we failed */
-        if (scr_my_rank_world == 0) {
-          scr_dbg(1, "Failed to rebuild dataset %d", current_id);
-          if (scr_log_enable) {
-            scr_log_event("REBUILD_FAIL", NULL, &current_id, NULL, NULL, NULL);
-          }
-        }
-
-        /* TODO: there is a bug here, since scr_cache_delete needs to read
-         * the redundancy descriptor from the filemap in order to delete the
-         * cache directory, but we may have failed to distribute the reddescs
-         * above so not every task has one */
+  /* Pick the newest checkpoint we can rebuild.  A checkpoint is only
+   * usable if no older output set was lost, since the job must rerun
+   * from before a lost output set.  Output sets older than the chosen
+   * checkpoint must be rebuilt now so they can be flushed, and if one
+   * fails we choose again from the checkpoints older than it. */
+  int ckpt_index = -1;
+  int searching = 1;
+  while (searching) {
+    /* rebuild checkpoints from newest to oldest until one works */
+    ckpt_index = -1;
+    for (i = ndsets - 1; i >= 0; i--) {
+      int id = dsets[i];
+      if (id >= fail_id || (flags[i] & SCR_REBUILD_DONE) ||
+          ! (flags[i] & SCR_REBUILD_CKPT))
+      {
+        continue;
+      }
+      flags[i] |= SCR_REBUILD_DONE;
+      if (scr_cache_rebuild_dset(cindex, id) == SCR_SUCCESS) {
+        flags[i] |= SCR_REBUILD_OK;
+        ckpt_index = i;
+        break;
+      }
+      if ((flags[i] & SCR_REBUILD_OUTPUT) && id < fail_id) {
+        fail_id = id;
+      }
+    }
 
-        /* rebuild failed, delete this dataset from cache */
-        scr_cache_delete(cindex, current_id);
-      } else {
-        /* rebuid worked, log success */
-        if (scr_my_rank_world == 0) {
-          scr_dbg(1, "Rebuilt dataset %d", current_id);
-          if (scr_log_enable) {
-            scr_log_event("REBUILD_SUCCESS", NULL, &current_id, NULL, NULL, NULL);
-          }
-        }
+    /* now rebuild any older output sets, if we found no checkpoint
+     * everything will be deleted so don't bother */
+    searching = 0;
+    for (i = 0; i < ckpt_index; i++) {
+      int id = dsets[i];
+      if ((flags[i] & SCR_REBUILD_DONE) || ! (flags[i] & SCR_REBUILD_OUTPUT)) {
+        continue;
+      }
+      flags[i] |= SCR_REBUILD_DONE;
+      if (scr_cache_rebuild_dset(cindex, id) == SCR_SUCCESS) {
+        flags[i] |= SCR_REBUILD_OK;
+      } else if (id < fail_id) {
+        /* lost an output set, so the checkpoint we picked is no good */
+        fail_id = id;
+        searching = 1;
+        break;
       }
     }
-  } while (current_id != -1);
+  }
 
-  /* free our list of dataset ids */
-  scr_free(&dsets);
+  /* record the checkpoint we'll restart from */
+  if (ckpt_index >= 0) {
+    rc = SCR_SUCCESS;
 
-  /* get an updated list of datasets since we may have rebuilt/deleted some */
-  scr_cache_index_list_datasets(cindex, &ndsets, &dsets);
+    int id = dsets[ckpt_index];
+    scr_dataset* dataset = scr_dataset_new();
+    scr_cache_index_get_dataset(cindex, id, dataset);
+    int ckpt_id;
+    scr_dataset_get_ckpt(dataset, &ckpt_id);
+    scr_dataset_delete(&dataset);
 
-  /* delete all datasets following the most recent checkpoint */
-  dset_index = 0;
-  do {
-    /* get the smallest index across all processes (returned in current_id),
-     * this also updates our dset_index value if appropriate */
-    scr_next_dataset(ndsets, dsets, &dset_index, &current_id);
+    scr_dataset_id    = id;
+    scr_checkpoint_id = ckpt_id;
+    scr_ckpt_dset_id  = id;
+  }
 
-    /* if we found a dataset, try to distribute and rebuild it */
-    if (current_id != -1 && current_id > scr_ckpt_dset_id) {
-      /* rebuild failed, delete this dataset from cache */
-      scr_cache_delete(cindex, current_id);
+  /* delete everything following the checkpoint, and defer the
+   * rebuild of older checkpoints until something needs them */
+  for (i = 0; i < ndsets; i++) {
+    int id = dsets[i];
+    if (id > scr_ckpt_dset_id) {
+      scr_cache_delete(cindex, id);
+    } else if (! (flags[i] & SCR_REBUILD_DONE)) {
+      scr_cache_rebuild_defer(id);
     }
-  } while (current_id != -1);
+  }
 
   /* free our list of dataset ids */
+  scr_free(&flags);
   scr_free(&dsets);
 
+  /* write any changes to the cache index */
+  scr_cache_index_sync(scr_cindex_file, cindex);
+
   /* stop timer and report performance */
   if (scr_my_rank_world == 0) {
     double time_end = MPI_Wtime();
@@ -17,6 +17,10 @@
 /* distribute and rebuild files in cache */
 int scr_cache_rebuild(scr_cache_index* cindex);
 
+/* rebuild older datasets that scr_cache_rebuild left for later,
+ * collective over scr_comm_world */
+int scr_cache_rebuild_pending(scr_cache_index* cindex);
+
 /* remove any dataset ids from flush file which are not in cache,
  * and add any datasets in cache that are not in the flush file */
 int scr_flush_file_rebuild(const scr_cache_index* cindenx);
@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2009, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-411039.
+ * All rights reserved.
+ * This file is part of The Scalable Checkpoint / Restart (SCR) library.
+ * For details, see https://sourceforge.net/projects/scalablecr/
+ * Please also read this file: LICENSE.TXT.
+*/
+
+#include "scr_globals.h"
+
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+/*
+=========================================
+Cache scrubber
+=========================================
+*/
+
+/* With SCR_SCRUB_BW set, each process re-reads the files it holds in
+ * cache from a background thread between SCR_Complete_output and the
+ * next collective SCR call, and compares each file against the CRC32
+ * recorded in its meta data.  The thread reads at no more than the given
+ * number of bytes per second and at idle I/O priority where the system
+ * supports it.  When the scrubber is stopped, any file found to be
+ * corrupt is deleted and its dataset is rebuilt from its redundancy
+ * data, which is collective, so the thread itself only reads. */
+
+/* a file to be checked by the scrubber */
+typedef struct {
+  int id;         /* dataset id the file belongs to */
+  char* file;     /* full path of file in cache */
+  uLong crc;      /* expected crc32 of file */
+  int corrupt;    /* set to 1 if the file did not match its crc */
+} scr_scrub_file;
+
+/* tracks the state of the scrubber */
+typedef struct {
+  int started;           /* whether a scrub has been started */
+  int num_files;         /* number of files in list */
+  scr_scrub_file* files; /* list of files to be checked */
+  volatile int stop;     /* set to 1 to ask the thread to stop */
+#ifdef HAVE_PTHREADS
+  int threaded;          /* whether the scrub is running in a thread */
+  pthread_t thread;      /* thread that reads the files */
+#endif
+} scr_scrub_state;
+
+static scr_scrub_state scr_scrub = { .started = 0 };
+
+/* longest we sleep at once while throttling, so that the thread notices
+ * a stop request promptly and each usleep stays under one second */
+#define SCR_SCRUB_SLEEP_USECS (100000)
+
+#ifdef HAVE_PTHREADS
+/* lower the I/O priority of the calling thread to idle if we can */
+static void scr_scrub_set_idle(void)
+{
+#if defined(__linux__) && defined(SYS_ioprio_set) && defined(SYS_gettid)
+  /* IOPRIO_WHO_PROCESS applied to a thread id, IOPRIO_CLASS_IDLE */
+  int who   = 1;
+  int class = 3;
+  int tid = (int) syscall(SYS_gettid);
+  syscall(SYS_ioprio_set, who, tid, class << 13);
+#endif
+}
+
+/* read file and compare with its expected crc, sleeping as needed to
+ * hold the read rate to scr_scrub_bw, returns SCR_SUCCESS if the file
+ * matches, or if we were asked to stop before finishing */
+static int scr_scrub_check(scr_scrub_state* state, scr_scrub_file* f, char* buf, size_t buf_size)
+{
+  int fd = scr_open(f->file, O_RDONLY);
+  if (fd < 0) {
+    scr_err("Scrubber failed to open file %s errno=%d %s @ %s:%d",
+      f->file, errno, strerror(errno), __FILE__, __LINE__
+    );
+    return SCR_FAILURE;
+  }
+
+  int rc = SCR_SUCCESS;
+  uLong crc = crc32(0L, Z_NULL, 0);
+  double start = scr_seconds();
+  double bytes = 0.0;
+  while (1) {
+    if (state->stop) {
+      /* we didn't finish, so we can't say the file is bad */
+      scr_close(f->file, fd);
+      return SCR_SUCCESS;
+    }
+
+    ssize_t nread = scr_read(f->file, fd, buf, buf_size);
+    if (nread < 0) {
+      scr_err("Scrubber failed to read file %s @ %s:%d",
+        f->file, __FILE__, __LINE__
+      );
+      rc = SCR_FAILURE;
+      break;
+    }
+    if (nread == 0) {
+      break;
+    }
+    crc = crc32(crc, (const Bytef*) buf, (uInt) nread);
+
+    /* sleep until we're back under the bandwidth limit */
+    bytes += (double) nread;
+    double expected = bytes / scr_scrub_bw;
+    double elapsed = scr_seconds() - start;
+    while (elapsed < expected && ! state->stop) {
+      double usecs = (expected - elapsed) * 1000000.0;
+      if (usecs > (double) SCR_SCRUB_SLEEP_USECS) {
+        usecs = (double) SCR_SCRUB_SLEEP_USECS;
+      }
+      usleep((useconds_t) usecs);
+      elapsed = scr_seconds() - start;
+    }
+  }
+
+  scr_close(f->file, fd);
+
+  if (rc == SCR_SUCCESS && crc != f->crc) {
+    scr_err("Scrubber found CRC32 mismatch on file %s, bad drive? @ %s:%d",
+      f->file, __FILE__, __LINE__
+    );
+    rc = SCR_FAILURE;
+  }
+
+  return rc;
+}
+
+/* read each file in the list and flag those that are corrupt */
+static void* scr_scrub_read(void* arg)
+{
+  scr_scrub_state* state = (scr_scrub_state*) arg;
+
+  scr_scrub_set_idle();
+
+  size_t buf_size = scr_file_buf_size;
+  char* buf = (char*) SCR_MALLOC(buf_size);
+
+  int i;
+  for (i = 0; i < state->num_files && ! state->stop; i++) {
+    scr_scrub_file* f = &state->files[i];
+    if (scr_scrub_check(state, f, buf, buf_size) != SCR_SUCCESS) {
+      f->corrupt = 1;
+    }
+  }
+
+  scr_free(&buf);
+
+  return NULL;
+}
+#endif /* HAVE_PTHREADS */
+
+/* free the file list */
+static void scr_scrub_reset(scr_scrub_state* state)
+{
+  int i;
+  for (i = 0; i < state->num_files; i++) {
+    scr_free(&state->files[i].file);
+  }
+  scr_free(&state->files);
+  state->num_files = 0;
+  state->started   = 0;
+  state->stop      = 0;
+}
+
+/* start checking files held in cache in the background,
+ * does nothing unless SCR_SCRUB_BW is set */
+int scr_cache_scrub_start(const scr_cache_index* cindex)
+{
+  scr_scrub_state* state = &scr_scrub;
+
+  if (scr_scrub_bw <= 0.0 || state->started) {
+    return SCR_SUCCESS;
+  }
+
+  /* build list of files, skipping bypass datasets since those live in
+   * the prefix directory, and any file we have no crc for */
+  int ndsets;
+  int* dsets;
+  scr_cache_index_list_datasets(cindex, &ndsets, &dsets);
+
+  int count = 0;
+  int i;
+  for (i = 0; i < ndsets; i++) {
+    int id = dsets[i];
+
+    int bypass = 0;
+    scr_cache_index_get_bypass(cindex, id, &bypass);
+    if (bypass) {
+      continue;
+    }
+
+    scr_filemap* map = scr_filemap_new();
+    scr_cache_get_map(cindex, id, map);
+
+    int num_files = scr_filemap_num_files(map);
+    state->files = (scr_scrub_file*) realloc(state->files,
+      (count + num_files) * sizeof(scr_scrub_file)
+    );
+    if (count + num_files > 0 && state->files == NULL) {
+      scr_abort(-1, "Failed to allocate list of files to scrub @ %s:%d",
+        __FILE__, __LINE__
+      );
+    }
+
+    kvtree_elem* elem;
+    for (elem = scr_filemap_first_file(map);
+         elem != NULL;
+         elem = kvtree_elem_next(elem))
+    {
+      char* file = kvtree_elem_key(elem);
+
+      scr_meta* meta = scr_meta_new();
+      uLong crc;
+      if (scr_filemap_get_meta(map, file, meta) == SCR_SUCCESS &&
+          scr_meta_is_complete(meta) &&
+          scr_meta_get_crc32(meta, &crc) == SCR_SUCCESS)
+      {
+        scr_scrub_file* f = &state->files[count];
+        f->id      = id;
+        f->file    = strdup(file);
+        f->crc     = crc;
+        f->corrupt = 0;
+        count++;
+      }
+      scr_meta_delete(&meta);
+    }
+
+    scr_filemap_delete(&map);
+  }
+  scr_free(&dsets);
+
+  state->num_files = count;
+  state->stop      = 0;
+  state->started   = 1;
+
+  /* without threads, we have nowhere to run the check */
+#ifdef HAVE_PTHREADS
+  state->threaded = 0;
+  if (count > 0) {
+    if (pthread_create(&state->thread, NULL, scr_scrub_read, state) == 0) {
+      state->threaded = 1;
+    }
+  }
+#endif
+
+  return SCR_SUCCESS;
+}
+
+/* stop the scrubber, then delete any file it found to be corrupt and
+ * rebuild its dataset from redundancy data, collective over scr_comm_world */
+int scr_cache_scrub_stop(scr_cache_index* cindex)
+{
+  scr_scrub_state* state = &scr_scrub;
+
+  /* scr_scrub_bw is the same on all processes */
+  if (scr_scrub_bw <= 0.0) {
+    return SCR_SUCCESS;
+  }
+
+  /* ask the thread to stop and wait for it */
+#ifdef HAVE_PTHREADS
+  if (state->threaded) {
+    state->stop = 1;
+    pthread_join(state->thread, NULL);
+    state->threaded = 0;
+  }
+#endif
+
+  /* delete our corrupt files, and note the newest dataset they belong to */
+  int corrupt = 0;
+  int max_id = -1;
+  int i;
+  for (i = 0; i < state->num_files; i++) {
+    scr_scrub_file* f = &state->files[i];
+    if (f->corrupt) {
+      scr_file_unlink(f->file);
+      corrupt++;
+      if (f->id > max_id) {
+        max_id = f->id;
+      }
+    }
+  }
+
+  /* count corrupt files across all processes */
+  int total;
+  MPI_Allreduce(&corrupt, &total, 1, MPI_INT, MPI_SUM, scr_comm_world);
+  if (total > 0 && scr_my_rank_world == 0) {
+    scr_dbg(1, "Scrubber found %d corrupt files in cache", total);
+    scr_metrics_add(SCR_METRIC_SCRUB_ERRORS, (double) total);
+  }
+
+  /* rebuild each affected dataset, newest first */
+  int rc = SCR_SUCCESS;
+  int id;
+  MPI_Allreduce(&max_id, &id, 1, MPI_INT, MPI_MAX, scr_comm_world);
+  while (id >= 0) {
+    char* dir = NULL;
+    int have_dir = (scr_cache_index_get_dir(cindex, id, &dir) == SCR_SUCCESS);
+    if (scr_alltrue(have_dir, scr_comm_world) &&
+        scr_reddesc_recover(cindex, id, dir) == SCR_SUCCESS)
+    {
+      if (scr_my_rank_world == 0) {
+        scr_dbg(1, "Rebuilt dataset %d after scrub", id);
+        scr_metrics_add(SCR_METRIC_REBUILDS, 1.0);
+      }
+    } else {
+      /* can't recover, so drop the dataset */
+      if (scr_my_rank_world == 0) {
+        scr_err("Failed to rebuild dataset %d after scrub, deleting it @ %s:%d",
+          id, __FILE__, __LINE__
+        );
+        scr_metrics_add(SCR_METRIC_REBUILD_FAILURES, 1.0);
+      }
+      scr_cache_delete(cindex, id);
+      rc = SCR_FAILURE;
+    }
+
+    /* find the next newest dataset we need to rebuild */
+    int next_id = -1;
+    for (i = 0; i < state->num_files; i++) {
+      scr_scrub_file* f = &state->files[i];
+      if (f->corrupt && f->id < id && f->id > next_id) {
+        next_id = f->id;
+      }
+    }
+    MPI_Allreduce(&next_id, &id, 1, MPI_INT, MPI_MAX, scr_comm_world);
+  }
+
+  scr_scrub_reset(state);
+
+  return rc;
+}
@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2009, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-411039.
+ * All rights reserved.
+ * This file is part of The Scalable Checkpoint / Restart (SCR) library.
+ * For details, see https://sourceforge.net/projects/scalablecr/
+ * Please also read this file: LICENSE.TXT.
+*/
+
+#ifndef SCR_CACHE_SCRUB_H
+#define SCR_CACHE_SCRUB_H
+
+#include "scr_cache_index.h"
+
+/* start checking files held in cache against their CRC32 values
+ * in a background thread, does nothing unless SCR_SCRUB_BW is set */
+int scr_cache_scrub_start(const scr_cache_index* cindex);
+
+/* stop the scrubber and rebuild any dataset in which it found a
+ * corrupt file, collective over scr_comm_world */
+int scr_cache_scrub_stop(scr_cache_index* cindex);
+
+#endif
@@ -72,11 +72,36 @@
 #define SCR_LOG_SYSLOG_LEVEL LOG_INFO
 #endif
 
+/* whether to export metrics to a file */
+#ifndef SCR_METRICS_ENABLE
+#define SCR_METRICS_ENABLE (0)
+#endif
+
+/* format of metrics file: PROM or JSON */
+#ifndef SCR_METRICS_FORMAT
+#define SCR_METRICS_FORMAT "PROM"
+#endif
+
+/* minimum number of seconds between writes of the metrics file */
+#ifndef SCR_METRICS_INTERVAL
+#define SCR_METRICS_INTERVAL (60)
+#endif
+
 /* default number of halt seconds to apply to a job */
 #ifndef SCR_HALT_SECONDS
 #define SCR_HALT_SECONDS (0)
 #endif
 
+/* whether to raise halt seconds to the time predicted to write and flush a final checkpoint */
+#ifndef SCR_HALT_PREDICT
+#define SCR_HALT_PREDICT (0)
+#endif
+
+/* factor applied to predicted flush time to allow for variation in file system bandwidth */
+#ifndef SCR_HALT_PREDICT_MARGIN
+#define SCR_HALT_PREDICT_MARGIN (1.25)
+#endif
+
 /* whether SCR will call exit if halt condition is detected */
 #ifndef SCR_HALT_EXIT
 #define SCR_HALT_EXIT (0)
@@ -192,6 +217,11 @@
 #define SCR_FETCH_BYPASS (0)
 #endif
 
+/* whether to restart directly from the prefix directory and stage files into cache afterwards */
+#ifndef SCR_FETCH_LAZY
+#define SCR_FETCH_LAZY (0)
+#endif
+
 /* set to 0 to disable flush, set to a positive number to set how many checkpoints between flushes */
 #ifndef SCR_FLUSH
 #define SCR_FLUSH (10)
@@ -222,11 +252,22 @@
 #define SCR_FLUSH_ASYNC (0)
 #endif
 
-/* Finalize async transfers in scr_poststage rather than in SCR_Finalize() */
+/* Finalize async transfers after the job exits rather than in SCR_Finalize() */
 #ifndef SCR_FLUSH_POSTSTAGE
 #define SCR_FLUSH_POSTSTAGE (0)
 #endif
 
+/* whether starting the async flush of a checkpoint cancels the flush of an older checkpoint */
+#ifndef SCR_FLUSH_SUPERSEDE
+#define SCR_FLUSH_SUPERSEDE (1)
+#endif
+
+/* bytes a flush or scavenge copies between progress records that let an
+ * interrupted copy resume from the last recorded offset (0 disables) */
+#ifndef SCR_FLUSH_RESUME_SIZE
+#define SCR_FLUSH_RESUME_SIZE (0)
+#endif
+
 /* aggregrate bandwidth limit to impose during asynchronous flushes */
 #ifndef SCR_FLUSH_ASYNC_BW
 #define SCR_FLUSH_ASYNC_BW (200*1024*1024)
@@ -237,11 +278,27 @@
 #define SCR_FLUSH_ASYNC_PERCENT (0.0) /* TODO: the fsync complicates this throttling, disable it for now */
 #endif
 
+/* number of threads scr_copy uses on each node to copy files during a scavenge */
+#ifndef SCR_SCAVENGE_THREADS
+#define SCR_SCAVENGE_THREADS (1)
+#endif
+
+/* max bytes of file data scr_copy may have in flight at once across its threads (0 disables) */
+#ifndef SCR_SCAVENGE_INFLIGHT
+#define SCR_SCAVENGE_INFLIGHT (1024ULL*1024ULL*1024ULL)
+#endif
+
 /* max number of checkpoints to keep in prefix (0 disables) */
 #ifndef SCR_PREFIX_SIZE
 #define SCR_PREFIX_SIZE (0)
 #endif
 
+/* max number of updates to append to the prefix index journal before
+ * rewriting the full index file (0 disables the journal) */
+#ifndef SCR_INDEX_JOURNAL
+#define SCR_INDEX_JOURNAL (64)
+#endif
+
 /* =========================================================================
  * Default checksum settings.
  * ========================================================================= */
@@ -261,6 +318,11 @@
 #define SCR_CRC_ON_DELETE (0)
 #endif
 
+/* bytes per second each process may read when scrubbing cache for corrupt files (0 disables) */
+#ifndef SCR_SCRUB_BW
+#define SCR_SCRUB_BW (0)
+#endif
+
 /* =========================================================================
  * The following settings adjust when SCR_Need_checkpoint() will return true.
  * If all settings are 0, all options are disabled and Need_checkpoint() always returns true.
@@ -281,6 +343,16 @@
 #define SCR_CHECKPOINT_OVERHEAD (0)
 #endif
 
+/* whether to tune the checkpoint interval from measured cost and failure history */
+#ifndef SCR_CHECKPOINT_AUTO
+#define SCR_CHECKPOINT_AUTO (0)
+#endif
+
+/* initial estimate of the mean time between failures in seconds for the tuner, 0 for none */
+#ifndef SCR_CHECKPOINT_MTBF
+#define SCR_CHECKPOINT_MTBF (0)
+#endif
+
 /* =========================================================================
  * The following applies to scr_io operations
  * ========================================================================= */
@@ -23,6 +23,7 @@
 #include "scr_filemap.h"
 #include "scr_dataset.h"
 #include "scr_cache_index.h"
+#include "scr_flush_nompi.h"
 
 #include "spath.h"
 #include "kvtree.h"
@@ -42,12 +43,19 @@
 #include <dirent.h>
 #include <regex.h>
 
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 #ifdef SCR_GLOBALS_H
 #error "globals.h accessed from tools"
 #endif
 
 #define PROG ("scr_copy")
 
+/* number of seconds between progress messages */
+#define PROGRESS_SECS (10.0)
+
 static char hostname[256] = "UNKNOWN_HOST";
 
 int print_usage()
@@ -59,10 +67,14 @@ int print_usage()
 
 struct arglist {
   char* cntldir;          /* control directory */
-  int id;                 /* dataset id */
+  int* ids;               /* list of dataset ids to copy */
+  int num_ids;            /* number of entries in ids */
   char* prefix;           /* prefix directory */
   unsigned long buf_size; /* number of bytes to copy file data to file system */
   int crc_flag;           /* whether to compute crc32 during copy */
+  int threads;            /* number of threads to copy files concurrently */
+  unsigned long long inflight; /* limit on sum of file sizes being copied at once */
+  unsigned long resume;   /* bytes between progress records, 0 to disable */
 };
 
 int process_args(int argc, char **argv, struct arglist* args)
@@ -74,30 +86,38 @@ int process_args(int argc, char **argv, struct arglist* args)
     {"prefix",     required_argument, NULL, 'd'},
     {"buf",        required_argument, NULL, 'b'},
     {"crc",        no_argument,       NULL, 'r'},
+    {"threads",    required_argument, NULL, 't'},
+    {"inflight",   required_argument, NULL, 'm'},
+    {"resume",     required_argument, NULL, 'u'},
     {0, 0, 0, 0}
   };
 
   /* set our options to default values */
   args->cntldir        = NULL;
-  args->id             = -1;
+  args->ids            = NULL;
+  args->num_ids        = 0;
   args->prefix         = NULL;
   args->buf_size       = SCR_FILE_BUF_SIZE;
   args->crc_flag       = SCR_CRC_ON_FLUSH;
+  args->threads        = SCR_SCAVENGE_THREADS;
+  args->inflight       = SCR_SCAVENGE_INFLIGHT;
+  args->resume         = SCR_FLUSH_RESUME_SIZE;
 
   /* loop through and process all options */
-  int c, id;
+  int c, id, threads;
   unsigned long long bytes;
   do {
     /* read in our next option */
     int option_index = 0;
-    c = getopt_long(argc, argv, "c:i:d:b:rh", long_options, &option_index);
+    c = getopt_long(argc, argv, "c:i:d:b:rt:m:u:h", long_options, &option_index);
     switch (c) {
       case 'c':
         /* control directory */
         args->cntldir = optarg;
         break;
       case 'i':
-        /* dataset id to flush */
+        /* dataset id to flush, may be given more than once to copy
+         * several datasets in a single pass */
         id = atoi(optarg);
         if (id <= 0) {
           scr_err("%s: Dataset id must be positive '--id %s'",
@@ -105,7 +125,15 @@ int process_args(int argc, char **argv, struct arglist* args)
           );
           return 0;
         }
-        args->id = id;
+        args->ids = (int*) realloc(args->ids, (args->num_ids + 1) * sizeof(int));
+        if (args->ids == NULL) {
+          scr_err("%s: Failed to allocate list of dataset ids @ %s:%d",
+            PROG, __FILE__, __LINE__
+          );
+          return 0;
+        }
+        args->ids[args->num_ids] = id;
+        args->num_ids++;
         break;
       case 'd':
         /* prefix directory */
@@ -125,6 +153,37 @@ int process_args(int argc, char **argv, struct arglist* args)
         /* compute and record crc32 during copy */
         args->crc_flag = 1;
         break;
+      case 't':
+        /* number of threads to copy files */
+        threads = atoi(optarg);
+        if (threads <= 0) {
+          scr_err("%s: Thread count must be positive '--threads %s'",
+            PROG, optarg
+          );
+          return 0;
+        }
+        args->threads = threads;
+        break;
+      case 'm':
+        /* limit on bytes being copied at once, 0 for no limit */
+        if (scr_abtoull(optarg, &bytes) != SCR_SUCCESS) {
+          scr_err("%s: Invalid value for in-flight bytes '--inflight %s'",
+            PROG, optarg
+          );
+          return 0;
+        }
+        args->inflight = bytes;
+        break;
+      case 'u':
+        /* bytes between progress records, 0 to disable */
+        if (scr_abtoull(optarg, &bytes) != SCR_SUCCESS) {
+          scr_err("%s: Invalid value for resume size '--resume %s'",
+            PROG, optarg
+          );
+          return 0;
+        }
+        args->resume = (unsigned long) bytes;
+        break;
       case 'h':
         /* print help message and exit */
         print_usage();
@@ -150,8 +209,8 @@ int process_args(int argc, char **argv, struct arglist* args)
     return 0;
   }
 
-  /* check that we got a dataset id */
-  if (args->id <= 0) {
+  /* check that we got at least one dataset id */
+  if (args->num_ids == 0) {
     scr_err("%s: Must specify dataset id via '--id <id>'",
       PROG
     );
@@ -262,11 +321,201 @@ static int scr_bool_have_files(scr_filemap* map)
 }
 #endif
 
-static int copy_files_for_filemap(
-  const spath* path_prefix,
+/* describes a single file to be copied from cache to the prefix directory */
+struct copy_task {
+  char* src;          /* full path to file in cache */
+  char* dst;          /* full path to destination file */
+  char* progress;     /* full path to progress record, NULL if not resumable */
+  unsigned long size; /* number of bytes to be copied */
+  int job;            /* index of filemap listing this file, -1 for redset files */
+  int copy;           /* whether to copy the file, 0 if src and dst are the same */
+  int segment;        /* whether src is a segment to be written into dst at offset */
+  unsigned long offset; /* offset of segment in dst */
+  int crc_flag;       /* whether to compute crc32 during the copy */
+  int rc;             /* SCR_SUCCESS if the copy succeeded */
+  uLong crc;          /* crc32 computed during the copy */
+};
+
+/* tracks a filemap whose files have been added to the queue */
+struct copy_job {
+  int id;                /* dataset id of the filemap */
+  int rank;              /* rank that wrote the filemap */
+  char* src_filemap;     /* full path to filemap in cache */
+  scr_filemap* map;      /* filemap read from cache */
+  scr_filemap* rank_map; /* files copied from this filemap */
+  spath* path_scr;       /* dataset metadata directory in prefix */
+  int valid;             /* whether to copy the filemap to the prefix directory */
+};
+
+/* list of files to be copied and state shared by the copy threads,
+ * the lock protects all fields that are modified after the copy starts */
+struct copy_queue {
+  struct copy_task* tasks; /* array of files to be copied */
+  int ntasks;              /* number of entries in tasks */
+  int maxtasks;            /* allocated length of tasks */
+  struct copy_job* jobs;   /* array of filemaps that list the files */
+  int njobs;               /* number of entries in jobs */
+  int maxjobs;             /* allocated length of jobs */
+  kvtree* dirs;            /* directories we have already created */
+  unsigned long buf_size;  /* buffer size to use to copy each file */
+  unsigned long resume;    /* bytes between progress records, 0 to disable */
+  unsigned long long limit;    /* max bytes in flight at once, 0 for no limit */
+  unsigned long long total;    /* total bytes to be copied */
+  int next;                    /* index of next task to start */
+  int done;                    /* number of tasks completed */
+  unsigned long long inflight; /* sum of sizes of files being copied now */
+  unsigned long long copied;   /* bytes copied so far */
+  double start;                /* time copy started */
+  double last_report;          /* time of last progress message */
+#ifdef HAVE_PTHREADS
+  pthread_mutex_t lock;        /* protects queue state during the copy */
+  pthread_cond_t cond;         /* signaled when a copy completes */
+#endif
+};
+
+static void copy_queue_init(struct copy_queue* q, const struct arglist* args)
+{
+  q->tasks    = NULL;
+  q->ntasks   = 0;
+  q->maxtasks = 0;
+  q->jobs     = NULL;
+  q->njobs    = 0;
+  q->maxjobs  = 0;
+  q->dirs     = kvtree_new();
+  q->buf_size = args->buf_size;
+  q->resume   = args->resume;
+  q->limit    = args->inflight;
+  q->total    = 0;
+  q->next     = 0;
+  q->done     = 0;
+  q->inflight = 0;
+  q->copied   = 0;
+  q->start       = 0.0;
+  q->last_report = 0.0;
+#ifdef HAVE_PTHREADS
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->cond, NULL);
+#endif
+}
+
+static void copy_queue_free(struct copy_queue* q)
+{
+  int i;
+  for (i = 0; i < q->ntasks; i++) {
+    scr_free(&q->tasks[i].src);
+    scr_free(&q->tasks[i].dst);
+    scr_free(&q->tasks[i].progress);
+  }
+  scr_free(&q->tasks);
+
+  for (i = 0; i < q->njobs; i++) {
+    scr_free(&q->jobs[i].src_filemap);
+    scr_filemap_delete(&q->jobs[i].map);
+    scr_filemap_delete(&q->jobs[i].rank_map);
+    spath_delete(&q->jobs[i].path_scr);
+  }
+  scr_free(&q->jobs);
+
+  kvtree_delete(&q->dirs);
+
+#ifdef HAVE_PTHREADS
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->cond);
+#endif
+}
+
+/* append a file to the queue, takes ownership of src and dst,
+ * records progress of the copy in the dataset metadata directory
+ * under path_scr if resuming is enabled, returns the new task */
+static struct copy_task* copy_queue_add(
+  struct copy_queue* q,
+  const spath* path_scr,
+  char* src,
+  char* dst,
+  unsigned long size,
+  int job,
+  int crc_flag)
+{
+  /* grow the task array if needed */
+  if (q->ntasks == q->maxtasks) {
+    int maxtasks = (q->maxtasks > 0) ? 2 * q->maxtasks : 64;
+    struct copy_task* tasks = (struct copy_task*) realloc(q->tasks, maxtasks * sizeof(struct copy_task));
+    if (tasks == NULL) {
+      scr_abort(-1, "Failed to allocate copy list: realloc(%d) errno=%d %s @ %s:%d",
+        maxtasks, errno, strerror(errno), __FILE__, __LINE__
+      );
+    }
+    q->tasks    = tasks;
+    q->maxtasks = maxtasks;
+  }
+
+  /* in case of bypass, only copy file if source and dest paths are different */
+  int copy = (strcmp(src, dst) != 0);
+
+  struct copy_task* t = &q->tasks[q->ntasks];
+  t->src      = src;
+  t->dst      = dst;
+  t->progress = NULL;
+  t->size     = copy ? size : 0;
+  t->job      = job;
+  t->copy     = copy;
+  t->segment  = 0;
+  t->offset   = 0;
+  t->crc_flag = crc_flag;
+  t->rc       = SCR_SUCCESS;
+  t->crc      = crc32(0L, Z_NULL, 0);
+  q->ntasks++;
+
+  /* an earlier flush or scavenge may have left a partial copy
+   * of this file, which we can pick up from its last record */
+  if (copy && q->resume > 0) {
+    char* metadir = spath_strdup(path_scr);
+    t->progress = scr_flush_progress_file(metadir, dst);
+    scr_free(&metadir);
+  }
+
+  q->total += t->size;
+  return t;
+}
+
+/* create directory unless we have already done so for an earlier file,
+ * since many files typically share a handful of directories */
+static int copy_queue_mkdir(struct copy_queue* q, const char* dir)
+{
+  /* nothing to do if we already created this directory */
+  if (kvtree_get(q->dirs, dir) != NULL) {
+    return SCR_SUCCESS;
+  }
+
+  /* make directory to file */
+  int rc = scr_mkdir(dir, S_IRWXU);
+  if (rc == SCR_SUCCESS) {
+    kvtree_set(q->dirs, dir, kvtree_new());
+  }
+  return rc;
+}
+
+/* print number of files and bytes copied so far and the bandwidth */
+static void copy_queue_progress(const struct copy_queue* q, double now)
+{
+  double secs = now - q->start;
+  double bw = 0.0;
+  if (secs > 0.0) {
+    bw = ((double) q->copied) / (1024.0 * 1024.0 * secs);
+  }
+  printf("scr_copy: %s: Copied %d of %d files, %llu of %llu bytes in %f secs, %f MB/s\n",
+    hostname, q->done, q->ntasks, q->copied, q->total, secs, bw
+  );
+  fflush(stdout);
+}
+
+/* read filemap and add each of its files to the queue */
+static int queue_files_for_filemap(
+  struct copy_queue* q,
   const spath* path_scr,
   const spath* cache_path,
   const char* entryname,
+  int id,
   int rank,
   const struct arglist* args,
   const char* hostname)
@@ -278,14 +527,34 @@ static int copy_files_for_filemap(
   spath_append_str(path_filemap, entryname);
   spath_reduce(path_filemap);
 
-  /* read in file map */
-  scr_filemap* map = scr_filemap_new();
-  scr_filemap_read(path_filemap, map);
-  const char* src_filemap = spath_strdup(path_filemap);
+  /* grow the job array if needed */
+  if (q->njobs == q->maxjobs) {
+    int maxjobs = (q->maxjobs > 0) ? 2 * q->maxjobs : 16;
+    struct copy_job* jobs = (struct copy_job*) realloc(q->jobs, maxjobs * sizeof(struct copy_job));
+    if (jobs == NULL) {
+      scr_abort(-1, "Failed to allocate filemap list: realloc(%d) errno=%d %s @ %s:%d",
+        maxjobs, errno, strerror(errno), __FILE__, __LINE__
+      );
+    }
+    q->jobs    = jobs;
+    q->maxjobs = maxjobs;
+  }
+
+  /* read in file map, we keep it until all of its files have been copied */
+  int job = q->njobs;
+  struct copy_job* j = &q->jobs[job];
+  j->id          = id;
+  j->rank        = rank;
+  j->map         = scr_filemap_new();
+  scr_filemap_read(path_filemap, j->map);
+  j->src_filemap = spath_strdup(path_filemap);
+  j->rank_map    = scr_filemap_new();
+  j->path_scr    = spath_dup(path_scr);
+  j->valid       = 1;
+  q->njobs++;
   spath_delete(&path_filemap);
 
-  /* allocate a rank filemap object */
-  scr_filemap* rank_map = scr_filemap_new();
+  scr_filemap* map = j->map;
 
   /* step through each file we have for this rank */
   kvtree_elem* file_elem = NULL;
@@ -309,155 +578,74 @@ static int copy_files_for_filemap(
       char* dst_dir = NULL;
       if (scr_meta_get_origpath(meta, &dst_dir) != SCR_SUCCESS) {
         printf("scr_copy: %s: Could not find original path for file %s in dataset id %d\n",
-          hostname, file, args->id
+          hostname, file, id
         );
-        printf("scr_copy: %s: Return code: 1\n", hostname);
         scr_meta_delete(&meta);
-        scr_filemap_delete(&map);
-        scr_filemap_delete(&rank_map);
+        j->valid = 0;
         return 1;
       }
   
-      /* TODO: keep a cache of directory names that we've already created */
-  
       /* make directory to file */
-      if (scr_mkdir(dst_dir, S_IRWXU) != SCR_SUCCESS) {
+      if (copy_queue_mkdir(q, dst_dir) != SCR_SUCCESS) {
         printf("scr_copy: %s: Failed to create path for file %s in dataset id %d\n",
-          hostname, file, args->id
+          hostname, file, id
         );
-        printf("scr_copy: %s: Return code: 1\n", hostname);
         scr_meta_delete(&meta);
-        scr_filemap_delete(&map);
-        scr_filemap_delete(&rank_map);
+        j->valid = 0;
         return 1;
       }
   
-      /* create destination file name */
+      /* create destination file name, a segment is written
+       * into its shared file rather than a file of its own */
+      unsigned long offset;
+      int segment = (scr_meta_get_segment(meta, &offset) == SCR_SUCCESS);
+      char* dst_name = NULL;
       spath* dst_path = spath_from_str(file);
+      if (segment && scr_meta_get_origname(meta, &dst_name) == SCR_SUCCESS) {
+        spath_delete(&dst_path);
+        dst_path = spath_from_str(dst_name);
+      }
       spath_basename(dst_path);
       spath_prepend_str(dst_path, dst_dir);
       spath_reduce(dst_path);
       char* dst_file = spath_strdup(dst_path);
-  
-      /* copy the file and optionally compute the crc during the copy */
-      int crc_valid = 0;
-      uLong crc = crc32(0L, Z_NULL, 0);
-      uLong* crc_p = NULL;
-      if (args->crc_flag) {
-        crc_valid = 1;
-        crc_p = &crc;
-      }
-      if (strcmp(file, dst_file) != 0) {
-        /* in case of bypass, only copy file if source and dest paths are different */
-        if (scr_file_copy(file, dst_file, args->buf_size, crc_p) != SCR_SUCCESS) {
-          crc_valid = 0;
-          rc = 1;
-        }
-      } else {
-        /* TODO: should we stat file and check its size? */
-        /* didn't attempt a copy, so we don't have a valid crc */
-        crc_valid = 0;
-      }
+      spath_delete(&dst_path);
 
-      /* apply metadata to file */
-      if (scr_meta_apply_stat(meta, dst_file) != SCR_SUCCESS) {
-        rc = 1;
-        scr_err("scr_copy: Failed to copy file metadata properties from %s to %s @ %s:%d",
-          file, dst_file, __FILE__, __LINE__
-        );
-      }
-  
-      /* add this file to the rank_map */
-      scr_filemap_add_file(rank_map, file);
-  
-      /* if file has crc32, check it against the one computed during
-       * the copy, otherwise if crc_flag is set, record crc32 */
-      if (crc_valid) {
-        uLong meta_crc;
-        if (scr_meta_get_crc32(meta, &meta_crc) == SCR_SUCCESS) {
-          if (crc != meta_crc) {
-            /* detected a crc mismatch during the copy */
-  
-            /* TODO: unlink the copied file */
-            /* scr_file_unlink(dst_file); */
-  
-            /* mark the file as invalid */
-            scr_meta_set_complete(meta, 0);
-  
-            rc = 1;
-            scr_err("scr_copy: CRC32 mismatch detected when flushing file %s to %s @ %s:%d",
-              file, dst_file, __FILE__, __LINE__
-            );
-  
-            /* TODO: would be good to log this, but right now only
-             * rank 0 can write log entries */
-            /*
-            if (scr_log_enable) {
-              scr_log_event("CRC32_MISMATCH", my_flushed_file, NULL, NULL, NULL);
-            }
-            */
-          }
-        } else {
-          /* the crc was not already in the metafile, but we just
-           * computed it, so set it */
-          scr_meta_set_crc32(meta, crc);
-        }
+      /* get size of file to limit bytes in flight */
+      unsigned long filesize = 0;
+      scr_meta_get_filesize(meta, &filesize);
+
+      /* add file to the list to be copied, segments are copied without a
+       * crc or a progress record, since only part of dst is theirs */
+      int crc_flag = segment ? 0 : args->crc_flag;
+      struct copy_task* t = copy_queue_add(q, path_scr, strdup(file), dst_file, filesize, job, crc_flag);
+      if (segment) {
+        t->segment = 1;
+        t->offset  = offset;
+        scr_free(&t->progress);
       }
   
-      /* record its meta data in the filemap */
-      scr_filemap_set_meta(rank_map, file, meta);
-  
-      /* free the destination file path and string */
-      scr_free(&dst_file);
-      spath_delete(&dst_path);
-  
       /* free the meta data object */
       scr_meta_delete(&meta);
     } else {
       /* have_file failed, so there was some problem accessing file */
       rc = 1;
       scr_err("scr_copy: File is unreadable or incomplete: CheckpointID %d, Rank %d, File: %s",
-        args->id, rank, file
+        id, rank, file
       );
     }
   }
-  
-  /* TODO: would be nice to use the updated filemap, since it has the CRC on the file,
-   * but we have to keep the same file that we applied the encoding to in case we need
-   * to rebuild it */
-  /* write out the rank filemap for scr_index */
-  spath* path_rank = spath_dup(path_scr);
-  spath_append_strf(path_rank, "filemap_%d", rank);
-#if 0
-  if (scr_filemap_write(path_rank, rank_map) != SCR_SUCCESS) {
-    rc = 1;
-  }
-#endif
-  char* dst_filemap = spath_strdup(path_rank);
-  if (scr_file_copy(src_filemap, dst_filemap, args->buf_size, NULL) != SCR_SUCCESS) {
-    rc = 1;
-  }
-  scr_free(&dst_filemap);
-  scr_free(&src_filemap);
-  spath_delete(&path_rank);
-
-  /* delete the rank filemap object */
-  scr_filemap_delete(&rank_map);
-  scr_filemap_delete(&map);
 
   return rc;
 }
 
-static int copy_files_redset(
-  const spath* path_prefix,
+/* add a redset file to the queue */
+static void queue_files_redset(
+  struct copy_queue* q,
   const spath* path_scr,
   const spath* cache_path,
-  const char* entryname,
-  const struct arglist* args,
-  const char* hostname)
+  const char* entryname)
 {
-  int rc = 0;
-
   /* define full path to the source redset file */
   spath* path = spath_dup(cache_path);
   spath_append_str(path, entryname);
@@ -471,76 +659,269 @@ static int copy_files_redset(
   char* dst_file = spath_strdup(dst_path);
 
   /* copy redset file to prefix directory */
-  if (scr_file_copy(file, dst_file, args->buf_size, NULL) != SCR_SUCCESS) {
-    rc = 1;
-  }
+  unsigned long size = scr_file_size(file);
+  copy_queue_add(q, path_scr, file, dst_file, size, -1, 0);
 
   /* free our paths */
-  scr_free(&dst_file);
   spath_delete(&dst_path);
-  scr_free(&file);
   spath_delete(&path);
+}
 
-  return rc;
+static void copy_queue_lock(struct copy_queue* q)
+{
+#ifdef HAVE_PTHREADS
+  pthread_mutex_lock(&q->lock);
+#endif
 }
 
-int main (int argc, char *argv[])
+static void copy_queue_unlock(struct copy_queue* q)
 {
-  /* get my hostname */
-  if (gethostname(hostname, sizeof(hostname)) != 0) {
-    scr_err("scr_copy: Call to gethostname failed @ %s:%d",
-      __FILE__, __LINE__
-    );
-    printf("scr_copy: UNKNOWN_HOST: Return code: 1\n");
-    return 1;
+#ifdef HAVE_PTHREADS
+  pthread_mutex_unlock(&q->lock);
+#endif
+}
+
+/* repeatedly take the next file from the queue and copy it,
+ * without pthreads the main thread copies all files itself */
+static void* copy_worker(void* arg)
+{
+  struct copy_queue* q = (struct copy_queue*) arg;
+
+  copy_queue_lock(q);
+  while (q->next < q->ntasks) {
+    struct copy_task* t = &q->tasks[q->next];
+
+#ifdef HAVE_PTHREADS
+    /* wait for other copies to finish if this file would exceed our
+     * limit on bytes in flight, but always let a file start if nothing
+     * else is being copied so that large files still make progress */
+    if (q->limit > 0 && q->inflight > 0 && q->inflight + t->size > q->limit) {
+      pthread_cond_wait(&q->cond, &q->lock);
+      continue;
+    }
+#endif
+
+    /* claim this file */
+    q->next++;
+    q->inflight += t->size;
+    copy_queue_unlock(q);
+
+    /* copy the file and optionally compute the crc during the copy */
+    if (t->copy && t->segment) {
+      t->rc = scr_file_copy_range(t->src, 0, t->dst, t->offset, t->size, q->buf_size);
+    } else if (t->copy) {
+      uLong* crc_p = (t->crc_flag) ? &t->crc : NULL;
+      t->rc = scr_flush_copy_resume(t->src, t->dst, t->progress, q->buf_size, q->resume, crc_p);
+    }
+
+    copy_queue_lock(q);
+    q->inflight -= t->size;
+    q->copied   += t->size;
+    q->done++;
+
+    /* periodically report progress */
+    double now = scr_seconds();
+    if (now - q->last_report >= PROGRESS_SECS) {
+      q->last_report = now;
+      copy_queue_progress(q, now);
+    }
+
+#ifdef HAVE_PTHREADS
+    /* wake any threads waiting for bytes in flight to drop */
+    pthread_cond_broadcast(&q->cond);
+#endif
   }
+  copy_queue_unlock(q);
 
-  /* process command line arguments, remember index to first argument */
-  struct arglist args;
-  if (! process_args(argc, argv, &args)) {
-    printf("scr_copy: %s: Return code: 1\n", hostname);
-    return 1;
+  return NULL;
+}
+
+/* copy all files in the queue using up to the given number of threads */
+static void copy_queue_run(struct copy_queue* q, int threads)
+{
+  q->start       = scr_seconds();
+  q->last_report = q->start;
+
+#ifdef HAVE_PTHREADS
+  /* no sense in starting more threads than we have files */
+  if (threads > q->ntasks) {
+    threads = q->ntasks;
   }
 
-  /* read cindex file to get metadata for dataset */
-  scr_cache_index* scr_cindex = scr_cache_index_new();
-  spath* scr_cindex_file = spath_from_str(args.cntldir);
-  spath_append_str(scr_cindex_file, "cindex.scrinfo");
-  scr_cache_index_read(scr_cindex_file, scr_cindex);
-  spath_delete(&scr_cindex_file);
+  /* start helper threads, the main thread acts as one of the workers */
+  int started = 0;
+  pthread_t* tids = NULL;
+  if (threads > 1) {
+    tids = (pthread_t*) SCR_MALLOC((threads - 1) * sizeof(pthread_t));
+    while (started < threads - 1) {
+      int rc = pthread_create(&tids[started], NULL, copy_worker, (void*) q);
+      if (rc != 0) {
+        /* we can still copy files with the threads we have */
+        scr_err("scr_copy: Failed to start copy thread: pthread_create() rc=%d @ %s:%d",
+          rc, __FILE__, __LINE__
+        );
+        break;
+      }
+      started++;
+    }
+  }
+#else
+  if (threads > 1) {
+    scr_dbg(1, "scr_copy: Built without pthreads, copying files sequentially");
+  }
+#endif
 
-  /* lookup path to given dataset id from cache index */
-  char* cachedir = NULL;
-  if (scr_cache_index_get_dir(scr_cindex, args.id, &cachedir) != SCR_SUCCESS) {
-    /* failed to lookup cache path for this dataset, so we can bail early */
-    printf("scr_copy: %s: Failed to find cache directory for dataset id %d\n",
-      hostname, args.id
-    );
-    scr_cache_index_delete(&scr_cindex);
-    return 1;
+  copy_worker((void*) q);
+
+#ifdef HAVE_PTHREADS
+  /* wait for helper threads to finish their last files */
+  int i;
+  for (i = 0; i < started; i++) {
+    pthread_join(tids[i], NULL);
+  }
+  scr_free(&tids);
+#endif
+}
+
+/* once all files have been copied, check their crc values, apply
+ * metadata, and copy each filemap to the prefix directory */
+static int copy_queue_complete(
+  struct copy_queue* q,
+  const struct arglist* args)
+{
+  int rc = 0;
+
+  int i;
+  for (i = 0; i < q->ntasks; i++) {
+    struct copy_task* t = &q->tasks[i];
+    if (t->rc != SCR_SUCCESS) {
+      rc = 1;
+    }
+
+    /* redset files have no metadata */
+    if (t->job < 0) {
+      continue;
+    }
+
+    const char* file     = t->src;
+    const char* dst_file = t->dst;
+    struct copy_job* j   = &q->jobs[t->job];
+
+    /* read the meta data for this file */
+    scr_meta* meta = scr_meta_new();
+    scr_filemap_get_meta(j->map, file, meta);
+
+    /* didn't attempt a copy in case of bypass, so we don't have a valid crc */
+    /* TODO: should we stat file and check its size? */
+    int crc_valid = (t->copy && t->crc_flag && t->rc == SCR_SUCCESS);
+    uLong crc = t->crc;
+
+    /* apply metadata to file, a segment only holds part of a shared file,
+     * so leave the metadata of that file alone */
+    if (! t->segment && scr_meta_apply_stat(meta, dst_file) != SCR_SUCCESS) {
+      rc = 1;
+      scr_err("scr_copy: Failed to copy file metadata properties from %s to %s @ %s:%d",
+        file, dst_file, __FILE__, __LINE__
+      );
+    }
+  
+    /* add this file to the rank_map */
+    scr_filemap_add_file(j->rank_map, file);
+  
+    /* if file has crc32, check it against the one computed during
+     * the copy, otherwise if crc_flag is set, record crc32 */
+    if (crc_valid) {
+      uLong meta_crc;
+      if (scr_meta_get_crc32(meta, &meta_crc) == SCR_SUCCESS) {
+        if (crc != meta_crc) {
+          /* detected a crc mismatch during the copy */
+  
+          /* TODO: unlink the copied file */
+          /* scr_file_unlink(dst_file); */
+  
+          /* mark the file as invalid */
+          scr_meta_set_complete(meta, 0);
+  
+          rc = 1;
+          scr_err("scr_copy: CRC32 mismatch detected when flushing file %s to %s @ %s:%d",
+            file, dst_file, __FILE__, __LINE__
+          );
+  
+          /* TODO: would be good to log this, but right now only
+           * rank 0 can write log entries */
+          /*
+          if (scr_log_enable) {
+            scr_log_event("CRC32_MISMATCH", my_flushed_file, NULL, NULL, NULL);
+          }
+          */
+        }
+      } else {
+        /* the crc was not already in the metafile, but we just
+         * computed it, so set it */
+        scr_meta_set_crc32(meta, crc);
+      }
+    }
+  
+    /* record its meta data in the filemap */
+    scr_filemap_set_meta(j->rank_map, file, meta);
+  
+    /* free the meta data object */
+    scr_meta_delete(&meta);
   }
 
+  for (i = 0; i < q->njobs; i++) {
+    struct copy_job* j = &q->jobs[i];
+
+    /* skip filemaps we failed to process */
+    if (! j->valid) {
+      continue;
+    }
+
+    /* TODO: would be nice to use the updated filemap, since it has the CRC on the file,
+     * but we have to keep the same file that we applied the encoding to in case we need
+     * to rebuild it */
+    /* write out the rank filemap for scr_index */
+    spath* path_rank = spath_dup(j->path_scr);
+    spath_append_strf(path_rank, "filemap_%d", j->rank);
 #if 0
-  kvtree_elem* rank_elem = scr_filemap_first_rank_by_dataset(map, args.id);
-  if (rank_elem == NULL) {
-    printf("scr_copy: %s: Do not have any files for dataset id %d\n",
-      hostname, args.id
+    if (scr_filemap_write(path_rank, j->rank_map) != SCR_SUCCESS) {
+      rc = 1;
+    }
+#endif
+    char* dst_filemap = spath_strdup(path_rank);
+    if (scr_file_copy(j->src_filemap, dst_filemap, args->buf_size, NULL) != SCR_SUCCESS) {
+      rc = 1;
+    }
+    scr_free(&dst_filemap);
+    spath_delete(&path_rank);
+  }
+
+  return rc;
+}
+
+/* scan the cache directory of the given dataset and add its files
+ * and redset files to the queue */
+static int queue_files_for_dataset(
+  struct copy_queue* q,
+  const scr_cache_index* cindex,
+  const spath* path_prefix,
+  int id,
+  const struct arglist* args)
+{
+  /* lookup path to given dataset id from cache index */
+  char* cachedir = NULL;
+  if (scr_cache_index_get_dir(cindex, id, &cachedir) != SCR_SUCCESS) {
+    /* failed to lookup cache path for this dataset */
+    printf("scr_copy: %s: Failed to find cache directory for dataset id %d\n",
+      hostname, id
     );
-    printf("scr_copy: %s: Return code: 1\n", hostname);
-    scr_filemap_delete(&map);
-    kvtree_delete(&hash);
     return 1;
   }
-#endif
-
-  /* path to prefix directory */
-  spath* path_prefix = spath_from_str(args.prefix);
-  spath_reduce(path_prefix);
 
   /* define the path to the dataset metadata subdirectory in prefix */
   spath* path_scr = spath_dup(path_prefix);
   spath_append_str(path_scr, ".scr");
-  spath_append_strf(path_scr, "scr.dataset.%d", args.id);
+  spath_append_strf(path_scr, "scr.dataset.%d", id);
   spath_reduce(path_scr);
 
   /* define the path to the dataset directory in cache */
@@ -590,8 +971,8 @@ int main (int argc, char *argv[])
           scr_free(&value);
         }
 
-        /* found a filemap, copy its files */
-        int tmp_rc = copy_files_for_filemap(path_prefix, path_scr, cache_path, entryname, rank, &args, hostname);
+        /* found a filemap, queue its files */
+        int tmp_rc = queue_files_for_filemap(q, path_scr, cache_path, entryname, id, rank, args, hostname);
         if (tmp_rc != 0) {
           rc = tmp_rc;
         }
@@ -600,41 +981,29 @@ int main (int argc, char *argv[])
 
       /* look for file names like: "reddescmap.er.0.redset" */
       if (regexec(&re_redsetmap_file, entryname, nmatch, pmatch, 0) == 0) {
-        /* found a filemap, copy its files */
-        int tmp_rc = copy_files_redset(path_prefix, path_scr, cache_path, entryname, &args, hostname);
-        if (tmp_rc != 0) {
-          rc = tmp_rc;
-        }
+        /* found a redset file, queue it */
+        queue_files_redset(q, path_scr, cache_path, entryname);
         continue;
       }
 
       /* look for file names like: "reddescmap.er.0.partner.0_1.redset" */
       if (regexec(&re_redsetmap_type_file, entryname, nmatch, pmatch, 0) == 0) {
-        /* found a filemap, copy its files */
-        int tmp_rc = copy_files_redset(path_prefix, path_scr, cache_path, entryname, &args, hostname);
-        if (tmp_rc != 0) {
-          rc = tmp_rc;
-        }
+        /* found a redset file, queue it */
+        queue_files_redset(q, path_scr, cache_path, entryname);
         continue;
       }
 
       /* look for file names like: "reddesc.er.0.redset" */
       if (regexec(&re_redset_file, entryname, nmatch, pmatch, 0) == 0) {
-        /* found a filemap, copy its files */
-        int tmp_rc = copy_files_redset(path_prefix, path_scr, cache_path, entryname, &args, hostname);
-        if (tmp_rc != 0) {
-          rc = tmp_rc;
-        }
+        /* found a redset file, queue it */
+        queue_files_redset(q, path_scr, cache_path, entryname);
         continue;
       }
 
       /* look for file names like: "reddesc.er.0.partner.0_1.redset" */
       if (regexec(&re_redset_type_file, entryname, nmatch, pmatch, 0) == 0) {
-        /* found a filemap, copy its files */
-        int tmp_rc = copy_files_redset(path_prefix, path_scr, cache_path, entryname, &args, hostname);
-        if (tmp_rc != 0) {
-          rc = tmp_rc;
-        }
+        /* found a redset file, queue it */
+        queue_files_redset(q, path_scr, cache_path, entryname);
         continue;
       }
     }
@@ -647,7 +1016,7 @@ int main (int argc, char *argv[])
   } else {
     /* failed to open directory */
     printf("scr_copy: %s: Failed to open directory %s in dataset id %d\n",
-      hostname, cache_str, args.id
+      hostname, cache_str, id
     );
     rc = 1;
   }
@@ -666,11 +1035,75 @@ int main (int argc, char *argv[])
   /* delete path to dataset metadata directory */
   spath_delete(&path_scr);
 
+  return rc;
+}
+
+int main (int argc, char *argv[])
+{
+  /* get my hostname */
+  if (gethostname(hostname, sizeof(hostname)) != 0) {
+    scr_err("scr_copy: Call to gethostname failed @ %s:%d",
+      __FILE__, __LINE__
+    );
+    printf("scr_copy: UNKNOWN_HOST: Return code: 1\n");
+    return 1;
+  }
+
+  /* process command line arguments, remember index to first argument */
+  struct arglist args;
+  if (! process_args(argc, argv, &args)) {
+    printf("scr_copy: %s: Return code: 1\n", hostname);
+    return 1;
+  }
+
+  /* read cindex file to get metadata for dataset */
+  scr_cache_index* scr_cindex = scr_cache_index_new();
+  spath* scr_cindex_file = spath_from_str(args.cntldir);
+  spath_append_str(scr_cindex_file, "cindex.scrinfo");
+  scr_cache_index_read(scr_cindex_file, scr_cindex);
+  spath_delete(&scr_cindex_file);
+
+  /* path to prefix directory */
+  spath* path_prefix = spath_from_str(args.prefix);
+  spath_reduce(path_prefix);
+
+  int rc = 0;
+
+  /* list of files to be copied, we queue the files from all datasets
+   * so that a single pass of the copy threads streams all of them */
+  struct copy_queue q;
+  copy_queue_init(&q, &args);
+
+  /* we may be missing some datasets on this node, keep going and
+   * copy what we have, scr_index detects any incomplete dataset */
+  int i;
+  for (i = 0; i < args.num_ids; i++) {
+    int tmp_rc = queue_files_for_dataset(&q, scr_cindex, path_prefix, args.ids[i], &args);
+    if (tmp_rc != 0) {
+      rc = tmp_rc;
+    }
+  }
+
+  /* copy the files we found */
+  copy_queue_run(&q, args.threads);
+  int tmp_rc = copy_queue_complete(&q, &args);
+  if (tmp_rc != 0) {
+    rc = tmp_rc;
+  }
+
+  /* report total bytes and bandwidth */
+  double end = scr_seconds();
+  copy_queue_progress(&q, end);
+
+  copy_queue_free(&q);
+
   /* free the prefix directory path */
   spath_delete(&path_prefix);
 
   scr_cache_index_delete(&scr_cindex);
 
+  scr_free(&args.ids);
+
   /* print our return code and exit */
   printf("scr_copy: %s: Return code: %d\n", hostname, rc);
   return rc;
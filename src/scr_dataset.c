@@ -47,6 +47,7 @@
 #define SCR_DATASET_KEY_NAME     ("NAME")
 #define SCR_DATASET_KEY_SIZE     ("SIZE")
 #define SCR_DATASET_KEY_FILES    ("FILES")
+#define SCR_DATASET_KEY_SEGMENTS ("SEGMENTS")
 #define SCR_DATASET_KEY_CREATED  ("CREATED")
 #define SCR_DATASET_KEY_JOBID    ("JOBID")
 #define SCR_DATASET_KEY_CLUSTER  ("CLUSTER")
@@ -132,6 +133,13 @@ int scr_dataset_set_files(scr_dataset* dataset, int files)
   return convert_kvtree_rc(kvtree_rc);
 }
 
+/* sets the number of files in the dataset that are segments of shared files */
+int scr_dataset_set_segments(scr_dataset* dataset, int segments)
+{
+  int kvtree_rc = kvtree_util_set_int(dataset, SCR_DATASET_KEY_SEGMENTS, segments);
+  return convert_kvtree_rc(kvtree_rc);
+}
+
 /* sets the created timestamp for the dataset */
 int scr_dataset_set_created(scr_dataset* dataset, int64_t usecs)
 {
@@ -215,6 +223,13 @@ int scr_dataset_get_files(const scr_dataset* dataset, int* files)
   return convert_kvtree_rc(kvtree_rc);
 }
 
+/* gets number of shared file segments in dataset, returns SCR_SUCCESS if successful */
+int scr_dataset_get_segments(const scr_dataset* dataset, int* segments)
+{
+  int kvtree_rc = kvtree_util_get_int(dataset, SCR_DATASET_KEY_SEGMENTS, segments);
+  return convert_kvtree_rc(kvtree_rc);
+}
+
 /* gets created timestamp of dataset, returns SCR_SUCCESS if successful */
 int scr_dataset_get_created(const scr_dataset* dataset, int64_t* usecs)
 {
@@ -79,6 +79,9 @@ int scr_dataset_set_size(scr_dataset* dataset, unsigned long size);
 /* sets the number of (logical) files in the dataset */
 int scr_dataset_set_files(scr_dataset* dataset, int files);
 
+/* sets the number of files in the dataset that are segments of shared files */
+int scr_dataset_set_segments(scr_dataset* dataset, int segments);
+
 /* sets the created timestamp for the dataset */
 int scr_dataset_set_created(scr_dataset* dataset, int64_t created);
 
@@ -118,6 +121,9 @@ int scr_dataset_get_size(const scr_dataset* dataset, unsigned long* size);
 /* gets number of (logical) files in dataset, returns SCR_SUCCESS if successful */
 int scr_dataset_get_files(const scr_dataset* dataset, int* files);
 
+/* gets number of shared file segments in dataset, returns SCR_SUCCESS if successful */
+int scr_dataset_get_segments(const scr_dataset* dataset, int* segments);
+
 /* gets created timestamp of dataset, returns SCR_SUCCESS if successful */
 int scr_dataset_get_created(const scr_dataset* dataset, int64_t* created);
 
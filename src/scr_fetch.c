@@ -32,6 +32,10 @@
 
 #include "scr_globals.h"
 
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 #include "spath.h"
 #include "kvtree.h"
 #include "kvtree_util.h"
@@ -59,6 +63,30 @@ Fetch functions
  *      and repeat #2
  */
 
+/* With SCR_FETCH_LAZY, the fetch only reads the summary and rank2file
+ * and records the dataset in cache as a bypass dataset, so that the
+ * restart reads its files directly from the prefix directory.  Once
+ * the restart completes, each process copies its files into cache in
+ * the background, and the next collective call that needs the cache
+ * switches the dataset over to the cached copy and applies its
+ * redundancy scheme. */
+
+/* tracks the background copy of a lazily fetched dataset */
+typedef struct {
+  int id;           /* id of dataset to be staged into cache, -1 if none */
+  int started;      /* whether the copy has been started */
+  int num_files;    /* number of files this process copies */
+  char** src_files; /* path of each file in the prefix directory */
+  char** dst_files; /* path of each file in cache */
+  int rc;           /* SCR_SUCCESS if all copies succeeded */
+#ifdef HAVE_PTHREADS
+  int threaded;     /* whether the copy is running in a thread */
+  pthread_t thread; /* thread that copies the files */
+#endif
+} scr_fetch_lazy_state;
+
+static scr_fetch_lazy_state scr_fetch_lazy_stage = { .id = -1 };
+
 /* read contents of summary file */
 static int scr_fetch_summary(
   const char* summary_dir,
@@ -149,20 +177,25 @@ cleanup:
   return rc;
 }
 
-/* fetch files from fetch_dir into cache_dir and update filemap */
-static int scr_fetch_data(
-  const kvtree* summary_hash,
+/* read the rank2file map in fetch_dir and return the list of files
+ * this process must read, each with the prefix directory prepended,
+ * if segments is not NULL, record the offset and length of each file
+ * that is a segment of a shared file under its path in segments,
+ * this is collective over scr_comm_world */
+static int scr_fetch_filelist(
   const char* fetch_dir,
-  const char* cache_dir,
-  scr_cache_index* cindex,
-  int id)
+  int* num_files,
+  char*** files,
+  kvtree* segments)
 {
-  int rc = SCR_SUCCESS;
+  *num_files = 0;
+  *files     = NULL;
 
   /* build path to rank2file map */
   spath* rank2file_path = spath_from_str(fetch_dir);
   spath_append_str(rank2file_path, "rank2file");
-  const char* rank2file = spath_strdup(rank2file_path);
+  char* rank2file = spath_strdup(rank2file_path);
+  spath_delete(&rank2file_path);
 
   /* get the list of files to read */
   kvtree* filelist = kvtree_new();
@@ -175,39 +208,86 @@ static int scr_fetch_data(
     return SCR_FAILURE;
   }
   scr_free(&rank2file);
-  spath_delete(&rank2file_path);
-
-  /* TODO: gather list of files to leader for each store descriptor,
-   * then use comm of store descriptor leaders in axl call,
-   * have leaders bcast success/fail back to all procs */
 
   /* allocate list of file names */
-  kvtree* files = kvtree_get(filelist, "FILE");
-  int num_files = kvtree_size(files);
-  const char** src_filelist  = (const char**) SCR_MALLOC(num_files * sizeof(char*));
-  const char** dest_filelist = (const char**) SCR_MALLOC(num_files * sizeof(char*));
+  kvtree* hash = kvtree_get(filelist, "FILE");
+  int count = kvtree_size(hash);
+  char** list = (char**) SCR_MALLOC(count * sizeof(char*));
 
-  /* create list of file names */
+  /* prepend prefix directory to each file */
   int i = 0;
   kvtree_elem* elem;
-  for (elem = kvtree_elem_first(files);
+  for (elem = kvtree_elem_first(hash);
        elem != NULL;
        elem = kvtree_elem_next(elem))
   {
-    /* get the filename */
     const char* file = kvtree_elem_key(elem);
-
-    /* prepend prefix directory to each file */
     spath* srcpath = spath_from_str(scr_prefix);
     spath_append_str(srcpath, file);
     spath_reduce(srcpath);
-    src_filelist[i] = spath_strdup(srcpath);
+    list[i] = spath_strdup(srcpath);
     spath_delete(&srcpath);
 
+    /* record the location of a segment in its shared file */
+    kvtree* file_hash = kvtree_elem_hash(elem);
+    unsigned long offset, length;
+    if (segments != NULL &&
+        kvtree_util_get_bytecount(file_hash, SCR_SUMMARY_6_KEY_OFFSET, &offset) == KVTREE_SUCCESS &&
+        kvtree_util_get_bytecount(file_hash, SCR_SUMMARY_6_KEY_LENGTH, &length) == KVTREE_SUCCESS)
+    {
+      kvtree* seg_hash = kvtree_new();
+      kvtree_util_set_bytecount(seg_hash, SCR_SUMMARY_6_KEY_OFFSET, offset);
+      kvtree_util_set_bytecount(seg_hash, SCR_SUMMARY_6_KEY_LENGTH, length);
+      kvtree_set(segments, list[i], seg_hash);
+    }
+    i++;
+  }
+
+  /* free the list of files */
+  kvtree_delete(&filelist);
+
+  *num_files = count;
+  *files     = list;
+  return SCR_SUCCESS;
+}
+
+/* fetch files from fetch_dir into cache_dir and update filemap */
+static int scr_fetch_data(
+  const kvtree* summary_hash,
+  const char* fetch_dir,
+  const char* cache_dir,
+  scr_cache_index* cindex,
+  int id)
+{
+  int rc = SCR_SUCCESS;
+
+  /* TODO: gather list of files to leader for each store descriptor,
+   * then use comm of store descriptor leaders in axl call,
+   * have leaders bcast success/fail back to all procs */
+
+  /* get the list of files to read */
+  int num_files;
+  char** files;
+  kvtree* segments = kvtree_new();
+  if (scr_fetch_filelist(fetch_dir, &num_files, &files, segments) != SCR_SUCCESS) {
+    kvtree_delete(&segments);
+    return SCR_FAILURE;
+  }
+
+  /* allocate list of file names */
+  const char** src_filelist  = (const char**) files;
+  const char** dest_filelist = (const char**) SCR_MALLOC(num_files * sizeof(char*));
+
+  /* create list of destination file names */
+  int i;
+  for (i = 0; i < num_files; i++) {
     /* compute and strdup detination name into dest list */
-    if (cache_dir != NULL) {
+    if (cache_dir != NULL && kvtree_get(segments, src_filelist[i]) != NULL) {
+      /* a segment of a shared file goes to its own file in cache */
+      dest_filelist[i] = scr_cache_segment_path(cache_dir, src_filelist[i], scr_my_rank_world);
+    } else if (cache_dir != NULL) {
       /* take basename of file and prepend cache directory */
-      spath* destpath = spath_from_str(file);
+      spath* destpath = spath_from_str(src_filelist[i]);
       spath_basename(destpath);
       spath_prepend_str(destpath, cache_dir);
       spath_reduce(destpath);
@@ -217,14 +297,8 @@ static int scr_fetch_data(
       /* otherwise, we don't transfer */
       dest_filelist[i] = strdup(src_filelist[i]);
     }
-
-    /* move on to the next file */
-    i++;
   }
 
-  /* free the list of files */
-  kvtree_delete(&filelist);
-
   /* now we can finally fetch the actual files */
   int success = 1;
   if (cache_dir != NULL) {
@@ -240,8 +314,39 @@ static int scr_fetch_data(
     //const scr_storedesc* storedesc = scr_cache_get_storedesc(cindex, id);
     axl_xfer_t xfer_type = scr_xfer_str_to_axl_type(SCR_FETCH_TYPE);
 
+    /* copy segments out of their shared files ourselves, and move
+     * whole files to the front of the list for AXL */
+    int axl_files = 0;
+    for (i = 0; i < num_files; i++) {
+      unsigned long offset, length;
+      kvtree* seg_hash = kvtree_get(segments, src_filelist[i]);
+      if (seg_hash != NULL) {
+        kvtree_util_get_bytecount(seg_hash, SCR_SUMMARY_6_KEY_OFFSET, &offset);
+        kvtree_util_get_bytecount(seg_hash, SCR_SUMMARY_6_KEY_LENGTH, &length);
+        unlink(dest_filelist[i]);
+        if (scr_file_copy_range(src_filelist[i], offset, dest_filelist[i], 0,
+              length, scr_file_buf_size) != SCR_SUCCESS)
+        {
+          scr_err("Failed to copy %lu bytes at offset %lu of %s to %s @ %s:%d",
+            length, offset, src_filelist[i], dest_filelist[i], __FILE__, __LINE__
+          );
+          success = 0;
+        }
+      } else {
+        const char* src = src_filelist[axl_files];
+        const char* dst = dest_filelist[axl_files];
+        src_filelist[axl_files]  = src_filelist[i];
+        dest_filelist[axl_files] = dest_filelist[i];
+        src_filelist[i]  = src;
+        dest_filelist[i] = dst;
+        axl_files++;
+      }
+    }
+
     /* fetch these files into the directory */
-    if (scr_axl(dset_name, NULL, num_files, src_filelist, dest_filelist, xfer_type, scr_comm_world) != SCR_SUCCESS) {
+    if (! scr_alltrue(axl_files == 0, scr_comm_world) &&
+        scr_axl(dset_name, NULL, axl_files, src_filelist, dest_filelist, xfer_type, scr_comm_world) != SCR_SUCCESS)
+    {
       success = 0;
     }
 
@@ -280,6 +385,15 @@ static int scr_fetch_data(
     scr_meta_set_ranks(meta, scr_ranks_world);
     scr_meta_set_orig(meta, src_file);
 
+    /* mark segments with their offset in the shared file */
+    unsigned long offset;
+    kvtree* seg_hash = kvtree_get(segments, src_file);
+    if (seg_hash != NULL &&
+        kvtree_util_get_bytecount(seg_hash, SCR_SUMMARY_6_KEY_OFFSET, &offset) == KVTREE_SUCCESS)
+    {
+      scr_meta_set_segment(meta, offset);
+    }
+
     /* build absolute path to file */
     spath* path_abs = spath_from_str(src_file);
     spath_reduce(path_abs);
@@ -326,6 +440,9 @@ static int scr_fetch_data(
   scr_free(&src_filelist);
   scr_free(&dest_filelist);
 
+  /* free the segment list */
+  kvtree_delete(&segments);
+
   return rc;
 }
 
@@ -368,6 +485,7 @@ int scr_fetch_dset(scr_cache_index* cindex, int dset_id, const char* dset_name,
   if (scr_fetch_summary(fetch_dir, summary_hash) != SCR_SUCCESS) {
     if (scr_my_rank_world == 0) {
       scr_dbg(1, "Failed to read summary file @ %s:%d", __FILE__, __LINE__);
+      scr_metrics_add(SCR_METRIC_FETCH_FAILURES, 1.0);
       if (scr_log_enable) {
         double time_end = MPI_Wtime();
         double time_diff = time_end - time_start;
@@ -429,6 +547,23 @@ int scr_fetch_dset(scr_cache_index* cindex, int dset_id, const char* dset_name,
     c->bypass = 1;
   }
 
+  /* with a lazy fetch, read directly from the prefix directory
+   * for the restart and stage files into cache afterwards,
+   * there is nothing to stage if the dataset would bypass cache anyway */
+  int lazy = 0;
+  if (scr_fetch_lazy && ! c->bypass) {
+    c->bypass = 1;
+    lazy = 1;
+  }
+
+  /* segments of shared files are always fetched into cache,
+   * since the restart reads each one from its own file */
+  int segments = 0;
+  if (scr_dataset_get_segments(dataset, &segments) == SCR_SUCCESS && segments > 0) {
+    c->bypass = 0;
+    lazy = 0;
+  }
+
   /* record bypass property in cache index*/
   scr_cache_index_set_bypass(cindex, dset_id, c->bypass);
 
@@ -470,6 +605,7 @@ int scr_fetch_dset(scr_cache_index* cindex, int dset_id, const char* dset_name,
       scr_dbg(1, "One or more processes failed to read its files @ %s:%d",
         __FILE__, __LINE__
       );
+      scr_metrics_add(SCR_METRIC_FETCH_FAILURES, 1.0);
       if (scr_log_enable) {
         double time_end = MPI_Wtime();
         double time_diff = time_end - time_start;
@@ -497,6 +633,11 @@ int scr_fetch_dset(scr_cache_index* cindex, int dset_id, const char* dset_name,
     /* record checkpoint id */
     *checkpoint_id = ckpt_id;
 
+    /* remember to stage this dataset into cache after the restart */
+    if (lazy) {
+      scr_fetch_lazy_stage.id = dset_id;
+    }
+
     /* update our flush file to indicate this checkpoint is in cache
      * as well as the parallel file system */
     /* TODO: should we place SCR_FLUSH_KEY_LOCATION_PFS before
@@ -528,6 +669,15 @@ int scr_fetch_dset(scr_cache_index* cindex, int dset_id, const char* dset_name,
       time_diff, files, total_bytes, bw, bw/scr_ranks_world
     );
 
+    /* record fetch in our metrics */
+    if (rc == SCR_SUCCESS) {
+      scr_metrics_add(SCR_METRIC_FETCHES, 1.0);
+      scr_metrics_add(SCR_METRIC_FETCH_BYTES, total_bytes);
+      scr_metrics_observe(SCR_METRIC_FETCH_SECS, time_diff);
+    } else {
+      scr_metrics_add(SCR_METRIC_FETCH_FAILURES, 1.0);
+    }
+
     /* log data on the fetch to the database */
     if (scr_log_enable) {
       if (rc == SCR_SUCCESS) {
@@ -550,6 +700,126 @@ int scr_fetch_dset(scr_cache_index* cindex, int dset_id, const char* dset_name,
   return rc;
 }
 
+/* While fetch_latest fetches one checkpoint, it checks the next older
+ * candidate in the background, so that if the fetch fails it can skip
+ * straight past candidates that are already known to be unreadable
+ * rather than attempting a full fetch of each in turn.  The summary
+ * and rank2file are read up front, since those are collective, and
+ * then each process checks that its files exist in a thread. */
+
+/* tracks the background check of the next candidate checkpoint */
+typedef struct {
+  int id;           /* id of dataset being checked, -1 if none */
+  int num_files;    /* number of files this process checks */
+  char** files;     /* path of each file in the prefix directory */
+  int valid;        /* set to 0 if any check fails */
+  int cancel;       /* set to stop checking early */
+#ifdef HAVE_PTHREADS
+  int threaded;     /* whether the check is running in a thread */
+  pthread_t thread; /* thread that checks the files */
+#endif
+} scr_fetch_probe_state;
+
+/* check that each file of the candidate exists and is readable */
+static void* scr_fetch_probe_check(void* arg)
+{
+  scr_fetch_probe_state* probe = (scr_fetch_probe_state*) arg;
+
+  int i;
+  for (i = 0; i < probe->num_files && ! probe->cancel; i++) {
+    if (access(probe->files[i], R_OK) < 0) {
+      /* either can't read this file or it doesn't exist */
+      probe->valid = 0;
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+/* start checking the dataset with given id, collective over scr_comm_world */
+static void scr_fetch_probe_start(scr_fetch_probe_state* probe, int id)
+{
+  probe->id        = id;
+  probe->num_files = 0;
+  probe->files     = NULL;
+  probe->valid     = 1;
+  probe->cancel    = 0;
+#ifdef HAVE_PTHREADS
+  probe->threaded  = 0;
+#endif
+
+  /* get path to dataset metadata directory in prefix */
+  spath* path = spath_from_str(scr_prefix_scr);
+  spath_append_strf(path, "scr.dataset.%d", id);
+  char* fetch_dir = spath_strdup(path);
+  spath_delete(&path);
+
+  /* read the summary and the list of files for this process */
+  kvtree* summary_hash = kvtree_new();
+  if (scr_fetch_summary(fetch_dir, summary_hash) != SCR_SUCCESS ||
+      scr_fetch_filelist(fetch_dir, &probe->num_files, &probe->files, NULL) != SCR_SUCCESS)
+  {
+    probe->valid = 0;
+  }
+  kvtree_delete(&summary_hash);
+  scr_free(&fetch_dir);
+
+  /* nothing more to check if the metadata is bad */
+  if (! probe->valid) {
+    return;
+  }
+
+  /* check the files in a thread if we can, otherwise we check when done */
+#ifdef HAVE_PTHREADS
+  if (pthread_create(&probe->thread, NULL, scr_fetch_probe_check, probe) == 0) {
+    probe->threaded = 1;
+  }
+#endif
+}
+
+/* wait for the check to finish and free its resources,
+ * returns 1 if all processes found all of their files,
+ * if cancel is set, stop the check early and return 0,
+ * collective over scr_comm_world unless cancel is set */
+static int scr_fetch_probe_finish(scr_fetch_probe_state* probe, int cancel)
+{
+  if (probe->id < 0) {
+    return 0;
+  }
+
+  /* stop or wait for the check */
+  probe->cancel = cancel;
+#ifdef HAVE_PTHREADS
+  if (probe->threaded) {
+    pthread_join(probe->thread, NULL);
+    probe->threaded = 0;
+  } else if (! cancel && probe->valid) {
+    scr_fetch_probe_check(probe);
+  }
+#else
+  if (! cancel && probe->valid) {
+    scr_fetch_probe_check(probe);
+  }
+#endif
+
+  /* free the list of files */
+  int i;
+  for (i = 0; i < probe->num_files; i++) {
+    scr_free(&probe->files[i]);
+  }
+  scr_free(&probe->files);
+  probe->num_files = 0;
+  probe->id = -1;
+
+  if (cancel) {
+    return 0;
+  }
+
+  /* determine whether everyone found their files */
+  return scr_alltrue(probe->valid, scr_comm_world);
+}
+
 /* attempt to fetch most recent checkpoint from prefix directory into
  * cache, fills in map if successful and sets fetch_attempted to 1 if
  * any fetch is attempted, returns SCR_SUCCESS if successful */
@@ -615,7 +885,7 @@ int scr_fetch_latest(scr_cache_index* cindex, int* fetch_attempted)
 
       /* record current marker on each node to not do this again */
       scr_cache_index_set_current(cindex, scr_fetch_current);
-      scr_cache_index_write(scr_cindex_file, cindex);
+      scr_cache_index_mark_dirty();
     }
 
     /* forget this value so that if we call fetch_latest again
@@ -623,6 +893,10 @@ int scr_fetch_latest(scr_cache_index* cindex, int* fetch_attempted)
     scr_free(&scr_fetch_current);
   }
 
+  /* background check of the next older checkpoint */
+  scr_fetch_probe_state probe;
+  probe.id = -1;
+
   /* now start fetching, we keep trying until we exhaust all valid
    * checkpoints */
   char target[SCR_MAX_FILENAME];
@@ -631,6 +905,9 @@ int scr_fetch_latest(scr_cache_index* cindex, int* fetch_attempted)
     /* initialize our target directory to empty string */
     strcpy(target, "");
 
+    /* id of the next older checkpoint to check while we fetch this one */
+    int candidate_id = -1;
+
     /* rank 0 determines the directory to fetch from */
     if (scr_my_rank_world == 0) {
       /* read the current directory if it's set */
@@ -657,6 +934,12 @@ int scr_fetch_latest(scr_cache_index* cindex, int* fetch_attempted)
       }
       target_id = next_id;
 
+      /* look up the checkpoint we would fall back to if this one fails */
+      if (target_id != -1) {
+        char candidate[SCR_MAX_FILENAME];
+        scr_index_get_most_recent_complete(index_hash, target_id, &candidate_id, candidate);
+      }
+
       /* TODODSET: need to verify that dataset is really a checkpoint
        * and keep searching if not */
 
@@ -681,9 +964,32 @@ int scr_fetch_latest(scr_cache_index* cindex, int* fetch_attempted)
 
     /* check whether we've got a path */
     if (strcmp(target, "") != 0) {
+      /* if we already checked this checkpoint while fetching the
+       * previous one, skip the fetch if any process is missing files */
+      int skip = 0;
+      if (probe.id != -1) {
+        int probe_id = probe.id;
+        int probe_valid = scr_fetch_probe_finish(&probe, 0);
+        if (probe_id == target_id && ! probe_valid) {
+          if (scr_my_rank_world == 0) {
+            scr_dbg(1, "Skipping fetch of `%s', one or more files are missing", target);
+          }
+          skip = 1;
+        }
+      }
+
+      /* start checking the next older checkpoint while we fetch this one */
+      MPI_Bcast(&candidate_id, 1, MPI_INT, 0, scr_comm_world);
+      if (! skip && candidate_id != -1) {
+        scr_fetch_probe_start(&probe, candidate_id);
+      }
+
       /* got something, attempt to fetch the checkpoint */
       int ckpt_id;
-      rc = scr_fetch_dset(cindex, target_id, target, &ckpt_id);
+      rc = SCR_FAILURE;
+      if (! skip) {
+        rc = scr_fetch_dset(cindex, target_id, target, &ckpt_id);
+      }
       if (rc == SCR_SUCCESS) {
         /* set the dataset and checkpoint ids */
         scr_dataset_id    = target_id;
@@ -714,6 +1020,9 @@ int scr_fetch_latest(scr_cache_index* cindex, int* fetch_attempted)
     }
   }
 
+  /* stop any check still running */
+  scr_fetch_probe_finish(&probe, 1);
+
   /* delete the index hash */
   if (scr_my_rank_world == 0) {
     kvtree_delete(&index_hash);
@@ -723,6 +1032,9 @@ int scr_fetch_latest(scr_cache_index* cindex, int* fetch_attempted)
    * (only rank 0 knows) */
   MPI_Bcast(fetch_attempted, 1, MPI_INT, 0, scr_comm_world);
 
+  /* write any changes to the cache index */
+  scr_cache_index_sync(scr_cindex_file, cindex);
+
   /* stop timer for fetch */
   if (scr_my_rank_world == 0) {
     time_end = MPI_Wtime();
@@ -732,3 +1044,220 @@ int scr_fetch_latest(scr_cache_index* cindex, int* fetch_attempted)
 
   return rc;
 }
+
+/* copy each file of a lazily fetched dataset into cache */
+static void* scr_fetch_lazy_copy(void* arg)
+{
+  scr_fetch_lazy_state* stage = (scr_fetch_lazy_state*) arg;
+
+  int rc = SCR_SUCCESS;
+  int i;
+  for (i = 0; i < stage->num_files; i++) {
+    if (scr_file_copy(stage->src_files[i], stage->dst_files[i], scr_file_buf_size, NULL) != SCR_SUCCESS) {
+      scr_err("Failed to stage %s into cache as %s @ %s:%d",
+        stage->src_files[i], stage->dst_files[i], __FILE__, __LINE__
+      );
+      rc = SCR_FAILURE;
+      break;
+    }
+  }
+  stage->rc = rc;
+
+  return NULL;
+}
+
+/* free file lists and forget about the staged dataset */
+static void scr_fetch_lazy_reset(void)
+{
+  scr_fetch_lazy_state* stage = &scr_fetch_lazy_stage;
+
+  int i;
+  for (i = 0; i < stage->num_files; i++) {
+    scr_free(&stage->src_files[i]);
+    scr_free(&stage->dst_files[i]);
+  }
+  scr_free(&stage->src_files);
+  scr_free(&stage->dst_files);
+
+  stage->id        = -1;
+  stage->started   = 0;
+  stage->num_files = 0;
+  stage->rc        = SCR_SUCCESS;
+}
+
+/* after a successful restart from a dataset fetched with SCR_FETCH_LAZY,
+ * start copying its files into cache in the background */
+int scr_fetch_lazy_start(scr_cache_index* cindex)
+{
+  scr_fetch_lazy_state* stage = &scr_fetch_lazy_stage;
+
+  /* nothing to do unless the last fetch was lazy */
+  if (stage->id < 0 || stage->started) {
+    return SCR_SUCCESS;
+  }
+  int id = stage->id;
+
+  /* get the directory the fetch created for this dataset in cache */
+  char* dir = NULL;
+  if (scr_cache_index_get_dir(cindex, id, &dir) != SCR_SUCCESS) {
+    /* dataset is no longer in cache */
+    scr_fetch_lazy_reset();
+    return SCR_FAILURE;
+  }
+
+  /* build list of files to copy from the bypass filemap,
+   * whose entries are the paths to the files in the prefix directory */
+  scr_filemap* map = scr_filemap_new();
+  scr_cache_get_map(cindex, id, map);
+
+  int num_files = scr_filemap_num_files(map);
+  stage->src_files = (char**) SCR_MALLOC(num_files * sizeof(char*));
+  stage->dst_files = (char**) SCR_MALLOC(num_files * sizeof(char*));
+
+  int i = 0;
+  kvtree_elem* elem;
+  for (elem = scr_filemap_first_file(map);
+       elem != NULL;
+       elem = kvtree_elem_next(elem))
+  {
+    const char* file = kvtree_elem_key(elem);
+
+    /* take basename of file and prepend cache directory */
+    spath* destpath = spath_from_str(file);
+    spath_basename(destpath);
+    spath_prepend_str(destpath, dir);
+    spath_reduce(destpath);
+
+    stage->src_files[i] = strdup(file);
+    stage->dst_files[i] = spath_strdup(destpath);
+    spath_delete(&destpath);
+
+    i++;
+  }
+  stage->num_files = num_files;
+  stage->rc        = SCR_SUCCESS;
+  stage->started   = 1;
+
+  scr_filemap_delete(&map);
+
+  /* copy in a thread if we can, otherwise we copy when completing */
+#ifdef HAVE_PTHREADS
+  stage->threaded = 0;
+  if (pthread_create(&stage->thread, NULL, scr_fetch_lazy_copy, stage) == 0) {
+    stage->threaded = 1;
+  }
+#endif
+
+  return SCR_SUCCESS;
+}
+
+/* wait for the background copy of a lazily fetched dataset, and if every
+ * process copied its files, switch the dataset to its cached copy and
+ * apply its redundancy scheme, this is collective over scr_comm_world */
+int scr_fetch_lazy_complete(scr_cache_index* cindex)
+{
+  scr_fetch_lazy_state* stage = &scr_fetch_lazy_stage;
+
+  /* nothing to do if there is no lazy fetch in progress,
+   * this is the same on all processes */
+  if (stage->id < 0) {
+    return SCR_SUCCESS;
+  }
+
+  /* the restart never completed, so the copy was never started */
+  if (! stage->started) {
+    scr_fetch_lazy_reset();
+    return SCR_SUCCESS;
+  }
+
+  int id = stage->id;
+
+  /* wait for the copy to finish, or do it now if it was not threaded */
+#ifdef HAVE_PTHREADS
+  if (stage->threaded) {
+    pthread_join(stage->thread, NULL);
+    stage->threaded = 0;
+  } else {
+    scr_fetch_lazy_copy(stage);
+  }
+#else
+  scr_fetch_lazy_copy(stage);
+#endif
+
+  /* if anyone failed to copy, drop the partial copies and
+   * keep reading this dataset from the prefix directory */
+  if (! scr_alltrue(stage->rc == SCR_SUCCESS, scr_comm_world)) {
+    int i;
+    for (i = 0; i < stage->num_files; i++) {
+      scr_file_unlink(stage->dst_files[i]);
+    }
+    if (scr_my_rank_world == 0) {
+      scr_dbg(1, "Failed to stage dataset %d into cache, leaving it in prefix directory", id);
+    }
+    scr_fetch_lazy_reset();
+    return SCR_FAILURE;
+  }
+
+  /* get the redundancy descriptor for this checkpoint */
+  int ckpt_id = 0;
+  scr_dataset* dataset = scr_dataset_new();
+  scr_cache_index_get_dataset(cindex, id, dataset);
+  scr_dataset_get_ckpt(dataset, &ckpt_id);
+  scr_dataset_delete(&dataset);
+  scr_reddesc* rd = scr_reddesc_for_checkpoint(ckpt_id, scr_nreddescs, scr_reddescs);
+
+  /* remove the redundancy data for the bypass filemap */
+  char* dir = NULL;
+  scr_cache_index_get_dir(cindex, id, &dir);
+  spath* path_scr = spath_from_str(dir);
+  spath_append_str(path_scr, ".scr");
+  char* dir_scr = spath_strdup(path_scr);
+  spath_delete(&path_scr);
+  scr_reddesc_unapply(cindex, id, dir_scr);
+  scr_free(&dir_scr);
+
+  /* build a filemap that refers to the cached copies */
+  scr_filemap* old_map = scr_filemap_new();
+  scr_cache_get_map(cindex, id, old_map);
+  scr_filemap* map = scr_filemap_new();
+  int i;
+  for (i = 0; i < stage->num_files; i++) {
+    const char* src_file = stage->src_files[i];
+    const char* dst_file = stage->dst_files[i];
+
+    scr_meta* meta = scr_meta_new();
+    scr_filemap_get_meta(old_map, src_file, meta);
+
+    /* record metadata of the cached copy so later checks compare against it */
+    struct stat stat_buf;
+    if (stat(dst_file, &stat_buf) == 0) {
+      scr_meta_set_stat(meta, &stat_buf);
+    }
+
+    scr_filemap_add_file(map, dst_file);
+    scr_filemap_set_meta(map, dst_file, meta);
+    scr_meta_delete(&meta);
+  }
+  scr_filemap_delete(&old_map);
+
+  /* the dataset now lives in cache */
+  scr_cache_index_set_bypass(cindex, id, 0);
+  scr_cache_set_map(cindex, id, map);
+  scr_cache_index_mark_dirty();
+
+  /* apply redundancy scheme to the cached files */
+  int rc = scr_reddesc_apply(map, rd, id);
+  if (rc != SCR_SUCCESS) {
+    /* drop the cached copy, the dataset is still in the prefix directory */
+    scr_cache_delete(cindex, id);
+  }
+
+  if (scr_my_rank_world == 0) {
+    scr_dbg(1, "Staged dataset %d into cache with return code %d", id, rc);
+  }
+
+  scr_filemap_delete(&map);
+  scr_fetch_lazy_reset();
+
+  return rc;
+}
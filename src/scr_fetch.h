@@ -19,4 +19,13 @@ int scr_fetch_latest(scr_filemap* map, int* fetch_attempted);
  * return its checkpoint id */
 int scr_fetch_dset(scr_cache_index* cindex, int dset_id, const char* dset_name, int* checkpoint_id);
 
+/* after a successful restart from a dataset fetched with SCR_FETCH_LAZY,
+ * start copying its files into cache in the background */
+int scr_fetch_lazy_start(scr_cache_index* cindex);
+
+/* wait for the background copy of a lazily fetched dataset, then switch
+ * the dataset to its cached copy and apply its redundancy scheme,
+ * collective over scr_comm_world */
+int scr_fetch_lazy_complete(scr_cache_index* cindex);
+
 #endif
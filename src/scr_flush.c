@@ -436,9 +436,10 @@ int scr_flush_complete(const scr_cache_index* cindex, int id, kvtree* file_list)
 
       /* if this is a checkpoint, update current to point to new dataset,
        * this must come after index_set_dataset above because set_current
-       * checks that named dataset is a checkpoint */
+       * checks that named dataset is a checkpoint, async flushes may
+       * complete out of order, so never move current to an older one */
       if (scr_dataset_is_ckpt(dataset)) {
-        scr_index_set_current(index_hash, name);
+        scr_index_advance_current(index_hash, name);
       }
 
       /* write the index file and delete the hash */
@@ -460,7 +461,7 @@ int scr_flush_complete(const scr_cache_index* cindex, int id, kvtree* file_list)
     if (scr_prefix_size > 0) {
       int is_ckpt = scr_dataset_is_ckpt(dataset);
       if (is_ckpt) {
-        scr_prefix_delete_sliding(id, scr_prefix_size);
+        scr_prefix_delete_sliding(scr_prefix_size);
       }
     }
 
@@ -474,3 +475,51 @@ int scr_flush_complete(const scr_cache_index* cindex, int id, kvtree* file_list)
 
   return flushed;
 }
+
+/*
+=========================================
+Track flush bandwidth to predict drain time
+=========================================
+*/
+
+/* weight given to the most recent flush in the bandwidth estimate */
+#define SCR_FLUSH_BW_WEIGHT (0.5)
+
+static double scr_flush_bw_estimate = 0.0; /* bytes/sec, 0 until a flush completes */
+static int    scr_flush_bw_count    = 0;   /* number of flushes recorded */
+
+/* record the size and duration of a flush that completed successfully,
+ * only rank 0 tracks this */
+void scr_flush_record_bw(double bytes, double secs)
+{
+  if (bytes <= 0.0 || secs <= 0.0) {
+    return;
+  }
+
+  scr_flush_bw_count++;
+
+  double bw = bytes / secs;
+  if (scr_flush_bw_estimate == 0.0) {
+    scr_flush_bw_estimate = bw;
+  } else {
+    scr_flush_bw_estimate = SCR_FLUSH_BW_WEIGHT * bw +
+      (1.0 - SCR_FLUSH_BW_WEIGHT) * scr_flush_bw_estimate;
+  }
+}
+
+/* returns the predicted number of seconds to flush the given number
+ * of bytes, or -1 if no flush has completed yet, only valid on rank 0 */
+double scr_flush_predict_secs(double bytes)
+{
+  if (scr_flush_bw_estimate <= 0.0) {
+    return -1.0;
+  }
+  return bytes / scr_flush_bw_estimate;
+}
+
+/* returns the number of successful flushes recorded so far,
+ * which callers use to detect that a flush has completed, only valid on rank 0 */
+int scr_flush_recorded_count(void)
+{
+  return scr_flush_bw_count;
+}
@@ -56,4 +56,16 @@ int scr_flush_prepare(const scr_cache_index* cindex, int id, kvtree* file_list);
  * complete the flush by writing the summary file */
 int scr_flush_complete(const scr_cache_index* cindex, int id, kvtree* file_list);
 
+/* record the size and duration of a flush that completed successfully,
+ * only rank 0 tracks this */
+void scr_flush_record_bw(double bytes, double secs);
+
+/* returns the predicted number of seconds to flush the given number
+ * of bytes, or -1 if no flush has completed yet, only valid on rank 0 */
+double scr_flush_predict_secs(double bytes);
+
+/* returns the number of successful flushes recorded so far,
+ * which callers use to detect that a flush has completed, only valid on rank 0 */
+int scr_flush_recorded_count(void);
+
 #endif
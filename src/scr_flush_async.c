@@ -16,16 +16,141 @@
 #include "kvtree_util.h"
 #include "axl_mpi.h"
 
+#include <sys/wait.h>
+#include <signal.h>
+
+/* command run by the detached process that finishes a flush after the job */
+#define SCR_FLUSH_FINISH_CMD (X_BINDIR"/scr_flush_file")
+
 #define ASYNC_KEY_OUT_DSET   "DSET"   /* list items by dataset id */
 #define ASYNC_KEY_OUT_STATUS "STATUS" /* tracks whether flush has failed in any stage */
 #define ASYNC_KEY_OUT_FILES  "FILES"  /* list of files to be transferred */
 #define ASYNC_KEY_OUT_AXL    "AXL"    /* tracks AXL id for outstanding transfer */
 #define ASYNC_KEY_OUT_TIME   "TIME"   /* start time of transfer from time */
 #define ASYNC_KEY_OUT_WTIME  "WTIME"  /* start time of transfer from Wtime */
+#define ASYNC_KEY_OUT_PENDING "PENDING" /* bytes left to write as of the last completed test */
+#define ASYNC_KEY_OUT_SUPERSEDED "SUPERSEDED" /* set if this flush cancelled an older one */
 
 /* tracks info for all outstanding transfers */
 static kvtree* scr_flush_async_list = NULL;
 
+/* minimum seconds between scans of destination file sizes when
+ * estimating the bytes a process has left to write */
+#define SCR_FLUSH_ASYNC_PENDING_SECS (1.0)
+
+/* Each outstanding transfer has a nonblocking allreduce that sums the
+ * number of processes whose transfer is not done and the bytes they have
+ * left to write.  A test consumes the reduction posted by the previous
+ * test and posts the next one, so that all processes act on the same
+ * result at the same call, and since the application computes between
+ * calls, the reduction has normally completed by then. */
+typedef struct scr_flush_async_req_struct {
+  int id;             /* dataset id of transfer */
+  int posted;         /* whether req is outstanding */
+  MPI_Request req;    /* request of outstanding allreduce */
+  double local[2];    /* 1 if our transfer is not done, and bytes we have left */
+  double global[2];   /* sum of local values across processes */
+  double pending;     /* bytes we had left as of our last scan of the destination files */
+  double pending_time; /* MPI_Wtime of our last scan, or negative if none */
+  struct scr_flush_async_req_struct* next;
+} scr_flush_async_req;
+
+static scr_flush_async_req* scr_flush_async_reqs = NULL;
+
+/* return the test state for the given dataset, creating it if needed */
+static scr_flush_async_req* scr_flush_async_req_get(int id)
+{
+  scr_flush_async_req* r;
+  for (r = scr_flush_async_reqs; r != NULL; r = r->next) {
+    if (r->id == id) {
+      return r;
+    }
+  }
+
+  r = (scr_flush_async_req*) SCR_MALLOC(sizeof(scr_flush_async_req));
+  r->id     = id;
+  r->posted = 0;
+  r->req    = MPI_REQUEST_NULL;
+  r->pending      = 0.0;
+  r->pending_time = -1.0;
+  r->next   = scr_flush_async_reqs;
+  scr_flush_async_reqs = r;
+  return r;
+}
+
+/* complete any outstanding reduction for the given dataset and free its
+ * test state, every process posts the same reductions, so this is safe
+ * to call from any point that all processes reach together */
+static void scr_flush_async_req_free(int id)
+{
+  scr_flush_async_req** prev = &scr_flush_async_reqs;
+  while (*prev != NULL) {
+    scr_flush_async_req* r = *prev;
+    if (r->id == id) {
+      if (r->posted) {
+        MPI_Wait(&r->req, MPI_STATUS_IGNORE);
+      }
+      *prev = r->next;
+      scr_free(&r);
+      return;
+    }
+    prev = &r->next;
+  }
+}
+
+/* free test state for all datasets */
+static void scr_flush_async_req_free_all(void)
+{
+  while (scr_flush_async_reqs != NULL) {
+    scr_flush_async_req_free(scr_flush_async_reqs->id);
+  }
+}
+
+/* estimate the bytes this process has left to write for a transfer
+ * from the size of each destination file */
+static double scr_flush_async_local_pending(kvtree* file_list)
+{
+  double bytes = 0.0;
+
+  kvtree* files = kvtree_get(file_list, SCR_KEY_FILE);
+  kvtree_elem* elem;
+  for (elem = kvtree_elem_first(files);
+       elem != NULL;
+       elem = kvtree_elem_next(elem))
+  {
+    kvtree* hash = kvtree_elem_hash(elem);
+    scr_meta* meta = kvtree_get(hash, SCR_KEY_META);
+
+    unsigned long filesize;
+    char* origpath;
+    char* origname;
+    if (scr_meta_get_filesize(meta, &filesize) != SCR_SUCCESS ||
+        scr_meta_get_origpath(meta, &origpath) != SCR_SUCCESS ||
+        scr_meta_get_origname(meta, &origname) != SCR_SUCCESS)
+    {
+      continue;
+    }
+
+    /* count what is not yet in the destination file as pending */
+    double left = (double) filesize;
+    spath* dest_path = spath_from_str(origpath);
+    spath_append_str(dest_path, origname);
+    char* dest = spath_strdup(dest_path);
+    struct stat statbuf;
+    if (stat(dest, &statbuf) == 0 && statbuf.st_size > 0) {
+      left -= (double) statbuf.st_size;
+    }
+    scr_free(&dest);
+    spath_delete(&dest_path);
+
+    if (left > 0.0) {
+      bytes += left;
+    }
+  }
+
+  return bytes;
+}
+
 /*
 =========================================
 Asynchronous flush functions
@@ -155,6 +280,9 @@ int scr_flush_async_stop()
     scr_dbg(1, "Stopping all async flush operations");
   }
 
+  /* complete any outstanding tests */
+  scr_flush_async_req_free_all();
+
   /* stop all ongoing transfers */
   if (AXL_Stop_comm(scr_comm_world) != AXL_SUCCESS) {
     return SCR_FAILURE;
@@ -172,6 +300,195 @@ int scr_flush_async_stop()
   return SCR_SUCCESS;
 }
 
+/* stop all ongoing transfers and start a detached process on each node
+ * that resumes them from their AXL state files after the job exits,
+ * the last of these to finish writes the summary file and updates
+ * the index, see --finish in scr_flush_file */
+int scr_flush_async_handoff(void)
+{
+  /* gather list of ranks on each node to the lowest rank on the node */
+  int node_rank, node_size;
+  MPI_Comm_rank(scr_comm_node, &node_rank);
+  MPI_Comm_size(scr_comm_node, &node_size);
+  int* ranks = NULL;
+  if (node_rank == 0) {
+    ranks = (int*) SCR_MALLOC(node_size * sizeof(int));
+  }
+  MPI_Gather(&scr_my_rank_world, 1, MPI_INT, ranks, 1, MPI_INT, 0, scr_comm_node);
+
+  /* number the nodes, each helper writes a marker with its node index
+   * so the last one can tell that all others are done */
+  int leader = (node_rank == 0);
+  int nodes = 0;
+  MPI_Allreduce(&leader, &nodes, 1, MPI_INT, MPI_SUM, scr_comm_world);
+  int node = 0;
+  MPI_Exscan(&leader, &node, 1, MPI_INT, MPI_SUM, scr_comm_world);
+  if (scr_my_rank_world == 0) {
+    node = 0;
+  }
+
+  /* helper removes this marker when it is done, we create it before we
+   * return so scr_postrun can't miss a helper that has not started yet */
+  char* running_file = NULL;
+  int can_start = 1;
+  if (leader) {
+    spath* running_path = spath_from_str(scr_prefix_scr);
+    spath_append_strf(running_path, "poststage.%d.running", node);
+    running_file = spath_strdup(running_path);
+    spath_delete(&running_path);
+
+    if (access(SCR_FLUSH_FINISH_CMD, X_OK) != 0) {
+      scr_err("Cannot execute poststage helper %s errno=%d %s @ %s:%d",
+        SCR_FLUSH_FINISH_CMD, errno, strerror(errno), __FILE__, __LINE__
+      );
+      can_start = 0;
+    } else {
+      int running_fd = scr_open(running_file, O_WRONLY | O_CREAT | O_TRUNC, scr_getmode(1, 1, 0));
+      if (running_fd >= 0) {
+        scr_close(running_file, running_fd);
+      } else {
+        scr_err("Failed to create poststage marker %s errno=%d %s @ %s:%d",
+          running_file, errno, strerror(errno), __FILE__, __LINE__
+        );
+        can_start = 0;
+      }
+    }
+  }
+
+  /* agree that every node can start its helper before we stop any
+   * transfer, if not, the transfers keep running for the caller to wait on */
+  if (! scr_alltrue(can_start, scr_comm_world)) {
+    if (running_file != NULL) {
+      unlink(running_file);
+    }
+    scr_free(&running_file);
+    scr_free(&ranks);
+    return SCR_FAILURE;
+  }
+
+  /* stop our transfers, their state files record what is left to copy */
+  if (scr_flush_async_stop() != SCR_SUCCESS) {
+    if (scr_my_rank_world == 0) {
+      scr_err("Failed to stop async flush for poststage @ %s:%d",
+        __FILE__, __LINE__
+      );
+    }
+    if (running_file != NULL) {
+      unlink(running_file);
+    }
+    scr_free(&running_file);
+    scr_free(&ranks);
+    return SCR_FAILURE;
+  }
+
+  int rc = SCR_SUCCESS;
+  pid_t helper = -1;
+  if (leader) {
+    /* build comma-separated list of ranks */
+    size_t ranks_len = (size_t) node_size * 12 + 1;
+    char* ranks_str = (char*) SCR_MALLOC(ranks_len);
+    size_t len = 0;
+    int i;
+    for (i = 0; i < node_size; i++) {
+      len += snprintf(ranks_str + len, ranks_len - len, "%s%d", (i > 0) ? "," : "", ranks[i]);
+    }
+
+    char node_str[32], nodes_str[32];
+    snprintf(node_str, sizeof(node_str), "%d", node);
+    snprintf(nodes_str, sizeof(nodes_str), "%d", nodes);
+
+    /* helper writes its output to a log file in the control directory of the prefix */
+    spath* log_path = spath_from_str(scr_prefix_scr);
+    spath_append_strf(log_path, "poststage.%d.log", node);
+    char* log_file = spath_strdup(log_path);
+    spath_delete(&log_path);
+
+    char* argv[] = {
+      SCR_FLUSH_FINISH_CMD, "--dir", scr_prefix, "--finish",
+      "--ranks", ranks_str, "--node", node_str, "--nodes", nodes_str, NULL
+    };
+
+    /* fork twice so the helper is not our child and is not
+     * killed with the session of the job step when we exit,
+     * the first child sends us the pid of the helper over a pipe
+     * so that we can stop it if another node fails to start its own */
+    int pipe_fds[2];
+    pid_t pid = -1;
+    if (pipe(pipe_fds) == 0) {
+      pid = fork();
+    }
+    if (pid == 0) {
+      setsid();
+      pid_t grandchild = fork();
+      if (grandchild != 0) {
+        ssize_t nwrite = write(pipe_fds[1], &grandchild, sizeof(grandchild));
+        _exit(nwrite == (ssize_t) sizeof(grandchild) ? 0 : 1);
+      }
+      close(pipe_fds[0]);
+      close(pipe_fds[1]);
+
+      int fd = open(log_file, O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR);
+      if (fd >= 0) {
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+      }
+      int null_fd = open("/dev/null", O_RDONLY);
+      if (null_fd >= 0) {
+        dup2(null_fd, STDIN_FILENO);
+        close(null_fd);
+      }
+
+      execv(SCR_FLUSH_FINISH_CMD, argv);
+      _exit(1);
+    } else if (pid < 0) {
+      scr_err("Failed to fork poststage helper errno=%d %s @ %s:%d",
+        errno, strerror(errno), __FILE__, __LINE__
+      );
+      rc = SCR_FAILURE;
+    } else {
+      close(pipe_fds[1]);
+      if (read(pipe_fds[0], &helper, sizeof(helper)) != (ssize_t) sizeof(helper) || helper < 0) {
+        scr_err("Failed to start poststage helper @ %s:%d",
+          __FILE__, __LINE__
+        );
+        helper = -1;
+        rc = SCR_FAILURE;
+      }
+      close(pipe_fds[0]);
+      waitpid(pid, NULL, 0);
+      if (rc == SCR_SUCCESS) {
+        scr_dbg(1, "Started poststage helper on %s for %d ranks, log in %s",
+          scr_my_hostname, node_size, log_file
+        );
+      }
+    }
+
+    scr_free(&log_file);
+    scr_free(&ranks_str);
+  }
+  scr_free(&ranks);
+
+  /* the transfers now belong to the helpers */
+  kvtree_delete(&scr_flush_async_list);
+  scr_flush_async_list = kvtree_new();
+
+  /* if any node failed to start its helper, stop the helpers that did
+   * start, so the caller can flush synchronously without a second writer */
+  if (! scr_alltrue(rc == SCR_SUCCESS, scr_comm_world)) {
+    if (helper > 0) {
+      kill(helper, SIGKILL);
+    }
+    if (running_file != NULL) {
+      unlink(running_file);
+    }
+    rc = SCR_FAILURE;
+  }
+
+  scr_free(&running_file);
+  return rc;
+}
+
 /* returns 1 if any async flush is ongoing, 0 otherwise */
 int scr_flush_async_in_progress(void)
 {
@@ -186,6 +503,114 @@ int scr_flush_async_in_list(int id)
   return (dset_hash != NULL);
 }
 
+/* cancel the flush of a dataset and delete what it has written to the
+ * prefix directory, the dataset stays in cache as if it was never flushed */
+int scr_flush_async_cancel(scr_cache_index* cindex, int id)
+{
+  kvtree* dset_hash = kvtree_get_kv_int(scr_flush_async_list, ASYNC_KEY_OUT_DSET, id);
+  if (dset_hash == NULL) {
+    return SCR_FAILURE;
+  }
+
+  /* get the dataset corresponding to this id */
+  scr_dataset* dataset = scr_dataset_new();
+  scr_cache_index_get_dataset(cindex, id, dataset);
+
+  /* lookup dataset name */
+  char* dset_name = NULL;
+  scr_dataset_get_name(dataset, &dset_name);
+
+  if (scr_my_rank_world == 0) {
+    scr_dbg(1, "Cancelling async flush of dataset %d `%s'", id, dset_name);
+  }
+
+  /* complete any test still in flight */
+  scr_flush_async_req_free(id);
+
+  /* stop the transfer, waiting on a cancelled transfer reports
+   * an error, which we expect here */
+  int rc = SCR_SUCCESS;
+  int axl_id;
+  if (kvtree_util_get_int(dset_hash, ASYNC_KEY_OUT_AXL, &axl_id) == KVTREE_SUCCESS) {
+    if (AXL_Cancel_comm(axl_id, scr_comm_world) != AXL_SUCCESS) {
+      scr_err("Failed to cancel AXL transfer handle %d @ %s:%d",
+        axl_id, __FILE__, __LINE__
+      );
+      rc = SCR_FAILURE;
+    }
+    AXL_Wait_comm(axl_id, scr_comm_world);
+    AXL_Free_comm(axl_id, scr_comm_world);
+  }
+
+  /* mark that we've stopped the flush */
+  scr_flush_file_location_unset(id, SCR_FLUSH_KEY_LOCATION_FLUSHING);
+
+  /* remove partial files and the incomplete index entry */
+  scr_prefix_delete(id, dset_name);
+
+  if (scr_my_rank_world == 0 && scr_log_enable) {
+    scr_log_event("ASYNC_FLUSH_CANCEL", "Superseded by newer checkpoint",
+                  &id, dset_name, NULL, NULL);
+  }
+
+  scr_dataset_delete(&dataset);
+
+  /* remove dset from async_list */
+  kvtree_unset_kv_int(scr_flush_async_list, ASYNC_KEY_OUT_DSET, id);
+
+  return rc;
+}
+
+/* After starting the flush of checkpoint id, cancel the flush of any older
+ * checkpoint that is not also output, since the newer checkpoint replaces
+ * it for restart, leaving its bandwidth to outputs and the new checkpoint.
+ * A flush that has cancelled another is never cancelled itself, so when
+ * checkpoints come faster than they can be flushed, every other one still
+ * reaches the file system. */
+static int scr_flush_async_supersede(scr_cache_index* cindex, int id)
+{
+  int num;
+  int* ids;
+  scr_flush_async_get_list(cindex, &num, &ids);
+
+  int cancelled = 0;
+  int i;
+  for (i = 0; i < num; i++) {
+    int old_id = ids[i];
+    if (old_id >= id) {
+      continue;
+    }
+
+    /* skip flushes that are protected because they superseded another */
+    kvtree* dset_hash = kvtree_get_kv_int(scr_flush_async_list, ASYNC_KEY_OUT_DSET, old_id);
+    int superseded = 0;
+    kvtree_util_get_int(dset_hash, ASYNC_KEY_OUT_SUPERSEDED, &superseded);
+    if (superseded) {
+      continue;
+    }
+
+    /* only cancel pure checkpoints, output must reach the file system */
+    scr_dataset* dataset = scr_dataset_new();
+    scr_cache_index_get_dataset(cindex, old_id, dataset);
+    int pure_ckpt = scr_dataset_is_ckpt(dataset) && ! scr_dataset_is_output(dataset);
+    scr_dataset_delete(&dataset);
+
+    if (pure_ckpt) {
+      scr_flush_async_cancel(cindex, old_id);
+      cancelled = 1;
+    }
+  }
+
+  scr_free(&ids);
+
+  if (cancelled) {
+    kvtree* dset_hash = kvtree_get_kv_int(scr_flush_async_list, ASYNC_KEY_OUT_DSET, id);
+    kvtree_util_set_int(dset_hash, ASYNC_KEY_OUT_SUPERSEDED, 1);
+  }
+
+  return SCR_SUCCESS;
+}
+
 /* start an asynchronous flush from cache to parallel file
  * system under SCR_PREFIX */
 int scr_flush_async_start(scr_cache_index* cindex, int id)
@@ -202,6 +627,14 @@ int scr_flush_async_start(scr_cache_index* cindex, int id)
   scr_dataset* dataset = scr_dataset_new();
   scr_cache_index_get_dataset(cindex, id, dataset);
 
+  /* segments of shared files are written into place by all processes
+   * together, which AXL can't do in the background, so flush now */
+  int segments = 0;
+  if (scr_dataset_get_segments(dataset, &segments) == SCR_SUCCESS && segments > 0) {
+    scr_dataset_delete(&dataset);
+    return scr_flush_sync(cindex, id);
+  }
+
   /* lookup dataset name */
   char* dset_name = NULL;
   scr_dataset_get_name(dataset, &dset_name);
@@ -270,6 +703,11 @@ int scr_flush_async_start(scr_cache_index* cindex, int id)
   /* attach file list for this transfer to outstanding list */
   kvtree_set(dset_hash, ASYNC_KEY_OUT_FILES, file_list);
 
+  /* nothing has been written yet */
+  unsigned long pending_bytes = 0;
+  scr_dataset_get_size(dataset, &pending_bytes);
+  kvtree_util_set_double(dset_hash, ASYNC_KEY_OUT_PENDING, (double) pending_bytes);
+
   /* create entry in index file to indicate that dataset may exist,
    * but is not yet complete */
   scr_flush_init_index(dataset);
@@ -331,6 +769,12 @@ int scr_flush_async_start(scr_cache_index* cindex, int id)
   const scr_storedesc* storedesc = scr_cache_get_storedesc(cindex, id);
   axl_xfer_t xfer_type = scr_xfer_str_to_axl_type(storedesc->xfer);
 
+  /* with poststage, a SYNC transfer would block here until all files
+   * are written, run it in threads instead so it can be handed off */
+  if (scr_flush_poststage && xfer_type == AXL_XFER_SYNC) {
+    xfer_type = AXL_XFER_PTHREAD;
+  }
+
   /* TODO: gather list of files to leader of store descriptor,
    * use communicator of leaders for AXL, then bcast result back */
 
@@ -381,6 +825,13 @@ int scr_flush_async_start(scr_cache_index* cindex, int id)
     );
   }
 
+  /* a new pure checkpoint replaces older ones that are still being flushed */
+  if (rc == SCR_SUCCESS && scr_flush_supersede &&
+      scr_dataset_is_ckpt(dataset) && ! scr_dataset_is_output(dataset))
+  {
+    scr_flush_async_supersede(cindex, id);
+  }
+
   /* free the dataset */
   scr_dataset_delete(&dataset);
 
@@ -389,17 +840,12 @@ int scr_flush_async_start(scr_cache_index* cindex, int id)
 
 /* check whether the flush from cache to parallel file system has completed,
  * this does not indicate whether the transfer was successful, only that it
- * can be completed with either success or error without waiting */
-int scr_flush_async_test(scr_cache_index* cindex, int id)
+ * can be completed with either success or error without waiting,
+ * sets bytes to the number of bytes left to write across all processes
+ * as of the previous test */
+int scr_flush_async_test(scr_cache_index* cindex, int id, double* bytes)
 {
-  /* make sure all processes make it this far before progressing */
-  MPI_Barrier(scr_comm_world);
-
-  /* start timer */
-  double time_start;
-  if (scr_my_rank_world == 0) {
-    time_start = MPI_Wtime();
-  }
+  *bytes = 0.0;
 
   /* if the transfer failed, indicate that transfer has completed */
   int status = SCR_FAILURE;
@@ -409,37 +855,69 @@ int scr_flush_async_test(scr_cache_index* cindex, int id)
     return SCR_SUCCESS;
   }
 
-  /* get the dataset corresponding to this id */
-  scr_dataset* dataset = scr_dataset_new();
-  scr_cache_index_get_dataset(cindex, id, dataset);
+  /* consume the result of the reduction posted by our previous test */
+  int rc = SCR_FAILURE;
+  scr_flush_async_req* r = scr_flush_async_req_get(id);
+  if (r->posted) {
+    MPI_Wait(&r->req, MPI_STATUS_IGNORE);
+    r->posted = 0;
+
+    kvtree_util_set_double(dset_hash, ASYNC_KEY_OUT_PENDING, r->global[1]);
+    if (r->global[0] == 0.0) {
+      /* every process has finished its transfer */
+      rc = SCR_SUCCESS;
+    }
+  }
 
-  /* lookup dataset name */
-  char* dset_name = NULL;
-  scr_dataset_get_name(dataset, &dset_name);
+  /* if not done, post a reduction with our current state for the next test */
+  if (rc != SCR_SUCCESS) {
+    int done = 0;
+    int axl_id;
+    if (kvtree_util_get_int(dset_hash, ASYNC_KEY_OUT_AXL, &axl_id) == KVTREE_SUCCESS &&
+        AXL_Test(axl_id) == AXL_SUCCESS)
+    {
+      done = 1;
+    }
 
-  if (scr_my_rank_world == 0) {
-    scr_dbg(1, "Testing async flush of dataset %d `%s'", id, dset_name);
-  }
+    /* stat'ing every destination file is costly on a parallel file
+     * system, so reuse our last estimate if it is recent enough */
+    if (! done) {
+      double now = MPI_Wtime();
+      if (r->pending_time < 0.0 || now - r->pending_time >= SCR_FLUSH_ASYNC_PENDING_SECS) {
+        kvtree* file_list = kvtree_get(dset_hash, ASYNC_KEY_OUT_FILES);
+        r->pending      = scr_flush_async_local_pending(file_list);
+        r->pending_time = now;
+      }
+    }
 
-  /* test whether transfer is done */
-  int rc = SCR_SUCCESS;
-  if (scr_axl_test(id, scr_comm_world) != SCR_SUCCESS) {
-    rc = SCR_FAILURE;
+    r->local[0] = done ? 0.0 : 1.0;
+    r->local[1] = done ? 0.0 : r->pending;
+    MPI_Iallreduce(r->local, r->global, 2, MPI_DOUBLE, MPI_SUM, scr_comm_world, &r->req);
+    r->posted = 1;
   }
 
-  /* stop timer and report cost */
+  kvtree_util_get_double(dset_hash, ASYNC_KEY_OUT_PENDING, bytes);
+
   if (scr_my_rank_world == 0) {
-    double time_end = MPI_Wtime();
-    double time_diff = time_end - time_start;
-    scr_dbg(1, "scr_flush_async_test: %f secs", time_diff);
+    scr_dbg(2, "Async flush of dataset %d %s, %e bytes pending",
+      id, (rc == SCR_SUCCESS) ? "done" : "in progress", *bytes
+    );
   }
 
-  /* free the dataset */
-  scr_dataset_delete(&dataset);
-
   return rc;
 }
 
+/* get the number of bytes left to write for the given dataset as of its
+ * last test, returns SCR_FAILURE if the dataset is not being flushed */
+int scr_flush_async_pending(int id, double* bytes)
+{
+  kvtree* dset_hash = kvtree_get_kv_int(scr_flush_async_list, ASYNC_KEY_OUT_DSET, id);
+  if (kvtree_util_get_double(dset_hash, ASYNC_KEY_OUT_PENDING, bytes) != KVTREE_SUCCESS) {
+    return SCR_FAILURE;
+  }
+  return SCR_SUCCESS;
+}
+
 /* complete the flush from cache to parallel file system */
 int scr_flush_async_complete(scr_cache_index* cindex, int id)
 {
@@ -461,6 +939,9 @@ int scr_flush_async_complete(scr_cache_index* cindex, int id)
   /* lookup record for thie dataset */
   kvtree* dset_hash = kvtree_get_kv_int(scr_flush_async_list, ASYNC_KEY_OUT_DSET, id);
 
+  /* complete any test still in flight */
+  scr_flush_async_req_free(id);
+
   /* wait for transfer to complete */
   if (scr_axl_wait(id, scr_comm_world) != SCR_SUCCESS) {
     kvtree_util_set_int(dset_hash, ASYNC_KEY_OUT_STATUS, SCR_FAILURE);
@@ -540,6 +1021,17 @@ int scr_flush_async_complete(scr_cache_index* cindex, int id)
       }
     }
 
+    /* record flush in our metrics */
+    if (status == SCR_SUCCESS) {
+      scr_metrics_add(SCR_METRIC_FLUSHES, 1.0);
+      scr_metrics_add(SCR_METRIC_FLUSH_BYTES, total_bytes);
+      scr_metrics_observe(SCR_METRIC_FLUSH_SECS, time_diff);
+      scr_metrics_flush_bw(total_bytes, time_diff);
+      scr_flush_record_bw(total_bytes, time_diff);
+    } else {
+      scr_metrics_add(SCR_METRIC_FLUSH_FAILURES, 1.0);
+    }
+
     /* log transfer stats */
     if (scr_log_enable) {
       unsigned long starttime;
@@ -584,15 +1076,9 @@ int scr_flush_async_wait(scr_cache_index* cindex, int id)
     /* delete the dataset object */
     scr_dataset_delete(&dataset);
 
-    while (scr_flush_file_is_flushing(id)) {
-      /* test whether the flush has completed, and if so complete the flush */
-      if (scr_flush_async_test(cindex, id) == SCR_SUCCESS) {
-        /* complete the flush */
-        scr_flush_async_complete(cindex, id);
-      } else {
-        /* otherwise, sleep to get out of the way */
-        usleep(10*1000*1000);
-      }
+    /* completing the flush waits on its transfer, so no need to poll it */
+    if (scr_flush_file_is_flushing(id)) {
+      scr_flush_async_complete(cindex, id);
     }
   }
   return SCR_SUCCESS;
@@ -623,8 +1109,7 @@ int scr_flush_async_waitall(scr_cache_index* cindex)
   return SCR_SUCCESS;
 }
 
-/* progress each dataset in turn until all are complete,
- * or we find the first that is still going */
+/* complete each dataset whose flush is done */
 int scr_flush_async_progall(scr_cache_index* cindex)
 {
   if (scr_flush_async_in_progress()) {
@@ -635,22 +1120,20 @@ int scr_flush_async_progall(scr_cache_index* cindex)
     int* ids;
     kvtree_list_int(dsets, &num, &ids);
 
-    /* iterate over each dataset and wait for it to complete */
+    /* iterate over each dataset and complete those that are done,
+     * every dataset in our list is being flushed, so we skip
+     * the check of the flush file, which would synchronize with rank 0,
+     * datasets may complete out of order, scr_flush_complete only moves
+     * the current checkpoint forward */
     int i;
     for (i = 0; i < num; i++) {
       int id = ids[i];
-      if (scr_flush_file_is_flushing(id)) {
-        /* test whether the flush has completed, and if so complete the flush */
-        if (scr_flush_async_test(cindex, id) == SCR_SUCCESS) {
-          /* complete the flush */
-          scr_flush_async_complete(cindex, id);
-        } else {
-          /* TODO: allow flushes to complete out of order */
-
-          /* flush is still going, so that we don't complete datasets
-           * out of order, break the loop and stop here */
-          break;
-        }
+
+      /* test whether the flush has completed, and if so complete the flush */
+      double bytes;
+      if (scr_flush_async_test(cindex, id, &bytes) == SCR_SUCCESS) {
+        /* complete the flush */
+        scr_flush_async_complete(cindex, id);
       }
     }
 
@@ -689,6 +1172,7 @@ int scr_flush_async_init()
 /* stop all ongoing asynchronous flush operations */
 int scr_flush_async_finalize()
 {
+  scr_flush_async_req_free_all();
   kvtree_delete(&scr_flush_async_list);
 
   return SCR_SUCCESS;
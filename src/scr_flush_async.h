@@ -17,6 +17,10 @@
 /* stop all ongoing asynchronous flush operations */
 int scr_flush_async_stop(void);
 
+/* stop all ongoing transfers and start a process on each node to
+ * finish them after the job exits */
+int scr_flush_async_handoff(void);
+
 /* returns 1 if any async flush is ongoing, 0 otherwise */
 int scr_flush_async_in_progress(void);
 
@@ -26,8 +30,15 @@ int scr_flush_async_in_list(int id);
 /* start an asynchronous flush from cache to parallel file system under SCR_PREFIX */
 int scr_flush_async_start(scr_cache_index* cindex, int id);
 
-/* check whether the flush from cache to parallel file system has completed */
-int scr_flush_async_test(scr_cache_index* cindex, int id);
+/* cancel the flush of a dataset and delete what it has written to the prefix directory */
+int scr_flush_async_cancel(scr_cache_index* cindex, int id);
+
+/* check whether the flush from cache to parallel file system has completed
+ * without blocking, and get the number of bytes left to write */
+int scr_flush_async_test(scr_cache_index* cindex, int id, double* bytes);
+
+/* get the number of bytes left to write for a dataset as of its last test */
+int scr_flush_async_pending(int id, double* bytes);
 
 /* complete the flush from cache to parallel file system */
 int scr_flush_async_complete(scr_cache_index* cindex, int id);
@@ -38,8 +49,7 @@ int scr_flush_async_wait(scr_cache_index* cindex, int id);
 /* wait until all datasets currently being flushed complete */
 int scr_flush_async_waitall(scr_cache_index* cindex);
 
-/* progress each dataset in turn until all are complete,
- * or we find the first that is still going */
+/* complete each dataset whose flush is done */
 int scr_flush_async_progall(scr_cache_index* cindex);
 
 /* get ordered list of ids being flushed,
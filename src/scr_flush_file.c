@@ -21,6 +21,7 @@
 #include "scr_cache_index.h"
 #include "scr_flush_sync.h"
 #include "scr_flush_nompi.h"
+#include "scr_index_api.h"
 
 #include "spath.h"
 #include "kvtree.h"
@@ -213,6 +214,242 @@ out:
   return rc;
 }
 
+/* parse a comma-separated list of ranks, caller frees ranks with scr_free,
+ * returns 1 on success, 0 otherwise */
+static int parse_ranks(const char* str, int* num, int** ranks)
+{
+  /* count entries so we can allocate our list */
+  int count = 1;
+  const char* p;
+  for (p = str; *p != '\0'; p++) {
+    if (*p == ',') {
+      count++;
+    }
+  }
+
+  int* list = (int*) SCR_MALLOC(count * sizeof(int));
+
+  int i = 0;
+  p = str;
+  while (i < count) {
+    char* end;
+    long rank = strtol(p, &end, 10);
+    if (end == p || rank < 0 || (*end != ',' && *end != '\0')) {
+      scr_err("%s: Invalid rank list '%s' @ %s:%d", PROG, str, __FILE__, __LINE__);
+      scr_free(&list);
+      return 0;
+    }
+    list[i++] = (int) rank;
+    p = end + 1;
+  }
+
+  *num   = count;
+  *ranks = list;
+  return 1;
+}
+
+/* create an empty file, returns 0 on success */
+static int touch_file(const char* file)
+{
+  mode_t mode_file = scr_getmode(1, 1, 0);
+  int fd = scr_open(file, O_WRONLY | O_CREAT | O_TRUNC, mode_file);
+  if (fd < 0) {
+    scr_err("%s: Failed to create %s errno=%d %s @ %s:%d",
+      PROG, file, errno, strerror(errno), __FILE__, __LINE__
+    );
+    return 1;
+  }
+  scr_close(file, fd);
+  return 0;
+}
+
+/* Mark a dataset that has been flushed as complete in the index file,
+ * and set it as current if it is a checkpoint, as scr_flush_complete
+ * does for flushes that finish within the job.  Returns 0 on success. */
+static int index_flushed_dataset(char* prefix, kvtree* flush_file, int dataset_id)
+{
+  kvtree* flush_key_dataset = kvtree_get_kv_int(flush_file, SCR_FLUSH_KEY_DATASET, dataset_id);
+  scr_dataset* dataset = kvtree_get(flush_key_dataset, SCR_FLUSH_KEY_DSETDESC);
+  char* name = NULL;
+  if (dataset == NULL || scr_dataset_get_name(dataset, &name) != SCR_SUCCESS) {
+    scr_err("%s: No dataset descriptor for dataset %d @ %s:%d", PROG, dataset_id, __FILE__, __LINE__);
+    return 1;
+  }
+
+  spath* prefix_path = spath_from_str(prefix);
+  kvtree* index = kvtree_new();
+  scr_index_read(prefix_path, index);
+
+  /* clear any existing entry for this dataset and mark it as complete */
+  scr_index_remove(index, name);
+  scr_index_set_dataset(index, dataset_id, name, dataset, 1);
+  scr_index_mark_flushed(index, dataset_id, name);
+  scr_index_clear_failed(index, dataset_id, name);
+  if (scr_dataset_is_ckpt(dataset)) {
+    /* a helper may finish an older checkpoint after a newer one */
+    scr_index_advance_current(index, name);
+  }
+
+  int rc = scr_index_write(prefix_path, index);
+
+  kvtree_delete(&index);
+  spath_delete(&prefix_path);
+
+  printf("%s: Dataset %d `%s' flushed and added to index\n", PROG, dataset_id, name);
+
+  return (rc == SCR_SUCCESS) ? 0 : 1;
+}
+
+/* Called from a helper process started by SCR_Finalize on each node when
+ * SCR_FLUSH_POSTSTAGE is set and the flush uses PTHREAD or SYNC transfers.
+ * For each dataset still being flushed, resume the transfers of the given
+ * ranks from their state files, then leave a marker in the dataset
+ * directory.  The helper that completes the set of markers writes the
+ * summary file, removes the dataset from the flush file, and adds the
+ * dataset to the index.  Returns 0 on success, 1 on error. */
+int finish_transfers(char* prefix, spath* flush_file_spath, int num_ranks, int* ranks, int node, int nodes)
+{
+  int rc = 0;
+
+  /* SCR_Finalize creates this marker before starting us, and scr_postrun
+   * waits until it is gone before scavenging */
+  spath* running_spath = spath_from_strf("%s/.scr/poststage.%d.running", prefix, node);
+  char* running_file = spath_strdup(running_spath);
+  spath_delete(&running_spath);
+  touch_file(running_file);
+
+  /* all helpers serialize updates to the flush and index files with this lock */
+  spath* lock_spath = spath_from_strf("%s/.scr/poststage.lock", prefix);
+  char* lock_file = spath_strdup(lock_spath);
+  spath_delete(&lock_spath);
+
+  /* get list of datasets that are being flushed */
+  kvtree* flush_file = kvtree_new();
+  kvtree_read_path(flush_file_spath, flush_file);
+  kvtree* dsets = kvtree_get(flush_file, SCR_FLUSH_KEY_DATASET);
+  int num_ids;
+  int* ids;
+  kvtree_list_int(dsets, &num_ids, &ids);
+
+  /* finish datasets in ascending order, so the most recent
+   * checkpoint is the last one to be marked as current */
+  int i;
+  for (i = 0; i < num_ids; i++) {
+    int id = ids[i];
+    kvtree* dset_hash = kvtree_get_kv_int(flush_file, SCR_FLUSH_KEY_DATASET, id);
+    kvtree* location = kvtree_get(dset_hash, SCR_FLUSH_KEY_LOCATION);
+    if (kvtree_get(location, SCR_FLUSH_KEY_LOCATION_FLUSHING) == NULL) {
+      continue;
+    }
+
+    /* copy the files of our ranks that have not yet been copied */
+    int failed = 0;
+    int j;
+    for (j = 0; j < num_ranks; j++) {
+      spath* state_file_spath = spath_from_strf("%s/.scr/scr.dataset.%d/rank_%d.state_file",
+          prefix, id, ranks[j]);
+      char* state_file = spath_strdup(state_file_spath);
+      spath_delete(&state_file_spath);
+
+      if (resume_transfer(state_file) != 0) {
+        scr_err("%s: Failed to resume transfer for rank %d of dataset %d @ %s:%d",
+          PROG, ranks[j], id, __FILE__, __LINE__
+        );
+        failed = 1;
+      }
+      scr_free(&state_file);
+    }
+    printf("%s: Node %d %s its transfers for dataset %d\n",
+      PROG, node, failed ? "failed" : "finished", id
+    );
+
+    /* record our result and see whether we are the last node to finish */
+    mode_t mode_file = scr_getmode(1, 1, 0);
+    int fd = scr_open_with_lock(lock_file, O_RDWR | O_CREAT, mode_file);
+    if (fd < 0) {
+      rc = 1;
+      continue;
+    }
+
+    spath* marker_spath = spath_from_strf("%s/.scr/scr.dataset.%d/node_%d.%s",
+        prefix, id, node, failed ? "failed" : "done");
+    char* marker = spath_strdup(marker_spath);
+    spath_delete(&marker_spath);
+    touch_file(marker);
+    scr_free(&marker);
+
+    int done = 0;
+    int reported = 0;
+    int n;
+    for (n = 0; n < nodes; n++) {
+      spath* done_spath = spath_from_strf("%s/.scr/scr.dataset.%d/node_%d.done", prefix, id, n);
+      spath* fail_spath = spath_from_strf("%s/.scr/scr.dataset.%d/node_%d.failed", prefix, id, n);
+      char* done_file = spath_strdup(done_spath);
+      char* fail_file = spath_strdup(fail_spath);
+      if (access(done_file, F_OK) == 0) {
+        done++;
+        reported++;
+      } else if (access(fail_file, F_OK) == 0) {
+        reported++;
+      }
+      scr_free(&fail_file);
+      scr_free(&done_file);
+      spath_delete(&fail_spath);
+      spath_delete(&done_spath);
+    }
+
+    if (reported == nodes) {
+      if (done == nodes) {
+        /* all files are on the file system, write the summary file,
+         * which also removes the dataset from the flush file */
+        kvtree* current = kvtree_new();
+        kvtree_read_path(flush_file_spath, current);
+        if (write_summary_file(prefix, current, id, flush_file_spath) != 0 ||
+            index_flushed_dataset(prefix, current, id) != 0)
+        {
+          rc = 1;
+        }
+        kvtree_delete(&current);
+      } else {
+        /* leave the dataset in the flush file for scr_postrun to scavenge */
+        scr_err("%s: Dataset %d failed to flush on %d of %d nodes @ %s:%d",
+          PROG, id, nodes - done, nodes, __FILE__, __LINE__
+        );
+        rc = 1;
+      }
+
+      /* clean up markers from all nodes */
+      for (n = 0; n < nodes; n++) {
+        spath* done_spath = spath_from_strf("%s/.scr/scr.dataset.%d/node_%d.done", prefix, id, n);
+        spath* fail_spath = spath_from_strf("%s/.scr/scr.dataset.%d/node_%d.failed", prefix, id, n);
+        char* done_file = spath_strdup(done_spath);
+        char* fail_file = spath_strdup(fail_spath);
+        unlink(done_file);
+        unlink(fail_file);
+        scr_free(&fail_file);
+        scr_free(&done_file);
+        spath_delete(&fail_spath);
+        spath_delete(&done_spath);
+      }
+    }
+
+    scr_close_with_unlock(lock_file, fd);
+
+    if (failed) {
+      rc = 1;
+    }
+  }
+
+  scr_free(&ids);
+  kvtree_delete(&flush_file);
+  scr_free(&lock_file);
+
+  unlink(running_file);
+  scr_free(&running_file);
+
+  return rc;
+}
+
 int print_usage()
 {
   printf("\n");
@@ -229,6 +466,8 @@ int print_usage()
   printf("  --name <id>        Print name of specified id\n");
   printf("  --resume -r        Resume/finalize a previous or ongoing transfer\n");
   printf("  --summary -S       Manually mark a transfer as complete and generate summary.scr\n");
+  printf("  --finish           Finish transfers handed off by SCR_Finalize for the ranks given\n");
+  printf("                     by --ranks <r1,r2,...> as node --node <n> of --nodes <count>\n");
   printf("\n");
   exit(1);
 }
@@ -246,6 +485,10 @@ struct arglist {
                    * when you've manually transferred the dataset files
                    * outside of SCR, and need to tell SCR that they're complete. */
   int resume;     /* Resume a previous or ongoing transfer */
+  int finish;     /* Finish transfers handed off at the end of a job */
+  char* ranks;    /* comma-separated list of ranks to finish */
+  int node;       /* index of node we are finishing transfers for */
+  int nodes;      /* number of nodes finishing transfers */
 };
 
 int process_args(int argc, char **argv, struct arglist* args)
@@ -266,6 +509,10 @@ int process_args(int argc, char **argv, struct arglist* args)
     {"help",        no_argument,       NULL, 'h'},
     {"summary",     no_argument,       NULL, 'S'},
     {"resume",      no_argument,       NULL, 'r'},
+    {"finish",      no_argument,       NULL, 'f'},
+    {"ranks",       required_argument, NULL, 'R'},
+    {"node",        required_argument, NULL, 'N'},
+    {"nodes",       required_argument, NULL, 'M'},
     {0, 0, 0, 0}
   };
 
@@ -280,6 +527,10 @@ int process_args(int argc, char **argv, struct arglist* args)
   args->name       = -1;
   args->summary    = 0;
   args->resume     = 0;
+  args->finish     = 0;
+  args->ranks      = NULL;
+  args->node       = 0;
+  args->nodes      = 1;
 
   /* loop through and process all options */
   int c;
@@ -346,6 +597,19 @@ int process_args(int argc, char **argv, struct arglist* args)
         args->summary = 1;
         ++opCount;
         break;
+      case 'f':
+        args->finish = 1;
+        ++opCount;
+        break;
+      case 'R':
+        args->ranks = optarg;
+        break;
+      case 'N':
+        args->node = atoi(optarg);
+        break;
+      case 'M':
+        args->nodes = atoi(optarg);
+        break;
       case 'h':
         /* print help message and exit */
         print_usage();
@@ -535,6 +799,23 @@ int main (int argc, char *argv[])
     goto cleanup;
   }
 
+  if (args.finish) {
+    int num_ranks;
+    int* ranks;
+    if (args.ranks == NULL || ! parse_ranks(args.ranks, &num_ranks, &ranks)) {
+      scr_err("--finish requires you to specify a list of ranks with '--ranks <r1,r2,...>'.");
+      goto cleanup;
+    }
+    if (args.nodes < 1 || args.node < 0 || args.node >= args.nodes) {
+      scr_err("--finish requires 0 <= --node < --nodes.");
+      scr_free(&ranks);
+      goto cleanup;
+    }
+    rc = finish_transfers(args.dir, file_path, num_ranks, ranks, args.node, args.nodes);
+    scr_free(&ranks);
+    goto cleanup;
+  }
+
   if (args.resume) {
      if (args.name == -1) {
       scr_err("-r requires you to specify dataset ID with '-s <id>'.");
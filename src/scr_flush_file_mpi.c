@@ -152,6 +152,23 @@ int scr_flush_file_location_unset(int id, const char* location)
   return SCR_SUCCESS;
 }
 
+/* returns path to the record that tracks a partial copy of dst_file
+ * during the flush of the specified dataset id, caller must free it,
+ * each rank records progress of its own files alongside the dataset
+ * metadata rather than in the flush file, which only rank 0 writes */
+char* scr_flush_file_progress(int id, const char* dst_file)
+{
+  spath* path = spath_from_str(scr_prefix_scr);
+  spath_append_strf(path, "scr.dataset.%d", id);
+  char* metadir = spath_strdup(path);
+  spath_delete(&path);
+
+  char* file = scr_flush_progress_file(metadir, dst_file);
+  scr_free(&metadir);
+
+  return file;
+}
+
 /* create an entry in the flush file for a dataset for scavenge,
  * including name, location, and flags */
 int scr_flush_file_new_entry(int id, const char* name, const scr_dataset* dataset, const char* location, int ckpt, int output)
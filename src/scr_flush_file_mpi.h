@@ -30,6 +30,10 @@ int scr_flush_file_location_test(int id, const char* location);
 /* removes a location for the specified dataset id from the flush file */
 int scr_flush_file_location_unset(int id, const char* location);
 
+/* returns path to the record that tracks a partial copy of dst_file
+ * during the flush of the specified dataset id, caller must free it */
+char* scr_flush_file_progress(int id, const char* dst_file);
+
 /* create an entry in the flush file for a dataset for scavenge,
  * including name, location, and flags */
 int scr_flush_file_new_entry(int id, const char* name, const scr_dataset* dataset, const char* location, int ckpt, int output);
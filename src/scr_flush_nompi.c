@@ -3,6 +3,16 @@
 #include "scr_globals.h"
 #include "scr_index_api.h"
 #include "scr_dataset.h"
+#include "scr_io.h"
+#include "scr_flush_nompi.h"
+#include "kvtree_util.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
 
 /* Remove a particular dataset from the flush file. */
 void scr_flush_file_dataset_remove_with_path(int id, const spath* flush_file)
@@ -89,3 +99,275 @@ int scr_flush_summary_file(
 
   return rc;
 }
+
+/* returns path to the record that tracks a partial copy of dst_file,
+ * kept in the progress subdirectory of the dataset metadata directory,
+ * caller must free the returned string */
+char* scr_flush_progress_file(const char* metadir, const char* dst_file)
+{
+  /* files from different directories may share a basename,
+   * so tag the record with a crc32 of the full destination path */
+  uLong crc = crc32(0L, Z_NULL, 0);
+  crc = crc32(crc, (const Bytef*) dst_file, (uInt) strlen(dst_file));
+
+  spath* dst_path = spath_from_str(dst_file);
+  spath_basename(dst_path);
+  char* name = spath_strdup(dst_path);
+  spath_delete(&dst_path);
+
+  spath* path = spath_from_str(metadir);
+  spath_append_str(path, "progress");
+  spath_append_strf(path, "%s.%08lx", name, (unsigned long) crc);
+  spath_reduce(path);
+  char* file = spath_strdup(path);
+  spath_delete(&path);
+
+  scr_free(&name);
+
+  return file;
+}
+
+/* record that the first offset bytes of the destination are on disk
+ * and that crc is the crc32 of those bytes */
+static int scr_flush_progress_write(const char* progress_file, unsigned long offset, uLong crc)
+{
+  kvtree* hash = kvtree_new();
+  kvtree_util_set_unsigned_long(hash, SCR_PROGRESS_KEY_OFFSET, offset);
+  kvtree_util_set_crc32(hash, SCR_PROGRESS_KEY_CRC, crc);
+  int rc = kvtree_write_file(progress_file, hash);
+  kvtree_delete(&hash);
+  return (rc == KVTREE_SUCCESS) ? SCR_SUCCESS : SCR_FAILURE;
+}
+
+/* determine the offset at which to resume copying src_file to dst_file,
+ * returns 0 unless progress_file records an offset that the destination
+ * already covers and whose crc32 matches the same bytes of the source,
+ * leaves src_fd positioned at the returned offset and sets crc to the
+ * crc32 of the source bytes before it */
+static unsigned long scr_flush_progress_offset(
+  const char* src_file,
+  int src_fd,
+  const char* dst_file,
+  const char* progress_file,
+  char* buf,
+  unsigned long buf_size,
+  uLong* crc)
+{
+  *crc = crc32(0L, Z_NULL, 0);
+
+  /* nothing to resume if we have no record */
+  if (access(progress_file, R_OK) < 0) {
+    return 0;
+  }
+
+  unsigned long offset = 0;
+  unsigned long rec_crc = 0;
+  kvtree* hash = kvtree_new();
+  if (kvtree_read_file(progress_file, hash) != KVTREE_SUCCESS ||
+      kvtree_util_get_unsigned_long(hash, SCR_PROGRESS_KEY_OFFSET, &offset) != KVTREE_SUCCESS ||
+      kvtree_util_get_crc32(hash, SCR_PROGRESS_KEY_CRC, &rec_crc) != KVTREE_SUCCESS)
+  {
+    offset = 0;
+  }
+  kvtree_delete(&hash);
+
+  /* the destination must hold at least the recorded bytes,
+   * and the source must not have shrunk since */
+  if (offset == 0 ||
+      scr_file_size(dst_file) < offset ||
+      scr_file_size(src_file) < offset)
+  {
+    return 0;
+  }
+
+  /* verify the recorded crc against the source, which is much cheaper
+   * to read from cache than to write the same bytes again */
+  unsigned long remaining = offset;
+  while (remaining > 0) {
+    size_t count = (remaining < buf_size) ? (size_t) remaining : (size_t) buf_size;
+    ssize_t nread = scr_read_attempt(src_file, src_fd, buf, count);
+    if (nread != (ssize_t) count) {
+      break;
+    }
+    *crc = crc32(*crc, (const Bytef*) buf, (uInt) nread);
+    remaining -= (unsigned long) nread;
+  }
+
+  if (remaining > 0 || *crc != (uLong) rec_crc) {
+    scr_dbg(1, "Ignoring stale progress record %s for %s @ %s:%d",
+      progress_file, dst_file, __FILE__, __LINE__
+    );
+    *crc = crc32(0L, Z_NULL, 0);
+    lseek(src_fd, 0, SEEK_SET);
+    return 0;
+  }
+
+  return offset;
+}
+
+/* copy src_file to dst_file, resuming after the offset recorded in
+ * progress_file if the recorded crc32 still matches the source,
+ * records progress every interval bytes (0 disables) and removes
+ * the record once the copy completes, computes crc32 of the full
+ * file if crc is not NULL */
+int scr_flush_copy_resume(
+  const char* src_file,
+  const char* dst_file,
+  const char* progress_file,
+  unsigned long buf_size,
+  unsigned long interval,
+  uLong* crc)
+{
+  /* fall back to a plain copy if we have nowhere to record progress */
+  if (progress_file == NULL) {
+    return scr_file_copy(src_file, dst_file, buf_size, crc);
+  }
+
+  int rc = SCR_SUCCESS;
+
+  /* open src_file for reading */
+  int src_fd = scr_open(src_file, O_RDONLY);
+  if (src_fd < 0) {
+    scr_err("Opening file to copy: scr_open(%s) errno=%d %s @ %s:%d",
+      src_file, errno, strerror(errno), __FILE__, __LINE__
+    );
+    return SCR_FAILURE;
+  }
+
+  /* open dst_file for writing, but keep any bytes we copied before */
+  mode_t mode_file = scr_getmode(1, 1, 0);
+  int dst_fd = scr_open(dst_file, O_WRONLY | O_CREAT, mode_file);
+  if (dst_fd < 0) {
+    scr_err("Opening file for writing: scr_open(%s) errno=%d %s @ %s:%d",
+      dst_file, errno, strerror(errno), __FILE__, __LINE__
+    );
+    scr_close(src_file, src_fd);
+    return SCR_FAILURE;
+  }
+
+  /* allocate buffer to read in file chunks */
+  char* buf = (char*) malloc(buf_size);
+  if (buf == NULL) {
+    scr_err("Allocating memory: malloc(%llu) errno=%d %s @ %s:%d",
+      buf_size, errno, strerror(errno), __FILE__, __LINE__
+    );
+    scr_close(dst_file, dst_fd);
+    scr_close(src_file, src_fd);
+    return SCR_FAILURE;
+  }
+
+  /* pick up where a previous copy left off, and drop anything
+   * it wrote after its last record */
+  uLong file_crc;
+  unsigned long offset = scr_flush_progress_offset(
+    src_file, src_fd, dst_file, progress_file, buf, buf_size, &file_crc
+  );
+  if (ftruncate(dst_fd, (off_t) offset) != 0 ||
+      lseek(dst_fd, (off_t) offset, SEEK_SET) != (off_t) offset)
+  {
+    scr_err("Failed to truncate %s to %lu bytes errno=%d %s @ %s:%d",
+      dst_file, offset, errno, strerror(errno), __FILE__, __LINE__
+    );
+    rc = SCR_FAILURE;
+  }
+  if (offset > 0) {
+    scr_dbg(1, "Resuming copy of %s at offset %lu", dst_file, offset);
+  }
+
+  /* reserve space for the rest of the file up front */
+  if (rc == SCR_SUCCESS &&
+      scr_file_preallocate(dst_file, dst_fd, scr_file_size(src_file)) != SCR_SUCCESS)
+  {
+    rc = SCR_FAILURE;
+  }
+
+  /* create the progress directory before we write our first record */
+  if (rc == SCR_SUCCESS && interval > 0) {
+    spath* progress_dir = spath_from_str(progress_file);
+    spath_dirname(progress_dir);
+    char* dir = spath_strdup(progress_dir);
+    spath_delete(&progress_dir);
+    scr_mkdir(dir, scr_getmode(1, 1, 1));
+    scr_free(&dir);
+  }
+
+  /* copy chunks, recording progress every interval bytes */
+  int wrote_record = 0;
+  unsigned long last_record = offset;
+  int copying = (rc == SCR_SUCCESS);
+  while (copying) {
+    /* attempt to read buf_size bytes from file */
+    ssize_t nread = scr_read_attempt(src_file, src_fd, buf, buf_size);
+
+    /* if we read some bytes, write them out */
+    if (nread > 0) {
+      file_crc = crc32(file_crc, (const Bytef*) buf, (uInt) nread);
+
+      ssize_t nwrite = scr_write_attempt(dst_file, dst_fd, buf, nread);
+      if (nwrite != nread) {
+        /* write had a problem, stop copying and return an error */
+        copying = 0;
+        rc = SCR_FAILURE;
+      } else {
+        offset += (unsigned long) nread;
+      }
+    }
+
+    /* assume a short read means we hit the end of the file */
+    if (nread < (ssize_t) buf_size) {
+      copying = 0;
+    }
+
+    /* check for a read error, stop copying and return an error */
+    if (nread < 0) {
+      copying = 0;
+      rc = SCR_FAILURE;
+    }
+
+    /* once the bytes are on disk, record how far we got */
+    if (copying && interval > 0 && offset - last_record >= interval) {
+      if (fsync(dst_fd) == 0 &&
+          scr_flush_progress_write(progress_file, offset, file_crc) == SCR_SUCCESS)
+      {
+        wrote_record = 1;
+        last_record  = offset;
+      }
+    }
+  }
+
+  /* free buffer */
+  scr_free(&buf);
+
+  /* close source and destination files */
+  if (scr_close(dst_file, dst_fd) != SCR_SUCCESS) {
+    rc = SCR_FAILURE;
+  }
+  if (scr_close(src_file, src_fd) != SCR_SUCCESS) {
+    rc = SCR_FAILURE;
+  }
+
+  if (rc == SCR_SUCCESS) {
+    /* the copy is complete, so the record is no longer needed */
+    scr_file_unlink(progress_file);
+
+    /* remove the progress directory once the last record is gone,
+     * this fails quietly while other files still have records */
+    if (interval > 0) {
+      spath* progress_dir = spath_from_str(progress_file);
+      spath_dirname(progress_dir);
+      char* dir = spath_strdup(progress_dir);
+      spath_delete(&progress_dir);
+      rmdir(dir);
+      scr_free(&dir);
+    }
+
+    if (crc != NULL) {
+      *crc = file_crc;
+    }
+  } else if (! wrote_record && last_record == 0) {
+    /* nothing worth resuming, so clean up like a plain copy */
+    unlink(dst_file);
+  }
+
+  return rc;
+}
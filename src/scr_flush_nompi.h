@@ -5,6 +5,8 @@
 #include "spath.h"
 #include "scr_dataset.h"
 
+#include <zlib.h>
+
 void scr_flush_file_dataset_remove_with_path(
   int id,
   const spath* flush_file
@@ -23,4 +25,26 @@ int scr_flush_summary_file(
   const char* summary_file
 );
 
+/* returns path to the record that tracks a partial copy of dst_file,
+ * kept in the progress subdirectory of the dataset metadata directory,
+ * caller must free the returned string */
+char* scr_flush_progress_file(
+  const char* metadir,
+  const char* dst_file
+);
+
+/* copy src_file to dst_file, resuming after the offset recorded in
+ * progress_file if the recorded crc32 still matches the source,
+ * records progress every interval bytes (0 disables) and removes
+ * the record once the copy completes, computes crc32 of the full
+ * file if crc is not NULL */
+int scr_flush_copy_resume(
+  const char* src_file,
+  const char* dst_file,
+  const char* progress_file,
+  unsigned long buf_size,
+  unsigned long interval,
+  uLong* crc
+);
+
 #endif
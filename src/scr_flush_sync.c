@@ -10,6 +10,7 @@
 */
 
 #include "scr_globals.h"
+#include "scr_flush_nompi.h"
 
 #include "spath.h"
 #include "kvtree.h"
@@ -23,6 +24,25 @@ Synchronous flush functions
 =========================================
 */
 
+/* returns 1 if file in file_list is a segment of a shared file,
+ * and fills in its offset in that file and its length */
+static int scr_flush_sync_segment(
+  const kvtree* file_list,
+  const char* file,
+  unsigned long* offset,
+  unsigned long* length)
+{
+  kvtree* file_hash = kvtree_get_kv(file_list, SCR_KEY_FILE, file);
+  scr_meta* meta = kvtree_get(file_hash, SCR_KEY_META);
+  if (scr_meta_get_segment(meta, offset) != SCR_SUCCESS) {
+    return 0;
+  }
+
+  *length = 0;
+  scr_meta_get_filesize(meta, length);
+  return 1;
+}
+
 /* flushes data for files specified in file_list (with flow control),
  * and records status of each file in data */
 static int scr_flush_sync_data(scr_cache_index* cindex, int id, kvtree* file_list)
@@ -93,7 +113,14 @@ static int scr_flush_sync_data(scr_cache_index* cindex, int id, kvtree* file_lis
     spath* rel = spath_relative(base, dest);
     char* relfile = spath_strdup(rel);
 
-    kvtree_set_kv(filelist, "FILE", relfile);
+    kvtree* file_hash = kvtree_set_kv(filelist, "FILE", relfile);
+
+    /* record where a segment goes in its shared file */
+    unsigned long offset, length;
+    if (scr_flush_sync_segment(file_list, src_filelist[i], &offset, &length)) {
+      kvtree_util_set_bytecount(file_hash, SCR_SUMMARY_6_KEY_OFFSET, offset);
+      kvtree_util_set_bytecount(file_hash, SCR_SUMMARY_6_KEY_LENGTH, length);
+    }
 
     scr_free(&relfile);
     spath_delete(&rel);
@@ -122,8 +149,94 @@ static int scr_flush_sync_data(scr_cache_index* cindex, int id, kvtree* file_lis
     /* TODO: gather list of files to leader of store descriptor,
      * use communicator of leaders for AXL, then bcast result back */
 
-    /* write files (via AXL) */
-    if (scr_axl(dset_name, state_file, numfiles, (const char**) src_filelist, (const char **) dst_filelist, xfer_type, scr_comm_world) != SCR_SUCCESS) {
+    /* the process holding the start of a shared file truncates it before
+     * anyone writes a segment into it, the allreduce in scr_alltrue
+     * ensures the truncate completes before the segments are written */
+    int segments = 0;
+    for (i = 0; i < numfiles; i++) {
+      unsigned long offset, length;
+      if (scr_flush_sync_segment(file_list, src_filelist[i], &offset, &length)) {
+        segments++;
+        if (offset == 0) {
+          mode_t mode_file = scr_getmode(1, 1, 0);
+          int fd = scr_open(dst_filelist[i], O_WRONLY | O_CREAT | O_TRUNC, mode_file);
+          if (fd < 0) {
+            scr_err("Opening file for writing: scr_open(%s) errno=%d %s @ %s:%d",
+              dst_filelist[i], errno, strerror(errno), __FILE__, __LINE__
+            );
+            success = 0;
+          } else {
+            scr_close(dst_filelist[i], fd);
+          }
+        }
+      }
+    }
+    scr_alltrue(segments == 0, scr_comm_world);
+
+    /* with progress records enabled, copy files ourselves for SYNC
+     * transfers so that an interrupted flush can resume, and for other
+     * types finish any file that an interrupted flush or scavenge left
+     * partially copied before handing the rest to AXL */
+    int resume_all = (scr_flush_resume_size > 0 && xfer_type == AXL_XFER_SYNC);
+    int axl_files = 0;
+    for (i = 0; i < numfiles; i++) {
+      /* copy segments into place in their shared file ourselves,
+       * since AXL only copies whole files */
+      unsigned long offset, length;
+      if (scr_flush_sync_segment(file_list, src_filelist[i], &offset, &length)) {
+        if (scr_file_copy_range(src_filelist[i], 0, dst_filelist[i], offset,
+              length, scr_file_buf_size) != SCR_SUCCESS)
+        {
+          scr_err("Failed to copy %s to offset %lu in %s @ %s:%d",
+            src_filelist[i], offset, dst_filelist[i], __FILE__, __LINE__
+          );
+          success = 0;
+        }
+        continue;
+      }
+
+      /* a file that bypassed cache is already in place,
+       * which happens when the dataset also has segments */
+      if (strcmp(src_filelist[i], dst_filelist[i]) == 0) {
+        if (access(src_filelist[i], R_OK) < 0) {
+          success = 0;
+        }
+        continue;
+      }
+
+      /* only look for a progress record when records are enabled */
+      char* progress = NULL;
+      int resume = 0;
+      if (scr_flush_resume_size > 0) {
+        progress = scr_flush_file_progress(id, dst_filelist[i]);
+        resume = (resume_all || access(progress, R_OK) == 0);
+      }
+      if (resume) {
+        if (scr_flush_copy_resume(src_filelist[i], dst_filelist[i], progress,
+              scr_file_buf_size, scr_flush_resume_size, NULL) != SCR_SUCCESS)
+        {
+          scr_err("Failed to copy %s to %s @ %s:%d",
+            src_filelist[i], dst_filelist[i], __FILE__, __LINE__
+          );
+          success = 0;
+        }
+      } else {
+        /* move this file to the front of the list for AXL */
+        char* src = src_filelist[axl_files];
+        char* dst = dst_filelist[axl_files];
+        src_filelist[axl_files] = src_filelist[i];
+        dst_filelist[axl_files] = dst_filelist[i];
+        src_filelist[i] = src;
+        dst_filelist[i] = dst;
+        axl_files++;
+      }
+      scr_free(&progress);
+    }
+
+    /* write remaining files (via AXL) */
+    if (! scr_alltrue(axl_files == 0, scr_comm_world) &&
+        scr_axl(dset_name, state_file, axl_files, (const char**) src_filelist, (const char **) dst_filelist, xfer_type, scr_comm_world) != SCR_SUCCESS)
+    {
       success = 0;
     }
   } else {
@@ -281,6 +394,17 @@ int scr_flush_sync(scr_cache_index* cindex, int id)
       }
     }
 
+    /* record flush in our metrics */
+    if (flushed == SCR_SUCCESS) {
+      scr_metrics_add(SCR_METRIC_FLUSHES, 1.0);
+      scr_metrics_add(SCR_METRIC_FLUSH_BYTES, total_bytes);
+      scr_metrics_observe(SCR_METRIC_FLUSH_SECS, time_diff);
+      scr_metrics_flush_bw(total_bytes, time_diff);
+      scr_flush_record_bw(total_bytes, time_diff);
+    } else {
+      scr_metrics_add(SCR_METRIC_FLUSH_FAILURES, 1.0);
+    }
+
     /* log transfer stats */
     if (scr_log_enable) {
       char* dir = NULL;
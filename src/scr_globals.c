@@ -100,6 +100,11 @@ char* scr_log_db_user     = NULL;                  /* mysql user name */
 char* scr_log_db_pass     = NULL;                  /* mysql password */
 char* scr_log_db_name     = NULL;                  /* mysql database name */
 
+int scr_metrics_enable     = SCR_METRICS_ENABLE;   /* whether to export metrics to a file */
+char* scr_metrics_file     = NULL;                 /* path of metrics file */
+char* scr_metrics_format   = NULL;                 /* format of metrics file: PROM or JSON */
+int scr_metrics_interval   = SCR_METRICS_INTERVAL; /* minimum secs between writes of metrics file */
+
 int scr_cache_size    = SCR_CACHE_SIZE;   /* set number of checkpoints to keep at one time */
 int scr_copy_type     = SCR_COPY_TYPE;    /* select which redundancy algorithm to use */
 char* scr_group       = NULL;             /* name of process group likely to fail */
@@ -114,12 +119,14 @@ int scr_axl_mkdir        = SCR_AXL_MKDIR;     /* whether to have AXL create dire
 
 int scr_halt_seconds     = SCR_HALT_SECONDS; /* secs remaining in allocation before job should be halted */
 int scr_halt_exit        = SCR_HALT_EXIT;    /* whether SCR will call exit if halt condition is detected */
+int scr_halt_predict     = SCR_HALT_PREDICT; /* whether to predict halt seconds from measured flush bandwidth */
 
 int   scr_purge            = 0;                    /* whether to delete all datasets from cache during SCR_Init */
 int   scr_distribute       = SCR_DISTRIBUTE;       /* whether to call scr_distribute_files during SCR_Init */
 int   scr_fetch            = SCR_FETCH;            /* whether to call scr_fetch_files during SCR_Init */
 int   scr_fetch_width      = SCR_FETCH_WIDTH;      /* specify number of processes to read files simultaneously */
 int   scr_fetch_bypass     = SCR_FETCH_BYPASS;     /* whether to use implied bypass mode on fetch */
+int   scr_fetch_lazy       = SCR_FETCH_LAZY;       /* whether to stage fetched files into cache after restart */
 char* scr_fetch_current    = NULL;                 /* name of checkpoint to start with during fetch */
 int   scr_flush            = SCR_FLUSH;            /* how many checkpoints between flushes */
 char* scr_flush_type       = NULL;                 /* AXL type to use when flushing data */
@@ -132,18 +139,26 @@ int    scr_flush_async             = SCR_FLUSH_ASYNC;         /* whether to use
 double scr_flush_async_bw          = SCR_FLUSH_ASYNC_BW;      /* bandwidth limit imposed during async flush */
 double scr_flush_async_percent     = SCR_FLUSH_ASYNC_PERCENT; /* runtime limit imposed during async flush */
 
-int scr_flush_poststage = SCR_FLUSH_POSTSTAGE; /* Use scr_poststage to finalize transfers */
+int scr_flush_poststage = SCR_FLUSH_POSTSTAGE; /* Finalize transfers after the job exits */
+int scr_flush_supersede = SCR_FLUSH_SUPERSEDE; /* whether a new checkpoint flush cancels an older one */
+unsigned long scr_flush_resume_size = SCR_FLUSH_RESUME_SIZE; /* bytes copied between flush progress records, 0 disables */
 
 int scr_prefix_size  = SCR_PREFIX_SIZE; /* max number of checkpoints to keep in prefix directory */
 int scr_prefix_purge = 0;               /* whether to delete all datasets listed in index file during SCR_Init */
 
+int scr_index_journal = SCR_INDEX_JOURNAL; /* max updates to append to index journal before compacting */
+
 int scr_crc_on_copy   = SCR_CRC_ON_COPY;   /* whether to enable crc32 checks during scr_swap_files() */
 int scr_crc_on_flush  = SCR_CRC_ON_FLUSH;  /* whether to enable crc32 checks during flush and fetch */
 int scr_crc_on_delete = SCR_CRC_ON_DELETE; /* whether to enable crc32 checks when deleting checkpoints */
 
+double scr_scrub_bw = SCR_SCRUB_BW; /* bytes/sec each process reads when scrubbing cache, 0 disables */
+
 int    scr_checkpoint_interval = SCR_CHECKPOINT_INTERVAL; /* times to call Need_checkpoint between checkpoints */
 int    scr_checkpoint_seconds  = SCR_CHECKPOINT_SECONDS;  /* min number of seconds between checkpoints */
 double scr_checkpoint_overhead = SCR_CHECKPOINT_OVERHEAD; /* max allowed overhead for checkpointing */
+int    scr_checkpoint_auto     = SCR_CHECKPOINT_AUTO;     /* whether to tune the checkpoint interval */
+double scr_checkpoint_mtbf     = SCR_CHECKPOINT_MTBF;     /* initial estimate of mean time between failures */
 int    scr_need_checkpoint_count = 0;   /* tracks the number of times Need_checkpoint has been called */
 double scr_time_checkpoint_total = 0.0; /* keeps a running total of the time spent to checkpoint */
 int    scr_time_checkpoint_count = 0;   /* keeps a running count of the number of checkpoints taken */
@@ -89,6 +89,7 @@
 #include "scr_param.h"
 #include "scr_env.h"
 #include "scr_index_api.h"
+#include "scr_interval.h"
 
 #include "scr_groupdesc.h"
 #include "scr_storedesc.h"
@@ -97,11 +98,13 @@
 #include "scr_flush_file_mpi.h"
 #include "scr_cache.h"
 #include "scr_cache_rebuild.h"
+#include "scr_cache_scrub.h"
 #include "scr_prefix.h"
 #include "scr_fetch.h"
 #include "scr_flush.h"
 #include "scr_flush_sync.h"
 #include "scr_flush_async.h"
+#include "scr_metrics.h"
 
 /*
 =========================================
@@ -154,6 +157,11 @@ extern char* scr_log_db_user;     /* mysql user name */
 extern char* scr_log_db_pass;     /* mysql password */
 extern char* scr_log_db_name;     /* mysql database name */
 
+extern int scr_metrics_enable;     /* whether to export metrics to a file */
+extern char* scr_metrics_file;     /* path of metrics file */
+extern char* scr_metrics_format;   /* format of metrics file: PROM or JSON */
+extern int scr_metrics_interval;   /* minimum secs between writes of metrics file */
+
 extern int scr_cache_size;    /* number of checkpoints to keep in cache at one time */
 extern int scr_copy_type;     /* select which redundancy algorithm to use */
 extern char* scr_group;       /* name of process group likely to fail */
@@ -167,6 +175,7 @@ extern int scr_copy_metadata;    /* whether file metadata should also be copied
 extern int scr_axl_mkdir;        /* whether to have AXL create directories for files during a flush */
 
 extern int scr_halt_seconds; /* secs remaining in allocation before job should be halted */
+extern int scr_halt_predict; /* whether to predict halt seconds from measured flush bandwidth */
 extern int scr_halt_exit;    /* whether SCR will call exit if halt condition is detected */
 
 extern int   scr_purge;            /* delete all datasets from cache on restart for debugging */
@@ -174,6 +183,7 @@ extern int   scr_distribute;       /* whether to call scr_distribute_files durin
 extern int   scr_fetch;            /* whether to call scr_fetch_files during SCR_Init */
 extern int   scr_fetch_width;      /* specify number of processes to read files simultaneously */
 extern int   scr_fetch_bypass;     /* whether to use implied bypass on fetch operations */
+extern int   scr_fetch_lazy;       /* whether to stage fetched files into cache after restart */
 extern char* scr_fetch_current;    /* specify name of checkpoint to start with in fetch_latest */
 extern int   scr_flush;            /* how many checkpoints between flushes */
 extern char* scr_flush_type;       /* AXL type to use when flushing datasets */
@@ -185,19 +195,27 @@ extern int   scr_drop_after_current; /* auto-drop datasets from index that come
 extern int scr_prefix_size;  /* max number of checkpoints to keep in prefix directory */
 extern int scr_prefix_purge; /* whether to delete all datasets listed in index file during SCR_Init */
 
+extern int scr_index_journal; /* max updates to append to index journal before compacting */
+
 extern int scr_flush_async;            /* whether to use asynchronous flush */
 extern double scr_flush_async_bw;      /* bandwidth limit imposed during async flush */
 extern double scr_flush_async_percent; /* runtime limit imposed during async flush */
 
-extern int scr_flush_poststage; /* whether to use scr_poststage.sh to finalize transfers */
+extern int scr_flush_poststage; /* whether to finalize transfers after the job exits */
+extern int scr_flush_supersede; /* whether a new checkpoint flush cancels an older one */
+extern unsigned long scr_flush_resume_size; /* bytes copied between flush progress records, 0 disables */
 
 extern int scr_crc_on_copy;   /* whether to enable crc32 checks during scr_swap_files() */
 extern int scr_crc_on_flush;  /* whether to enable crc32 checks during flush and fetch */
 extern int scr_crc_on_delete; /* whether to enable crc32 checks when deleting checkpoints */
 
+extern double scr_scrub_bw; /* bytes/sec each process reads when scrubbing cache, 0 disables */
+
 extern int    scr_checkpoint_interval;   /* times to call Need_checkpoint between checkpoints */
 extern int    scr_checkpoint_seconds;    /* min number of seconds between checkpoints */
 extern double scr_checkpoint_overhead;   /* max allowed overhead for checkpointing */
+extern int    scr_checkpoint_auto;       /* whether to tune the checkpoint interval */
+extern double scr_checkpoint_mtbf;       /* initial estimate of mean time between failures */
 extern int    scr_need_checkpoint_count; /* tracks the number of times Need_checkpoint has been called */
 extern double scr_time_checkpoint_total; /* keeps a running total of the time spent to checkpoint */
 extern int    scr_time_checkpoint_count; /* keeps a running count of the number of checkpoints taken */
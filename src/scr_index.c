@@ -49,8 +49,13 @@
 #include <getopt.h>
 
 #include <dirent.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/syscall.h>
 
-#include <regex.h>
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
 
 #define SCR_IO_KEY_DIR     ("DIR")
 #define SCR_IO_KEY_FILE    ("FILE")
@@ -67,6 +72,9 @@
 #error "globals.h accessed from tools"
 #endif
 
+/* max number of scan threads and rebuild processes to run at once, 0 for no limit */
+static int scr_index_jobs = 0;
+
 /* Hash format returned from scr_read_dir
  *
  * DIR
@@ -408,129 +416,232 @@ int scr_summary_write(const spath* prefix, const spath* dir, kvtree* hash)
   return rc;
 }
 
+/* describes a single rebuild command */
+struct rebuild_task {
+  kvtree* cmd_hash;         /* argv values for this command, keyed by index */
+  unsigned long bytes;      /* bytes of redundancy data in the set */
+  pid_t pid;                /* pid of child running this command */
+  double start;             /* time the command was started */
+};
+
+/* sort rebuild tasks by decreasing size */
+static int rebuild_task_cmp(const void* a, const void* b)
+{
+  const struct rebuild_task* ta = (const struct rebuild_task*) a;
+  const struct rebuild_task* tb = (const struct rebuild_task*) b;
+  if (ta->bytes > tb->bytes) {
+    return -1;
+  }
+  if (ta->bytes < tb->bytes) {
+    return 1;
+  }
+  return 0;
+}
+
 /* forks and execs processes to rebuild missing files and waits for them to complete,
+ * keeps at most scr_index_jobs processes running at once and starts the commands
+ * for the largest sets first so that they don't hold up the tail end of the build,
+ * sizes records the number of bytes in each set keyed by the command index in cmds,
  * returns SCR_FAILURE if any dataset failed to rebuild, SCR_SUCCESS otherwise */
-int scr_fork_rebuilds(const spath* dir, const char* build_cmd, kvtree* cmds)
+int scr_fork_rebuilds(const spath* dir, const char* build_cmd, kvtree* cmds, const kvtree* sizes)
 {
   int rc = SCR_SUCCESS;
 
   /* count the number of build commands */
   int builds = kvtree_size(cmds);
-
-  /* allocate space to hold the pid for each child */
-  pid_t* pids = NULL;
-  if (builds > 0) {
-    pids = (pid_t*) malloc(builds * sizeof(pid_t));
-    if (pids == NULL) {
-      scr_err("Failed to allocate space to record pids @ %s:%d",
-        __FILE__, __LINE__
-      );
-      return SCR_FAILURE;
-    }
+  if (builds == 0) {
+    return rc;
   }
 
-  /* allocate character string for chdir */
-  char* dir_str = spath_strdup(dir);
-
-  /* TODO: flow control the number of builds ongoing at a time */
+  /* allocate space to track each command */
+  struct rebuild_task* tasks = (struct rebuild_task*) malloc(builds * sizeof(struct rebuild_task));
+  if (tasks == NULL) {
+    scr_err("Failed to allocate space to record pids @ %s:%d",
+      __FILE__, __LINE__
+    );
+    return SCR_FAILURE;
+  }
 
-  /* step through and fork off each of our build commands */
-  int pid_count = 0;
+  /* record each command and the size of its set */
+  int count = 0;
   kvtree_elem* elem = NULL;
   for (elem = kvtree_elem_first(cmds);
        elem != NULL;
        elem = kvtree_elem_next(elem))
   {
-    /* get the hash of argv values for this command */
-    kvtree* cmd_hash = kvtree_elem_hash(elem);
+    char* key = kvtree_elem_key(elem);
+
+    struct rebuild_task* t = &tasks[count];
+    t->cmd_hash = kvtree_elem_hash(elem);
+    t->bytes    = 0;
+    t->pid      = -1;
+    t->start    = 0.0;
+    kvtree_util_get_bytecount(sizes, key, &t->bytes);
 
     /* sort the arguments by their index */
-    kvtree_sort_int(cmd_hash, KVTREE_SORT_ASCENDING);
-
-    /* print the command to screen, so the user knows what's happening */
-    int offset = 0;
-    char full_cmd[SCR_MAX_FILENAME];
-    kvtree_elem* arg_elem = NULL;
-    for (arg_elem = kvtree_elem_first(cmd_hash);
-         arg_elem != NULL;
-         arg_elem = kvtree_elem_next(arg_elem))
-    {
-      char* key = kvtree_elem_key(arg_elem);
-      char* arg_str = kvtree_elem_get_first_val(cmd_hash, key);
-      int remaining = sizeof(full_cmd) - offset;
-      if (remaining > 0) {
-        offset += snprintf(full_cmd + offset, remaining, "%s ", arg_str);
-      }
-    }
-    scr_dbg(0, "Rebuild command: %s\n", full_cmd);
+    kvtree_sort_int(t->cmd_hash, KVTREE_SORT_ASCENDING);
 
-    /* count the number of command line arguments */
-    int argc = kvtree_size(cmd_hash);
+    count++;
+  }
 
-    /* issue build command */
-    pids[pid_count] = fork();
-    if (pids[pid_count] == 0) {
-      /* this is the child, which will do the exec, build the argv array */
+  /* start the largest sets first */
+  qsort(tasks, count, sizeof(struct rebuild_task), rebuild_task_cmp);
 
-      /* allocate space for the argv array */
-      char** argv = (char**) malloc((argc + 1) * sizeof(char*));
-      if (argv == NULL) {
-        scr_err("Failed to allocate memory for build execv @ %s:%d",
-          __FILE__, __LINE__
-        );
-        exit(1);
-      }
+  /* limit the number of processes running at once */
+  int jobs = scr_index_jobs;
+  if (jobs <= 0 || jobs > count) {
+    jobs = count;
+  }
+
+  /* allocate character string for chdir */
+  char* dir_str = spath_strdup(dir);
 
-      /* fill in our argv values and null-terminate the array */
-      int index = 0;
+  /* track time spent on each set */
+  double time_start = scr_seconds();
+  double secs_min = 0.0;
+  double secs_max = 0.0;
+  double secs_sum = 0.0;
+  int finished = 0;
+
+  /* step through and fork off each of our build commands,
+   * waiting for a running command to finish when we hit our limit */
+  int next = 0;
+  int running = 0;
+  while (next < count || running > 0) {
+    while (next < count && running < jobs) {
+      struct rebuild_task* t = &tasks[next];
+      kvtree* cmd_hash = t->cmd_hash;
+      next++;
+
+      /* print the command to screen, so the user knows what's happening */
+      int offset = 0;
+      char full_cmd[SCR_MAX_FILENAME];
+      full_cmd[0] = '\0';
       kvtree_elem* arg_elem = NULL;
       for (arg_elem = kvtree_elem_first(cmd_hash);
            arg_elem != NULL;
            arg_elem = kvtree_elem_next(arg_elem))
       {
         char* key = kvtree_elem_key(arg_elem);
-        argv[index] = kvtree_elem_get_first_val(cmd_hash, key);
-        index++;
+        char* arg_str = kvtree_elem_get_first_val(cmd_hash, key);
+        int remaining = sizeof(full_cmd) - offset;
+        if (remaining > 0) {
+          offset += snprintf(full_cmd + offset, remaining, "%s ", arg_str);
+        }
       }
-      argv[index] = NULL;
+      scr_dbg(0, "Rebuild command: %s\n", full_cmd);
+
+      /* count the number of command line arguments */
+      int argc = kvtree_size(cmd_hash);
+
+      /* issue build command */
+      t->start = scr_seconds();
+      t->pid = fork();
+      if (t->pid == 0) {
+        /* this is the child, which will do the exec, build the argv array */
+
+        /* allocate space for the argv array */
+        char** argv = (char**) malloc((argc + 1) * sizeof(char*));
+        if (argv == NULL) {
+          scr_err("Failed to allocate memory for build execv @ %s:%d",
+            __FILE__, __LINE__
+          );
+          exit(1);
+        }
+
+        /* fill in our argv values and null-terminate the array */
+        int index = 0;
+        kvtree_elem* arg_elem = NULL;
+        for (arg_elem = kvtree_elem_first(cmd_hash);
+             arg_elem != NULL;
+             arg_elem = kvtree_elem_next(arg_elem))
+        {
+          char* key = kvtree_elem_key(arg_elem);
+          argv[index] = kvtree_elem_get_first_val(cmd_hash, key);
+          index++;
+        }
+        argv[index] = NULL;
+
+        /* cd to current working directory */
+        if (chdir(dir_str) != 0) {
+          scr_err("Failed to change to directory %s @ %s:%d",
+            dir_str, __FILE__, __LINE__
+          );
+          exit(1);
+        }
+
+        /* execv the build command */
+        execv(build_cmd, argv);
 
-      /* cd to current working directory */
-      if (chdir(dir_str) != 0) {
-        scr_err("Failed to change to directory %s @ %s:%d",
-          dir_str, __FILE__, __LINE__
+        /* we only get here if the exec failed */
+        scr_err("Failed to exec %s errno=%d %s @ %s:%d",
+          build_cmd, errno, strerror(errno), __FILE__, __LINE__
         );
         exit(1);
+      } else if (t->pid < 0) {
+        scr_err("Failed to fork rebuild process errno=%d %s @ %s:%d",
+          errno, strerror(errno), __FILE__, __LINE__
+        );
+        rc = SCR_FAILURE;
+        continue;
       }
+      running++;
+    }
 
-      /* execv the build command */
-      execv(build_cmd, argv);
+    /* nothing left to wait on if all forks failed */
+    if (running == 0) {
+      break;
     }
-    pid_count++;
-  }
 
-  /* wait for for each child to finish */
-  while (pid_count > 0) {
+    /* wait for a child to finish */
     int stat = 0;
-    int ret = wait(&stat);
-    if (ret == -1 || ret == (pid_t)-1) {
+    pid_t ret = wait(&stat);
+    if (ret == (pid_t)-1) {
       scr_err("Got a -1 from wait @ %s:%d",
         __FILE__, __LINE__
       );
       rc = SCR_FAILURE;
+      break;
     } else if (stat != 0) {
       scr_err("Child returned with non-zero @ %s:%d",
         __FILE__, __LINE__
       );
       rc = SCR_FAILURE;
     }
-    pid_count--;
+    running--;
+
+    /* record time spent on this set */
+    int i;
+    for (i = 0; i < next; i++) {
+      if (tasks[i].pid == ret) {
+        double secs = scr_seconds() - tasks[i].start;
+        if (finished == 0 || secs < secs_min) {
+          secs_min = secs;
+        }
+        if (finished == 0 || secs > secs_max) {
+          secs_max = secs;
+        }
+        secs_sum += secs;
+        finished++;
+        tasks[i].pid = -1;
+        break;
+      }
+    }
+  }
+
+  /* report time to rebuild all sets */
+  double time_end = scr_seconds();
+  if (finished > 0) {
+    scr_dbg(0, "Rebuilt %d sets using %d processes in %f secs, per set min %f avg %f max %f secs",
+      finished, jobs, time_end - time_start, secs_min, secs_sum / (double) finished, secs_max
+    );
   }
 
   /* free the directory string */
   scr_free(&dir_str);
 
-  /* free the pid array */
-  scr_free(&pids);
+  /* free the task array */
+  scr_free(&tasks);
 
   return rc;
 }
@@ -551,6 +662,9 @@ static int scr_rebuild_redset(
   /* at least one rank is missing files, attempt to rebuild them */
   int build_command_count = 0;
 
+  /* records bytes of redundancy data for each build command */
+  kvtree* sizes_hash = kvtree_new();
+
   /* step through each of our redundancy sets */
   kvtree_elem* elem = NULL;
   kvtree* type_hash = kvtree_get(dset_hash, type_key);
@@ -626,14 +740,28 @@ static int scr_rebuild_redset(
       argc++;
 
       /* write each of the existing redundancy file names, skipping the missing member */
+      unsigned long bytes = 0;
       for (member = 1; member <= members; member++) {
         kvtree* member_hash = kvtree_get_kv_int(set_hash, SCR_SCAN_KEY_MEMBER, member);
         if (member_hash != NULL) {
           char* filename = kvtree_elem_get_first_val(member_hash, SCR_SUMMARY_6_KEY_FILE);
           kvtree_setf(buildcmd_hash, NULL, "%d %s", argc, filename);
           argc++;
+
+          /* add size of redundancy file to estimate work for this set */
+          spath* path_file = spath_dup(dir);
+          spath_append_str(path_file, filename);
+          char* file = spath_strdup(path_file);
+          bytes += scr_file_size(file);
+          scr_free(&file);
+          spath_delete(&path_file);
         }
       }
+
+      /* record size of this set so larger sets can be rebuilt first */
+      char build_str[32];
+      snprintf(build_str, sizeof(build_str), "%d", build_command_count - 1);
+      kvtree_util_set_bytecount(sizes_hash, build_str, bytes);
     }
   }
 
@@ -649,7 +777,7 @@ static int scr_rebuild_redset(
   } else {
     /* we have a shot to rebuild everything, let's give it a go */
     kvtree* builds_hash = kvtree_get(dset_hash, SCR_SCAN_KEY_BUILD);
-    if (scr_fork_rebuilds(dir, rebuild_cmd, builds_hash) != SCR_SUCCESS) {
+    if (scr_fork_rebuilds(dir, rebuild_cmd, builds_hash, sizes_hash) != SCR_SUCCESS) {
       scr_err("At least one rebuild failed for dataset %d in %s @ %s:%d",
         dset_id, dir_str, __FILE__, __LINE__
       );
@@ -658,6 +786,8 @@ static int scr_rebuild_redset(
   }
   scr_free(&dir_str);
 
+  kvtree_delete(&sizes_hash);
+
   return rc;
 }
 
@@ -1147,9 +1277,21 @@ int scr_scan_filemap(const spath* path_prefix, const spath* path_filemap, int ds
       continue;
     }
 
-    /* check that the file size matches */
+    /* check that the file size matches, a segment only covers part
+     * of its shared file, so check that the file extends past its end */
     unsigned long size = scr_file_size(full_filename);
-    if (meta_filesize != size) {
+    unsigned long offset = 0;
+    int segment = (scr_meta_get_segment(meta, &offset) == SCR_SUCCESS);
+    if (segment && size < offset + meta_filesize) {
+      scr_err("File is %lu bytes but segment ends at %lu bytes: %s @ %s:%d",
+        size, offset + meta_filesize, full_filename, __FILE__, __LINE__
+      );
+      scr_meta_delete(&meta);
+      scr_free(&relative_filename);
+      scr_free(&full_filename);
+      continue;
+    }
+    if (! segment && meta_filesize != size) {
       scr_err("File is %lu bytes but expected to be %lu bytes: %s @ %s:%d",
         size, meta_filesize, full_filename, __FILE__, __LINE__
       );
@@ -1181,14 +1323,22 @@ int scr_scan_filemap(const spath* path_prefix, const spath* path_filemap, int ds
      *       RANK
      *         <rank>
      *           FILE
-     *             <filename_relative_to_prefix> */
+     *             <filename_relative_to_prefix>
+     *               OFFSET
+     *                 <offset_of_segment>
+     *               LENGTH
+     *                 <length_of_segment> */
     /* TODODSET: rank2file_hash may not exist yet */
     kvtree* list_hash = kvtree_set_kv_int(scan, SCR_SCAN_KEY_DLIST, dset_id);
     //kvtree_setf(list_hash, NULL, "%s %s %s", SCR_SCAN_KEY_MAP, cache_file_name, full_filename);
     kvtree* rank2file_hash = kvtree_get(list_hash, SCR_SUMMARY_6_KEY_RANK2FILE);
     kvtree_set_kv_int(rank2file_hash, SCR_SUMMARY_6_KEY_RANKS, meta_ranks);
     kvtree* rank_hash = kvtree_set_kv_int(rank2file_hash, SCR_SUMMARY_6_KEY_RANK, rank_id);
-    kvtree_set_kv(rank_hash, SCR_SUMMARY_6_KEY_FILE, relative_filename);
+    kvtree* file_hash = kvtree_set_kv(rank_hash, SCR_SUMMARY_6_KEY_FILE, relative_filename);
+    if (segment) {
+      kvtree_util_set_bytecount(file_hash, SCR_SUMMARY_6_KEY_OFFSET, offset);
+      kvtree_util_set_bytecount(file_hash, SCR_SUMMARY_6_KEY_LENGTH, meta_filesize);
+    }
 
     uLong meta_crc;
     if (scr_meta_get_crc32(meta, &meta_crc) == SCR_SUCCESS) {
@@ -1251,290 +1401,267 @@ int scr_scan_redset(
   return rc;
 }
 
-/* returns 1 if name matches "filemap_<rank>" regex and extracts rank value,
- * returns 0 if no match */
-int match_filemap(const char* name, const regex_t* re, int* rank)
+/* kinds of file names found in a dataset directory */
+#define SCAN_NAME_NONE    (0) /* not a file we track */
+#define SCAN_NAME_FILEMAP (1) /* filemap_<rank> */
+#define SCAN_NAME_REDSET  (2) /* redundancy file */
+
+/* parses a non-negative decimal integer at *str and advances past it,
+ * returns 1 on success and 0 if there is no integer */
+static int scan_name_int(const char** str, int* val)
 {
-  /* assume we don't match */
-  int rc = 0;
+  const char* p = *str;
+  if (*p < '0' || *p > '9') {
+    return 0;
+  }
 
-  /* check whether the regex matches */
-  size_t nmatch = 2;
-  regmatch_t pmatch[nmatch];
-  if (regexec(re, name, nmatch, pmatch, 0) == 0) {
-    /* made a match, now extract the rank value */
-    char* value = strndup(name + pmatch[1].rm_so, (size_t)(pmatch[1].rm_eo - pmatch[1].rm_so));
-    if (value != NULL) {
-      /* got the rank as a string */
-      rc = 1;
-      *rank = atoi(value);
-      scr_free(&value);
+  long value = 0;
+  while (*p >= '0' && *p <= '9') {
+    value = value * 10 + (*p - '0');
+    if (value > INT_MAX) {
+      return 0;
     }
+    p++;
   }
 
-  return rc;
+  *val = (int) value;
+  *str = p;
+  return 1;
 }
 
-/* returns 1 if name matches partner regex and extracts rank and partner rank,
- * returns 0 if no match */
-int match_partner(
-  const char* name,
-  const regex_t* re,
-  int* rank,
-  int* group_id,
-  int* group_num,
-  int* group_rank,
-  int* group_size)
+/* checks for literal string lit at *str and advances past it,
+ * returns 1 on match and 0 otherwise */
+static int scan_name_lit(const char** str, const char* lit)
 {
-  /* assume we don't match */
-  int rc = 0;
-
-  /* if the file is an partner file, read in the partner parameters */
-  size_t nmatch = 6;
-  regmatch_t pmatch[nmatch];
-  if (regexec(re, name, nmatch, pmatch, 0) == 0) {
-    /* got a match */
-    rc = 1;
-
-    /* intialize output variables */
-    *rank       = -1;
-    *group_id   = -1;
-    *group_num  = -1;
-    *group_rank = -1;
-    *group_size = -1;
-
-    /* get our global rank */
-    char* value = strndup(name + pmatch[1].rm_so, (size_t)(pmatch[1].rm_eo - pmatch[1].rm_so));
-    if (value != NULL) {
-      *rank = atoi(value);
-      scr_free(&value);
-    }
-
-    /* get our group_id */
-    value = strndup(name + pmatch[2].rm_so, (size_t)(pmatch[2].rm_eo - pmatch[2].rm_so));
-    if (value != NULL) {
-      *group_id = atoi(value);
-      scr_free(&value);
-    }
-
-    /* get the number of groups */
-    value = strndup(name + pmatch[3].rm_so, (size_t)(pmatch[3].rm_eo - pmatch[3].rm_so));
-    if (value != NULL) {
-      *group_num = atoi(value);
-      scr_free(&value);
-    }
-
-    /* get the rank */
-    value = strndup(name + pmatch[4].rm_so, (size_t)(pmatch[4].rm_eo - pmatch[4].rm_so));
-    if (value != NULL) {
-      *group_rank = atoi(value);
-      scr_free(&value);
-    }
-
-    /* get the rank of our right partner */
-    value = strndup(name + pmatch[5].rm_so, (size_t)(pmatch[5].rm_eo - pmatch[5].rm_so));
-    if (value != NULL) {
-      *group_size = atoi(value);
-      scr_free(&value);
-    }
+  size_t len = strlen(lit);
+  if (strncmp(*str, lit, len) != 0) {
+    return 0;
   }
-
-  return rc;
+  *str += len;
+  return 1;
 }
 
-/* returns 1 if name matches XOR regex and extracts rank, group, group size, and group rank,
- w returns 0 if no match */
-int match_xor(
+/* classifies a file name from a dataset directory in a single pass, names are one of:
+ *   filemap_<rank>
+ *   reddesc.er.<rank>.<type>.grp_<id>_of_<num>.mem_<rank>_of_<size>.redset
+ *   reddescmap.er.<rank>.<type>.grp_<id>_of_<num>.mem_<rank>_of_<size>.redset
+ * where type is partner, xor, or rs, sets keyname to the scan key for redundancy
+ * files, and returns one of the SCAN_NAME values */
+static int scan_name_classify(
   const char* name,
-  const regex_t* re,
+  const char** keyname,
   int* rank,
   int* group_id,
   int* group_num,
   int* group_rank,
   int* group_size)
 {
-  /* assume we don't match */
-  int rc = 0;
-
-  /* if the file is an XOR file, read in the XOR set parameters */
-  size_t nmatch = 6;
-  regmatch_t pmatch[nmatch];
-  if (regexec(re, name, nmatch, pmatch, 0) == 0) {
-    /* got a match */
-    rc = 1;
-
-    /* intialize output variables */
-    *rank       = -1;
-    *group_id   = -1;
-    *group_num  = -1;
-    *group_rank = -1;
-    *group_size = -1;
+  const char* p = name;
 
-    /* get the rank of the xor set */
-    char* value = strndup(name + pmatch[1].rm_so, (size_t)(pmatch[1].rm_eo - pmatch[1].rm_so));
-    if (value != NULL) {
-      *rank = atoi(value);
-      scr_free(&value);
+  /* look for file names like: "filemap_0" */
+  if (scan_name_lit(&p, "filemap_")) {
+    if (scan_name_int(&p, rank) && *p == '\0') {
+      return SCAN_NAME_FILEMAP;
     }
+    return SCAN_NAME_NONE;
+  }
 
-    /* get the id of the xor set */
-    value = strndup(name + pmatch[2].rm_so, (size_t)(pmatch[2].rm_eo - pmatch[2].rm_so));
-    if (value != NULL) {
-      *group_id = atoi(value);
-      scr_free(&value);
-    }
+  /* otherwise all names we care about start with reddesc or reddescmap */
+  if (! scan_name_lit(&p, "reddesc")) {
+    return SCAN_NAME_NONE;
+  }
+  int map = scan_name_lit(&p, "map");
 
-    /* get the number of xor sets */
-    value = strndup(name + pmatch[3].rm_so, (size_t)(pmatch[3].rm_eo - pmatch[3].rm_so));
-    if (value != NULL) {
-      *group_num = atoi(value);
-      scr_free(&value);
-    }
+  if (! scan_name_lit(&p, ".er.") || ! scan_name_int(&p, rank) || ! scan_name_lit(&p, ".")) {
+    return SCAN_NAME_NONE;
+  }
 
-    /* get the rank in the xor set */
-    value = strndup(name + pmatch[4].rm_so, (size_t)(pmatch[4].rm_eo - pmatch[4].rm_so));
-    if (value != NULL) {
-      *group_rank = atoi(value);
-      scr_free(&value);
-    }
+  /* identify the redundancy scheme */
+  if (scan_name_lit(&p, "partner")) {
+    *keyname = map ? SCR_SCAN_KEY_MAPPARTNER : SCR_SCAN_KEY_PARTNER;
+  } else if (scan_name_lit(&p, "xor")) {
+    *keyname = map ? SCR_SCAN_KEY_MAPXOR : SCR_SCAN_KEY_XOR;
+  } else if (scan_name_lit(&p, "rs")) {
+    *keyname = map ? SCR_SCAN_KEY_MAPRS : SCR_SCAN_KEY_RS;
+  } else {
+    return SCAN_NAME_NONE;
+  }
 
-    /* get the size of the xor set */
-    value = strndup(name + pmatch[5].rm_so, (size_t)(pmatch[5].rm_eo - pmatch[5].rm_so));
-    if (value != NULL) {
-      *group_size = atoi(value);
-      scr_free(&value);
-    }
+  /* extract group info */
+  if (scan_name_lit(&p, ".grp_")  && scan_name_int(&p, group_id) &&
+      scan_name_lit(&p, "_of_")   && scan_name_int(&p, group_num) &&
+      scan_name_lit(&p, ".mem_")  && scan_name_int(&p, group_rank) &&
+      scan_name_lit(&p, "_of_")   && scan_name_int(&p, group_size) &&
+      strcmp(p, ".redset") == 0)
+  {
+    return SCAN_NAME_REDSET;
   }
 
-  return rc;
+  return SCAN_NAME_NONE;
 }
 
-/* returns 1 if name matches XOR regex and extracts rank, group, group size, and group rank,
- * returns 0 if no match */
-int match_rs(
-  const char* name,
-  const regex_t* re,
-  int* rank,
-  int* group_id,
-  int* group_num,
-  int* group_rank,
-  int* group_size)
-{
-  /* assume we don't match */
-  int rc = 0;
-
-  /* if the file is an RS file, read in the RS set parameters */
-  size_t nmatch = 6;
-  regmatch_t pmatch[nmatch];
-  if (regexec(re, name, nmatch, pmatch, 0) == 0) {
-    /* got a match */
-    rc = 1;
+/* list of filemap files found in a dataset directory,
+ * which are split among scan threads to be read */
+struct scan_filemaps {
+  const spath* prefix; /* prefix directory */
+  const spath* dir;    /* dataset metadata directory */
+  int dset_id;         /* dataset id */
+  char** names;        /* name of each filemap file */
+  int* ranks;          /* rank of each filemap file */
+  int count;           /* number of filemaps in list */
+  int max;             /* allocated length of names and ranks */
+  int next;            /* index of next filemap to be read */
+#ifdef HAVE_PTHREADS
+  pthread_mutex_t lock; /* protects next */
+#endif
+};
 
-    /* intialize output variables */
-    *rank       = -1;
-    *group_id   = -1;
-    *group_num  = -1;
-    *group_rank = -1;
-    *group_size = -1;
+/* state for a single scan thread, each thread records its results
+ * in its own scan hash, which are merged after all threads finish */
+struct scan_worker {
+  struct scan_filemaps* list; /* list of filemaps to be read */
+  kvtree* scan;               /* scan hash to record results */
+  int ranks;                  /* tracks number of ranks across filemaps */
+  int rc;                     /* SCR_SUCCESS unless some filemap failed */
+};
 
-    /* get the rank of the xor set */
-    char* value = strndup(name + pmatch[1].rm_so, (size_t)(pmatch[1].rm_eo - pmatch[1].rm_so));
-    if (value != NULL) {
-      *rank = atoi(value);
-      scr_free(&value);
-    }
+/* records a name found while reading a dataset directory,
+ * filemaps are added to the list to be read later,
+ * redundancy files are added directly to the scan hash */
+static int scan_files_add_name(const char* name, struct scan_filemaps* list, kvtree* scan)
+{
+  int rc = SCR_SUCCESS;
 
-    /* get the id of the xor set */
-    value = strndup(name + pmatch[2].rm_so, (size_t)(pmatch[2].rm_eo - pmatch[2].rm_so));
-    if (value != NULL) {
-      *group_id = atoi(value);
-      scr_free(&value);
-    }
+  const char* keyname = NULL;
+  int rank, group_id, group_num, group_rank, group_size;
+  int type = scan_name_classify(name, &keyname, &rank, &group_id, &group_num, &group_rank, &group_size);
+  if (type == SCAN_NAME_FILEMAP) {
+    /* grow the list if needed */
+    if (list->count == list->max) {
+      int max = (list->max > 0) ? 2 * list->max : 1024;
+      char** names = (char**) realloc(list->names, max * sizeof(char*));
+      if (names == NULL) {
+        scr_err("Failed to allocate filemap list @ %s:%d",
+          __FILE__, __LINE__
+        );
+        return SCR_FAILURE;
+      }
+      list->names = names;
 
-    /* get the number of xor sets */
-    value = strndup(name + pmatch[3].rm_so, (size_t)(pmatch[3].rm_eo - pmatch[3].rm_so));
-    if (value != NULL) {
-      *group_num = atoi(value);
-      scr_free(&value);
-    }
+      int* ranks = (int*) realloc(list->ranks, max * sizeof(int));
+      if (ranks == NULL) {
+        scr_err("Failed to allocate filemap list @ %s:%d",
+          __FILE__, __LINE__
+        );
+        return SCR_FAILURE;
+      }
+      list->ranks = ranks;
 
-    /* get the rank in the xor set */
-    value = strndup(name + pmatch[4].rm_so, (size_t)(pmatch[4].rm_eo - pmatch[4].rm_so));
-    if (value != NULL) {
-      *group_rank = atoi(value);
-      scr_free(&value);
+      list->max = max;
     }
 
-    /* get the size of the xor set */
-    value = strndup(name + pmatch[5].rm_so, (size_t)(pmatch[5].rm_eo - pmatch[5].rm_so));
-    if (value != NULL) {
-      *group_size = atoi(value);
-      scr_free(&value);
-    }
+    list->names[list->count] = strdup(name);
+    list->ranks[list->count] = rank;
+    list->count++;
+  } else if (type == SCAN_NAME_REDSET) {
+    /* add info for redundancy file to our scan hash */
+    rc = scr_scan_redset(name, list->dset_id, keyname, rank, group_id, group_num, group_rank, group_size, scan);
   }
 
   return rc;
 }
 
-/* Reads fmap files from given dataset directory and adds them to scan hash.
- * Returns SCR_SUCCESS if the files could be scanned */
-int scr_scan_files(const spath* prefix, const spath* dir, int dset_id, kvtree* scan)
-{
-  int rc = SCR_SUCCESS;
-
-  /* get dataset info from flush file */
-  scr_scan_flush(prefix, dset_id, scan);
-
-  /* create path to scr subdirectory */
-  spath* meta_path = spath_dup(dir);
+#if defined(__linux__) && defined(SYS_getdents64)
+/* layout of records returned by the getdents64 system call */
+struct scan_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
 
-  /* allocate directory in string form */
-  char* dir_str = spath_strdup(meta_path);
+/* number of bytes to request in each call to getdents64 */
+#define SCAN_DIRENT_BUF_SIZE (256*1024)
+#endif
 
-  /* regex to identify filemap files and extract rank from filename */
-  regex_t re_filemap_file;
-  regcomp(&re_filemap_file, "filemap_([0-9]+)", REG_EXTENDED);
+/* reads names from the given directory and adds each to the filemap list or scan hash */
+static int scan_files_read_dir(const char* dir_str, struct scan_filemaps* list, kvtree* scan)
+{
+  int rc = SCR_SUCCESS;
 
-  /* set up a regular expression so we can extract the partner set information from a file */
-  regex_t re_partner_file;
-  regcomp(&re_partner_file, "reddesc.er.([0-9]+).partner.grp_([0-9]+)_of_([0-9]+).mem_([0-9]+)_of_([0-9]+).redset", REG_EXTENDED);
+#if defined(__linux__) && defined(SYS_getdents64)
+  /* read entries in large batches directly from the kernel,
+   * which cuts system calls on directories with many thousands of files */
+  int fd = open(dir_str, O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    scr_err("Failed to open directory %s (errno=%d %s) @ %s:%d",
+      dir_str, errno, strerror(errno), __FILE__, __LINE__
+    );
+    return SCR_FAILURE;
+  }
 
-  /* set up a regular expression so we can extract the partner set information for filemaps */
-  regex_t re_mappartner_file;
-  regcomp(&re_mappartner_file, "reddescmap.er.([0-9]+).partner.grp_([0-9]+)_of_([0-9]+).mem_([0-9]+)_of_([0-9]+).redset", REG_EXTENDED);
+  char* buf = (char*) malloc(SCAN_DIRENT_BUF_SIZE);
+  if (buf == NULL) {
+    scr_err("Failed to allocate directory buffer @ %s:%d",
+      __FILE__, __LINE__
+    );
+    close(fd);
+    return SCR_FAILURE;
+  }
 
-  /* set up a regular expression so we can extract the xor set information from a file */
-  regex_t re_xor_file;
-  regcomp(&re_xor_file, "reddesc.er.([0-9]+).xor.grp_([0-9]+)_of_([0-9]+).mem_([0-9]+)_of_([0-9]+).redset", REG_EXTENDED);
+  while (rc == SCR_SUCCESS) {
+    long nread = syscall(SYS_getdents64, fd, buf, SCAN_DIRENT_BUF_SIZE);
+    if (nread < 0) {
+      scr_err("Failed to read directory %s (errno=%d %s) @ %s:%d",
+        dir_str, errno, strerror(errno), __FILE__, __LINE__
+      );
+      rc = SCR_FAILURE;
+      break;
+    }
+    if (nread == 0) {
+      /* reached the end of the directory */
+      break;
+    }
 
-  /* set up a regular expression so we can extract the xor set information for filemaps */
-  regex_t re_mapxor_file;
-  regcomp(&re_mapxor_file, "reddescmap.er.([0-9]+).xor.grp_([0-9]+)_of_([0-9]+).mem_([0-9]+)_of_([0-9]+).redset", REG_EXTENDED);
+    long offset = 0;
+    while (offset < nread) {
+      struct scan_dirent64* dp = (struct scan_dirent64*) (buf + offset);
+      offset += dp->d_reclen;
 
-  /* set up a regular expression so we can extract the rs set information from a file */
-  regex_t re_rs_file;
-  regcomp(&re_rs_file, "reddesc.er.([0-9]+).rs.grp_([0-9]+)_of_([0-9]+).mem_([0-9]+)_of_([0-9]+).redset", REG_EXTENDED);
+      /* distinguish between directories and files */
+      if (dp->d_type == DT_DIR) {
+        continue;
+      }
 
-  /* set up a regular expression so we can extract the rs set information for filemaps */
-  regex_t re_maprs_file;
-  regcomp(&re_maprs_file, "reddescmap.er.([0-9]+).rs.grp_([0-9]+)_of_([0-9]+).mem_([0-9]+)_of_([0-9]+).redset", REG_EXTENDED);
+      int tmp_rc = scan_files_add_name(dp->d_name, list, scan);
+      if (tmp_rc != SCR_SUCCESS) {
+        rc = tmp_rc;
+        break;
+      }
+    }
+  }
 
-  /* function to track ranks value across a set of files to be scanned */
-  int ranks = -1;
+  scr_free(&buf);
 
+  if (close(fd) < 0) {
+    scr_err("Failed to close directory %s (errno=%d %s) @ %s:%d",
+      dir_str, errno, strerror(errno), __FILE__, __LINE__
+    );
+    rc = SCR_FAILURE;
+  }
+#else
   /* open the directory */
   DIR* dirp = opendir(dir_str);
   if (dirp == NULL) {
     scr_err("Failed to open directory %s (errno=%d %s) @ %s:%d",
       dir_str, errno, strerror(errno), __FILE__, __LINE__
     );
-    rc = SCR_FAILURE;
-    goto cleanup;
+    return SCR_FAILURE;
   }
 
   /* read each file from the directory */
   struct dirent* dp = NULL;
-  int rank, group_id, group_num, group_rank, group_size;
   do {
     errno = 0;
     dp = readdir(dirp);
@@ -1551,71 +1678,11 @@ int scr_scan_files(const spath* prefix, const spath* dir, int dset_id, kvtree* s
         name = dp->d_name;
       #endif
 
-      /* we only process fmap files */
       if (name != NULL) {
-        if (match_filemap(name, &re_filemap_file, &rank)) {
-          /* create a full path of the file name */
-          spath* filemap_path = spath_dup(meta_path);
-          spath_append_str(filemap_path, name);
-
-          /* read file contents into our scan hash */
-          int tmp_rc = scr_scan_filemap(prefix, filemap_path, dset_id, rank, &ranks, scan);
-          if (tmp_rc != SCR_SUCCESS) {
-            rc = tmp_rc;
-            spath_delete(&filemap_path);
-            break;
-          }
-
-          /* delete the path */
-          spath_delete(&filemap_path);
-        } else if (match_partner(name, &re_partner_file, &rank, &group_id, &group_num, &group_rank, &group_size)) {
-          /* add info for XOR file to our scan hash */
-          const char* keyname = SCR_SCAN_KEY_PARTNER;
-          int tmp_rc = scr_scan_redset(name, dset_id, keyname, rank, group_id, group_num, group_rank, group_size, scan);
-          if (tmp_rc != SCR_SUCCESS) {
-            rc = tmp_rc;
-            break;
-          }
-        } else if (match_partner(name, &re_mappartner_file, &rank, &group_id, &group_num, &group_rank, &group_size)) {
-          /* add info for XOR file to our scan hash */
-          const char* keyname = SCR_SCAN_KEY_MAPPARTNER;
-          int tmp_rc = scr_scan_redset(name, dset_id, keyname, rank, group_id, group_num, group_rank, group_size, scan);
-          if (tmp_rc != SCR_SUCCESS) {
-            rc = tmp_rc;
-            break;
-          }
-        } else if (match_xor(name, &re_xor_file, &rank, &group_id, &group_num, &group_rank, &group_size)) {
-          /* add info for XOR file to our scan hash */
-          const char* keyname = SCR_SCAN_KEY_XOR;
-          int tmp_rc = scr_scan_redset(name, dset_id, keyname, rank, group_id, group_num, group_rank, group_size, scan);
-          if (tmp_rc != SCR_SUCCESS) {
-            rc = tmp_rc;
-            break;
-          }
-        } else if (match_xor(name, &re_mapxor_file, &rank, &group_id, &group_num, &group_rank, &group_size)) {
-          /* add info for XOR file to our scan hash */
-          const char* keyname = SCR_SCAN_KEY_MAPXOR;
-          int tmp_rc = scr_scan_redset(name, dset_id, keyname, rank, group_id, group_num, group_rank, group_size, scan);
-          if (tmp_rc != SCR_SUCCESS) {
-            rc = tmp_rc;
-            break;
-          }
-        } else if (match_rs(name, &re_rs_file, &rank, &group_id, &group_num, &group_rank, &group_size)) {
-          /* add info for RS file to our scan hash */
-          const char* keyname = SCR_SCAN_KEY_RS;
-          int tmp_rc = scr_scan_redset(name, dset_id, keyname, rank, group_id, group_num, group_rank, group_size, scan);
-          if (tmp_rc != SCR_SUCCESS) {
-            rc = tmp_rc;
-            break;
-          }
-        } else if (match_rs(name, &re_maprs_file, &rank, &group_id, &group_num, &group_rank, &group_size)) {
-          /* add info for RS file to our scan hash */
-          const char* keyname = SCR_SCAN_KEY_MAPRS;
-          int tmp_rc = scr_scan_redset(name, dset_id, keyname, rank, group_id, group_num, group_rank, group_size, scan);
-          if (tmp_rc != SCR_SUCCESS) {
-            rc = tmp_rc;
-            break;
-          }
+        int tmp_rc = scan_files_add_name(name, list, scan);
+        if (tmp_rc != SCR_SUCCESS) {
+          rc = tmp_rc;
+          break;
         }
       }
     } else {
@@ -1636,16 +1703,178 @@ int scr_scan_files(const spath* prefix, const spath* dir, int dset_id, kvtree* s
     );
     rc = SCR_FAILURE;
   }
+#endif
 
-cleanup:
-  /* free the xor regular expression */
-  regfree(&re_filemap_file);
-  regfree(&re_partner_file);
-  regfree(&re_mappartner_file);
-  regfree(&re_xor_file);
-  regfree(&re_mapxor_file);
-  regfree(&re_rs_file);
-  regfree(&re_maprs_file);
+  return rc;
+}
+
+/* repeatedly takes the next filemap from the list and reads it into the scan hash of this worker */
+static void* scan_filemaps_worker(void* arg)
+{
+  struct scan_worker* w = (struct scan_worker*) arg;
+  struct scan_filemaps* list = w->list;
+
+  while (1) {
+    /* claim the next filemap */
+#ifdef HAVE_PTHREADS
+    pthread_mutex_lock(&list->lock);
+#endif
+    int i = list->next;
+    list->next++;
+#ifdef HAVE_PTHREADS
+    pthread_mutex_unlock(&list->lock);
+#endif
+    if (i >= list->count) {
+      break;
+    }
+
+    /* create a full path of the file name */
+    spath* filemap_path = spath_dup(list->dir);
+    spath_append_str(filemap_path, list->names[i]);
+
+    /* read file contents into our scan hash */
+    int tmp_rc = scr_scan_filemap(list->prefix, filemap_path, list->dset_id, list->ranks[i], &w->ranks, w->scan);
+    if (tmp_rc != SCR_SUCCESS) {
+      w->rc = tmp_rc;
+    }
+
+    /* delete the path */
+    spath_delete(&filemap_path);
+  }
+
+  return NULL;
+}
+
+/* reads all filemaps in the list into the scan hash using up to scr_index_jobs threads */
+static int scan_files_read_filemaps(struct scan_filemaps* list, kvtree* scan)
+{
+  int rc = SCR_SUCCESS;
+
+  /* no sense in starting more threads than we have filemaps */
+  int threads = scr_index_jobs;
+  if (threads > list->count) {
+    threads = list->count;
+  }
+  if (threads < 1) {
+    threads = 1;
+  }
+#ifndef HAVE_PTHREADS
+  threads = 1;
+#endif
+
+  /* allocate state for each thread,
+   * the main thread records its results directly in the scan hash */
+  struct scan_worker* workers = (struct scan_worker*) malloc(threads * sizeof(struct scan_worker));
+  if (workers == NULL) {
+    scr_err("Failed to allocate scan threads @ %s:%d",
+      __FILE__, __LINE__
+    );
+    return SCR_FAILURE;
+  }
+  int i;
+  for (i = 0; i < threads; i++) {
+    workers[i].list  = list;
+    workers[i].scan  = (i == 0) ? scan : kvtree_new();
+    workers[i].ranks = -1;
+    workers[i].rc    = SCR_SUCCESS;
+  }
+
+#ifdef HAVE_PTHREADS
+  /* start helper threads */
+  int started = 1;
+  pthread_t* tids = NULL;
+  if (threads > 1) {
+    tids = (pthread_t*) malloc(threads * sizeof(pthread_t));
+    if (tids != NULL) {
+      while (started < threads) {
+        int tmp_rc = pthread_create(&tids[started], NULL, scan_filemaps_worker, (void*) &workers[started]);
+        if (tmp_rc != 0) {
+          /* the threads we have will read the remaining filemaps */
+          scr_err("Failed to start scan thread: pthread_create() rc=%d @ %s:%d",
+            tmp_rc, __FILE__, __LINE__
+          );
+          break;
+        }
+        started++;
+      }
+    }
+  }
+#endif
+
+  scan_filemaps_worker((void*) &workers[0]);
+
+#ifdef HAVE_PTHREADS
+  /* wait for helper threads to finish */
+  for (i = 1; i < started; i++) {
+    pthread_join(tids[i], NULL);
+  }
+  scr_free(&tids);
+#endif
+
+  /* merge results from each thread, if threads see a different number of ranks,
+   * the scan hash will have more than one RANKS value and scr_inspect_scan
+   * will mark the dataset as invalid */
+  for (i = 0; i < threads; i++) {
+    if (workers[i].rc != SCR_SUCCESS) {
+      rc = workers[i].rc;
+    }
+    if (i > 0) {
+      kvtree_merge(scan, workers[i].scan);
+      kvtree_delete(&workers[i].scan);
+    }
+  }
+  scr_free(&workers);
+
+  return rc;
+}
+
+/* Reads fmap files from given dataset directory and adds them to scan hash.
+ * Returns SCR_SUCCESS if the files could be scanned */
+int scr_scan_files(const spath* prefix, const spath* dir, int dset_id, kvtree* scan)
+{
+  int rc = SCR_SUCCESS;
+
+  /* get dataset info from flush file */
+  scr_scan_flush(prefix, dset_id, scan);
+
+  /* create path to scr subdirectory */
+  spath* meta_path = spath_dup(dir);
+
+  /* allocate directory in string form */
+  char* dir_str = spath_strdup(meta_path);
+
+  /* list of filemaps to be read */
+  struct scan_filemaps list;
+  list.prefix  = prefix;
+  list.dir     = meta_path;
+  list.dset_id = dset_id;
+  list.names   = NULL;
+  list.ranks   = NULL;
+  list.count   = 0;
+  list.max     = 0;
+  list.next    = 0;
+#ifdef HAVE_PTHREADS
+  pthread_mutex_init(&list.lock, NULL);
+#endif
+
+  /* identify filemaps and record redundancy files */
+  rc = scan_files_read_dir(dir_str, &list, scan);
+
+  /* read each filemap into our scan hash */
+  if (rc == SCR_SUCCESS) {
+    rc = scan_files_read_filemaps(&list, scan);
+  }
+
+  /* free the filemap list */
+  int i;
+  for (i = 0; i < list.count; i++) {
+    scr_free(&list.names[i]);
+  }
+  scr_free(&list.names);
+  scr_free(&list.ranks);
+#ifdef HAVE_PTHREADS
+  pthread_mutex_destroy(&list.lock);
+#endif
 
   /* free our directory string */
   scr_free(&dir_str);
@@ -2037,26 +2266,15 @@ cleanup:
   return rc;
 }
 
-/* given a prefix directory and a dataset id,
- * attempt add the dataset to the index file.
- * Returns SCR_SUCCESS if dataset can be indexed,
- * either as complete or incomplete */
-int index_build(const spath* prefix, int id, int* complete_flag)
+/* reads the summary file of the given dataset, building it if it is missing,
+ * and records the dataset in the index hash, does not write the index file */
+static int index_build_entry(kvtree* index, const spath* prefix, int id, int* complete_flag)
 {
   int rc = SCR_SUCCESS;
 
   /* assume dataset is not complete */
   *complete_flag = 0;
 
-  /* get string versions of prefix */
-  char* prefix_str = spath_strdup(prefix);
-
-  /* create a new hash to store our index file data */
-  kvtree* index = kvtree_new();
-
-  /* read index file from the prefix directory */
-  scr_index_read(prefix, index);
-
   /* create a new hash to hold our summary file data */
   kvtree* summary = kvtree_new();
 
@@ -2082,11 +2300,10 @@ int index_build(const spath* prefix, int id, int* complete_flag)
       /* found the name, now check whether it's complete (assume that it's not) */
       int complete;
       if (kvtree_util_get_int(summary, SCR_SUMMARY_6_KEY_COMPLETE, &complete) == KVTREE_SUCCESS) {
-        /* write values to the index file */
+        /* record values in the index */
         scr_index_remove(index, dataset_name);
         scr_index_set_dataset(index, id, dataset_name, dataset, complete);
         scr_index_mark_flushed(index, id, dataset_name);
-        scr_index_write(prefix, index);
 
         /* update return flag to indicate that dataset is complete */
         *complete_flag = complete;
@@ -2106,11 +2323,131 @@ int index_build(const spath* prefix, int id, int* complete_flag)
   /* free our summary file hash */
   kvtree_delete(&summary);
 
+  return rc;
+}
+
+/* given a prefix directory and a dataset id,
+ * attempt add the dataset to the index file.
+ * Returns SCR_SUCCESS if dataset can be indexed,
+ * either as complete or incomplete */
+int index_build(const spath* prefix, int id, int* complete_flag)
+{
+  /* create a new hash to store our index file data */
+  kvtree* index = kvtree_new();
+
+  /* read index file from the prefix directory */
+  scr_index_read(prefix, index);
+
+  /* add the dataset and write the index file */
+  int rc = index_build_entry(index, prefix, id, complete_flag);
+  if (rc == SCR_SUCCESS) {
+    scr_index_write(prefix, index);
+  }
+
   /* free our index hash */
   kvtree_delete(&index);
 
-  /* free our strings */
-  scr_free(&prefix_str);
+  return rc;
+}
+
+/* builds the summary files for a list of datasets concurrently by forking
+ * a process for each, keeping at most scr_index_jobs running at once and
+ * dividing the scan threads among them, then adds all datasets to the
+ * index with a single write, prints a line for each dataset stating
+ * whether it is complete, and returns SCR_SUCCESS only if all are */
+int index_build_list(const spath* prefix, int count, const int* ids)
+{
+  int rc = SCR_SUCCESS;
+
+  /* limit the number of processes running at once, and split our
+   * threads among them so the node isn't oversubscribed */
+  int jobs = scr_index_jobs;
+  if (jobs <= 0 || jobs > count) {
+    jobs = count;
+  }
+  int child_jobs = 1;
+  if (scr_index_jobs > jobs) {
+    child_jobs = scr_index_jobs / jobs;
+  }
+
+  /* each child only writes the summary file in its own dataset
+   * directory, so they don't step on each other, flush our output
+   * first so the children don't print it again when they exit */
+  fflush(stdout);
+  double time_start = scr_seconds();
+  int next = 0;
+  int running = 0;
+  while (next < count || running > 0) {
+    while (next < count && running < jobs) {
+      int id = ids[next];
+      next++;
+
+      pid_t pid = fork();
+      if (pid == 0) {
+        /* this is the child, build the summary and exit */
+        scr_index_jobs = child_jobs;
+        spath* dataset_path = spath_dup(prefix);
+        spath_append_str(dataset_path, ".scr");
+        spath_append_strf(dataset_path, "scr.dataset.%d", id);
+        int build_rc = scr_summary_build(prefix, dataset_path, id);
+        spath_delete(&dataset_path);
+        exit((build_rc == SCR_SUCCESS) ? 0 : 1);
+      } else if (pid < 0) {
+        /* we'll build this summary below when we add it to the index */
+        scr_err("Failed to fork summary build for dataset %d errno=%d %s @ %s:%d",
+          id, errno, strerror(errno), __FILE__, __LINE__
+        );
+        continue;
+      }
+      running++;
+    }
+
+    /* nothing left to wait on if all forks failed */
+    if (running == 0) {
+      break;
+    }
+
+    /* wait for a child to finish, a failed build shows up as
+     * a missing or incomplete summary file below */
+    int stat = 0;
+    if (wait(&stat) == (pid_t)-1) {
+      scr_err("Got a -1 from wait @ %s:%d",
+        __FILE__, __LINE__
+      );
+      break;
+    }
+    running--;
+  }
+
+  scr_dbg(1, "Built summaries for %d datasets using %d processes in %f secs",
+    count, jobs, scr_seconds() - time_start
+  );
+
+  /* read index file from the prefix directory */
+  kvtree* index = kvtree_new();
+  scr_index_read(prefix, index);
+
+  /* add each dataset to the index */
+  int added = 0;
+  int i;
+  for (i = 0; i < count; i++) {
+    int complete = 0;
+    if (index_build_entry(index, prefix, ids[i], &complete) == SCR_SUCCESS) {
+      added++;
+    }
+    if (complete != 1) {
+      rc = SCR_FAILURE;
+    }
+    printf("scr_index: Dataset %d %s\n", ids[i], (complete == 1) ? "complete" : "incomplete");
+  }
+
+  /* write the index file once for all datasets */
+  if (added > 0) {
+    scr_index_write(prefix, index);
+  }
+
+  /* free our index hash */
+  kvtree_delete(&index);
 
   return rc;
 }
@@ -2260,12 +2597,13 @@ int print_usage()
   printf("\n");
   printf("  Options:\n");
   printf("    -l, --list              List indexed datasets (default behavior)\n");
-  printf("    -b, --build=<id>        Rebuild dataset <id> and add to index\n");
+  printf("    -b, --build=<id>        Rebuild dataset <id> and add to index, may be repeated to build several at once\n");
   printf("    -a, --add=<name>        Add dataset <name> to index (requires summary file to exist)\n");
   printf("        --drop=<name>       Drop dataset <name> from index (does not delete files)\n");
   printf("        --drop-after=<name> Drop all datasets after <name> from index (does not delete files)\n");
   printf("    -c, --current=<name>    Set <name> as current restart dataset\n");
   printf("    -p, --prefix=<dir>      Specify prefix directory (defaults to current working directory)\n");
+  printf("    -j, --jobs=<n>          Use at most <n> scan threads and rebuild processes with --build (defaults to number of CPUs)\n");
   printf("    -h, --help              Print usage\n");
   printf("\n");
   return SCR_SUCCESS;
@@ -2274,13 +2612,15 @@ int print_usage()
 struct arglist {
   spath* prefix;
   char* name;
-  int id;
+  int* ids;
+  int num_ids;
   int list;
   int build;
   int add;
   int drop;
   int drop_after;
   int current;
+  int jobs;
 };
 
 /* free any memory allocation during get_args */
@@ -2288,6 +2628,7 @@ int free_args(struct arglist* args)
 {
   spath_delete(&(args->prefix));
   scr_free(&(args->name));
+  scr_free(&(args->ids));
   return SCR_SUCCESS;
 }
 
@@ -2296,15 +2637,20 @@ int get_args(int argc, char **argv, struct arglist* args)
   /* set to default values */
   args->prefix     = NULL;
   args->name       = NULL;
-  args->id         = -1;
+  args->ids        = NULL;
+  args->num_ids    = 0;
   args->list       = 1;
   args->build      = 0;
   args->add        = 0;
   args->drop       = 0;
   args->drop_after = 0;
   args->current    = 0;
+  args->jobs       = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (args->jobs <= 0) {
+    args->jobs = 1;
+  }
 
-  static const char *opt_string = "lb:a:d:p:h";
+  static const char *opt_string = "lb:a:d:p:j:h";
   static struct option long_options[] = {
     {"list",       no_argument,       NULL, 'l'},
     {"build",      required_argument, NULL, 'b'},
@@ -2313,6 +2659,7 @@ int get_args(int argc, char **argv, struct arglist* args)
     {"drop-after", required_argument, NULL, 'z'},
     {"current",    required_argument, NULL, 'c'},
     {"prefix",     required_argument, NULL, 'p'},
+    {"jobs",       required_argument, NULL, 'j'},
     {"help",       no_argument,       NULL, 'h'},
     {NULL,         no_argument,       NULL,   0}
   };
@@ -2325,7 +2672,15 @@ int get_args(int argc, char **argv, struct arglist* args)
         args->list = 1;
         break;
       case 'b':
-        args->id    = atoi(optarg);
+        args->ids = (int*) realloc(args->ids, (args->num_ids + 1) * sizeof(int));
+        if (args->ids == NULL) {
+          scr_err("Failed to allocate list of dataset ids @ %s:%d",
+            __FILE__, __LINE__
+          );
+          return SCR_FAILURE;
+        }
+        args->ids[args->num_ids] = atoi(optarg);
+        args->num_ids++;
         args->build = 1;
         args->list  = 0;
         break;
@@ -2352,6 +2707,13 @@ int get_args(int argc, char **argv, struct arglist* args)
       case 'p':
         args->prefix = spath_from_str(optarg);
         break;
+      case 'j':
+        args->jobs = atoi(optarg);
+        if (args->jobs <= 0) {
+          scr_err("Number of jobs must be positive '--jobs %s'", optarg);
+          return SCR_FAILURE;
+        }
+        break;
       case 'h':
         return SCR_FAILURE;
       default:
@@ -2395,7 +2757,9 @@ int main(int argc, char *argv[])
   /* get references to prefix and subdirectory paths */
   spath* prefix = args.prefix;
   char* name = args.name;
-  int id = args.id;
+
+  /* limit number of concurrent rebuild processes */
+  scr_index_jobs = args.jobs;
 
   /* these options all require a prefix directory */
   if (args.build == 1 || args.add == 1 || args.drop == 1 || args.drop_after == 1 || args.current == 1 || args.list == 1) {
@@ -2417,12 +2781,17 @@ int main(int argc, char *argv[])
     /* add the dataset id to the index.scr file in the prefix directory,
      * build missing files if necessary */
     rc = SCR_FAILURE;
-    int complete = 0;
-    if (index_build(prefix, id, &complete) == SCR_SUCCESS) {
-      if (complete == 1) {
-        /* only return success if we find a value for complete, and if that value is 1 */
-        rc = SCR_SUCCESS;
+    if (args.num_ids == 1) {
+      int complete = 0;
+      if (index_build(prefix, args.ids[0], &complete) == SCR_SUCCESS) {
+        if (complete == 1) {
+          /* only return success if we find a value for complete, and if that value is 1 */
+          rc = SCR_SUCCESS;
+        }
       }
+    } else {
+      /* build several datasets at once, succeeds only if all are complete */
+      rc = index_build_list(prefix, args.num_ids, args.ids);
     }
   } else if (args.add == 1) {
     /* add the named dataset to the index file (requires summary file to exist) */
@@ -129,16 +129,395 @@
  *          1
  */
 
-/* read the index file from given directory and merge its contents into the given hash */
-int scr_index_read(const spath* dir, kvtree* index)
+/* Rather than rewrite the full index file on each update, a process
+ * that has read the index can append just the entries it changed to a
+ * journal file that sits next to the index file.  Each record in the
+ * journal is a kvtree of the form:
+ *
+ *  OP
+ *    SET|UNSET
+ *  KEY
+ *    <top level key in index, e.g., DSET>
+ *  NAME
+ *    <child of top level key, e.g., 6>
+ *  VALUE
+ *    <subtree assigned to KEY/NAME for a SET>
+ *
+ * scr_index_read applies the journal records in order on top of the
+ * index file.  The index file format is unchanged, and the journal is
+ * folded back into the index file (compacted) once it holds more than
+ * the configured number of records, whenever a process that has no
+ * cached copy of the index writes it, and by scr_index_compact.
+ * Tools that read index.scr directly see a complete index after
+ * compaction. */
+
+#define SCR_INDEX_JOURNAL_FILENAME "index.scr.journal"
+
+#define SCR_INDEX_JOURNAL_KEY_OP    ("OP")
+#define SCR_INDEX_JOURNAL_KEY_KEY   ("KEY")
+#define SCR_INDEX_JOURNAL_KEY_NAME  ("NAME")
+#define SCR_INDEX_JOURNAL_KEY_VALUE ("VALUE")
+
+#define SCR_INDEX_JOURNAL_OP_SET   ("SET")
+#define SCR_INDEX_JOURNAL_OP_UNSET ("UNSET")
+
+/* max number of records in journal before compacting, 0 disables the journal */
+static int scr_index_journal_max = 0;
+
+/* copy of the index as of the last read or write by this process,
+ * along with the state of the files on disk at that time, so that we
+ * can detect whether another process has modified them since */
+static char* scr_index_cache_file = NULL; /* index file the cache describes */
+static kvtree* scr_index_cache = NULL;    /* contents of index file plus journal */
+static struct stat scr_index_cache_stat;  /* stat of index file */
+static off_t scr_index_cache_journal = 0; /* valid bytes in journal file */
+static int scr_index_cache_records = 0;   /* number of records in journal file */
+
+/* build names of index and journal files in given prefix directory */
+static void scr_index_files(const spath* dir, char** index_file, char** journal_file)
 {
-  int rc = SCR_FAILURE;
-
-  /* build the file name for the index file */
   spath* path_index = spath_dup(dir);
   spath_append_str(path_index, ".scr");
   spath_append_str(path_index, SCR_INDEX_FILENAME);
-  char* index_file = spath_strdup(path_index);
+  *index_file = spath_strdup(path_index);
+  spath_delete(&path_index);
+
+  spath* path_journal = spath_dup(dir);
+  spath_append_str(path_journal, ".scr");
+  spath_append_str(path_journal, SCR_INDEX_JOURNAL_FILENAME);
+  *journal_file = spath_strdup(path_journal);
+  spath_delete(&path_journal);
+}
+
+/* drop our cached copy of the index */
+static void scr_index_cache_clear(void)
+{
+  scr_free(&scr_index_cache_file);
+  kvtree_delete(&scr_index_cache);
+  scr_index_cache_journal = 0;
+  scr_index_cache_records = 0;
+}
+
+/* record a copy of the index along with the current state of its files */
+static void scr_index_cache_set(
+  const char* index_file,
+  const kvtree* index,
+  off_t journal_bytes,
+  int records)
+{
+  scr_index_cache_clear();
+
+  /* nothing to do if journal is disabled */
+  if (scr_index_journal_max <= 0) {
+    return;
+  }
+
+  if (stat(index_file, &scr_index_cache_stat) != 0) {
+    return;
+  }
+
+  scr_index_cache_file = strdup(index_file);
+  scr_index_cache = kvtree_new();
+  kvtree_merge(scr_index_cache, index);
+  scr_index_cache_journal = journal_bytes;
+  scr_index_cache_records = records;
+}
+
+/* returns 1 if our cached copy describes the given index file,
+ * and neither the index file nor its journal have changed since */
+static int scr_index_cache_valid(const char* index_file, const char* journal_file)
+{
+  if (scr_index_cache == NULL || strcmp(scr_index_cache_file, index_file) != 0) {
+    return 0;
+  }
+
+  /* the index file is replaced via rename on each compaction */
+  struct stat st;
+  if (stat(index_file, &st) != 0 ||
+      st.st_ino   != scr_index_cache_stat.st_ino   ||
+      st.st_size  != scr_index_cache_stat.st_size  ||
+      st.st_mtime != scr_index_cache_stat.st_mtime)
+  {
+    return 0;
+  }
+
+  /* the journal only grows until it is removed on compaction */
+  off_t journal_bytes = 0;
+  if (stat(journal_file, &st) == 0) {
+    journal_bytes = st.st_size;
+  }
+  if (journal_bytes != scr_index_cache_journal) {
+    return 0;
+  }
+
+  return 1;
+}
+
+/* apply a single journal record to the index */
+static void scr_index_journal_apply(kvtree* index, kvtree* record)
+{
+  char* op   = kvtree_elem_get_first_val(record, SCR_INDEX_JOURNAL_KEY_OP);
+  char* key  = kvtree_elem_get_first_val(record, SCR_INDEX_JOURNAL_KEY_KEY);
+  char* name = kvtree_elem_get_first_val(record, SCR_INDEX_JOURNAL_KEY_NAME);
+  if (op == NULL || key == NULL || name == NULL) {
+    return;
+  }
+
+  kvtree* key_hash = kvtree_get(index, key);
+  if (strcmp(op, SCR_INDEX_JOURNAL_OP_SET) == 0) {
+    if (key_hash == NULL) {
+      key_hash = kvtree_set(index, key, kvtree_new());
+    }
+    kvtree* value = kvtree_extract(record, SCR_INDEX_JOURNAL_KEY_VALUE);
+    if (value == NULL) {
+      value = kvtree_new();
+    }
+    kvtree_unset(key_hash, name);
+    kvtree_set(key_hash, name, value);
+  } else if (strcmp(op, SCR_INDEX_JOURNAL_OP_UNSET) == 0) {
+    if (key_hash != NULL) {
+      kvtree_unset(key_hash, name);
+      if (kvtree_size(key_hash) == 0) {
+        kvtree_unset(index, key);
+      }
+    }
+  }
+}
+
+/* apply records from journal file to index, sets bytes to the number
+ * of bytes in the journal that were applied and records to the number
+ * of records, returns SCR_FAILURE if the journal has a partial record
+ * at its end (e.g., a process died while appending) */
+static int scr_index_journal_replay(
+  const char* journal_file,
+  kvtree* index,
+  off_t* bytes,
+  int* records)
+{
+  int rc = SCR_SUCCESS;
+
+  *bytes   = 0;
+  *records = 0;
+
+  /* no journal means there is nothing to apply */
+  int fd = scr_open(journal_file, O_RDONLY);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      return SCR_SUCCESS;
+    }
+    scr_err("Opening index journal: scr_open(%s) errno=%d %s @ %s:%d",
+      journal_file, errno, strerror(errno), __FILE__, __LINE__
+    );
+    return SCR_FAILURE;
+  }
+
+  /* get size of journal so we can detect a partial record at its end */
+  struct stat st;
+  off_t size = 0;
+  if (fstat(fd, &st) == 0) {
+    size = st.st_size;
+  }
+
+  while (*bytes < size) {
+    kvtree* record = kvtree_new();
+    ssize_t nread = kvtree_read_fd(journal_file, fd, record);
+    if (nread <= 0) {
+      kvtree_delete(&record);
+      break;
+    }
+    scr_index_journal_apply(index, record);
+    kvtree_delete(&record);
+    *bytes += (off_t) nread;
+    (*records)++;
+  }
+
+  if (*bytes != size) {
+    scr_dbg(1, "Ignoring partial record at end of index journal: %s", journal_file);
+    rc = SCR_FAILURE;
+  }
+
+  scr_close(journal_file, fd);
+
+  return rc;
+}
+
+/* returns 1 if the given trees have the same contents and layout */
+static int scr_index_tree_equal(const kvtree* a, const kvtree* b)
+{
+  size_t size_a = kvtree_pack_size(a);
+  size_t size_b = kvtree_pack_size(b);
+  if (size_a != size_b) {
+    return 0;
+  }
+
+  char* buf_a = (char*) SCR_MALLOC(size_a);
+  char* buf_b = (char*) SCR_MALLOC(size_b);
+  kvtree_pack(buf_a, a);
+  kvtree_pack(buf_b, b);
+  int equal = (memcmp(buf_a, buf_b, size_a) == 0);
+  scr_free(&buf_b);
+  scr_free(&buf_a);
+
+  return equal;
+}
+
+/* append a journal record to the given file descriptor */
+static int scr_index_journal_write(
+  const char* journal_file,
+  int fd,
+  const char* op,
+  const char* key,
+  const char* name,
+  const kvtree* value)
+{
+  kvtree* record = kvtree_new();
+  kvtree_util_set_str(record, SCR_INDEX_JOURNAL_KEY_OP, op);
+  kvtree_util_set_str(record, SCR_INDEX_JOURNAL_KEY_KEY, key);
+  kvtree_util_set_str(record, SCR_INDEX_JOURNAL_KEY_NAME, name);
+  if (value != NULL) {
+    kvtree* copy = kvtree_new();
+    kvtree_merge(copy, value);
+    kvtree_set(record, SCR_INDEX_JOURNAL_KEY_VALUE, copy);
+  }
+
+  ssize_t nwrite = kvtree_write_fd(journal_file, fd, record);
+  kvtree_delete(&record);
+
+  return (nwrite > 0) ? SCR_SUCCESS : SCR_FAILURE;
+}
+
+/* append records to journal that transform the old index into the new one,
+ * compares entries two levels deep, e.g., DSET/<id> or NAME/<name>,
+ * increments records by the number of records written */
+static int scr_index_journal_append(
+  const char* journal_file,
+  const kvtree* old_index,
+  const kvtree* new_index,
+  int* records)
+{
+  int rc = SCR_SUCCESS;
+
+  mode_t mode_file = scr_getmode(1, 1, 0);
+  int fd = scr_open(journal_file, O_WRONLY | O_CREAT | O_APPEND, mode_file);
+  if (fd < 0) {
+    scr_err("Opening index journal: scr_open(%s) errno=%d %s @ %s:%d",
+      journal_file, errno, strerror(errno), __FILE__, __LINE__
+    );
+    return SCR_FAILURE;
+  }
+
+  /* record entries that were added or changed */
+  kvtree_elem* key_elem;
+  for (key_elem = kvtree_elem_first(new_index);
+       key_elem != NULL && rc == SCR_SUCCESS;
+       key_elem = kvtree_elem_next(key_elem))
+  {
+    char* key = kvtree_elem_key(key_elem);
+    kvtree* new_hash = kvtree_elem_hash(key_elem);
+    kvtree* old_hash = kvtree_get(old_index, key);
+
+    kvtree_elem* name_elem;
+    for (name_elem = kvtree_elem_first(new_hash);
+         name_elem != NULL && rc == SCR_SUCCESS;
+         name_elem = kvtree_elem_next(name_elem))
+    {
+      char* name = kvtree_elem_key(name_elem);
+      kvtree* new_value = kvtree_elem_hash(name_elem);
+      kvtree* old_value = kvtree_get(old_hash, name);
+      if (old_value == NULL || ! scr_index_tree_equal(old_value, new_value)) {
+        rc = scr_index_journal_write(journal_file, fd, SCR_INDEX_JOURNAL_OP_SET, key, name, new_value);
+        (*records)++;
+      }
+    }
+  }
+
+  /* record entries that were removed */
+  for (key_elem = kvtree_elem_first(old_index);
+       key_elem != NULL && rc == SCR_SUCCESS;
+       key_elem = kvtree_elem_next(key_elem))
+  {
+    char* key = kvtree_elem_key(key_elem);
+    kvtree* old_hash = kvtree_elem_hash(key_elem);
+    kvtree* new_hash = kvtree_get(new_index, key);
+
+    kvtree_elem* name_elem;
+    for (name_elem = kvtree_elem_first(old_hash);
+         name_elem != NULL && rc == SCR_SUCCESS;
+         name_elem = kvtree_elem_next(name_elem))
+    {
+      char* name = kvtree_elem_key(name_elem);
+      if (kvtree_get(new_hash, name) == NULL) {
+        rc = scr_index_journal_write(journal_file, fd, SCR_INDEX_JOURNAL_OP_UNSET, key, name, NULL);
+        (*records)++;
+      }
+    }
+  }
+
+  if (scr_close(journal_file, fd) != SCR_SUCCESS) {
+    rc = SCR_FAILURE;
+  }
+
+  return rc;
+}
+
+/* write full index to a temporary file, rename it over the index file,
+ * then remove the journal, a crash after the rename but before the
+ * journal is removed is safe since replaying the journal on top of the
+ * new index file yields the same contents */
+static int scr_index_write_full(const char* index_file, const char* journal_file, const kvtree* index)
+{
+  char* tmp_file = scr_strdupf("%s.tmp", index_file);
+
+  int rc = SCR_SUCCESS;
+  if (kvtree_write_file(tmp_file, index) != KVTREE_SUCCESS) {
+    rc = SCR_FAILURE;
+  }
+
+  if (rc == SCR_SUCCESS && rename(tmp_file, index_file) != 0) {
+    scr_err("Failed to rename %s to %s errno=%d %s @ %s:%d",
+      tmp_file, index_file, errno, strerror(errno), __FILE__, __LINE__
+    );
+    rc = SCR_FAILURE;
+  }
+
+  if (rc == SCR_SUCCESS) {
+    if (unlink(journal_file) != 0 && errno != ENOENT) {
+      scr_err("Failed to remove index journal %s errno=%d %s @ %s:%d",
+        journal_file, errno, strerror(errno), __FILE__, __LINE__
+      );
+      rc = SCR_FAILURE;
+    }
+  } else {
+    unlink(tmp_file);
+  }
+
+  scr_free(&tmp_file);
+
+  return rc;
+}
+
+/* set max number of records to append to the index journal before compacting
+ * the journal into the index file, 0 disables the journal so that each write
+ * rewrites the full index file */
+int scr_index_set_journal(int max_records)
+{
+  scr_index_journal_max = max_records;
+  if (scr_index_journal_max <= 0) {
+    scr_index_cache_clear();
+  }
+  return SCR_SUCCESS;
+}
+
+/* read the index file from given directory and merge its contents into the given hash,
+ * applies any records in the index journal */
+int scr_index_read(const spath* dir, kvtree* index)
+{
+  int rc = SCR_FAILURE;
+
+  /* build the file names for the index file and its journal */
+  char* index_file;
+  char* journal_file;
+  scr_index_files(dir, &index_file, &journal_file);
 
   /* if we can access it, read the index file */
   if (scr_file_exists(index_file) == SCR_SUCCESS) {
@@ -153,6 +532,19 @@ int scr_index_read(const spath* dir, kvtree* index)
       if (kvtree_util_get_int(tmp, SCR_INDEX_KEY_VERSION, &version) == KVTREE_SUCCESS) {
         /* got a version number, check that it's what we expect */
         if (version == SCR_INDEX_FILE_VERSION_2) {
+          /* apply any updates recorded in the journal */
+          off_t journal_bytes;
+          int records;
+          int journal_rc = scr_index_journal_replay(journal_file, tmp, &journal_bytes, &records);
+
+          /* remember what we read so a later write can append to the journal,
+           * a damaged journal is rewritten in full on the next write */
+          if (journal_rc == SCR_SUCCESS) {
+            scr_index_cache_set(index_file, tmp, journal_bytes, records);
+          } else {
+            scr_index_cache_clear();
+          }
+
           /* got the correct version, copy file contents into caller's kvtree */
           kvtree_merge(index, tmp);
         } else {
@@ -169,26 +561,30 @@ int scr_index_read(const spath* dir, kvtree* index)
         );
         rc = SCR_FAILURE;
       }
-
-      /* free our temporary tree */
-      kvtree_delete(&tmp);
     }
+
+    /* free our temporary tree */
+    kvtree_delete(&tmp);
   }
 
-  /* free path and string */
+  /* free strings */
+  scr_free(&journal_file);
   scr_free(&index_file);
-  spath_delete(&path_index);
 
   return rc;
 }
 
-/* overwrite the contents of the index file in given directory with given hash */
+/* overwrite the contents of the index file in given directory with given hash,
+ * if the journal is enabled and this process holds an up-to-date copy of the
+ * index, only the entries that changed are appended to the journal */
 int scr_index_write(const spath* dir, kvtree* index)
 {
-  /* build the file name for the index file */
-  spath* path_index = spath_dup(dir);
-  spath_append_str(path_index, ".scr");
-  spath_append_str(path_index, SCR_INDEX_FILENAME);
+  int rc = SCR_FAILURE;
+
+  /* build the file names for the index file and its journal */
+  char* index_file;
+  char* journal_file;
+  scr_index_files(dir, &index_file, &journal_file);
 
   /* set the index file version key if it's not set already */
   kvtree* version = kvtree_get(index, SCR_INDEX_KEY_VERSION);
@@ -196,12 +592,61 @@ int scr_index_write(const spath* dir, kvtree* index)
     kvtree_util_set_int(index, SCR_INDEX_KEY_VERSION, SCR_INDEX_FILE_VERSION_2);
   }
 
-  /* write out the file */
-  int kvtree_rc = kvtree_write_path(path_index, index);
-  int rc = (kvtree_rc == KVTREE_SUCCESS) ? SCR_SUCCESS : SCR_FAILURE;
+  /* append changes to the journal if we can */
+  if (scr_index_journal_max > 0 && scr_index_cache_valid(index_file, journal_file)) {
+    int records = scr_index_cache_records;
+    if (scr_index_journal_append(journal_file, scr_index_cache, index, &records) == SCR_SUCCESS &&
+        records <= scr_index_journal_max)
+    {
+      struct stat st;
+      if (stat(journal_file, &st) == 0) {
+        scr_index_cache_set(index_file, index, st.st_size, records);
+        rc = SCR_SUCCESS;
+      }
+    }
+  }
 
-  /* free path */
-  spath_delete(&path_index);
+  /* otherwise write out the full file, which also compacts the journal */
+  if (rc != SCR_SUCCESS) {
+    rc = scr_index_write_full(index_file, journal_file, index);
+    if (rc == SCR_SUCCESS) {
+      scr_index_cache_set(index_file, index, 0, 0);
+    } else {
+      scr_index_cache_clear();
+    }
+  }
+
+  /* free strings */
+  scr_free(&journal_file);
+  scr_free(&index_file);
+
+  return rc;
+}
+
+/* fold any records in the index journal into the index file */
+int scr_index_compact(const spath* dir)
+{
+  int rc = SCR_SUCCESS;
+
+  /* build the file names for the index file and its journal */
+  char* index_file;
+  char* journal_file;
+  scr_index_files(dir, &index_file, &journal_file);
+
+  /* nothing to do if there is no journal */
+  if (scr_file_exists(journal_file) == SCR_SUCCESS) {
+    kvtree* index = kvtree_new();
+    rc = scr_index_read(dir, index);
+    if (rc == SCR_SUCCESS) {
+      rc = scr_index_write_full(index_file, journal_file, index);
+    }
+    kvtree_delete(&index);
+    scr_index_cache_clear();
+  }
+
+  /* free strings */
+  scr_free(&journal_file);
+  scr_free(&index_file);
 
   return rc;
 }
@@ -327,6 +772,30 @@ int scr_index_set_current(kvtree* index, const char* name)
   return SCR_SUCCESS;
 }
 
+/* set dataset name as current to restart from unless current already
+ * names a newer checkpoint, used when flushes may complete out of order */
+int scr_index_advance_current(kvtree* index, const char* name)
+{
+  /* lookup the dataset id based on the dataset name */
+  int id;
+  if (scr_index_get_id_by_name(index, name, &id) != SCR_SUCCESS) {
+    /* failed to find dataset by this name */
+    return SCR_FAILURE;
+  }
+
+  /* leave current alone if it points to a newer dataset */
+  char* current = NULL;
+  int current_id;
+  if (scr_index_get_current(index, &current) == SCR_SUCCESS &&
+      scr_index_get_id_by_name(index, current, &current_id) == SCR_SUCCESS &&
+      current_id >= id)
+  {
+    return SCR_SUCCESS;
+  }
+
+  return scr_index_set_current(index, name);
+}
+
 /* get dataset name as current to restart from */
 int scr_index_get_current(kvtree* index, char** name)
 {
@@ -595,6 +1064,53 @@ int scr_index_get_most_recent_complete(const kvtree* index, int earlier_than, in
   return SCR_FAILURE;
 }
 
+/* given a window of the most recent complete checkpoints, lookup the id and
+ * name of the newest pure checkpoint outside of that window, the window is
+ * anchored on the newest complete checkpoint in the index so that the result
+ * does not depend on the order in which checkpoints complete,
+ * sets id to -1 and returns SCR_FAILURE if there is nothing to delete */
+int scr_index_get_outside_window(kvtree* index, int window, int* id, char* name)
+{
+  /* assume that we won't find a dataset to delete */
+  *id = -1;
+
+  /* step from the newest complete checkpoint to older ones */
+  int count = 0;
+  int target_id = -1;
+  char target[SCR_MAX_FILENAME];
+  while (1) {
+    /* TODO: delete checkpoint if not valid, even if in window? */
+    int next_id = -1;
+    scr_index_get_most_recent_complete(index, target_id, &next_id, target);
+    if (next_id < 0) {
+      /* ran out of checkpoints to consider */
+      return SCR_FAILURE;
+    }
+    target_id = next_id;
+
+    /* keep this checkpoint if we're still in the window */
+    if (count < window) {
+      count++;
+      continue;
+    }
+
+    /* not in window, but we also keep any checkpoints
+     * that are marked as output */
+    int is_output = 0;
+    scr_dataset* dataset = scr_dataset_new();
+    if (scr_index_get_dataset(index, target_id, target, dataset) == SCR_SUCCESS) {
+      is_output = scr_dataset_is_output(dataset);
+    }
+    scr_dataset_delete(&dataset);
+
+    if (! is_output) {
+      *id = target_id;
+      strcpy(name, target);
+      return SCR_SUCCESS;
+    }
+  }
+}
+
 /* lookup the dataset having the lowest id, return its id and name,
  * sets id to -1 to indicate no dataset is left */
 int scr_index_get_oldest(const kvtree* index, int* id, char* name)
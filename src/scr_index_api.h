@@ -25,6 +25,13 @@ int scr_index_read(const spath* dir, kvtree* index);
 /* overwrite the contents of the index file in given directory with given hash */
 int scr_index_write(const spath* dir, kvtree* index);
 
+/* set max number of records to append to the index journal before compacting
+ * the journal into the index file, 0 disables the journal */
+int scr_index_set_journal(int max_records);
+
+/* fold any records in the index journal into the index file */
+int scr_index_compact(const spath* dir);
+
 /* read index file and return max dataset and checkpoint ids,
  * returns SCR_SUCCESS if file read successfully */
 int scr_index_get_max_ids(const spath* dir, int* dset_id, int* ckpt_id, int* ckpt_dset_id);
@@ -35,6 +42,10 @@ int scr_index_remove(kvtree* index, const char* name);
 /* set dataset name as current to restart from */
 int scr_index_set_current(kvtree* index, const char* name);
 
+/* set dataset name as current to restart from unless current already
+ * names a newer checkpoint, used when flushes may complete out of order */
+int scr_index_advance_current(kvtree* index, const char* name);
+
 /* get dataset name as current to restart from */
 int scr_index_get_current(kvtree* index, char** name);
 
@@ -75,6 +86,13 @@ int scr_index_get_id_by_name(const kvtree* index, const char* name, int* id);
  * setting earlier_than = -1 disables this filter */
 int scr_index_get_most_recent_complete(const kvtree* index, int earlier_than, int* id, char* name);
 
+/* given a window of the most recent complete checkpoints, lookup the id and
+ * name of the newest pure checkpoint outside of that window, the window is
+ * anchored on the newest complete checkpoint in the index so that the result
+ * does not depend on the order in which checkpoints complete,
+ * sets id to -1 and returns SCR_FAILURE if there is nothing to delete */
+int scr_index_get_outside_window(kvtree* index, int window, int* id, char* name);
+
 /* lookup the dataset having the lowest id, return its id and name,
  * sets id to -1 to indicate no dataset is left */
 int scr_index_get_oldest(const kvtree* index, int* id, char* name);
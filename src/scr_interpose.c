@@ -15,12 +15,17 @@
  * application:
  *   1) MPI_Init() to call SCR_Init() after returning from MPI_Init()
  *   2) MPI_Finalize() to call SCR_Finalize() before calling MPI_Finalize()
- *   3) open()/fopen() to call SCR_Start_checkpoint() and/or SCR_Route_file()
- *      before opening the file
+ *   3) open()/open64()/openat()/creat()/fopen() to call SCR_Start_checkpoint()
+ *      and/or SCR_Route_file() before opening the file
  *   4) close()/fclose() to call SCR_Complete_checkpoint() after closing file
+ *   5) write()/pwrite() to count bytes written to checkpoint files
  *
  * This library determines which files are checkpoint files by comparing them
  * to a regular expression provided by the user via an environment variable.
+ * Since every open in the process passes through here, each regular expression
+ * is paired with any literal prefix and suffix that a match requires, which
+ * lets us reject most non-checkpoint files without calling regexec, and open
+ * checkpoint files are looked up by file descriptor in a direct-mapped table.
  *
  * Here are some articles and examples on interposing libraries:
  *   http://www.cs.cmu.edu/afs/cs.cmu.edu/academic/class/15213-s03/src/interposition/mymalloc.c
@@ -38,6 +43,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 #include <stdarg.h>
 
@@ -57,13 +63,12 @@ static int scri_interpose_enabled = 0;
 static int scri_in_checkpoint     = 0;
 static int scri_ranks             = 0;
 static int scri_rank              = -1;
+static int scri_debug             = 0;
 
 static int scri_re_low_high_compiled = 0;
 static int scri_re_low_N_compiled    = 0;
-static int scri_re_scr_file_compiled = 0;
 static regex_t scri_re_low_high;
 static regex_t scri_re_low_N;
-static regex_t scri_re_scr_file;
 
 /* interpose MPI functions */
 int (* scri_real_mpi_init)  (int *, char ***) = NULL;
@@ -73,26 +78,24 @@ int (* scri_real_mpi_fini)  ()                = NULL;
 /*
 int (* scri_real_open)      (const char *, int, mode_t);
 */
-int (* scri_real_open)      (const char *, int, ...) = NULL;
-int (* scri_real_close)     (int)                    = NULL;
+int (* scri_real_open)      (const char *, int, ...)      = NULL;
+int (* scri_real_open64)    (const char *, int, ...)      = NULL;
+int (* scri_real_openat)    (int, const char *, int, ...) = NULL;
+int (* scri_real_creat)     (const char *, mode_t)        = NULL;
+int (* scri_real_close)     (int)                         = NULL;
 
 /* interpose fopen/fclose functions */
 FILE* (* scri_real_fopen)   (const char *, const char *) = NULL;
+FILE* (* scri_real_fopen64) (const char *, const char *) = NULL;
 int   (* scri_real_fclose)  (FILE*)                      = NULL;
 
 /* interpose mkdir function */
 int (* scri_real_mkdir)     (const char *, mode_t) = NULL;
 
-/* TODO: also intercept
- *   creat() -- form of open()
- *   mkdir() -- for checkpoint directories -- turn into a NOP
- */
-
-/* interpose read/write functions */
-/*
-ssize_t (* real_read)  (int fd, void *buf, size_t count);
-ssize_t (* real_write) (int fd, const void *buf, size_t count);
-*/
+/* interpose write functions */
+ssize_t (* scri_real_write)   (int, const void *, size_t)          = NULL;
+ssize_t (* scri_real_pwrite)  (int, const void *, size_t, off_t)   = NULL;
+ssize_t (* scri_real_pwrite64)(int, const void *, size_t, off64_t) = NULL;
 
 /*
 ==============================================================================
@@ -108,6 +111,17 @@ Checkpoint tracking functions and data structures
 #define SCRI_FD      (1)
 #define SCRI_FSTREAM (2)
 
+/* a compiled regular expression along with literal text that
+ * any matching name must begin and end with */
+struct scri_pattern
+{
+  regex_t re;
+  char*   prefix;     /* literal prefix required by pattern, or NULL */
+  size_t  prefix_len;
+  char*   suffix;     /* literal suffix required by pattern, or NULL */
+  size_t  suffix_len;
+};
+
 struct scri_checkpointfile
 {
   int   valid;   /* whether checkpoint file entry is valid */
@@ -115,15 +129,15 @@ struct scri_checkpointfile
   int   need_closed; /* whether checkpoint file is open and needs to be closed to complete a checkpoint */
   char* filename;
   char* tempname;
-  regex_t re;
+  struct scri_pattern pat;
   int   ftype;
   int   fd;
   int   flags;
   FILE* fstream;
   char* mode;
+  unsigned long long bytes; /* number of bytes written through write/pwrite since open */
 };
 
-/* TODO: change this fixed array to a linked list */
 /* keeps track of checkpoint files */
 static int    scri_checkpoint_files_valid = 0;
 static struct scri_checkpointfile scri_checkpoint_files[MAX_CHECKPOINT_FILES];
@@ -131,24 +145,196 @@ static struct scri_checkpointfile scri_checkpoint_files[MAX_CHECKPOINT_FILES];
 /* TODO: support a list of directories like we do for files */
 /* keeps track of checkpoint directory */
 static int     scri_checkpoint_dir_valid = 0;
-static regex_t scri_re_checkpoint_dir;
+static struct scri_pattern scri_checkpoint_dir;
+
+/* maps an open file descriptor to its index in scri_checkpoint_files,
+ * or -1 if the descriptor is not a checkpoint file, the table is indexed
+ * directly by descriptor value and allocated once at init, so that threads
+ * can look up descriptors while another opens a file, descriptors beyond
+ * the end of the table fall back to a scan of scri_checkpoint_files */
+#define SCRI_FD_MAP_MAX (1024 * 1024)
+static int* scri_fd_map      = NULL;
+static int  scri_fd_map_size = 0;
+
+/* returns 1 if c has special meaning in an extended regular expression */
+static int scri_is_regex_special(char c)
+{
+  return (strchr(".[]()*+?{}|^$\\", c) != NULL);
+}
 
-/* given a filename and regular expression, return whether there is a match */
-static int scri_file_matches(const char* filename, regex_t* re)
+/* returns 1 if c is a regex operator that makes the preceding atom optional */
+static int scri_is_regex_optional(char c)
 {
-  size_t nmatch = 0;
-  regmatch_t pmatch[5];
+  return (c == '*' || c == '?' || c == '{');
+}
 
-  /* check for a match on the filename, and check that it's *not* an .scr file */
-  memset(pmatch, 0, sizeof(regmatch_t) * nmatch);
-  if (regexec(re, filename, nmatch, pmatch, 0) == 0 &&
-      regexec(&scri_re_scr_file, filename, nmatch, pmatch, 0) == REG_NOMATCH)
+/* compute the literal prefix and suffix required of any string matching
+ * the given extended regular expression, these are left as NULL if the
+ * pattern does not require one, we are conservative here since a false
+ * prefilter match just falls through to regexec */
+static void scri_pattern_literals(struct scri_pattern* pat, const char* regex)
+{
+  pat->prefix     = NULL;
+  pat->prefix_len = 0;
+  pat->suffix     = NULL;
+  pat->suffix_len = 0;
+
+  /* alternation at any level can defeat both anchors, so give up */
+  if (strchr(regex, '|') != NULL) {
+    return;
+  }
+
+  size_t len = strlen(regex);
+
+  /* with a leading ^ anchor, collect literal characters that follow */
+  if (len > 0 && regex[0] == '^') {
+    size_t end = 1;
+    while (end < len && ! scri_is_regex_special(regex[end])) {
+      end++;
+    }
+
+    /* the last literal is optional if followed by *, ?, or {m,n} */
+    if (end < len && end > 1 && scri_is_regex_optional(regex[end])) {
+      end--;
+    }
+
+    if (end > 1) {
+      pat->prefix_len = end - 1;
+      pat->prefix     = strndup(regex + 1, pat->prefix_len);
+    }
+  }
+
+  /* with a trailing unescaped $ anchor, collect literal characters before it */
+  if (len > 1 && regex[len - 1] == '$' && regex[len - 2] != '\\') {
+    size_t start = len - 1;
+    while (start > 0 &&
+           ! scri_is_regex_special(regex[start - 1]) &&
+           (start < 2 || regex[start - 2] != '\\'))
+    {
+      start--;
+    }
+
+    /* a literal run that begins the pattern is a valid suffix,
+     * but if it's preceded by ^ then it was fully captured above */
+    if (start < len - 1) {
+      pat->suffix_len = (len - 1) - start;
+      pat->suffix     = strndup(regex + start, pat->suffix_len);
+    }
+  }
+}
+
+/* compile the given extended regular expression into pat, returns regcomp code */
+static int scri_pattern_compile(struct scri_pattern* pat, const char* regex)
+{
+  int rc = regcomp(&pat->re, regex, REG_EXTENDED);
+  if (rc == 0) {
+    scri_pattern_literals(pat, regex);
+  }
+  return rc;
+}
+
+/* free resources associated with pattern */
+static void scri_pattern_free(struct scri_pattern* pat)
+{
+  regfree(&pat->re);
+  if (pat->prefix != NULL) {
+    free(pat->prefix);
+    pat->prefix = NULL;
+  }
+  if (pat->suffix != NULL) {
+    free(pat->suffix);
+    pat->suffix = NULL;
+  }
+}
+
+/* returns 1 if the filename ends with the SCR file extension,
+ * this matches the regex ".scr$" without calling regexec */
+static int scri_is_scr_file(const char* filename, size_t len)
+{
+  return (len >= 4 && strcmp(filename + len - 3, "scr") == 0);
+}
+
+/* given a filename and pattern, return whether there is a match */
+static int scri_file_matches(const char* filename, const struct scri_pattern* pat)
+{
+  size_t len = strlen(filename);
+
+  /* reject quickly on the literal prefix and suffix */
+  if (pat->prefix != NULL &&
+      strncmp(filename, pat->prefix, pat->prefix_len) != 0)
+  {
+    return 0;
+  }
+  if (pat->suffix != NULL &&
+      (len < pat->suffix_len ||
+       memcmp(filename + len - pat->suffix_len, pat->suffix, pat->suffix_len) != 0))
   {
+    return 0;
+  }
+
+  /* check that it's *not* an .scr file */
+  if (scri_is_scr_file(filename, len)) {
+    return 0;
+  }
+
+  /* check for a match on the filename */
+  if (regexec(&pat->re, filename, 0, NULL, 0) == 0) {
     return 1;
   }
   return 0;
 }
 
+/* allocate the descriptor table with one entry per descriptor the
+ * process may open, if this fails we always scan instead */
+static void scri_fd_map_init()
+{
+  struct rlimit lim;
+  if (getrlimit(RLIMIT_NOFILE, &lim) != 0 ||
+      lim.rlim_cur == RLIM_INFINITY || lim.rlim_cur > (rlim_t) SCRI_FD_MAP_MAX)
+  {
+    lim.rlim_cur = (rlim_t) SCRI_FD_MAP_MAX;
+  }
+
+  int size = (int) lim.rlim_cur;
+  int* map = (int*) malloc(size * sizeof(int));
+  if (map == NULL) {
+    if (scri_debug > 0) {
+      fprintf(stderr,"SCRI: Failed to allocate file descriptor table of %d entries, using scan @ %s:%d\n",
+              size, __FILE__, __LINE__
+      );
+    }
+    return;
+  }
+
+  int i;
+  for (i = 0; i < size; i++) {
+    map[i] = -1;
+  }
+  scri_fd_map      = map;
+  scri_fd_map_size = size;
+}
+
+/* associate fd with the given checkpoint file index, or -1 to clear it */
+static void scri_fd_map_set(int fd, int index)
+{
+  if (fd >= 0 && fd < scri_fd_map_size) {
+    scri_fd_map[fd] = index;
+  }
+}
+
+/* return checkpoint file index associated with fd, -1 if none,
+ * or -2 if fd is not covered by the table and the caller must scan */
+static int scri_fd_map_get(int fd)
+{
+  if (fd < 0) {
+    return -1;
+  }
+  if (fd >= scri_fd_map_size) {
+    return -2;
+  }
+  return scri_fd_map[fd];
+}
+
 /* start a new checkpoint if not already in one, mark each file as need_closed */
 static int scri_start_checkpoint()
 {
@@ -194,6 +380,19 @@ static int scri_complete_checkpoint(int index)
 
     /* if there are no files yet to be completed, complete the checkpoint */
     if (!still_open) {
+      /* report bytes we saw written to checkpoint files */
+      if (scri_debug > 0) {
+        unsigned long long bytes = 0;
+        for(i=0; i<MAX_CHECKPOINT_FILES; i++) {
+          if (scri_checkpoint_files[i].valid) {
+            bytes += scri_checkpoint_files[i].bytes;
+          }
+        }
+        fprintf(stderr,"SCRI: Rank %d: Completing checkpoint, %llu bytes written via write/pwrite\n",
+                scri_rank, bytes
+        );
+      }
+
       /* disable the interposer since SCR_Complete_checkpoint calls open/close */
       scri_interpose_enabled = 0;
       SCR_Complete_checkpoint(1);
@@ -213,7 +412,7 @@ static int scri_index_by_filename(const char* filename)
   int i;
   for(i=0; i<MAX_CHECKPOINT_FILES; i++) {
     if (scri_checkpoint_files[i].valid &&
-        scri_file_matches(filename, &scri_checkpoint_files[i].re))
+        scri_file_matches(filename, &scri_checkpoint_files[i].pat))
     {
       return i;
     }
@@ -224,29 +423,53 @@ static int scri_index_by_filename(const char* filename)
 /* lookup a checkpoint file index given an open file descriptor */
 static int scri_index_by_fd(const int fd)
 {
-  int i;
-  for(i=0; i<MAX_CHECKPOINT_FILES; i++) {
-    if (scri_checkpoint_files[i].valid &&
-        scri_checkpoint_files[i].ftype == SCRI_FD &&
-        fd == scri_checkpoint_files[i].fd)
-    {
-      return i;
+  int i = scri_fd_map_get(fd);
+  if (i == -2) {
+    for (i = 0; i < MAX_CHECKPOINT_FILES; i++) {
+      if (scri_checkpoint_files[i].valid &&
+          scri_checkpoint_files[i].ftype == SCRI_FD &&
+          fd == scri_checkpoint_files[i].fd)
+      {
+        return i;
+      }
     }
+    return MAX_CHECKPOINT_FILES;
+  }
+  if (i >= 0 &&
+      scri_checkpoint_files[i].valid &&
+      scri_checkpoint_files[i].ftype == SCRI_FD &&
+      fd == scri_checkpoint_files[i].fd)
+  {
+    return i;
   }
   return MAX_CHECKPOINT_FILES;
 }
 
-/* lookup a checkpoint file index given an open file stream */
-static int scri_index_by_fstream(const FILE* fstream)
+/* lookup a checkpoint file index given an open file stream,
+ * must be called before the stream is closed */
+static int scri_index_by_fstream(FILE* fstream)
 {
-  int i;
-  for(i=0; i<MAX_CHECKPOINT_FILES; i++) {
-    if (scri_checkpoint_files[i].valid &&
-        scri_checkpoint_files[i].ftype == SCRI_FSTREAM &&
-        fstream == scri_checkpoint_files[i].fstream)
-    {
-      return i;
+  if (fstream == NULL) {
+    return MAX_CHECKPOINT_FILES;
+  }
+  int i = scri_fd_map_get(fileno(fstream));
+  if (i == -2) {
+    for (i = 0; i < MAX_CHECKPOINT_FILES; i++) {
+      if (scri_checkpoint_files[i].valid &&
+          scri_checkpoint_files[i].ftype == SCRI_FSTREAM &&
+          fstream == scri_checkpoint_files[i].fstream)
+      {
+        return i;
+      }
     }
+    return MAX_CHECKPOINT_FILES;
+  }
+  if (i >= 0 &&
+      scri_checkpoint_files[i].valid &&
+      scri_checkpoint_files[i].ftype == SCRI_FSTREAM &&
+      fstream == scri_checkpoint_files[i].fstream)
+  {
+    return i;
   }
   return MAX_CHECKPOINT_FILES;
 }
@@ -256,7 +479,7 @@ static int scri_is_checkpoint_dirname(const char* name)
 {
   if (scri_interpose_enabled &&
       scri_checkpoint_dir_valid &&
-      scri_file_matches(name, &scri_re_checkpoint_dir))
+      scri_file_matches(name, &scri_checkpoint_dir))
   {
     return 1;
   }
@@ -290,7 +513,7 @@ static int scri_is_checkpoint_fd(const int fd)
 }
 
 /* returns 1 if the given file stream is a checkpoint file, and 0 otherwise */
-static int scri_is_checkpoint_fstream(const FILE* fstream)
+static int scri_is_checkpoint_fstream(FILE* fstream)
 {
   int i = scri_index_by_fstream(fstream);
   if (scri_interpose_enabled &&
@@ -302,6 +525,17 @@ static int scri_is_checkpoint_fstream(const FILE* fstream)
   return 0;
 }
 
+/* add bytes written to fd to its checkpoint file entry if it has one */
+static void scri_count_bytes(const int fd, ssize_t bytes)
+{
+  if (bytes > 0) {
+    int i = scri_index_by_fd(fd);
+    if (i < MAX_CHECKPOINT_FILES) {
+      scri_checkpoint_files[i].bytes += (unsigned long long) bytes;
+    }
+  }
+}
+
 /* record file descriptor and flags used in open call for this filename */
 static int scri_add_checkpoint_fd(const char* file, const char* temp, const int fd, const int flags)
 {
@@ -311,6 +545,8 @@ static int scri_add_checkpoint_fd(const char* file, const char* temp, const int
     scri_checkpoint_files[i].ftype    = SCRI_FD;
     scri_checkpoint_files[i].fd       = fd;
     scri_checkpoint_files[i].flags    = flags;
+    scri_checkpoint_files[i].bytes    = 0;
+    scri_fd_map_set(fd, i);
     return 0;
   }
 
@@ -332,6 +568,7 @@ static int scri_drop_checkpoint_fd(const int fd)
       free(scri_checkpoint_files[i].tempname);
       scri_checkpoint_files[i].tempname = NULL;
     }
+    scri_fd_map_set(fd, -1);
     scri_checkpoint_files[i].ftype = SCRI_FNULL;
     scri_checkpoint_files[i].fd    = -1;
     scri_checkpoint_files[i].flags = 0;
@@ -342,14 +579,17 @@ static int scri_drop_checkpoint_fd(const int fd)
 }
 
 /* record the fstream value and the mode used in the fopen call for this filename */
-static int scri_add_checkpoint_fstream(const char* file, const char* temp, const FILE* fstream, const char* mode)
+static int scri_add_checkpoint_fstream(const char* file, const char* temp, FILE* fstream, const char* mode)
 {
   int i = scri_index_by_filename(file);
   if (i < MAX_CHECKPOINT_FILES) {
     scri_checkpoint_files[i].tempname = strdup(temp);
     scri_checkpoint_files[i].ftype    = SCRI_FSTREAM;
-    scri_checkpoint_files[i].fstream  = (FILE*) fstream;
+    scri_checkpoint_files[i].fd       = fileno(fstream);
+    scri_checkpoint_files[i].fstream  = fstream;
     scri_checkpoint_files[i].mode     = strdup(mode);
+    scri_checkpoint_files[i].bytes    = 0;
+    scri_fd_map_set(scri_checkpoint_files[i].fd, i);
     return 0;
   }
 
@@ -362,16 +602,17 @@ static int scri_add_checkpoint_fstream(const char* file, const char* temp, const
   return 1;
 }
 
-/* drop the fstream for this filename (file has been closed) */
-static int scri_drop_checkpoint_fstream(const FILE* fstream)
+/* drop the checkpoint file entry at index i for a stream (file has been closed) */
+static int scri_drop_checkpoint_fstream(int i)
 {
-  int i = scri_index_by_fstream(fstream);
   if (i < MAX_CHECKPOINT_FILES) {
+    scri_fd_map_set(scri_checkpoint_files[i].fd, -1);
     if (scri_checkpoint_files[i].tempname != NULL) {
       free(scri_checkpoint_files[i].tempname);
       scri_checkpoint_files[i].tempname = NULL;
     }
     scri_checkpoint_files[i].ftype   = SCRI_FNULL;
+    scri_checkpoint_files[i].fd      = -1;
     scri_checkpoint_files[i].fstream = NULL;
     if (scri_checkpoint_files[i].mode != NULL) {
       free(scri_checkpoint_files[i].mode);
@@ -387,7 +628,7 @@ static int scri_drop_checkpoint_fstream(const FILE* fstream)
 static int scri_define_checkpoint_dirname_regex(const char* dirname)
 {
   /* compile the filename regex pattern */
-  int rc = regcomp(&scri_re_checkpoint_dir, dirname, REG_EXTENDED);
+  int rc = scri_pattern_compile(&scri_checkpoint_dir, dirname);
   if (rc != 0) {
     fprintf(stderr,"SCRI: ERROR: Checkpoint directory name regex compilation for %s failed (rc=%d) @ %s:%d\n",
             dirname, rc, __FILE__, __LINE__
@@ -418,7 +659,7 @@ static int scri_define_checkpoint_filename_regex(const char* filename)
       }
 
       /* compile the filename regex pattern */
-      int rc = regcomp(&scri_checkpoint_files[i].re, filename, REG_EXTENDED);
+      int rc = scri_pattern_compile(&scri_checkpoint_files[i].pat, filename);
       if (rc != 0) {
         fprintf(stderr,"SCRI: ERROR: Failed to compile filename regex %s (rc=%d) @ %s:%d\n",
                 filename, rc, __FILE__, __LINE__
@@ -617,9 +858,15 @@ static void scr_interpose_init()
   if (scri_real_open == NULL) {
     scri_real_open  = (int (*)(const char *, int, ...)) mydlsym("open");
   }
-  /*
-  scri_real_open  = (int (*)(const char *, int, mode_t)) mydlsym("open");
-  */
+  if (scri_real_open64 == NULL) {
+    scri_real_open64 = (int (*)(const char *, int, ...)) mydlsym("open64");
+  }
+  if (scri_real_openat == NULL) {
+    scri_real_openat = (int (*)(int, const char *, int, ...)) mydlsym("openat");
+  }
+  if (scri_real_creat == NULL) {
+    scri_real_creat  = (int (*)(const char *, mode_t)) mydlsym("creat");
+  }
   if (scri_real_close == NULL) {
     scri_real_close = (int (*)(int fd)) mydlsym("close");
   }
@@ -628,6 +875,9 @@ static void scr_interpose_init()
   if (scri_real_fopen == NULL) {
     scri_real_fopen  = (FILE* (*)(const char *, const char *)) mydlsym("fopen");
   }
+  if (scri_real_fopen64 == NULL) {
+    scri_real_fopen64 = (FILE* (*)(const char *, const char *)) mydlsym("fopen64");
+  }
   if (scri_real_fclose == NULL) {
     scri_real_fclose = (int (*)(FILE*)) mydlsym("fclose");
   }
@@ -637,11 +887,22 @@ static void scr_interpose_init()
     scri_real_mkdir = (int (*)(const char*, mode_t)) mydlsym("mkdir");
   }
 
-  /* interpose read/write functions */
-/*
-  real_read  = (ssize_t (*)(int fd, void *buf, size_t count))       mydlsym("read");
-  real_write = (ssize_t (*)(int fd, const void *buf, size_t count)) mydlsym("write");
-*/
+  /* interpose write functions */
+  if (scri_real_write == NULL) {
+    scri_real_write    = (ssize_t (*)(int, const void *, size_t)) mydlsym("write");
+  }
+  if (scri_real_pwrite == NULL) {
+    scri_real_pwrite   = (ssize_t (*)(int, const void *, size_t, off_t)) mydlsym("pwrite");
+  }
+  if (scri_real_pwrite64 == NULL) {
+    scri_real_pwrite64 = (ssize_t (*)(int, const void *, size_t, off64_t)) mydlsym("pwrite64");
+  }
+
+  /* print byte counts if debugging is enabled */
+  char* value = getenv("SCR_DEBUG");
+  if (value != NULL) {
+    scri_debug = atoi(value);
+  }
 
   /* initialize the data structures */
   if (!scri_checkpoint_files_valid) {
@@ -657,9 +918,15 @@ static void scr_interpose_init()
       scri_checkpoint_files[i].flags    = 0;
       scri_checkpoint_files[i].fstream  = NULL;
       scri_checkpoint_files[i].mode     = NULL;
+      scri_checkpoint_files[i].bytes    = 0;
     }
   }
 
+  /* allocate the descriptor table */
+  if (scri_fd_map == NULL) {
+    scri_fd_map_init();
+  }
+
   /* compile the low-high range regex pattern */
   /* we surround each regcomp with a compiled flag in case the call to regex,
    * leads to a call to open, which in turns calls scri_init() again
@@ -667,7 +934,6 @@ static void scr_interpose_init()
   int rc;
   char low_high_range[] = "^([0-9]+)-([0-9]+):";
   char low_N_range[]    = "^([0-9]+)-(N):";
-  char scr_file_ext[]   = ".scr$";
   if (!scri_re_low_high_compiled) {
     scri_re_low_high_compiled = 1;
     rc = regcomp(&scri_re_low_high, low_high_range, REG_EXTENDED);
@@ -688,16 +954,6 @@ static void scr_interpose_init()
       exit(1);
     }
   }
-  if (!scri_re_scr_file_compiled) {
-    scri_re_scr_file_compiled = 1;
-    rc = regcomp(&scri_re_scr_file, scr_file_ext, REG_EXTENDED);
-    if (rc != 0) {
-      fprintf(stderr,"SCRI: ERROR: Failed to compile scr file extension regex: %s (rc=%d) @ %s:%d\n",
-             scr_file_ext, rc, __FILE__, __LINE__
-      );
-      exit(1);
-    }
-  }
 
   scri_interpose_enabled = 1;
   scri_initialized = 1;
@@ -765,9 +1021,8 @@ int MPI_Finalize ()
   /* free off the regular expression structures */
   regfree(&scri_re_low_high);
   regfree(&scri_re_low_N);
-  regfree(&scri_re_scr_file);
   if (scri_checkpoint_dir_valid) {
-    regfree(&scri_re_checkpoint_dir);
+    scri_pattern_free(&scri_checkpoint_dir);
   }
   if (scri_checkpoint_files_valid) {
     int i;
@@ -783,11 +1038,18 @@ int MPI_Finalize ()
           free(scri_checkpoint_files[i].tempname);
           scri_checkpoint_files[i].tempname = NULL;
         }
-        regfree(&scri_checkpoint_files[i].re);
+        scri_pattern_free(&scri_checkpoint_files[i].pat);
       }
     }
   }
 
+  /* free the file descriptor table */
+  if (scri_fd_map != NULL) {
+    free(scri_fd_map);
+    scri_fd_map = NULL;
+  }
+  scri_fd_map_size = 0;
+
   /* call the real MPI_Finalize */
   rc = (*scri_real_mpi_fini)();
 
@@ -800,22 +1062,17 @@ Interpose open/close functions
 ==============================================================================
 */
 
-#ifdef open 
-#undef open
-#endif
-/*
-int open(const char *pathname, int flags, mode_t mode)
-*/
-int open(const char *pathname, int flags, ...)
+/* common logic for the open family, if pathname is a checkpoint file
+ * start a checkpoint when opened for writing and route it to cache,
+ * sets checkpoint to 1 if pathname is a checkpoint file and returns
+ * the name of the file to actually open, which may point to temp */
+static const char* scri_route_open(const char* pathname, int flags, char* temp, int* checkpoint)
 {
   const char* name = pathname;
 
-  if (!scri_initialized) { scr_interpose_init(); }
-
   /* check whether pathname matches pattern for a checkpoint file */
-  char temp[SCR_MAX_FILENAME];
-  int checkpoint = scri_is_checkpoint_filename(pathname);
-  if (checkpoint) {
+  *checkpoint = scri_is_checkpoint_filename(pathname);
+  if (*checkpoint) {
     /* don't start a new checkpoint if the file is being opened as read-only */
     /* O_RDONLY == 0 so we can't do a straight bit test, instead check whether either RDWR or WRONLY is set */
     /* TODO: must be a better way to do this */
@@ -830,6 +1087,39 @@ int open(const char *pathname, int flags, ...)
     }
     scri_interpose_enabled = 1;
   }
+  return name;
+}
+
+/* record the file descriptor returned by a call in the open family */
+static void scri_record_open(int checkpoint, const char* pathname, const char* name, int fd, int flags)
+{
+  /* mark file descriptor as checkpoint file */
+  if (checkpoint) {
+    if (fd < 0) {
+      /* Don't want to kick out here because user may have expected this open to fail, e.g., read-only */
+      fprintf(stderr,"SCRI: ERROR: Failed to open %s for rerouting %s (errno=%d %s) @ %s:%d\n",
+              name, pathname, errno, strerror(errno), __FILE__, __LINE__
+      );
+    } else {
+      scri_add_checkpoint_fd(pathname, name, fd, flags);
+    }
+  }
+}
+
+#ifdef open 
+#undef open
+#endif
+/*
+int open(const char *pathname, int flags, mode_t mode)
+*/
+int open(const char *pathname, int flags, ...)
+{
+  if (!scri_initialized) { scr_interpose_init(); }
+
+  /* check whether pathname matches pattern for a checkpoint file */
+  char temp[SCR_MAX_FILENAME];
+  int checkpoint;
+  const char* name = scri_route_open(pathname, flags, temp, &checkpoint);
 
   /* extract the mode (see man 2 open) */
   mode_t mode = 0;
@@ -844,21 +1134,103 @@ int open(const char *pathname, int flags, ...)
   int rc = (*scri_real_open)(name, flags, mode);
 
   /* mark file descriptor as checkpoint file */
-  if (checkpoint) {
-    if (rc < 0) {
-      /* Don't want to kick out here because user may have expected this open to fail, e.g., read-only */
-      fprintf(stderr,"SCRI: ERROR: Failed to open %s for rerouting %s (errno=%d %s) @ %s:%d\n",
-              name, pathname, errno, strerror(errno), __FILE__, __LINE__
-      );
-    } else {
-      scri_add_checkpoint_fd(pathname, name, rc, flags);
-    }
+  scri_record_open(checkpoint, pathname, name, rc, flags);
+
+  /* return what ever the real open call returned */
+  return rc;
+}
+
+#ifdef open64
+#undef open64
+#endif
+int open64(const char *pathname, int flags, ...)
+{
+  if (!scri_initialized) { scr_interpose_init(); }
+
+  /* check whether pathname matches pattern for a checkpoint file */
+  char temp[SCR_MAX_FILENAME];
+  int checkpoint;
+  const char* name = scri_route_open(pathname, flags, temp, &checkpoint);
+
+  /* extract the mode (see man 2 open) */
+  mode_t mode = 0;
+  if (flags & O_CREAT) {
+    va_list ap;
+    va_start(ap, flags);
+    mode = va_arg(ap, mode_t);
+    va_end(ap);
   }
 
+  /* open the file */
+  int rc = (*scri_real_open64)(name, flags, mode);
+
+  /* mark file descriptor as checkpoint file */
+  scri_record_open(checkpoint, pathname, name, rc, flags);
+
   /* return what ever the real open call returned */
   return rc;
 }
 
+#ifdef openat
+#undef openat
+#endif
+int openat(int dirfd, const char *pathname, int flags, ...)
+{
+  if (!scri_initialized) { scr_interpose_init(); }
+
+  /* we can only match names that are resolved the same way as open,
+   * so skip paths that are relative to some other directory */
+  char temp[SCR_MAX_FILENAME];
+  int checkpoint = 0;
+  const char* name = pathname;
+  if (dirfd == AT_FDCWD || pathname[0] == '/') {
+    name = scri_route_open(pathname, flags, temp, &checkpoint);
+  }
+
+  /* extract the mode (see man 2 open) */
+  mode_t mode = 0;
+  if (flags & O_CREAT) {
+    va_list ap;
+    va_start(ap, flags);
+    mode = va_arg(ap, mode_t);
+    va_end(ap);
+  }
+
+  /* open the file, the routed name is absolute so dirfd is ignored */
+  int rc = (*scri_real_openat)(dirfd, name, flags, mode);
+
+  /* mark file descriptor as checkpoint file */
+  scri_record_open(checkpoint, pathname, name, rc, flags);
+
+  /* return what ever the real open call returned */
+  return rc;
+}
+
+#ifdef creat
+#undef creat
+#endif
+int creat(const char *pathname, mode_t mode)
+{
+  if (!scri_initialized) { scr_interpose_init(); }
+
+  /* creat is equivalent to open with these flags */
+  int flags = O_CREAT | O_WRONLY | O_TRUNC;
+
+  /* check whether pathname matches pattern for a checkpoint file */
+  char temp[SCR_MAX_FILENAME];
+  int checkpoint;
+  const char* name = scri_route_open(pathname, flags, temp, &checkpoint);
+
+  /* open the file */
+  int rc = (*scri_real_creat)(name, mode);
+
+  /* mark file descriptor as checkpoint file */
+  scri_record_open(checkpoint, pathname, name, rc, flags);
+
+  /* return what ever the real creat call returned */
+  return rc;
+}
+
 #ifdef close 
 #undef close
 #endif
@@ -885,15 +1257,11 @@ int close(int fd)
   return rc;
 } 
 
-#ifdef fopen 
-#undef fopen
-#endif
-FILE* fopen(const char * pathname, const char * mode)
+/* common logic for fopen and fopen64 */
+static FILE* scri_fopen(FILE* (*real_fopen)(const char*, const char*), const char* pathname, const char* mode)
 {
   const char* name = pathname;
 
-  if (!scri_initialized) { scr_interpose_init(); }
-
   /* check whether pathname matches pattern for a checkpoint file */
   char temp[SCR_MAX_FILENAME];
   int checkpoint = scri_is_checkpoint_filename(pathname);
@@ -912,7 +1280,7 @@ FILE* fopen(const char * pathname, const char * mode)
   }
 
   /* open the file */
-  FILE* rc = (*scri_real_fopen)(name, mode);
+  FILE* rc = (*real_fopen)(name, mode);
 
   /* mark file descriptor as checkpoint file */
   if (checkpoint) {
@@ -930,6 +1298,24 @@ FILE* fopen(const char * pathname, const char * mode)
   return rc;
 }
 
+#ifdef fopen 
+#undef fopen
+#endif
+FILE* fopen(const char * pathname, const char * mode)
+{
+  if (!scri_initialized) { scr_interpose_init(); }
+  return scri_fopen(scri_real_fopen, pathname, mode);
+}
+
+#ifdef fopen64
+#undef fopen64
+#endif
+FILE* fopen64(const char * pathname, const char * mode)
+{
+  if (!scri_initialized) { scr_interpose_init(); }
+  return scri_fopen(scri_real_fopen64, pathname, mode);
+}
+
 #ifdef fclose 
 #undef fclose
 #endif
@@ -939,23 +1325,69 @@ int fclose(FILE* fstream)
 
   /* TODO: need to fsync here as well? */
 
+  /* look up the stream before closing it, since we can't
+   * query its file descriptor after it has been closed */
+  int checkpoint = scri_is_checkpoint_fstream(fstream);
+  int i = scri_index_by_fstream(fstream);
+
   /* close the file */
   int rc = (*scri_real_fclose)(fstream);
 
   /* if fd matches a checkpoint file, call SCR_COMPLETE and then remove fd from list */
-  if (scri_is_checkpoint_fstream(fstream)) {
+  if (checkpoint) {
     /* complete the checkpoint */
-    int i = scri_index_by_fstream(fstream);
     scri_complete_checkpoint(i);
 
     /* drop the file descriptor from our active set */
-    scri_drop_checkpoint_fstream(fstream);
+    scri_drop_checkpoint_fstream(i);
   }
 
   /* return what ever the real close call gave us */
   return rc;
 } 
 
+/*
+==============================================================================
+Interpose write functions
+==============================================================================
+*/
+
+#ifdef write
+#undef write
+#endif
+ssize_t write(int fd, const void *buf, size_t count)
+{
+  if (!scri_initialized) { scr_interpose_init(); }
+
+  ssize_t rc = (*scri_real_write)(fd, buf, count);
+  scri_count_bytes(fd, rc);
+  return rc;
+}
+
+#ifdef pwrite
+#undef pwrite
+#endif
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset)
+{
+  if (!scri_initialized) { scr_interpose_init(); }
+
+  ssize_t rc = (*scri_real_pwrite)(fd, buf, count, offset);
+  scri_count_bytes(fd, rc);
+  return rc;
+}
+
+#ifdef pwrite64
+#undef pwrite64
+#endif
+ssize_t pwrite64(int fd, const void *buf, size_t count, off64_t offset)
+{
+  if (!scri_initialized) { scr_interpose_init(); }
+
+  ssize_t rc = (*scri_real_pwrite64)(fd, buf, count, offset);
+  scri_count_bytes(fd, rc);
+  return rc;
+}
+
 /*
 ==============================================================================
 Interpose mkdir functions
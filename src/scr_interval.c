@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2009, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-411039.
+ * All rights reserved.
+ * This file is part of The Scalable Checkpoint / Restart (SCR) library.
+ * For details, see https://sourceforge.net/projects/scalablecr/
+ * Please also read this file: LICENSE.TXT.
+*/
+
+#include "scr_globals.h"
+
+#include <math.h>
+
+/*
+=========================================
+Checkpoint interval tuner
+=========================================
+*/
+
+/* With SCR_CHECKPOINT_AUTO set, SCR_Need_checkpoint computes the
+ * checkpoint interval with Daly's model from the average cost of a
+ * checkpoint and the mean time between failures of the job.  Both
+ * are kept in a file in the prefix directory so that the next run
+ * starts from what earlier runs measured.  Each run marks the file as
+ * running when it starts and clears the mark in SCR_Finalize, so a
+ * run that finds the mark still set knows the previous run failed. */
+
+/* we weight the saved average cost as though it came from at most
+ * this many checkpoints, so that the estimate follows changes in cost */
+#define SCR_INTERVAL_MAX_COUNT (16)
+
+static spath* scr_interval_file = NULL;
+
+static double scr_interval_cost     = 0.0; /* average checkpoint cost in secs */
+static int    scr_interval_count    = 0;   /* number of checkpoints in average */
+static double scr_interval_runtime  = 0.0; /* secs run by earlier runs */
+static int    scr_interval_failures = 0;   /* number of failed runs */
+static double scr_interval_start    = 0.0; /* time this run started */
+static double scr_interval_secs     = 0.0; /* current interval, 0 if unknown */
+
+/* optimum time between checkpoints for the given cost and mean time
+ * between failures, following Daly's higher order estimate */
+static double scr_interval_daly(double cost, double mtbf)
+{
+  if (cost >= 2.0 * mtbf) {
+    return mtbf;
+  }
+  double x = cost / (2.0 * mtbf);
+  return sqrt(2.0 * cost * mtbf) * (1.0 + sqrt(x) / 3.0 + x / 9.0) - cost;
+}
+
+/* recompute the interval from our current estimates */
+static void scr_interval_update(void)
+{
+  /* total time observed, counting this run so far */
+  double runtime = scr_interval_runtime + (MPI_Wtime() - scr_interval_start);
+
+  /* without a failure, we only know that the mean time between failures
+   * is at least as long as we've run, and it's at least the configured seed */
+  double mtbf = scr_checkpoint_mtbf;
+  if (scr_interval_failures > 0) {
+    mtbf = runtime / (double) scr_interval_failures;
+  } else if (runtime > mtbf) {
+    mtbf = runtime;
+  }
+
+  if (scr_interval_count > 0 && mtbf > 0.0) {
+    scr_interval_secs = scr_interval_daly(scr_interval_cost, mtbf);
+    scr_dbg(2, "Checkpoint interval %f secs from cost %f secs and MTBF %f secs",
+      scr_interval_secs, scr_interval_cost, mtbf
+    );
+  }
+}
+
+/* write our estimates to the file in the prefix directory */
+static void scr_interval_write(int running)
+{
+  double runtime = scr_interval_runtime + (MPI_Wtime() - scr_interval_start);
+
+  kvtree* hash = kvtree_new();
+  kvtree_util_set_double(hash, SCR_INTERVAL_KEY_COST,     scr_interval_cost);
+  kvtree_util_set_int(hash,    SCR_INTERVAL_KEY_COUNT,    scr_interval_count);
+  kvtree_util_set_double(hash, SCR_INTERVAL_KEY_RUNTIME,  runtime);
+  kvtree_util_set_int(hash,    SCR_INTERVAL_KEY_FAILURES, scr_interval_failures);
+  kvtree_util_set_int(hash,    SCR_INTERVAL_KEY_RUNNING,  running);
+  if (kvtree_write_path(scr_interval_file, hash) != KVTREE_SUCCESS) {
+    scr_dbg(1, "Failed to write checkpoint interval file @ %s:%d",
+      __FILE__, __LINE__
+    );
+  }
+  kvtree_delete(&hash);
+}
+
+void scr_interval_init(void)
+{
+  scr_interval_file = spath_from_str(scr_prefix_scr);
+  spath_append_str(scr_interval_file, "interval.scr");
+
+  scr_interval_start = MPI_Wtime();
+
+  /* read what earlier runs recorded, if anything */
+  kvtree* hash = kvtree_new();
+  if (kvtree_read_path(scr_interval_file, hash) == KVTREE_SUCCESS) {
+    kvtree_util_get_double(hash, SCR_INTERVAL_KEY_COST,     &scr_interval_cost);
+    kvtree_util_get_int(hash,    SCR_INTERVAL_KEY_COUNT,    &scr_interval_count);
+    kvtree_util_get_double(hash, SCR_INTERVAL_KEY_RUNTIME,  &scr_interval_runtime);
+    kvtree_util_get_int(hash,    SCR_INTERVAL_KEY_FAILURES, &scr_interval_failures);
+
+    /* the previous run never reached SCR_Finalize, so count it as a failure */
+    int running = 0;
+    kvtree_util_get_int(hash, SCR_INTERVAL_KEY_RUNNING, &running);
+    if (running) {
+      scr_interval_failures++;
+    }
+  }
+  kvtree_delete(&hash);
+
+  scr_interval_update();
+  scr_dbg(1, "Checkpoint interval tuner: cost %f secs over %d checkpoints, %d failures in %f secs",
+    scr_interval_cost, scr_interval_count, scr_interval_failures, scr_interval_runtime
+  );
+
+  /* mark this run as running so the next run can tell if we fail */
+  scr_interval_write(1);
+}
+
+void scr_interval_record(double cost)
+{
+  /* fold the new cost into the running average */
+  int count = scr_interval_count;
+  if (count > SCR_INTERVAL_MAX_COUNT - 1) {
+    count = SCR_INTERVAL_MAX_COUNT - 1;
+  }
+  scr_interval_cost = (scr_interval_cost * (double) count + cost) / (double) (count + 1);
+  scr_interval_count++;
+
+  scr_interval_update();
+  scr_interval_write(1);
+}
+
+int scr_interval_need(double last_end, double now)
+{
+  /* the mean time between failures grows as we run without failing */
+  scr_interval_update();
+
+  if (scr_interval_secs <= 0.0) {
+    return -1;
+  }
+  return (now - last_end >= scr_interval_secs);
+}
+
+void scr_interval_finalize(void)
+{
+  scr_interval_write(0);
+  spath_delete(&scr_interval_file);
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2009, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-411039.
+ * All rights reserved.
+ * This file is part of The Scalable Checkpoint / Restart (SCR) library.
+ * For details, see https://sourceforge.net/projects/scalablecr/
+ * Please also read this file: LICENSE.TXT.
+*/
+
+#ifndef SCR_INTERVAL_H
+#define SCR_INTERVAL_H
+
+/* read the checkpoint cost and failure history saved by earlier runs,
+ * counting the last run as a failure if it did not finalize,
+ * only rank 0 should call this */
+void scr_interval_init(void);
+
+/* record the cost in seconds of a checkpoint that just completed,
+ * recompute the interval, and save the history, only rank 0 should call this */
+void scr_interval_record(double cost);
+
+/* returns 1 if the tuned interval has elapsed since the given end time
+ * of the last checkpoint, 0 if not, and -1 if there is not yet enough
+ * history to compute an interval, only rank 0 should call this */
+int scr_interval_need(double last_end, double now);
+
+/* save the history and mark the run as having finalized,
+ * only rank 0 should call this */
+void scr_interval_finalize(void);
+
+#endif
@@ -33,6 +33,9 @@
 /* Implements a reliable open/read/write/close interface via open and close.
  * Implements directory manipulation functions. */
 
+/* need this to pick up fallocate and FALLOC_FL_KEEP_SIZE */
+#define _GNU_SOURCE
+
 #include "scr_conf.h"
 #include "scr.h"
 #include "scr_err.h"
@@ -165,6 +168,21 @@ int scr_close(const char* file, int fd)
   return SCR_SUCCESS;
 }
 
+/* close file without an fsync, for files on memory-backed storage
+ * (tmpfs) where there is no device to sync to */
+int scr_close_nosync(const char* file, int fd)
+{
+  if (close(fd) != 0) {
+    /* hit an error, print message */
+    scr_err("Closing file descriptor %d for file %s: errno=%d %s @ %s:%d",
+      fd, file, errno, strerror(errno), __FILE__, __LINE__
+    );
+    return SCR_FAILURE;
+  }
+
+  return SCR_SUCCESS;
+}
+
 int scr_file_lock_read(const char* file, int fd)
 {
   #ifdef SCR_FILE_LOCK_USE_FLOCK
@@ -747,6 +765,27 @@ int scr_file_unlink(const char* file)
   return SCR_SUCCESS;
 }
 
+/* reserve size bytes of storage for an open file without changing its size,
+ * fails only if the file system lacks the space, a file system that
+ * cannot preallocate just extends the file as it is written */
+int scr_file_preallocate(const char* file, int fd, unsigned long size)
+{
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+  if (size > 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t) size) != 0) {
+    if (errno == ENOSPC || errno == EDQUOT) {
+      scr_err("Not enough space to preallocate %lu bytes for %s errno=%d %s @ %s:%d",
+        size, file, errno, strerror(errno), __FILE__, __LINE__
+      );
+      return SCR_FAILURE;
+    }
+    scr_dbg(3, "Failed to preallocate %lu bytes for %s errno=%d %s @ %s:%d",
+      size, file, errno, strerror(errno), __FILE__, __LINE__
+    );
+  }
+#endif
+  return SCR_SUCCESS;
+}
+
 /* opens, reads, and computes the crc32 value for the given filename */
 int scr_crc32(const char* filename, uLong* crc)
 {
@@ -950,6 +989,18 @@ int scr_file_copy(
   posix_fadvise(dst_fd, 0, 0, POSIX_FADV_DONTNEED | POSIX_FADV_SEQUENTIAL);
 #endif
 
+  /* reserve space for the whole file up front, which avoids extending
+   * the file on every write and catches a full file system early */
+  struct stat src_stat;
+  if (fstat(src_fd, &src_stat) == 0 &&
+      scr_file_preallocate(dst_file, dst_fd, (unsigned long) src_stat.st_size) != SCR_SUCCESS)
+  {
+    scr_close(dst_file, dst_fd);
+    scr_close(src_file, src_fd);
+    unlink(dst_file);
+    return SCR_FAILURE;
+  }
+
   /* allocate buffer to read in file chunks */
   char* buf = (char*) malloc(buf_size);
   if (buf == NULL) {
@@ -1021,3 +1072,113 @@ int scr_file_copy(
 
   return rc;
 }
+
+/* copy size bytes starting at src_offset in src_file to dst_offset in dst_file,
+ * creates dst_file if needed but never truncates it, since other processes
+ * may be writing their own ranges of the same file */
+int scr_file_copy_range(
+  const char* src_file,
+  unsigned long src_offset,
+  const char* dst_file,
+  unsigned long dst_offset,
+  unsigned long size,
+  unsigned long buf_size)
+{
+  /* check that we got something for a source file */
+  if (src_file == NULL || strcmp(src_file, "") == 0) {
+    scr_err("Invalid source file @ %s:%d",
+      __FILE__, __LINE__
+    );
+    return SCR_FAILURE;
+  }
+
+  /* check that we got something for a destination file */
+  if (dst_file == NULL || strcmp(dst_file, "") == 0) {
+    scr_err("Invalid destination file @ %s:%d",
+      __FILE__, __LINE__
+    );
+    return SCR_FAILURE;
+  }
+
+  int rc = SCR_SUCCESS;
+
+  /* open src_file for reading */
+  int src_fd = scr_open(src_file, O_RDONLY);
+  if (src_fd < 0) {
+    scr_err("Opening file to copy: scr_open(%s) errno=%d %s @ %s:%d",
+      src_file, errno, strerror(errno), __FILE__, __LINE__
+    );
+    return SCR_FAILURE;
+  }
+
+  /* open dst_file for writing, leaving any existing data in place */
+  mode_t mode_file = scr_getmode(1, 1, 0);
+  int dst_fd = scr_open(dst_file, O_WRONLY | O_CREAT, mode_file);
+  if (dst_fd < 0) {
+    scr_err("Opening file for writing: scr_open(%s) errno=%d %s @ %s:%d",
+      dst_file, errno, strerror(errno), __FILE__, __LINE__
+    );
+    scr_close(src_file, src_fd);
+    return SCR_FAILURE;
+  }
+
+  /* seek to the start of the range in each file */
+  if (scr_lseek(src_file, src_fd, (off_t) src_offset, SEEK_SET) != SCR_SUCCESS ||
+      scr_lseek(dst_file, dst_fd, (off_t) dst_offset, SEEK_SET) != SCR_SUCCESS)
+  {
+    scr_close(dst_file, dst_fd);
+    scr_close(src_file, src_fd);
+    return SCR_FAILURE;
+  }
+
+  /* allocate buffer to read in file chunks */
+  char* buf = (char*) malloc(buf_size);
+  if (buf == NULL) {
+    scr_err("Allocating memory: malloc(%llu) errno=%d %s @ %s:%d",
+      buf_size, errno, strerror(errno), __FILE__, __LINE__
+    );
+    scr_close(dst_file, dst_fd);
+    scr_close(src_file, src_fd);
+    return SCR_FAILURE;
+  }
+
+  /* copy chunks until we have the whole range */
+  unsigned long remaining = size;
+  while (remaining > 0) {
+    size_t count = (size_t) buf_size;
+    if (remaining < buf_size) {
+      count = (size_t) remaining;
+    }
+
+    /* the source must hold the full range, so a short read is an error */
+    ssize_t nread = scr_read_attempt(src_file, src_fd, buf, count);
+    if (nread != (ssize_t) count) {
+      scr_err("Reading %lu bytes at offset %lu from %s @ %s:%d",
+        size, src_offset, src_file, __FILE__, __LINE__
+      );
+      rc = SCR_FAILURE;
+      break;
+    }
+
+    ssize_t nwrite = scr_write_attempt(dst_file, dst_fd, buf, count);
+    if (nwrite != (ssize_t) count) {
+      rc = SCR_FAILURE;
+      break;
+    }
+
+    remaining -= (unsigned long) count;
+  }
+
+  /* free buffer */
+  scr_free(&buf);
+
+  /* close source and destination files */
+  if (scr_close(dst_file, dst_fd) != SCR_SUCCESS) {
+    rc = SCR_FAILURE;
+  }
+  if (scr_close(src_file, src_fd) != SCR_SUCCESS) {
+    rc = SCR_FAILURE;
+  }
+
+  return rc;
+}
@@ -38,6 +38,9 @@ int scr_open(const char* file, int flags, ...);
 /* close file with an fsync */
 int scr_close(const char* file, int fd);
 
+/* close file without an fsync, for files on memory-backed storage */
+int scr_close_nosync(const char* file, int fd);
+
 /* get and release file locks */
 int scr_file_lock_read(const char* file, int fd);
 int scr_file_lock_write(const char* file, int fd);
@@ -108,6 +111,10 @@ int scr_file_is_writeable(const char* file);
 /* delete a file */
 int scr_file_unlink(const char* file);
 
+/* reserve size bytes of storage for an open file without changing its size,
+ * fails only if the file system lacks the space */
+int scr_file_preallocate(const char* file, int fd, unsigned long size);
+
 /* opens, reads, and computes the crc32 value for the given filename */
 int scr_crc32(const char* filename, uLong* crc);
 
@@ -139,4 +146,15 @@ int scr_file_copy(
   uLong* crc
 );
 
+/* copy size bytes from src_offset in src_file to dst_offset in dst_file,
+ * without truncating dst_file */
+int scr_file_copy_range(
+  const char* src_file,
+  unsigned long src_offset,
+  const char* dst_file,
+  unsigned long dst_offset,
+  unsigned long size,
+  unsigned long buf_size
+);
+
 #endif
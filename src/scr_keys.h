@@ -123,6 +123,17 @@ Define common hash key strings
 
 #define SCR_NODES_KEY_NODES ("NODES")
 
+/* flush progress record keys, these persist across jobs to resume a partial copy */
+#define SCR_PROGRESS_KEY_OFFSET ("OFFSET")
+#define SCR_PROGRESS_KEY_CRC    ("CRC")
+
+/* checkpoint interval tuner file keys, this file persists across jobs */
+#define SCR_INTERVAL_KEY_COST     ("COST")
+#define SCR_INTERVAL_KEY_COUNT    ("COUNT")
+#define SCR_INTERVAL_KEY_RUNTIME  ("RUNTIME")
+#define SCR_INTERVAL_KEY_FAILURES ("FAILURES")
+#define SCR_INTERVAL_KEY_RUNNING  ("RUNNING")
+
 /* transfer file keys */
 #define SCR_TRANSFER_KEY_FILES       ("FILES")
 #define SCR_TRANSFER_KEY_DESTINATION ("DESTINATION")
@@ -182,6 +193,7 @@ Define common hash key strings
 #define SCR_META_KEY_NAME     ("NAME")
 #define SCR_META_KEY_SIZE     ("SIZE")
 #define SCR_META_KEY_CRC      ("CRC")
+#define SCR_META_KEY_SEGMENT  ("SEGMENT")
 #define SCR_META_KEY_COMPLETE ("COMPLETE")
 #define SCR_META_KEY_MODE     ("MODE")
 #define SCR_META_KEY_UID      ("UID")
@@ -157,6 +157,14 @@ int scr_meta_set_crc32(scr_meta* meta, uLong crc)
   return (rc == KVTREE_SUCCESS) ? SCR_SUCCESS : SCR_FAILURE;
 }
 
+/* marks the file as a segment of a shared file that starts at the given offset */
+int scr_meta_set_segment(scr_meta* meta, unsigned long offset)
+{
+  kvtree_unset(meta, SCR_META_KEY_SEGMENT);
+  int rc = kvtree_util_set_bytecount(meta, SCR_META_KEY_SEGMENT, offset);
+  return (rc == KVTREE_SUCCESS) ? SCR_SUCCESS : SCR_FAILURE;
+}
+
 static void scr_stat_get_atimes(const struct stat* sb, uint64_t* secs, uint64_t* nsecs)
 {
     *secs = (uint64_t) sb->st_atime;
@@ -306,6 +314,13 @@ int scr_meta_get_crc32(const scr_meta* meta, uLong* crc)
   return (rc == KVTREE_SUCCESS) ? SCR_SUCCESS : SCR_FAILURE;
 }
 
+/* gets offset of a segment within its shared file, returns SCR_SUCCESS if the file is a segment */
+int scr_meta_get_segment(const scr_meta* meta, unsigned long* offset)
+{
+  int rc = kvtree_util_get_bytecount(meta, SCR_META_KEY_SEGMENT, offset);
+  return (rc == KVTREE_SUCCESS) ? SCR_SUCCESS : SCR_FAILURE;
+}
+
 /*
 =========================================
 Check field values
@@ -324,6 +339,13 @@ int scr_meta_is_complete(const scr_meta* meta)
   return SCR_FAILURE;
 }
 
+/* return SCR_SUCCESS if the file is a segment of a shared file */
+int scr_meta_is_segment(const scr_meta* meta)
+{
+  unsigned long offset;
+  return scr_meta_get_segment(meta, &offset);
+}
+
 /* return SCR_SUCCESS if rank is set in meta data, and if it matches the specified value */
 int scr_meta_check_rank(const scr_meta* meta, int rank)
 {
@@ -97,6 +97,9 @@ int scr_meta_set_stat(scr_meta* meta, struct stat* statbuf);
 /* set the crc32 field on meta */
 int scr_meta_set_crc32(scr_meta* meta, uLong crc);
 
+/* marks the file as a segment of a shared file that starts at the given offset */
+int scr_meta_set_segment(scr_meta* meta, unsigned long offset);
+
 /*
 =========================================
 Get field values
@@ -130,6 +133,9 @@ int scr_meta_get_complete(const scr_meta* meta, int* complete);
 /* get the crc32 field in meta data, returns SCR_SUCCESS if a field is set */
 int scr_meta_get_crc32(const scr_meta* meta, uLong* crc);
 
+/* gets offset of a segment within its shared file, returns SCR_SUCCESS if the file is a segment */
+int scr_meta_get_segment(const scr_meta* meta, unsigned long* offset);
+
 /*
 =========================================
 Check field values
@@ -139,6 +145,9 @@ Check field values
 /* return SCR_SUCCESS if meta data is marked as complete */
 int scr_meta_is_complete(const scr_meta* meta);
 
+/* return SCR_SUCCESS if the file is a segment of a shared file */
+int scr_meta_is_segment(const scr_meta* meta);
+
 /* return SCR_SUCCESS if rank is set in meta data, and if it matches the specified value */
 int scr_meta_check_rank(const scr_meta* meta, int rank);
 
@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2009, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-411039.
+ * All rights reserved.
+ * This file is part of The Scalable Checkpoint / Restart (SCR) library.
+ * For details, see https://sourceforge.net/projects/scalablecr/
+ * Please also read this file: LICENSE.TXT.
+*/
+
+/* Implements metrics collection and export for SCR.
+ *
+ * Counters and histograms are updated on rank 0, which is where the
+ * timing and byte counts for collective operations are already
+ * computed for the debug messages and the log.  Each process that is
+ * rank 0 of the control directory writes a snapshot for its node,
+ * which includes the capacity and usage of each store on that node.
+ * The snapshot on rank 0 also includes the job-wide counters.
+ *
+ * Snapshots are written to a temporary file and renamed into place
+ * so that a collector never reads a partial file. */
+
+#include "scr_globals.h"
+#include "scr_metrics.h"
+
+#include <sys/statvfs.h>
+
+/* upper bounds in seconds of each histogram bucket,
+ * an implicit +Inf bucket follows the last */
+#define SCR_METRICS_NUM_BUCKETS (8)
+static const double scr_metrics_buckets[SCR_METRICS_NUM_BUCKETS] = {
+  0.1, 1.0, 5.0, 10.0, 30.0, 60.0, 300.0, 1800.0
+};
+
+/* names, labels, and descriptions of counters, indexed by SCR_METRIC_* id,
+ * consecutive entries that share a name are written as one metric family */
+static const char* scr_metrics_counter_names[SCR_METRIC_NUM_COUNTERS][3] = {
+  {"scr_datasets_total",    "type=\"checkpoint\"", "Number of datasets completed"},
+  {"scr_datasets_total",    "type=\"output\"",     "Number of datasets completed"},
+  {"scr_dataset_bytes_total", "type=\"checkpoint\"", "Bytes written by the application to SCR"},
+  {"scr_dataset_bytes_total", "type=\"output\"",     "Bytes written by the application to SCR"},
+  {"scr_flushes_total",     "result=\"success\"",  "Number of datasets flushed to the prefix directory"},
+  {"scr_flushes_total",     "result=\"failure\"",  "Number of datasets flushed to the prefix directory"},
+  {"scr_flush_bytes_total", NULL,                  "Bytes flushed to the prefix directory"},
+  {"scr_fetches_total",     "result=\"success\"",  "Number of datasets fetched from the prefix directory"},
+  {"scr_fetches_total",     "result=\"failure\"",  "Number of datasets fetched from the prefix directory"},
+  {"scr_fetch_bytes_total", NULL,                  "Bytes fetched from the prefix directory"},
+  {"scr_rebuilds_total",    "result=\"success\"",  "Number of datasets rebuilt in cache"},
+  {"scr_rebuilds_total",    "result=\"failure\"",  "Number of datasets rebuilt in cache"},
+  {"scr_scrub_errors_total", NULL,                 "Number of corrupt files found in cache by the scrubber"},
+};
+
+/* names and descriptions of histograms, indexed by SCR_METRIC_* id */
+static const char* scr_metrics_histogram_names[SCR_METRIC_NUM_HISTOGRAMS][2] = {
+  {"scr_checkpoint_seconds", "Time from start to end of checkpoint"},
+  {"scr_encode_seconds",     "Time to apply redundancy encoding"},
+  {"scr_flush_seconds",      "Time to flush dataset to the prefix directory"},
+  {"scr_fetch_seconds",      "Time to fetch dataset from the prefix directory"},
+};
+
+typedef struct {
+  unsigned long buckets[SCR_METRICS_NUM_BUCKETS]; /* count of observations <= each bound */
+  unsigned long count; /* total number of observations */
+  double sum;          /* sum of all observations */
+} scr_metrics_histogram;
+
+static double scr_metrics_counters[SCR_METRIC_NUM_COUNTERS];
+static scr_metrics_histogram scr_metrics_histograms[SCR_METRIC_NUM_HISTOGRAMS];
+static double scr_metrics_last_flush_bw = 0.0; /* bandwidth of most recent flush in bytes/sec */
+static kvtree* scr_metrics_halts = NULL;       /* maps halt reason to count */
+static time_t scr_metrics_last_write = 0;      /* time of last snapshot */
+
+/* initialize metrics */
+int scr_metrics_init(void)
+{
+  memset(scr_metrics_counters, 0, sizeof(scr_metrics_counters));
+  memset(scr_metrics_histograms, 0, sizeof(scr_metrics_histograms));
+  scr_metrics_last_flush_bw = 0.0;
+  scr_metrics_last_write    = 0;
+
+  if (scr_metrics_halts == NULL) {
+    scr_metrics_halts = kvtree_new();
+  }
+
+  /* default to a file in the control directory,
+   * which is node-local and unique to this job */
+  if (scr_metrics_enable && scr_metrics_file == NULL) {
+    spath* path = spath_from_str(scr_cntl_prefix);
+    if (strcasecmp(scr_metrics_format, "JSON") == 0) {
+      spath_append_str(path, "metrics.json");
+    } else {
+      spath_append_str(path, "metrics.prom");
+    }
+    scr_metrics_file = spath_strdup(path);
+    spath_delete(&path);
+  }
+
+  return SCR_SUCCESS;
+}
+
+/* write a final snapshot and free resources */
+int scr_metrics_finalize(void)
+{
+  int rc = scr_metrics_write(1);
+  kvtree_delete(&scr_metrics_halts);
+  return rc;
+}
+
+/* add value to specified counter */
+void scr_metrics_add(int counter, double value)
+{
+  if (! scr_metrics_enable) {
+    return;
+  }
+  if (counter < 0 || counter >= SCR_METRIC_NUM_COUNTERS) {
+    return;
+  }
+  scr_metrics_counters[counter] += value;
+}
+
+/* record an observation of secs in specified histogram */
+void scr_metrics_observe(int histogram, double secs)
+{
+  if (! scr_metrics_enable) {
+    return;
+  }
+  if (histogram < 0 || histogram >= SCR_METRIC_NUM_HISTOGRAMS) {
+    return;
+  }
+
+  /* buckets are cumulative, so bump every bucket whose bound covers secs */
+  scr_metrics_histogram* h = &scr_metrics_histograms[histogram];
+  int i;
+  for (i = 0; i < SCR_METRICS_NUM_BUCKETS; i++) {
+    if (secs <= scr_metrics_buckets[i]) {
+      h->buckets[i]++;
+    }
+  }
+  h->count++;
+  h->sum += secs;
+}
+
+/* record that job halted for given reason */
+void scr_metrics_halt(const char* reason)
+{
+  if (! scr_metrics_enable || scr_metrics_halts == NULL) {
+    return;
+  }
+  if (reason == NULL) {
+    reason = "UNKNOWN";
+  }
+
+  int count = 0;
+  kvtree_util_get_int(scr_metrics_halts, reason, &count);
+  kvtree_util_set_int(scr_metrics_halts, reason, count + 1);
+}
+
+/* record the bandwidth of the most recent flush in bytes/sec */
+void scr_metrics_flush_bw(double bytes, double secs)
+{
+  if (! scr_metrics_enable) {
+    return;
+  }
+  if (secs > 0.0) {
+    scr_metrics_last_flush_bw = bytes / secs;
+  }
+}
+
+/* return a newly allocated copy of str escaping characters that are
+ * special in both Prometheus label values and JSON strings,
+ * caller must free the result */
+static char* scr_metrics_escape(const char* str)
+{
+  /* each character expands to at most two */
+  char* escaped = (char*) SCR_MALLOC(2 * strlen(str) + 1);
+  char* e = escaped;
+  const char* c;
+  for (c = str; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      *e++ = '\\';
+      *e++ = *c;
+    } else if (*c == '\n') {
+      *e++ = '\\';
+      *e++ = 'n';
+    } else {
+      *e++ = *c;
+    }
+  }
+  *e = '\0';
+  return escaped;
+}
+
+/* write str to fp escaping characters that are special
+ * in both Prometheus label values and JSON strings */
+static void scr_metrics_print_escaped(FILE* fp, const char* str)
+{
+  char* escaped = scr_metrics_escape(str);
+  fputs(escaped, fp);
+  scr_free(&escaped);
+}
+
+/* write snapshot in Prometheus text exposition format */
+static void scr_metrics_write_prom(FILE* fp, int job_metrics)
+{
+  int i, j;
+
+  /* the jobid appears as a label value on every sample */
+  char* jobid = scr_metrics_escape(scr_jobid);
+
+  if (job_metrics) {
+    /* counters */
+    const char* last = NULL;
+    for (i = 0; i < SCR_METRIC_NUM_COUNTERS; i++) {
+      const char* name   = scr_metrics_counter_names[i][0];
+      const char* labels = scr_metrics_counter_names[i][1];
+      const char* help   = scr_metrics_counter_names[i][2];
+      if (last == NULL || strcmp(last, name) != 0) {
+        fprintf(fp, "# HELP %s %s\n", name, help);
+        fprintf(fp, "# TYPE %s counter\n", name);
+        last = name;
+      }
+      fprintf(fp, "%s{jobid=\"%s\"%s%s} %.17g\n",
+        name, jobid, (labels != NULL) ? "," : "", (labels != NULL) ? labels : "",
+        scr_metrics_counters[i]
+      );
+    }
+
+    /* histograms */
+    for (i = 0; i < SCR_METRIC_NUM_HISTOGRAMS; i++) {
+      const char* name = scr_metrics_histogram_names[i][0];
+      const scr_metrics_histogram* h = &scr_metrics_histograms[i];
+      fprintf(fp, "# HELP %s %s\n", name, scr_metrics_histogram_names[i][1]);
+      fprintf(fp, "# TYPE %s histogram\n", name);
+      for (j = 0; j < SCR_METRICS_NUM_BUCKETS; j++) {
+        fprintf(fp, "%s_bucket{jobid=\"%s\",le=\"%g\"} %lu\n",
+          name, jobid, scr_metrics_buckets[j], h->buckets[j]
+        );
+      }
+      fprintf(fp, "%s_bucket{jobid=\"%s\",le=\"+Inf\"} %lu\n", name, jobid, h->count);
+      fprintf(fp, "%s_sum{jobid=\"%s\"} %.17g\n", name, jobid, h->sum);
+      fprintf(fp, "%s_count{jobid=\"%s\"} %lu\n", name, jobid, h->count);
+    }
+
+    /* flush bandwidth */
+    fprintf(fp, "# HELP scr_flush_bandwidth_bytes_per_second Bandwidth of most recent flush\n");
+    fprintf(fp, "# TYPE scr_flush_bandwidth_bytes_per_second gauge\n");
+    fprintf(fp, "scr_flush_bandwidth_bytes_per_second{jobid=\"%s\"} %.17g\n",
+      jobid, scr_metrics_last_flush_bw
+    );
+
+    /* halt reasons */
+    fprintf(fp, "# HELP scr_halts_total Number of times the job was halted by reason\n");
+    fprintf(fp, "# TYPE scr_halts_total counter\n");
+    kvtree_elem* elem;
+    for (elem = kvtree_elem_first(scr_metrics_halts);
+         elem != NULL;
+         elem = kvtree_elem_next(elem))
+    {
+      char* reason = kvtree_elem_key(elem);
+      int count = 0;
+      kvtree_util_get_int(scr_metrics_halts, reason, &count);
+      fprintf(fp, "scr_halts_total{jobid=\"%s\",reason=\"", jobid);
+      scr_metrics_print_escaped(fp, reason);
+      fprintf(fp, "\"} %d\n", count);
+    }
+  }
+
+  /* number of datasets in cache on this node */
+  fprintf(fp, "# HELP scr_cache_datasets Number of datasets held in cache\n");
+  fprintf(fp, "# TYPE scr_cache_datasets gauge\n");
+  fprintf(fp, "scr_cache_datasets{jobid=\"%s\"} %d\n",
+    jobid, scr_cache_index_num_datasets(scr_cindex)
+  );
+
+  /* capacity and usage of each store */
+  fprintf(fp, "# HELP scr_store_size_bytes Capacity of file system holding store\n");
+  fprintf(fp, "# TYPE scr_store_size_bytes gauge\n");
+  fprintf(fp, "# HELP scr_store_used_bytes Bytes used on file system holding store\n");
+  fprintf(fp, "# TYPE scr_store_used_bytes gauge\n");
+  for (i = 0; i < scr_nstoredescs; i++) {
+    const scr_storedesc* store = &scr_storedescs[i];
+    struct statvfs vfs;
+    if (! store->enabled || statvfs(store->name, &vfs) != 0) {
+      continue;
+    }
+    double size = (double) vfs.f_blocks * (double) vfs.f_frsize;
+    double used = (double) (vfs.f_blocks - vfs.f_bfree) * (double) vfs.f_frsize;
+    fprintf(fp, "scr_store_size_bytes{jobid=\"%s\",store=\"", jobid);
+    scr_metrics_print_escaped(fp, store->name);
+    fprintf(fp, "\"} %.17g\n", size);
+    fprintf(fp, "scr_store_used_bytes{jobid=\"%s\",store=\"", jobid);
+    scr_metrics_print_escaped(fp, store->name);
+    fprintf(fp, "\"} %.17g\n", used);
+  }
+
+  scr_free(&jobid);
+}
+
+/* write snapshot as a single JSON object */
+static void scr_metrics_write_json(FILE* fp, int job_metrics)
+{
+  int i, j;
+
+  fprintf(fp, "{\"jobid\": \"");
+  scr_metrics_print_escaped(fp, scr_jobid);
+  fprintf(fp, "\", \"time\": %lu", (unsigned long) scr_log_seconds());
+
+  if (job_metrics) {
+    /* counters, labeled entries are keyed by their label value */
+    fprintf(fp, ",\n \"counters\": {");
+    for (i = 0; i < SCR_METRIC_NUM_COUNTERS; i++) {
+      const char* labels = scr_metrics_counter_names[i][1];
+      fprintf(fp, "%s\n  \"%s", (i > 0) ? "," : "", scr_metrics_counter_names[i][0]);
+      if (labels != NULL) {
+        /* convert a label like type="checkpoint" to a suffix :checkpoint */
+        const char* value = strchr(labels, '"');
+        fprintf(fp, ":%.*s", (int) strlen(value) - 2, value + 1);
+      }
+      fprintf(fp, "\": %.17g", scr_metrics_counters[i]);
+    }
+    fprintf(fp, "\n },\n \"histograms\": {");
+    for (i = 0; i < SCR_METRIC_NUM_HISTOGRAMS; i++) {
+      const scr_metrics_histogram* h = &scr_metrics_histograms[i];
+      fprintf(fp, "%s\n  \"%s\": {\"count\": %lu, \"sum\": %.17g, \"buckets\": [",
+        (i > 0) ? "," : "", scr_metrics_histogram_names[i][0], h->count, h->sum
+      );
+      for (j = 0; j < SCR_METRICS_NUM_BUCKETS; j++) {
+        fprintf(fp, "%s[%g, %lu]", (j > 0) ? ", " : "", scr_metrics_buckets[j], h->buckets[j]);
+      }
+      fprintf(fp, "]}");
+    }
+    fprintf(fp, "\n },\n \"flush_bandwidth_bytes_per_second\": %.17g", scr_metrics_last_flush_bw);
+
+    fprintf(fp, ",\n \"halts\": {");
+    kvtree_elem* elem;
+    for (elem = kvtree_elem_first(scr_metrics_halts);
+         elem != NULL;
+         elem = kvtree_elem_next(elem))
+    {
+      char* reason = kvtree_elem_key(elem);
+      int count = 0;
+      kvtree_util_get_int(scr_metrics_halts, reason, &count);
+      fprintf(fp, "%s\"", (elem != kvtree_elem_first(scr_metrics_halts)) ? ", " : "");
+      scr_metrics_print_escaped(fp, reason);
+      fprintf(fp, "\": %d", count);
+    }
+    fprintf(fp, "}");
+  }
+
+  fprintf(fp, ",\n \"cache_datasets\": %d", scr_cache_index_num_datasets(scr_cindex));
+
+  fprintf(fp, ",\n \"stores\": {");
+  int first = 1;
+  for (i = 0; i < scr_nstoredescs; i++) {
+    const scr_storedesc* store = &scr_storedescs[i];
+    struct statvfs vfs;
+    if (! store->enabled || statvfs(store->name, &vfs) != 0) {
+      continue;
+    }
+    double size = (double) vfs.f_blocks * (double) vfs.f_frsize;
+    double used = (double) (vfs.f_blocks - vfs.f_bfree) * (double) vfs.f_frsize;
+    fprintf(fp, "%s\n  \"", first ? "" : ",");
+    scr_metrics_print_escaped(fp, store->name);
+    fprintf(fp, "\": {\"size_bytes\": %.17g, \"used_bytes\": %.17g}", size, used);
+    first = 0;
+  }
+  fprintf(fp, "\n }\n}\n");
+}
+
+/* write a snapshot of the current metrics if the configured interval
+ * has expired since the last snapshot, or always if force is set */
+int scr_metrics_write(int force)
+{
+  /* nothing to do if metrics are disabled */
+  if (! scr_metrics_enable || scr_metrics_file == NULL) {
+    return SCR_SUCCESS;
+  }
+
+  /* only one process per node writes a snapshot */
+  if (scr_storedesc_cntl == NULL || scr_storedesc_cntl->rank != 0) {
+    return SCR_SUCCESS;
+  }
+
+  /* check whether enough time has passed since the last snapshot */
+  time_t now = scr_log_seconds();
+  if (! force && (now - scr_metrics_last_write) < (time_t) scr_metrics_interval) {
+    return SCR_SUCCESS;
+  }
+  scr_metrics_last_write = now;
+
+  /* write to a temporary file, then rename it into place */
+  char tmpfile[SCR_MAX_FILENAME];
+  snprintf(tmpfile, sizeof(tmpfile), "%s.tmp.%d", scr_metrics_file, scr_my_rank_world);
+
+  FILE* fp = fopen(tmpfile, "w");
+  if (fp == NULL) {
+    scr_err("Opening metrics file for write: fopen(%s) errno=%d %s @ %s:%d",
+      tmpfile, errno, strerror(errno), __FILE__, __LINE__
+    );
+    return SCR_FAILURE;
+  }
+
+  /* counters and histograms are only tracked on rank 0 */
+  int job_metrics = (scr_my_rank_world == 0);
+  if (strcasecmp(scr_metrics_format, "JSON") == 0) {
+    scr_metrics_write_json(fp, job_metrics);
+  } else {
+    scr_metrics_write_prom(fp, job_metrics);
+  }
+
+  if (fclose(fp) != 0) {
+    scr_err("Closing metrics file: fclose(%s) errno=%d %s @ %s:%d",
+      tmpfile, errno, strerror(errno), __FILE__, __LINE__
+    );
+    unlink(tmpfile);
+    return SCR_FAILURE;
+  }
+
+  if (rename(tmpfile, scr_metrics_file) != 0) {
+    scr_err("Renaming metrics file: rename(%s, %s) errno=%d %s @ %s:%d",
+      tmpfile, scr_metrics_file, errno, strerror(errno), __FILE__, __LINE__
+    );
+    unlink(tmpfile);
+    return SCR_FAILURE;
+  }
+
+  return SCR_SUCCESS;
+}
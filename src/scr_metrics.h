@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2009, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-411039.
+ * All rights reserved.
+ * This file is part of The Scalable Checkpoint / Restart (SCR) library.
+ * For details, see https://sourceforge.net/projects/scalablecr/
+ * Please also read this file: LICENSE.TXT.
+*/
+
+/* Collects runtime counters and histograms for SCR operations and
+ * periodically writes a snapshot to a file in either Prometheus
+ * text exposition format (for node_exporter's textfile collector)
+ * or JSON. */
+
+#ifndef SCR_METRICS_H
+#define SCR_METRICS_H
+
+/* counters, each is a monotonically increasing sum */
+#define SCR_METRIC_CHECKPOINTS      (0)  /* number of checkpoints completed */
+#define SCR_METRIC_OUTPUTS          (1)  /* number of non-checkpoint datasets completed */
+#define SCR_METRIC_CHECKPOINT_BYTES (2)  /* bytes written in checkpoints */
+#define SCR_METRIC_OUTPUT_BYTES     (3)  /* bytes written in non-checkpoint datasets */
+#define SCR_METRIC_FLUSHES          (4)  /* number of successful flushes */
+#define SCR_METRIC_FLUSH_FAILURES   (5)  /* number of failed flushes */
+#define SCR_METRIC_FLUSH_BYTES      (6)  /* bytes copied to prefix directory */
+#define SCR_METRIC_FETCHES          (7)  /* number of successful fetches */
+#define SCR_METRIC_FETCH_FAILURES   (8)  /* number of failed fetches */
+#define SCR_METRIC_FETCH_BYTES      (9)  /* bytes copied from prefix directory */
+#define SCR_METRIC_REBUILDS         (10) /* number of datasets rebuilt in cache */
+#define SCR_METRIC_REBUILD_FAILURES (11) /* number of datasets that failed to rebuild */
+#define SCR_METRIC_SCRUB_ERRORS     (12) /* number of corrupt files found by the scrubber */
+#define SCR_METRIC_NUM_COUNTERS     (13)
+
+/* histograms, each records a distribution of durations in seconds */
+#define SCR_METRIC_CHECKPOINT_SECS  (0) /* time from start to end of checkpoint */
+#define SCR_METRIC_ENCODE_SECS      (1) /* time to apply redundancy scheme */
+#define SCR_METRIC_FLUSH_SECS       (2) /* time to flush dataset to prefix directory */
+#define SCR_METRIC_FETCH_SECS       (3) /* time to fetch dataset from prefix directory */
+#define SCR_METRIC_NUM_HISTOGRAMS   (4)
+
+/* initialize metrics, call after control directory is defined */
+int scr_metrics_init(void);
+
+/* write a final snapshot and free resources */
+int scr_metrics_finalize(void);
+
+/* add value to specified counter */
+void scr_metrics_add(int counter, double value);
+
+/* record an observation of secs in specified histogram */
+void scr_metrics_observe(int histogram, double secs);
+
+/* record that job halted for given reason */
+void scr_metrics_halt(const char* reason);
+
+/* record the bandwidth of the most recent flush in bytes/sec */
+void scr_metrics_flush_bw(double bytes, double secs);
+
+/* write a snapshot of the current metrics if the configured interval
+ * has expired since the last snapshot, or always if force is set */
+int scr_metrics_write(int force);
+
+#endif
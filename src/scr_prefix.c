@@ -18,6 +18,7 @@
 #include "dtcmp.h"
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
 
 /* delete named dataset from index file in prefix directory */
@@ -45,8 +46,9 @@ static int scr_prefix_remove_index(const char* name)
   return SCR_SUCCESS;
 }
 
-/* open dirname, scan entries, and delete them */
-static int scr_prefix_rmscan(const char* dirname)
+/* open dirname, scan entries, and delete them,
+ * descends into subdirectories up to depth levels */
+static int scr_prefix_rmscan_depth(const char* dirname, int depth)
 {
   int rc = SCR_SUCCESS;
 
@@ -72,8 +74,13 @@ static int scr_prefix_rmscan(const char* dirname)
       char* item = spath_strdup(path);
       spath_delete(&path);
 
-      /* delete the item */
-      scr_file_unlink(item);
+      /* delete the item, descending into subdirectories like progress/ */
+      struct stat statbuf;
+      if (depth > 0 && lstat(item, &statbuf) == 0 && S_ISDIR(statbuf.st_mode)) {
+        scr_prefix_rmscan_depth(item, depth - 1);
+      } else {
+        scr_file_unlink(item);
+      }
 
       scr_free(&item);
     }
@@ -88,6 +95,13 @@ static int scr_prefix_rmscan(const char* dirname)
   return rc;
 }
 
+/* open dirname, scan entries, and delete them along with
+ * any subdirectories one level down */
+static int scr_prefix_rmscan(const char* dirname)
+{
+  return scr_prefix_rmscan_depth(dirname, 1);
+}
+
 /* deletes user data files from prefix directory for named dataset */
 static int scr_prefix_delete_data(int id)
 {
@@ -327,9 +341,9 @@ int scr_prefix_delete(int id, const char* name)
 
 /* keep a sliding window of checkpoints in the prefix directory,
  * delete any pure checkpoints that fall outside of the window
- * defined by the given dataset id and the window width,
+ * of the given width ending at the newest complete checkpoint,
  * excludes checkpoints that are marked as output */
-int scr_prefix_delete_sliding(int id, int window)
+int scr_prefix_delete_sliding(int window)
 {
   /* rank 0 reads the index file */
   kvtree* index_hash = NULL;
@@ -351,47 +365,16 @@ int scr_prefix_delete_sliding(int id, int window)
     continue_deleting = 0;
   }
 
-  /* we count the current checkpoint as a member of the window */
-  window--;
-
   /* iterate over all checkpoints in the prefix directory,
-   * deleting any pure checkpoints that fall outside of the window */
-  int target_id = id;
+   * deleting any pure checkpoints that fall outside of the window,
+   * flushes may complete out of order, so we measure the window from
+   * the newest complete checkpoint rather than the one just flushed */
   while (continue_deleting) {
-    /* rank 0 determines the directory to fetch from */
+    /* rank 0 picks the next checkpoint to delete */
+    int target_id = -1;
     char target[SCR_MAX_FILENAME];
     if (scr_my_rank_world == 0) {
-      /* TODO: delete checkpoint if not valid, even if in window? */
-
-      /* get the most recent complete checkpoint older than the target id */
-      int next_id = -1;
-      scr_index_get_most_recent_complete(index_hash, target_id, &next_id, target);
-      target_id = next_id;
-
-      /* found the next most recent checkpoint,
-       * consider whether we should keep it */
-      if (target_id >= 0) {
-        /* keep this checkpoint if we're still in the window */
-        if (window > 0) {
-          /* saved by the window, look for something older */
-          window--;
-          continue;
-        }
-
-        /* not in window, but we also keep any checkpoints
-         * that are marked as output */
-        scr_dataset* dataset = scr_dataset_new();
-        if (scr_index_get_dataset(index_hash, target_id, target, dataset) == SCR_SUCCESS) {
-          /* get output flag for this dataset */
-          int is_output = scr_dataset_is_output(dataset);
-          if (is_output) {
-            /* this checkpoint is also marked as output, so don't delete it */
-            scr_dataset_delete(&dataset);
-            continue;
-          }
-        }
-        scr_dataset_delete(&dataset);
-      }
+      scr_index_get_outside_window(index_hash, window, &target_id, target);
     }
 
     /* broadcast target id from rank 0 */
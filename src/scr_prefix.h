@@ -17,9 +17,9 @@ int scr_prefix_delete(int id, const char* name);
 
 /* keep a sliding window of checkpoints in the prefix directory,
  * delete any pure checkpoints that fall outside of the window
- * defined by the given dataset id and the window width,
+ * of the given width ending at the newest complete checkpoint,
  * excludes checkpoints that are marked as output */
-int scr_prefix_delete_sliding(int id, int window);
+int scr_prefix_delete_sliding(int window);
 
 /* delete all datasets listed in the index file,
  * both checkpoint and output */
@@ -547,9 +547,17 @@ int scr_reddesc_apply(
     my_counts[0] += 1;
     my_counts[1] += scr_file_size(file);
 
-    /* if crc_on_copy is set, compute crc and update meta file */
+    /* if crc_on_copy is set, compute crc and update meta file,
+     * skip files whose crc was already computed from a registered
+     * memory buffer, since that would only read the file back */
     if (scr_crc_on_copy) {
-      scr_compute_crc(map, file);
+      uLong crc;
+      scr_meta* meta = scr_meta_new();
+      scr_filemap_get_meta(map, file, meta);
+      if (scr_meta_get_crc32(meta, &crc) != SCR_SUCCESS) {
+        scr_compute_crc(map, file);
+      }
+      scr_meta_delete(&meta);
     }
   }
 
@@ -686,6 +694,9 @@ print_timing:
             time_diff, files, bytes, bw, bw/scr_ranks_world
     );
 
+    /* record time to encode in our metrics */
+    scr_metrics_observe(SCR_METRIC_ENCODE_SECS, time_diff);
+
     /* log data on the copy in the database */
     if (scr_log_enable) {
       char* dir = scr_cache_dir_get(desc, id);
@@ -12,6 +12,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <errno.h>
+
+/* need statfs and file system magic numbers to detect memory-backed stores */
+#if defined(__linux__)
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#endif
 
 #include "mpi.h"
 
@@ -44,6 +52,7 @@ static int scr_storedesc_init(scr_storedesc* s)
   s->name      = NULL;
   s->max_count = 0;
   s->can_mkdir = 0;
+  s->memory    = 0;
   s->xfer      = NULL;
   s->view      = NULL;
   s->comm      = MPI_COMM_NULL;
@@ -91,6 +100,7 @@ static int scr_storedesc_copy(scr_storedesc* out, const scr_storedesc* in)
   out->name      = strdup(in->name);
   out->max_count = in->max_count;
   out->can_mkdir = in->can_mkdir;
+  out->memory    = in->memory;
   out->xfer      = strdup(in->xfer);
   out->view      = strdup(in->view);
   MPI_Comm_dup(in->comm, &out->comm);
@@ -100,6 +110,40 @@ static int scr_storedesc_copy(scr_storedesc* out, const scr_storedesc* in)
   return SCR_SUCCESS;
 }
 
+/* returns 1 if the given path is on a memory-backed file system,
+ * 0 if it is not, and -1 if we cannot tell, since the store directory
+ * may not exist yet, we check the nearest parent directory that does */
+static int scr_storedesc_is_memory(const char* path)
+{
+#if defined(__linux__) && defined(TMPFS_MAGIC) && defined(RAMFS_MAGIC)
+  int rc = -1;
+  spath* dir = spath_from_str(path);
+  while (1) {
+    char* dirstr = spath_strdup(dir);
+    struct statfs fs;
+    int statfs_rc = statfs(dirstr, &fs);
+    int statfs_errno = errno;
+    scr_free(&dirstr);
+
+    if (statfs_rc == 0) {
+      rc = (fs.f_type == TMPFS_MAGIC || fs.f_type == RAMFS_MAGIC);
+      break;
+    }
+
+    /* stop on any error other than a missing directory,
+     * or once we run out of parent directories to try */
+    if (statfs_errno != ENOENT || spath_components(dir) <= 1) {
+      break;
+    }
+    spath_dirname(dir);
+  }
+  spath_delete(&dir);
+  return rc;
+#else
+  return -1;
+#endif
+}
+
 /* build a store descriptor corresponding to the specified hash,
  * this function is collective, because it issues MPI calls */
 static int scr_storedesc_create_from_hash(
@@ -157,6 +201,21 @@ static int scr_storedesc_create_from_hash(
   s->can_mkdir = 1;
   kvtree_util_get_int(hash, SCR_CONFIG_KEY_MKDIR, &(s->can_mkdir));
 
+  /* a store of TYPE=MEMORY lives in node memory, files written
+   * there need no fsync, verify the path really is memory-backed */
+  char* store_type = NULL;
+  kvtree_util_get_str(hash, SCR_CONFIG_KEY_TYPE, &store_type);
+  if (store_type != NULL && strcasecmp(store_type, "MEMORY") == 0) {
+    /* trust the configuration when we cannot check it */
+    int is_memory = scr_storedesc_is_memory(s->name);
+    s->memory = (is_memory != 0);
+    if (is_memory == 0) {
+      scr_warn("Store %s has TYPE=MEMORY but is not on tmpfs, treating it as a regular store @ %s:%d",
+        s->name, __FILE__, __LINE__
+      );
+    }
+  }
+
   /* set the type of the store which selects transfer mode */
   char* flush_type = scr_flush_type;
   kvtree_util_get_str(hash, SCR_CONFIG_KEY_FLUSH, &flush_type);
@@ -194,6 +253,11 @@ static int scr_storedesc_create_from_hash(
     s->enabled = 0;
   }
 
+  /* only treat the store as memory-backed if it is everywhere */
+  if (! scr_alltrue(s->memory, comm)) {
+    s->memory = 0;
+  }
+
   return SCR_SUCCESS;
 }
 
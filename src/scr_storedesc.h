@@ -48,6 +48,7 @@ typedef struct {
   char*    name;      /* name of store */
   int      max_count; /* maximum number of datasets to be stored in device */
   int      can_mkdir; /* flag indicating whether mkdir/rmdir work */
+  int      memory;    /* flag indicating whether store is backed by node memory (tmpfs) */
   char*    xfer;      /* AXL xfer type string (bbapi, sync, pthread, etc..) */
   char*    view;      /* indicates whether store is node-local or global */
   MPI_Comm comm;      /* communicator of processes that can access storage */
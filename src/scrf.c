@@ -332,6 +332,90 @@ FORTRAN_API void FORT_CALL FORT_NAME(scr_route_file)(char* name FORT_MIXED_LEN(n
   return;
 }
 
+FORTRAN_API void FORT_CALL FORT_NAME(scr_route_file_size)(char* name FORT_MIXED_LEN(name_len),
+                                           long long* size,
+                                           char* file FORT_MIXED_LEN(file_len),
+                                           int* ierror FORT_END_LEN(name_len) FORT_END_LEN(file_len))
+{
+  /* convert filename from a Fortran string to C string */
+  char name_tmp[SCR_MAX_FILENAME];
+  if (scr_fstr2cstr(name, name_len, name_tmp, sizeof(name_tmp)) != 0) {
+    *ierror = !SCR_SUCCESS;
+    return;
+  }
+
+  /* size is passed as an INTEGER*8 count of bytes */
+  if (*size < 0) {
+    *ierror = !SCR_SUCCESS;
+    return;
+  }
+
+  /* get the filename to use */
+  char file_tmp[SCR_MAX_FILENAME];
+  *ierror = SCR_Route_file_size(name_tmp, (size_t) *size, file_tmp);
+
+  /* convert filename from C to Fortran string */
+  if (scr_cstr2fstr(file_tmp, file, file_len) != 0) {
+    *ierror = !SCR_SUCCESS;
+    return;
+  }
+
+  return;
+}
+
+FORTRAN_API void FORT_CALL FORT_NAME(scr_route_file_segment)(char* name FORT_MIXED_LEN(name_len),
+                                           long long* offset,
+                                           char* file FORT_MIXED_LEN(file_len),
+                                           int* ierror FORT_END_LEN(name_len) FORT_END_LEN(file_len))
+{
+  /* convert filename from a Fortran string to C string */
+  char name_tmp[SCR_MAX_FILENAME];
+  if (scr_fstr2cstr(name, name_len, name_tmp, sizeof(name_tmp)) != 0) {
+    *ierror = !SCR_SUCCESS;
+    return;
+  }
+
+  /* offset is passed as an INTEGER*8 byte offset */
+  if (*offset < 0) {
+    *ierror = !SCR_SUCCESS;
+    return;
+  }
+
+  /* get the filename to use */
+  char file_tmp[SCR_MAX_FILENAME];
+  *ierror = SCR_Route_file_segment(name_tmp, (size_t) *offset, file_tmp);
+
+  /* convert filename from C to Fortran string */
+  if (scr_cstr2fstr(file_tmp, file, file_len) != 0) {
+    *ierror = !SCR_SUCCESS;
+    return;
+  }
+
+  return;
+}
+
+FORTRAN_API void FORT_CALL FORT_NAME(scr_register_memory)(char* name FORT_MIXED_LEN(name_len),
+                                           void* buf, long long* size,
+                                           int* ierror FORT_END_LEN(name_len))
+{
+  /* convert name from a Fortran string to C string */
+  char name_tmp[SCR_MAX_FILENAME];
+  if (scr_fstr2cstr(name, name_len, name_tmp, sizeof(name_tmp)) != 0) {
+    *ierror = !SCR_SUCCESS;
+    return;
+  }
+
+  /* size is passed as an INTEGER*8 count of bytes */
+  if (*size < 0) {
+    *ierror = !SCR_SUCCESS;
+    return;
+  }
+
+  *ierror = SCR_Register_memory(name_tmp, buf, (size_t) *size);
+
+  return;
+}
+
 /*================================================
  * Dataset management
  *================================================*/
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2009, Lawrence Livermore National Security, LLC.
+ * Produced at the Lawrence Livermore National Laboratory.
+ * Written by Adam Moody <moody20@llnl.gov>.
+ * LLNL-CODE-411039.
+ * All rights reserved.
+ * This file is part of The Scalable Checkpoint / Restart (SCR) library.
+ * For details, see https://sourceforge.net/projects/scalablecr/
+ * Please also read this file: LICENSE.TXT.
+*/
+
+/* Runs some tests on scr_index_api functions to verify that they
+ * produce the expected output.
+ * Exits with 0 if successful, 1 otherwise. */
+
+#include "scr.h"
+#include "scr_dataset.h"
+#include "scr_index_api.h"
+
+#include "kvtree.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures = 0;
+
+/* record a failed check along with a message */
+static void check(int cond, const char* msg)
+{
+  if (! cond) {
+    printf("FAIL: %s\n", msg);
+    failures++;
+  }
+}
+
+/* add a checkpoint with the given id to the index, named ckpt.<id> */
+static void add_ckpt(kvtree* index, int id, int output, int complete)
+{
+  char name[SCR_MAX_FILENAME];
+  snprintf(name, sizeof(name), "ckpt.%d", id);
+
+  scr_dataset* dataset = scr_dataset_new();
+  scr_dataset_set_id(dataset, id);
+  scr_dataset_set_name(dataset, name);
+  scr_dataset_set_flags(dataset, SCR_FLAG_CHECKPOINT | (output ? SCR_FLAG_OUTPUT : 0));
+  scr_dataset_set_ckpt(dataset, id);
+
+  scr_index_remove(index, name);
+  scr_index_set_dataset(index, id, name, dataset, complete);
+
+  scr_dataset_delete(&dataset);
+}
+
+/* return the id of the checkpoint outside of window, or -1 if none */
+static int outside(kvtree* index, int window)
+{
+  int id;
+  char name[SCR_MAX_FILENAME];
+  scr_index_get_outside_window(index, window, &id, name);
+  return id;
+}
+
+/* flushes of checkpoints 1 and 2 are both in flight, and 2 completes first */
+static void test_window_out_of_order(void)
+{
+  kvtree* index = kvtree_new();
+  add_ckpt(index, 1, 0, 0);
+  add_ckpt(index, 2, 0, 0);
+
+  /* 2 completes, it is the only complete checkpoint, keep it */
+  add_ckpt(index, 2, 0, 1);
+  check(outside(index, 1) == -1, "nothing to delete after checkpoint 2 completes");
+
+  /* 1 completes late, it falls outside a window of one anchored on 2 */
+  add_ckpt(index, 1, 0, 1);
+  check(outside(index, 1) == 1, "checkpoint 1 is outside the window after it completes late");
+
+  /* once 1 is gone, the window is satisfied */
+  scr_index_remove(index, "ckpt.1");
+  check(outside(index, 1) == -1, "nothing to delete once checkpoint 1 is removed");
+
+  kvtree_delete(&index);
+}
+
+/* in-order completion keeps the window ending at the newest checkpoint */
+static void test_window_in_order(void)
+{
+  kvtree* index = kvtree_new();
+  add_ckpt(index, 1, 0, 1);
+  add_ckpt(index, 2, 0, 1);
+  add_ckpt(index, 3, 0, 1);
+
+  check(outside(index, 3) == -1, "window of three keeps three checkpoints");
+  check(outside(index, 2) == 1,  "window of two drops the oldest checkpoint");
+
+  /* incomplete checkpoints neither count toward the window nor get deleted */
+  add_ckpt(index, 4, 0, 0);
+  check(outside(index, 2) == 1, "incomplete checkpoint does not move the window");
+
+  kvtree_delete(&index);
+}
+
+/* checkpoints that are also output are never deleted */
+static void test_window_keeps_output(void)
+{
+  kvtree* index = kvtree_new();
+  add_ckpt(index, 1, 0, 1);
+  add_ckpt(index, 2, 1, 1);
+  add_ckpt(index, 3, 0, 1);
+
+  check(outside(index, 1) == 1, "skips checkpoint marked as output and returns the next older one");
+  scr_index_remove(index, "ckpt.1");
+  check(outside(index, 1) == -1, "never returns a checkpoint marked as output");
+
+  kvtree_delete(&index);
+}
+
+int main(int argc, char* argv[])
+{
+  test_window_out_of_order();
+  test_window_in_order();
+  test_window_keeps_output();
+
+  if (failures > 0) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}